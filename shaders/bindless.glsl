@@ -0,0 +1,7 @@
+// The bindless set, see BindlessDescriptors.h. Storage buffers of every layout share binding 0, so each shader declares
+// the buffer blocks it reads there itself, as arrays indexed like the images and samplers below.
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 1) uniform texture2D bindlessImages[];
+layout(set = 0, binding = 2) uniform sampler bindlessSamplers[];
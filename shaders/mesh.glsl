@@ -0,0 +1,14 @@
+// Decoding of the quantized vertex attributes written by mesh_converter, see MeshFormat.h.
+
+// positionScale and positionOffset come from the mesh's header.
+vec3 decodePosition(vec3 position, float positionScale, vec3 positionOffset) {
+    return position * positionScale + positionOffset;
+}
+
+// Unfolds the octahedron's lower half, which the encoding folded over the upper half.
+vec3 decodeNormal(vec2 octahedral) {
+    vec3 normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+    float fold = max(-normal.z, 0.0);
+    normal.xy += mix(vec2(fold), vec2(-fold), greaterThanEqual(normal.xy, vec2(0.0)));
+    return normalize(normal);
+}
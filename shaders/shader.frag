@@ -1,10 +1,19 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "bindless.glsl"
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexcoord;
+// Instances of one draw may use different materials, so the indices are not uniform across the draw.
+layout(location = 2) flat in uint fragTexture;
+layout(location = 3) flat in uint fragSampler;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    vec3 texel = texture(sampler2D(bindlessImages[nonuniformEXT(fragTexture)], bindlessSamplers[nonuniformEXT(fragSampler)]),
+                         fragTexcoord).rgb;
+    outColor = vec4(fragColor * texel, 1.0);
+}
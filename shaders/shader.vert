@@ -1,21 +1,72 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) out vec3 fragColor;
+#include "bindless.glsl"
+#include "mesh.glsl"
+
+// Matches SceneInstance in Scene.h.
+struct Instance {
+    // Rows of the world transform's upper 3x4.
+    vec4 world[3];
+    // xyz: world space bounding sphere center, w: radius.
+    vec4 bounds;
+};
+
+// Matches Material in main.cpp. The texture and sampler are indices into the bindless arrays.
+struct Material {
+    vec4 baseColor;
+    uint texture;
+    uint samplerIndex;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+} instanceBuffers[];
+
+layout(std430, set = 0, binding = 0) readonly buffer InstanceMaterials {
+    uint materialIndices[];
+} instanceMaterialBuffers[];
+
+layout(std430, set = 0, binding = 0) readonly buffer Materials {
+    Material materials[];
+} materialBuffers[];
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// Matches ViewUniforms in Camera.h. Written right before the frame is submitted.
+layout(set = 1, binding = 0) uniform View {
+    mat4 viewProjection;
+} view;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+// Matches DrawConstants in main.cpp. The buffers are indices into the bindless storage buffers, the same for every draw.
+layout(push_constant) uniform DrawConstants {
+    vec3 positionOffset;
+    float positionScale;
+    uint instanceBuffer;
+    uint instanceMaterialBuffer;
+    uint materialBuffer;
+} draw;
+
+// Locations match the MESH_*_LOCATION constants in MeshFormat.h.
+layout(location = 0) in vec3 inPosition;
+layout(location = 3) in vec4 inColor;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexcoord;
+layout(location = 2) flat out uint fragTexture;
+layout(location = 3) flat out uint fragSampler;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    Instance instance = instanceBuffers[draw.instanceBuffer].instances[gl_InstanceIndex];
+    uint materialIndex = instanceMaterialBuffers[draw.instanceMaterialBuffer].materialIndices[gl_InstanceIndex];
+    Material material = materialBuffers[draw.materialBuffer].materials[materialIndex];
+
+    mat3x4 world = mat3x4(instance.world[0], instance.world[1], instance.world[2]);
+    vec3 position = decodePosition(inPosition, draw.positionScale, draw.positionOffset);
+
+    gl_Position = view.viewProjection * vec4(vec4(position, 1.0) * world, 1.0);
+    fragColor = inColor.rgb * material.baseColor.rgb;
+    // Meshes may come without texture coordinates, so the texture is projected onto the mesh's xy plane.
+    fragTexcoord = position.xy;
+    fragTexture = material.texture;
+    fragSampler = material.samplerIndex;
+}
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "bindless.glsl"
+
+layout(location = 0) in vec2 fragTexcoord;
+
+layout(location = 0) out vec4 outColor;
+
+// Matches UpscaleConstants in main.cpp. The scene was rendered into the top left of its image.
+layout(push_constant) uniform UpscaleConstants {
+    // The rendered part of the image in texture coordinates.
+    vec2 renderScale;
+    // Half a texel in from its far edges, so filtering never reads texels outside of it.
+    vec2 renderMax;
+    uint image;
+    uint samplerIndex;
+} upscale;
+
+void main() {
+    vec2 texcoord = min(fragTexcoord * upscale.renderScale, upscale.renderMax);
+    outColor = texture(sampler2D(bindlessImages[upscale.image], bindlessSamplers[upscale.samplerIndex]), texcoord);
+}
@@ -0,0 +1,10 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out vec2 fragTexcoord;
+
+// A triangle covering the viewport, with texture coordinates of 0 to 1 across it.
+void main() {
+    fragTexcoord = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(fragTexcoord * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,81 @@
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+static atomic<bool> isCounting = false;
+static atomic<uint64_t> allocationCount = 0;
+
+void AllocationCounter::start() {
+    allocationCount.store(0, memory_order_relaxed);
+    isCounting.store(true, memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::stop() {
+    isCounting.store(false, memory_order_relaxed);
+    return allocationCount.load(memory_order_relaxed);
+}
+
+static void countAllocation() {
+    if (isCounting.load(memory_order_relaxed)) {
+        allocationCount.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+static void *allocate(size_t size) noexcept {
+    countAllocation();
+    return malloc(size > 0 ? size : 1);
+}
+
+static void *allocateAligned(size_t size, align_val_t alignment) noexcept {
+    countAllocation();
+    size_t bytes = static_cast<size_t>(alignment);
+    size = (max(size, bytes) + bytes - 1) / bytes * bytes;
+#ifdef _WIN32
+    return _aligned_malloc(size, bytes);
+#else
+    return aligned_alloc(bytes, size);
+#endif
+}
+
+static void freeAligned(void *pointer) noexcept {
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+}
+
+static void *throwIfNull(void *pointer) {
+    if (pointer == nullptr) {
+        throw bad_alloc();
+    }
+
+    return pointer;
+}
+
+void *operator new(size_t size) { return throwIfNull(allocate(size)); }
+void *operator new[](size_t size) { return throwIfNull(allocate(size)); }
+void *operator new(size_t size, align_val_t alignment) { return throwIfNull(allocateAligned(size, alignment)); }
+void *operator new[](size_t size, align_val_t alignment) { return throwIfNull(allocateAligned(size, alignment)); }
+void *operator new(size_t size, const nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](size_t size, const nothrow_t &) noexcept { return allocate(size); }
+void *operator new(size_t size, align_val_t alignment, const nothrow_t &) noexcept { return allocateAligned(size, alignment); }
+void *operator new[](size_t size, align_val_t alignment, const nothrow_t &) noexcept { return allocateAligned(size, alignment); }
+
+void operator delete(void *pointer) noexcept { free(pointer); }
+void operator delete[](void *pointer) noexcept { free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { free(pointer); }
+void operator delete(void *pointer, const nothrow_t &) noexcept { free(pointer); }
+void operator delete[](void *pointer, const nothrow_t &) noexcept { free(pointer); }
+void operator delete(void *pointer, align_val_t) noexcept { freeAligned(pointer); }
+void operator delete[](void *pointer, align_val_t) noexcept { freeAligned(pointer); }
+void operator delete(void *pointer, size_t, align_val_t) noexcept { freeAligned(pointer); }
+void operator delete[](void *pointer, size_t, align_val_t) noexcept { freeAligned(pointer); }
+void operator delete(void *pointer, align_val_t, const nothrow_t &) noexcept { freeAligned(pointer); }
+void operator delete[](void *pointer, align_val_t, const nothrow_t &) noexcept { freeAligned(pointer); }
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts the global heap allocations of every thread between start() and stop(), to check that a code path runs without
+// touching the heap. It replaces the global operator new and delete of the executable, which cost a relaxed load while
+// not counting. Allocations that bypass operator new, like the driver's, are not counted.
+class AllocationCounter {
+  public:
+    static void start();
+    // Returns the allocations since start().
+    static uint64_t stop();
+};
@@ -0,0 +1,104 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+using namespace std;
+
+static double percentile(const vector<double> &sortedSamples, double fraction) {
+    size_t rank = static_cast<size_t>(ceil(fraction * sortedSamples.size()));
+    return sortedSamples[clamp<size_t>(rank, 1, sortedSamples.size()) - 1];
+}
+
+static void printDistribution(ostream &out, const char *label, vector<double> samples) {
+    out << label;
+
+    if (samples.empty()) {
+        out << "\tn/a\n";
+        return;
+    }
+
+    sort(begin(samples), end(samples));
+
+    out << "\tp50 " << percentile(samples, 0.50) << " ms"
+        << "\tp95 " << percentile(samples, 0.95) << " ms"
+        << "\tp99 " << percentile(samples, 0.99) << " ms"
+        << "\tmax " << samples.back() << " ms\n";
+}
+
+Benchmark::Benchmark(uint32_t warmupFrameCount, uint32_t frameCount) : warmupFrames(warmupFrameCount) {
+    for (Series *series : {&cpuFrameTimes, &gpuFrameTimes, &recordTimes, &inputToSubmitTimes, &inputToPresentTimes, &renderScales}) {
+        series->samples.reserve(frameCount);
+    }
+}
+
+bool Benchmark::add(Series &series, double milliseconds) {
+    if (series.count++ < warmupFrames) {
+        return false;
+    }
+
+    series.samples.push_back(milliseconds);
+    return true;
+}
+
+void Benchmark::beginFrame() {
+    frameStart = Clock::now();
+
+    if (cpuFrameTimes.count == warmupFrames) {
+        measureStart = frameStart;
+    }
+}
+
+void Benchmark::endFrame() {
+    auto frameEnd = Clock::now();
+
+    if (add(cpuFrameTimes, chrono::duration<double, milli>(frameEnd - frameStart).count())) {
+        measureEnd = frameEnd;
+    }
+}
+
+void Benchmark::addGpuFrameTime(double milliseconds) { add(gpuFrameTimes, milliseconds); }
+
+void Benchmark::addRecordTime(double milliseconds) { add(recordTimes, milliseconds); }
+
+void Benchmark::addInputToSubmitTime(double milliseconds) { add(inputToSubmitTimes, milliseconds); }
+
+void Benchmark::addInputToPresentTime(double milliseconds) { add(inputToPresentTimes, milliseconds); }
+
+void Benchmark::addRenderScale(double scale) { add(renderScales, scale); }
+
+void Benchmark::printReport(ostream &out) const {
+    size_t frameCount = cpuFrameTimes.samples.size();
+
+    out << "Benchmark (" << frameCount << " frames, " << warmupFrames << " warmup):\n";
+
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << fixed << setprecision(3);
+
+    printDistribution(out, "\tCPU", cpuFrameTimes.samples);
+    printDistribution(out, "\tGPU", gpuFrameTimes.samples);
+    printDistribution(out, "\tRecord", recordTimes.samples);
+    printDistribution(out, "\tInput to submit", inputToSubmitTimes.samples);
+    printDistribution(out, "\tInput to present", inputToPresentTimes.samples);
+
+    // Only reported with dynamic resolution.
+    if (!renderScales.samples.empty()) {
+        vector<double> scales = renderScales.samples;
+        sort(begin(scales), end(scales));
+
+        out << "\tRender scale\tp50 " << percentile(scales, 0.50) << "\tp5 " << percentile(scales, 0.05) << "\tmin "
+            << scales.front() << '\n';
+    }
+
+    double seconds = chrono::duration<double>(measureEnd - measureStart).count();
+    if (frameCount > 0 && seconds > 0.0) {
+        out << "\tFPS\t" << frameCount / seconds << '\n';
+    } else {
+        out << "\tFPS\tn/a\n";
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
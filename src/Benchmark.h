@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Collects per-frame CPU and GPU timings of a fixed length run and reports their distribution.
+class Benchmark {
+  public:
+    // Reserves room for every frame's samples, so adding them never allocates during the run.
+    Benchmark(uint32_t warmupFrameCount, uint32_t frameCount);
+
+    void beginFrame();
+    void endFrame();
+
+    // GPU time of a completed frame; arrives a few frames after endFrame() of the frame it belongs to.
+    void addGpuFrameTime(double milliseconds);
+
+    // CPU time spent recording the frame's command buffers.
+    void addRecordTime(double milliseconds);
+
+    // Latency from sampling the frame's input to submitting it, and to it reaching the display where that is known.
+    void addInputToSubmitTime(double milliseconds);
+    void addInputToPresentTime(double milliseconds);
+
+    // Fraction of the full resolution per axis the frame rendered at.
+    void addRenderScale(double scale);
+
+    void printReport(std::ostream &out) const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Series {
+        uint32_t count = 0;
+        std::vector<double> samples;
+    };
+
+    uint32_t warmupFrames;
+    Clock::time_point frameStart;
+    Clock::time_point measureStart;
+    Clock::time_point measureEnd;
+    Series cpuFrameTimes;
+    Series gpuFrameTimes;
+    Series recordTimes;
+    Series inputToSubmitTimes;
+    Series inputToPresentTimes;
+    Series renderScales;
+
+    bool add(Series &series, double milliseconds);
+};
@@ -0,0 +1,145 @@
+#include "BindlessDescriptors.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+// Indexed by BindlessType.
+const VkDescriptorType DESCRIPTOR_TYPES[] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                                             VK_DESCRIPTOR_TYPE_SAMPLER};
+const char *const TYPE_NAMES[] = {"storage buffer", "sampled image", "sampler"};
+
+void BindlessDescriptors::create(VkDevice device) {
+    logicalDevice = device;
+
+    arrays[static_cast<uint32_t>(BindlessType::StorageBuffer)].capacity = STORAGE_BUFFER_CAPACITY;
+    arrays[static_cast<uint32_t>(BindlessType::SampledImage)].capacity = SAMPLED_IMAGE_CAPACITY;
+    arrays[static_cast<uint32_t>(BindlessType::Sampler)].capacity = SAMPLER_CAPACITY;
+
+    VkDescriptorSetLayoutBinding bindings[3];
+    VkDescriptorBindingFlags bindingFlags[3];
+    VkDescriptorPoolSize poolSizes[3];
+
+    for (uint32_t i = 0; i < 3; i++) {
+        bindings[i] = {.binding = i,
+                       .descriptorType = DESCRIPTOR_TYPES[i],
+                       .descriptorCount = arrays[i].capacity,
+                       .stageFlags = VK_SHADER_STAGE_ALL};
+        // Only the descriptors a draw actually reads have to be valid.
+        bindingFlags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+        poolSizes[i] = {.type = DESCRIPTOR_TYPES[i], .descriptorCount = arrays[i].capacity};
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+                                                                 .bindingCount = 3,
+                                                                 .pBindingFlags = bindingFlags};
+    VkDescriptorSetLayoutCreateInfo layoutInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                                               .pNext = &bindingFlagsInfo,
+                                               .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+                                               .bindingCount = 3,
+                                               .pBindings = bindings};
+
+    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+        throw runtime_error("Failed to create bindless descriptor set layout!");
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                                        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+                                        .maxSets = 1,
+                                        .poolSizeCount = 3,
+                                        .pPoolSizes = poolSizes};
+
+    if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw runtime_error("Failed to create bindless descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                          .descriptorPool = descriptorPool,
+                                          .descriptorSetCount = 1,
+                                          .pSetLayouts = &setLayout};
+
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+        throw runtime_error("Failed to allocate bindless descriptor set!");
+    }
+}
+
+void BindlessDescriptors::destroy() {
+    vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, setLayout, nullptr);
+}
+
+uint32_t BindlessDescriptors::addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    lock_guard lock(mutex);
+
+    uint32_t index = allocateIndex(BindlessType::StorageBuffer);
+    VkDescriptorBufferInfo bufferInfo{.buffer = buffer, .offset = offset, .range = range};
+    write(BindlessType::StorageBuffer, index, &bufferInfo, nullptr);
+
+    return index;
+}
+
+uint32_t BindlessDescriptors::addSampledImage(VkImageView view, VkImageLayout layout) {
+    lock_guard lock(mutex);
+
+    uint32_t index = allocateIndex(BindlessType::SampledImage);
+    VkDescriptorImageInfo imageInfo{.imageView = view, .imageLayout = layout};
+    write(BindlessType::SampledImage, index, nullptr, &imageInfo);
+
+    return index;
+}
+
+uint32_t BindlessDescriptors::addSampler(VkSampler sampler) {
+    lock_guard lock(mutex);
+
+    uint32_t index = allocateIndex(BindlessType::Sampler);
+    VkDescriptorImageInfo imageInfo{.sampler = sampler};
+    write(BindlessType::Sampler, index, nullptr, &imageInfo);
+
+    return index;
+}
+
+void BindlessDescriptors::remove(BindlessType type, uint32_t index, uint64_t retireValue) {
+    lock_guard lock(mutex);
+    arrays[static_cast<uint32_t>(type)].retiring.push_back({.retireValue = retireValue, .index = index});
+}
+
+void BindlessDescriptors::retire(uint64_t completedValue) {
+    lock_guard lock(mutex);
+
+    for (DescriptorArray &array : arrays) {
+        while (!array.retiring.empty() && array.retiring.front().retireValue <= completedValue) {
+            array.freeIndices.push_back(array.retiring.front().index);
+            array.retiring.pop_front();
+        }
+    }
+}
+
+uint32_t BindlessDescriptors::allocateIndex(BindlessType type) {
+    DescriptorArray &array = arrays[static_cast<uint32_t>(type)];
+
+    if (!array.freeIndices.empty()) {
+        uint32_t index = array.freeIndices.back();
+        array.freeIndices.pop_back();
+        return index;
+    }
+
+    if (array.usedCount == array.capacity) {
+        throw runtime_error(string("Out of bindless ") + TYPE_NAMES[static_cast<uint32_t>(type)] + " descriptors!");
+    }
+
+    return array.usedCount++;
+}
+
+void BindlessDescriptors::write(BindlessType type, uint32_t index, const VkDescriptorBufferInfo *bufferInfo,
+                                const VkDescriptorImageInfo *imageInfo) {
+    VkWriteDescriptorSet descriptorWrite{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                         .dstSet = descriptorSet,
+                                         .dstBinding = static_cast<uint32_t>(type),
+                                         .dstArrayElement = index,
+                                         .descriptorCount = 1,
+                                         .descriptorType = DESCRIPTOR_TYPES[static_cast<uint32_t>(type)],
+                                         .pImageInfo = imageInfo,
+                                         .pBufferInfo = bufferInfo};
+
+    vkUpdateDescriptorSets(logicalDevice, 1, &descriptorWrite, 0, nullptr);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// The kinds of descriptors, each an array at the binding of its value in shaders/bindless.glsl.
+enum class BindlessType { StorageBuffer, SampledImage, Sampler };
+
+// A single descriptor set holding every storage buffer, sampled image and sampler that draws use, in one array per kind.
+//
+// Shaders index the arrays with indices they read from push constants or from other buffers, so the set is bound once
+// per command buffer no matter how many materials the draws use, and draws can be sorted, batched and drawn indirectly
+// without rebinding anything. The bindings are partially bound and update-after-bind, so adding a descriptor writes into
+// the set while command buffers that use it are being recorded or executed; only descriptors that pending frames might
+// still read must not change, so a removed index is reused only once the frame timeline passed the value it was removed
+// at. Thread safe.
+class BindlessDescriptors {
+  public:
+    static const uint32_t STORAGE_BUFFER_CAPACITY = 1024;
+    static const uint32_t SAMPLED_IMAGE_CAPACITY = 4096;
+    static const uint32_t SAMPLER_CAPACITY = 64;
+
+    void create(VkDevice device);
+    // The device has to be idle.
+    void destroy();
+
+    // Return the descriptor's index in its array.
+    uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+    uint32_t addSampledImage(VkImageView view, VkImageLayout layout);
+    uint32_t addSampler(VkSampler sampler);
+
+    // Frees the index once retire() passes a frame value of at least retireValue, the value of the last frame that may use it.
+    void remove(BindlessType type, uint32_t index, uint64_t retireValue);
+    // Called with the frame timeline's value once the frames up to it completed.
+    void retire(uint64_t completedValue);
+
+    VkDescriptorSetLayout layout() const { return setLayout; }
+    VkDescriptorSet set() const { return descriptorSet; }
+
+  private:
+    struct RetiringIndex {
+        uint64_t retireValue;
+        uint32_t index;
+    };
+
+    struct DescriptorArray {
+        uint32_t capacity = 0;
+        // Indices below this were handed out at some point.
+        uint32_t usedCount = 0;
+        std::vector<uint32_t> freeIndices;
+        // In the order they were removed, so the retire values only grow.
+        std::deque<RetiringIndex> retiring;
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+    std::mutex mutex;
+    DescriptorArray arrays[3];
+
+    // Under the lock.
+    uint32_t allocateIndex(BindlessType type);
+    void write(BindlessType type, uint32_t index, const VkDescriptorBufferInfo *bufferInfo, const VkDescriptorImageInfo *imageInfo);
+};
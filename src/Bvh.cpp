@@ -0,0 +1,393 @@
+#include "Bvh.h"
+
+#include "FrameArena.h"
+
+#include <algorithm>
+
+using namespace std;
+
+const uint32_t SAH_BIN_COUNT = 16;
+// Subtrees per thread, so threads that finish early take over the remaining ones.
+const uint32_t CULL_TASKS_PER_THREAD = 4;
+
+// Inverted far enough to be outside of every plane, yet small enough that the plane tests do not overflow.
+const Aabb EMPTY_BOX = {.min = {1e30f, 1e30f, 1e30f}, .max = {-1e30f, -1e30f, -1e30f}};
+
+struct Bvh::BinaryNode {
+    Aabb box;
+    uint32_t children[2];
+    // NO_CHILD for inner nodes.
+    uint32_t object;
+};
+
+struct Bvh::CullPlanes {
+    // a, b, c and d of every plane, broadcast.
+    Lanes coefficients[6][4];
+    // Node::bounds component of the corner farthest along the plane's normal per axis, and of the nearest one.
+    uint32_t farthest[6][3];
+    uint32_t nearest[6][3];
+};
+
+static void merge(Aabb &box, const Aabb &other) {
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        box.min[axis] = min(box.min[axis], other.min[axis]);
+        box.max[axis] = max(box.max[axis], other.max[axis]);
+    }
+}
+
+static float surfaceArea(const Aabb &box) {
+    float x = max(box.max[0] - box.min[0], 0.0f);
+    float y = max(box.max[1] - box.min[1], 0.0f);
+    float z = max(box.max[2] - box.min[2], 0.0f);
+    return 2.0f * (x * y + y * z + z * x);
+}
+
+static float centroid(const Aabb &box, uint32_t axis) { return 0.5f * (box.min[axis] + box.max[axis]); }
+
+Frustum extractFrustum(const float (&viewProjection)[16]) {
+    // Row i of the column-major matrix.
+    auto row = [&](uint32_t i, uint32_t column) { return viewProjection[column * 4 + i]; };
+
+    Frustum frustum;
+
+    for (uint32_t column = 0; column < 4; column++) {
+        frustum.planes[0][column] = row(3, column) + row(0, column);
+        frustum.planes[1][column] = row(3, column) - row(0, column);
+        frustum.planes[2][column] = row(3, column) + row(1, column);
+        frustum.planes[3][column] = row(3, column) - row(1, column);
+        frustum.planes[4][column] = row(2, column);
+        frustum.planes[5][column] = row(3, column) - row(2, column);
+    }
+
+    return frustum;
+}
+
+void Bvh::build(const vector<Aabb> &boxes) {
+    nodes.clear();
+    objectSlots.assign(boxes.size(), 0);
+    orderedObjects.clear();
+    orderedObjects.reserve(boxes.size());
+
+    if (!boxes.empty()) {
+        vector<uint32_t> objects(boxes.size());
+        for (uint32_t i = 0; i < objects.size(); i++) {
+            objects[i] = i;
+        }
+
+        vector<BinaryNode> binaryNodes;
+        binaryNodes.reserve(2 * boxes.size());
+        uint32_t root = buildBinary(boxes, objects, 0, static_cast<uint32_t>(objects.size()), binaryNodes);
+
+        collapse(binaryNodes, root, NO_CHILD, 0);
+    }
+
+    isNodeDirty.assign(nodes.size(), 0);
+}
+
+uint32_t Bvh::buildBinary(const vector<Aabb> &boxes, vector<uint32_t> &objects, uint32_t first, uint32_t count,
+                          vector<BinaryNode> &binaryNodes) {
+    uint32_t index = static_cast<uint32_t>(binaryNodes.size());
+    binaryNodes.push_back({.box = EMPTY_BOX, .children = {NO_CHILD, NO_CHILD}, .object = NO_CHILD});
+
+    Aabb box = EMPTY_BOX;
+    Aabb centroids = EMPTY_BOX;
+
+    for (uint32_t i = first; i < first + count; i++) {
+        const Aabb &objectBox = boxes[objects[i]];
+        merge(box, objectBox);
+
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            centroids.min[axis] = min(centroids.min[axis], centroid(objectBox, axis));
+            centroids.max[axis] = max(centroids.max[axis], centroid(objectBox, axis));
+        }
+    }
+
+    binaryNodes[index].box = box;
+
+    if (count == 1) {
+        binaryNodes[index].object = objects[first];
+        return index;
+    }
+
+    uint32_t axis = 0;
+    for (uint32_t i = 1; i < 3; i++) {
+        if (centroids.max[i] - centroids.min[i] > centroids.max[axis] - centroids.min[axis]) {
+            axis = i;
+        }
+    }
+
+    float extent = centroids.max[axis] - centroids.min[axis];
+    uint32_t leftCount = 0;
+
+    if (extent > 0.0f) {
+        struct Bin {
+            Aabb box = EMPTY_BOX;
+            uint32_t count = 0;
+        };
+
+        Bin bins[SAH_BIN_COUNT];
+        float binScale = SAH_BIN_COUNT / extent;
+        auto binOf = [&](uint32_t object) {
+            float offset = (centroid(boxes[object], axis) - centroids.min[axis]) * binScale;
+            return min(static_cast<uint32_t>(offset), SAH_BIN_COUNT - 1);
+        };
+
+        for (uint32_t i = first; i < first + count; i++) {
+            Bin &bin = bins[binOf(objects[i])];
+            merge(bin.box, boxes[objects[i]]);
+            bin.count++;
+        }
+
+        // Cost of splitting after bin i: the objects on each side weighted by the surface area of their box.
+        float rightAreas[SAH_BIN_COUNT];
+        Aabb right = EMPTY_BOX;
+        for (uint32_t i = SAH_BIN_COUNT - 1; i > 0; i--) {
+            merge(right, bins[i].box);
+            rightAreas[i] = surfaceArea(right);
+        }
+
+        Aabb left = EMPTY_BOX;
+        uint32_t leftObjects = 0;
+        float bestCost = INFINITY;
+        uint32_t bestSplit = 0;
+
+        for (uint32_t split = 1; split < SAH_BIN_COUNT; split++) {
+            merge(left, bins[split - 1].box);
+            leftObjects += bins[split - 1].count;
+
+            float cost = surfaceArea(left) * leftObjects + rightAreas[split] * (count - leftObjects);
+            if (leftObjects > 0 && leftObjects < count && cost < bestCost) {
+                bestCost = cost;
+                bestSplit = split;
+            }
+        }
+
+        if (bestSplit > 0) {
+            auto middle = partition(objects.begin() + first, objects.begin() + first + count,
+                                    [&](uint32_t object) { return binOf(object) < bestSplit; });
+            leftCount = static_cast<uint32_t>(middle - (objects.begin() + first));
+        }
+    }
+
+    // Every centroid fell into a single bin, so split by count instead.
+    if (leftCount == 0) {
+        leftCount = count / 2;
+        nth_element(objects.begin() + first, objects.begin() + first + leftCount, objects.begin() + first + count,
+                    [&](uint32_t a, uint32_t b) { return centroid(boxes[a], axis) < centroid(boxes[b], axis); });
+    }
+
+    uint32_t leftChild = buildBinary(boxes, objects, first, leftCount, binaryNodes);
+    uint32_t rightChild = buildBinary(boxes, objects, first + leftCount, count - leftCount, binaryNodes);
+
+    binaryNodes[index].children[0] = leftChild;
+    binaryNodes[index].children[1] = rightChild;
+
+    return index;
+}
+
+// Pulls up the grandchildren with the largest surface area until the node has WIDTH children.
+uint32_t Bvh::collapse(const vector<BinaryNode> &binaryNodes, uint32_t binaryNode, uint32_t parent, uint32_t parentSlot) {
+    vector<uint32_t> children;
+
+    if (binaryNodes[binaryNode].object != NO_CHILD) {
+        children.push_back(binaryNode);
+    } else {
+        children.assign(begin(binaryNodes[binaryNode].children), end(binaryNodes[binaryNode].children));
+    }
+
+    while (children.size() < WIDTH) {
+        size_t largest = children.size();
+
+        for (size_t i = 0; i < children.size(); i++) {
+            const BinaryNode &child = binaryNodes[children[i]];
+
+            if (child.object == NO_CHILD &&
+                (largest == children.size() || surfaceArea(child.box) > surfaceArea(binaryNodes[children[largest]].box))) {
+                largest = i;
+            }
+        }
+
+        if (largest == children.size()) {
+            break;
+        }
+
+        uint32_t expanded = children[largest];
+        children[largest] = binaryNodes[expanded].children[0];
+        children.push_back(binaryNodes[expanded].children[1]);
+    }
+
+    uint32_t node = static_cast<uint32_t>(nodes.size());
+    Node &created = nodes.emplace_back();
+    created.parent = parent;
+    created.parentSlot = parentSlot;
+    created.firstObject = static_cast<uint32_t>(orderedObjects.size());
+
+    for (uint32_t slot = 0; slot < WIDTH; slot++) {
+        setSlot(node, slot, NO_CHILD, EMPTY_BOX);
+    }
+
+    for (uint32_t slot = 0; slot < children.size(); slot++) {
+        const BinaryNode &child = binaryNodes[children[slot]];
+
+        if (child.object != NO_CHILD) {
+            objectSlots[child.object] = node * WIDTH + slot;
+            orderedObjects.push_back(child.object);
+            setSlot(node, slot, child.object | OBJECT_BIT, child.box);
+        } else {
+            // Creates nodes, so the reference to this one is not held across it.
+            uint32_t childNode = collapse(binaryNodes, children[slot], node, slot);
+            setSlot(node, slot, childNode, child.box);
+        }
+    }
+
+    nodes[node].objectCount = static_cast<uint32_t>(orderedObjects.size()) - nodes[node].firstObject;
+
+    return node;
+}
+
+void Bvh::setSlot(uint32_t node, uint32_t slot, uint32_t child, const Aabb &box) {
+    Node &target = nodes[node];
+    target.children[slot] = child;
+
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        target.bounds[axis][slot] = box.min[axis];
+        target.bounds[3 + axis][slot] = box.max[axis];
+    }
+}
+
+void Bvh::refit(const vector<Aabb> &boxes, const vector<uint32_t> &changedObjects) {
+    for (uint32_t object : changedObjects) {
+        uint32_t node = objectSlots[object] / WIDTH;
+
+        setSlot(node, objectSlots[object] % WIDTH, object | OBJECT_BIT, boxes[object]);
+        isNodeDirty[node] = 1;
+    }
+
+    for (size_t i = nodes.size(); i-- > 0;) {
+        if (isNodeDirty[i] == 0) {
+            continue;
+        }
+
+        isNodeDirty[i] = 0;
+        const Node &node = nodes[i];
+
+        if (node.parent == NO_CHILD) {
+            continue;
+        }
+
+        // Empty slots hold an inverted box, so they drop out of the union.
+        Aabb box = EMPTY_BOX;
+        for (uint32_t slot = 0; slot < WIDTH; slot++) {
+            for (uint32_t axis = 0; axis < 3; axis++) {
+                box.min[axis] = min(box.min[axis], node.bounds[axis][slot]);
+                box.max[axis] = max(box.max[axis], node.bounds[3 + axis][slot]);
+            }
+        }
+
+        setSlot(node.parent, node.parentSlot, static_cast<uint32_t>(i), box);
+        isNodeDirty[node.parent] = 1;
+    }
+}
+
+void Bvh::testNode(const CullPlanes &planes, const Node &node, uint32_t &outsideMask, uint32_t &crossingMask) const {
+    Lanes zero = broadcastLanes(0.0f);
+    outsideMask = 0;
+    crossingMask = 0;
+
+    for (uint32_t group = 0; group < WIDTH; group += LANE_COUNT) {
+        for (uint32_t plane = 0; plane < 6; plane++) {
+            const Lanes *coefficients = planes.coefficients[plane];
+            const uint32_t *farthest = planes.farthest[plane];
+            const uint32_t *nearest = planes.nearest[plane];
+
+            // A box is outside when even its corner farthest along the normal is, and crosses the plane when its nearest
+            // corner is outside.
+            Lanes farDistance = addLanes(addLanes(multiplyLanes(coefficients[0], loadLanes(&node.bounds[farthest[0]][group])),
+                                                  multiplyLanes(coefficients[1], loadLanes(&node.bounds[farthest[1]][group]))),
+                                         addLanes(multiplyLanes(coefficients[2], loadLanes(&node.bounds[farthest[2]][group])),
+                                                  coefficients[3]));
+            Lanes nearDistance = addLanes(addLanes(multiplyLanes(coefficients[0], loadLanes(&node.bounds[nearest[0]][group])),
+                                                   multiplyLanes(coefficients[1], loadLanes(&node.bounds[nearest[1]][group]))),
+                                          addLanes(multiplyLanes(coefficients[2], loadLanes(&node.bounds[nearest[2]][group])),
+                                                   coefficients[3]));
+
+            outsideMask |= lessThanMask(farDistance, zero) << group;
+            crossingMask |= lessThanMask(nearDistance, zero) << group;
+        }
+    }
+}
+
+void Bvh::visit(const CullPlanes &planes, uint32_t node, vector<uint32_t> &visible, pmr::vector<uint32_t> &queue) const {
+    uint32_t outsideMask;
+    uint32_t crossingMask;
+    testNode(planes, nodes[node], outsideMask, crossingMask);
+
+    for (uint32_t slot = 0; slot < WIDTH; slot++) {
+        uint32_t child = nodes[node].children[slot];
+
+        if (child == NO_CHILD || (outsideMask & (1u << slot)) != 0) {
+            continue;
+        }
+
+        if ((child & OBJECT_BIT) != 0) {
+            visible.push_back(child & ~OBJECT_BIT);
+        } else if ((crossingMask & (1u << slot)) != 0) {
+            queue.push_back(child);
+        } else {
+            auto first = orderedObjects.begin() + nodes[child].firstObject;
+            visible.insert(visible.end(), first, first + nodes[child].objectCount);
+        }
+    }
+}
+
+void Bvh::cull(const Frustum &frustum, ThreadPool &threadPool, vector<uint32_t> &visible) {
+    visible.clear();
+
+    if (nodes.empty()) {
+        return;
+    }
+
+    CullPlanes planes;
+
+    for (uint32_t plane = 0; plane < 6; plane++) {
+        for (uint32_t i = 0; i < 4; i++) {
+            planes.coefficients[plane][i] = broadcastLanes(frustum.planes[plane][i]);
+        }
+
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            bool isPositive = frustum.planes[plane][axis] >= 0.0f;
+            planes.farthest[plane][axis] = isPositive ? 3 + axis : axis;
+            planes.nearest[plane][axis] = isPositive ? axis : 3 + axis;
+        }
+    }
+
+    // Breadth-first over the first levels until every thread has a few subtrees to take.
+    uint32_t taskTarget = CULL_TASKS_PER_THREAD * (threadPool.threadCount() + 1);
+    size_t next = 0;
+
+    tasks.assign(1, 0);
+
+    while (next < tasks.size() && tasks.size() - next < taskTarget) {
+        visit(planes, tasks[next++], visible, tasks);
+    }
+
+    tasks.erase(tasks.begin(), tasks.begin() + next);
+    taskVisible.resize(max(taskVisible.size(), tasks.size()));
+
+    threadPool.parallelFor(static_cast<uint32_t>(tasks.size()), [&](uint32_t task) {
+        vector<uint32_t> &taskObjects = taskVisible[task];
+        pmr::vector<uint32_t> stack({tasks[task]}, &FrameArena::thread());
+
+        taskObjects.clear();
+
+        while (!stack.empty()) {
+            uint32_t node = stack.back();
+            stack.pop_back();
+            visit(planes, node, taskObjects, stack);
+        }
+    });
+
+    for (size_t task = 0; task < tasks.size(); task++) {
+        visible.insert(visible.end(), taskVisible[task].begin(), taskVisible[task].end());
+    }
+}
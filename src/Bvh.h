@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+struct Aabb {
+    float min[3];
+    float max[3];
+};
+
+// Six planes (a, b, c, d) with the inside at a * x + b * y + c * z + d >= 0.
+struct Frustum {
+    float planes[6][4];
+};
+
+// Same planes as isInFrustum() in cull.comp, for Vulkan's clip space depth range of [0, w]. viewProjection is column-major.
+Frustum extractFrustum(const float (&viewProjection)[16]);
+
+// Bounding volume hierarchy over the boxes of objects for frustum culling on the CPU.
+//
+// It is built top-down with the binned surface area heuristic as a binary tree, which is then collapsed into nodes of
+// WIDTH children whose boxes are stored as structure of arrays, so one SIMD instruction tests all children of a node
+// against a plane. A child is either a node or a single object. The objects are numbered in tree order, so a child node
+// entirely inside the frustum adds the contiguous objects of its subtree without visiting it. Moving objects only refit
+// the boxes above them, the topology stays the one of the last build, so rebuild once the objects moved far.
+class Bvh {
+  public:
+    static const uint32_t WIDTH = LANE_COUNT > 4 ? LANE_COUNT : 4;
+
+    // Object i is boxes[i].
+    void build(const std::vector<Aabb> &boxes);
+    // boxes holds every object's box, of which changedObjects moved since the last build or refit.
+    void refit(const std::vector<Aabb> &boxes, const std::vector<uint32_t> &changedObjects);
+
+    // Replaces visible with the objects whose box intersects the frustum. The subtrees below the first levels are traversed
+    // in parallel on the pool's threads, with their traversal stacks in the frame arena.
+    void cull(const Frustum &frustum, ThreadPool &threadPool, std::vector<uint32_t> &visible);
+
+  private:
+    static const uint32_t NO_CHILD = UINT32_MAX;
+    // Marks a child that is an object instead of a node.
+    static const uint32_t OBJECT_BIT = 0x80000000u;
+
+    struct alignas(64) Node {
+        // The children's boxes, one SIMD group per component: min xyz, then max xyz. Empty slots hold an inverted box
+        // that is outside of every plane.
+        float bounds[6][WIDTH];
+        uint32_t children[WIDTH];
+        // NO_CHILD for the root.
+        uint32_t parent;
+        uint32_t parentSlot;
+        // The subtree's objects in orderedObjects.
+        uint32_t firstObject;
+        uint32_t objectCount;
+    };
+
+    struct BinaryNode;
+    struct CullPlanes;
+
+    // Nodes are created parents first, so a reverse pass always refits the children before their parents.
+    std::vector<Node> nodes;
+    // Node index * WIDTH + slot holding every object.
+    std::vector<uint32_t> objectSlots;
+    std::vector<uint32_t> orderedObjects;
+    std::vector<uint8_t> isNodeDirty;
+    std::vector<std::vector<uint32_t>> taskVisible;
+    std::pmr::vector<uint32_t> tasks;
+
+    uint32_t buildBinary(const std::vector<Aabb> &boxes, std::vector<uint32_t> &objects, uint32_t first, uint32_t count,
+                         std::vector<BinaryNode> &binaryNodes);
+    uint32_t collapse(const std::vector<BinaryNode> &binaryNodes, uint32_t binaryNode, uint32_t parent, uint32_t parentSlot);
+    void setSlot(uint32_t node, uint32_t slot, uint32_t child, const Aabb &box);
+
+    // Returns bit masks of the children outside of the frustum and of those crossing one of its planes.
+    void testNode(const CullPlanes &planes, const Node &node, uint32_t &outsideMask, uint32_t &crossingMask) const;
+    // Takes the node's visible objects and inside subtrees and queues the children that need further traversal.
+    void visit(const CullPlanes &planes, uint32_t node, std::vector<uint32_t> &visible, std::pmr::vector<uint32_t> &queue) const;
+};
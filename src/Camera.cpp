@@ -0,0 +1,36 @@
+#include "Camera.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+const float RADIANS_PER_PIXEL = 0.005f;
+// The scene lies at depth 0.5 and spans [-1, 1], so turning it by up to 30 degrees keeps it inside [0, 1].
+const float MAX_ANGLE = 0.5f;
+const float PIVOT_DEPTH = 0.5f;
+
+void Camera::turn(double deltaX, double deltaY) {
+    yaw = clamp(yaw + static_cast<float>(deltaX) * RADIANS_PER_PIXEL, -MAX_ANGLE, MAX_ANGLE);
+    pitch = clamp(pitch + static_cast<float>(deltaY) * RADIANS_PER_PIXEL, -MAX_ANGLE, MAX_ANGLE);
+}
+
+void Camera::viewProjection(float (&matrix)[16]) const {
+    float cy = cos(yaw), sy = sin(yaw);
+    float cp = cos(pitch), sp = sin(pitch);
+
+    // The rotation about x by pitch after the one about y by yaw, about the pivot (0, 0, PIVOT_DEPTH).
+    const float rotation[3][3] = {{cy, 0.0f, sy}, {sp * sy, cp, -sp * cy}, {-cp * sy, sp, cp * cy}};
+
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            matrix[column * 4 + row] = rotation[row][column];
+        }
+        matrix[column * 4 + 3] = 0.0f;
+    }
+
+    matrix[12] = -rotation[0][2] * PIVOT_DEPTH;
+    matrix[13] = -rotation[1][2] * PIVOT_DEPTH;
+    matrix[14] = PIVOT_DEPTH - rotation[2][2] * PIVOT_DEPTH;
+    matrix[15] = 1.0f;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Matches the View blocks in shader.vert and cull.comp.
+struct ViewUniforms {
+    // Column-major.
+    float viewProjection[16];
+};
+
+// Turns the scene, which is laid out in clip space, about its center. The projection stays the identity, so the initial
+// orientation renders the scene as laid out. The angles are limited so the flat scene stays inside the depth range.
+class Camera {
+  public:
+    // Turns by a cursor movement in pixels.
+    void turn(double deltaX, double deltaY);
+
+    void viewProjection(float (&matrix)[16]) const;
+
+  private:
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+};
@@ -0,0 +1,132 @@
+#include "CommandRecorder.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+// Below this many items per range the cost of an extra secondary command buffer outweighs recording in parallel.
+const uint32_t MIN_ITEMS_PER_SECONDARY = 256;
+
+void CommandRecorder::create(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, ThreadPool &threadPool,
+                             uint32_t recordingThreadCount) {
+    logicalDevice = device;
+    workers = &threadPool;
+    frames.resize(framesInFlight);
+
+    for (auto &frame : frames) {
+        frame.primaryPool = createPool(queueFamilyIndex);
+        frame.primary = allocate(frame.primaryPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+        for (uint32_t i = 0; i < max(recordingThreadCount, 1u); i++) {
+            frame.secondaryPools.push_back(createPool(queueFamilyIndex));
+            frame.secondaries.push_back(allocate(frame.secondaryPools.back(), VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+        }
+    }
+}
+
+void CommandRecorder::destroy() {
+    for (auto &frame : frames) {
+        for (auto pool : frame.secondaryPools) {
+            vkDestroyCommandPool(logicalDevice, pool, nullptr);
+        }
+
+        vkDestroyCommandPool(logicalDevice, frame.primaryPool, nullptr);
+    }
+
+    frames.clear();
+}
+
+VkCommandPool CommandRecorder::createPool(uint32_t queueFamilyIndex) {
+    VkCommandPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                     .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                                     .queueFamilyIndex = queueFamilyIndex};
+
+    VkCommandPool pool;
+    if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw runtime_error("Failed to create command pool!");
+    }
+
+    return pool;
+}
+
+VkCommandBuffer CommandRecorder::allocate(VkCommandPool pool, VkCommandBufferLevel level) {
+    VkCommandBufferAllocateInfo allocInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, .commandPool = pool, .level = level, .commandBufferCount = 1};
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw runtime_error("Failed to allocate command buffers!");
+    }
+
+    return commandBuffer;
+}
+
+VkCommandBuffer CommandRecorder::beginFrame(uint32_t frame) {
+    FrameCommands &commands = frames[frame];
+
+    vkResetCommandPool(logicalDevice, commands.primaryPool, 0);
+    for (auto pool : commands.secondaryPools) {
+        vkResetCommandPool(logicalDevice, pool, 0);
+    }
+
+    VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                       .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                                       .pInheritanceInfo = nullptr};
+
+    if (vkBeginCommandBuffer(commands.primary, &beginInfo) != VK_SUCCESS) {
+        throw runtime_error("Failed to begin recording command buffer!");
+    }
+
+    return commands.primary;
+}
+
+VkCommandBuffer CommandRecorder::endFrame(uint32_t frame) {
+    VkCommandBuffer primary = frames[frame].primary;
+
+    if (vkEndCommandBuffer(primary) != VK_SUCCESS) {
+        throw runtime_error("Failed to record command buffer!");
+    }
+
+    return primary;
+}
+
+void CommandRecorder::recordRanges(uint32_t frame, const VkCommandBufferInheritanceInfo &inheritance, uint32_t itemCount,
+                                   const void *recordRange, void (*call)(const void *, VkCommandBuffer, uint32_t, uint32_t)) {
+    if (itemCount == 0) {
+        return;
+    }
+
+    FrameCommands &commands = frames[frame];
+
+    uint32_t rangeCount = min(static_cast<uint32_t>(commands.secondaries.size()),
+                              (itemCount + MIN_ITEMS_PER_SECONDARY - 1) / MIN_ITEMS_PER_SECONDARY);
+    uint32_t rangeSize = (itemCount + rangeCount - 1) / rangeCount;
+    rangeCount = (itemCount + rangeSize - 1) / rangeSize;
+
+    VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                       .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                                                VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+                                       .pInheritanceInfo = &inheritance};
+
+    // Range i always goes into secondary i, which is allocated from pool i, so no two threads touch the same pool.
+    workers->parallelFor(rangeCount, [&](uint32_t i) {
+        CpuZone zone("Record secondary");
+        VkCommandBuffer secondary = commands.secondaries[i];
+
+        if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS) {
+            throw runtime_error("Failed to begin recording secondary command buffer!");
+        }
+
+        uint32_t first = i * rangeSize;
+        call(recordRange, secondary, first, min(rangeSize, itemCount - first));
+
+        if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+            throw runtime_error("Failed to record secondary command buffer!");
+        }
+    });
+
+    vkCmdExecuteCommands(commands.primary, rangeCount, commands.secondaries.data());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <vector>
+
+// Command buffers that are re-recorded every frame.
+//
+// Each frame in flight owns a transient pool for its primary command buffer and one pool per recording thread for
+// secondary command buffers, so threads never share a pool and a whole frame is recycled with vkResetCommandPool
+// instead of freeing and reallocating individual command buffers.
+class CommandRecorder {
+  public:
+    void create(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, ThreadPool &threadPool, uint32_t recordingThreadCount);
+    void destroy();
+
+    // Resets the frame's pools and begins its primary command buffer. Only call once the frame's previous submission completed.
+    VkCommandBuffer beginFrame(uint32_t frame);
+    VkCommandBuffer endFrame(uint32_t frame);
+
+    // Splits [0, itemCount) into contiguous ranges, records each range into its own secondary command buffer in parallel
+    // and executes them from the frame's primary command buffer, which has to be inside the inherited render pass.
+    // recordRange(secondary, first, count) records a range.
+    template <typename RecordRange>
+    void recordSecondaries(uint32_t frame, const VkCommandBufferInheritanceInfo &inheritance, uint32_t itemCount,
+                           const RecordRange &recordRange) {
+        // Called through a function pointer, so the callable is not copied into a std::function that might allocate.
+        recordRanges(frame, inheritance, itemCount, &recordRange,
+                     [](const void *context, VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+                         (*static_cast<const RecordRange *>(context))(secondary, first, count);
+                     });
+    }
+
+    uint32_t recordingThreadCount() const { return static_cast<uint32_t>(frames.empty() ? 0 : frames.front().secondaryPools.size()); }
+
+  private:
+    struct FrameCommands {
+        VkCommandPool primaryPool;
+        VkCommandBuffer primary;
+        std::vector<VkCommandPool> secondaryPools;
+        std::vector<VkCommandBuffer> secondaries;
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    ThreadPool *workers = nullptr;
+    std::vector<FrameCommands> frames;
+
+    VkCommandPool createPool(uint32_t queueFamilyIndex);
+    VkCommandBuffer allocate(VkCommandPool pool, VkCommandBufferLevel level);
+    void recordRanges(uint32_t frame, const VkCommandBufferInheritanceInfo &inheritance, uint32_t itemCount, const void *recordRange,
+                      void (*call)(const void *recordRange, VkCommandBuffer secondary, uint32_t first, uint32_t count));
+};
@@ -0,0 +1,91 @@
+#include "DeviceCapabilities.h"
+
+using namespace std;
+
+bool DeviceCapabilities::hasExtensions(const vector<const char *> &names) const {
+    for (const char *name : names) {
+        if (extensions.count(name) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice device, VkSurfaceKHR surface) {
+    DeviceCapabilities capabilities{.device = device,
+                                    .vulkan12Features = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES},
+                                    .presentIdFeatures = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR},
+                                    .presentWaitFeatures = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR},
+                                    .surfaceCapabilities = {}};
+
+    vkGetPhysicalDeviceProperties(device, &capabilities.properties);
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+    for (const auto &extension : extensions) {
+        capabilities.extensions.insert(extension.extensionName);
+    }
+
+    if (capabilities.properties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceFeatures2 features{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &capabilities.vulkan12Features};
+
+        // Extension features may only be chained when the device has the extension.
+        if (capabilities.extensions.count(VK_KHR_PRESENT_ID_EXTENSION_NAME) > 0) {
+            capabilities.presentIdFeatures.pNext = features.pNext;
+            features.pNext = &capabilities.presentIdFeatures;
+        }
+
+        if (capabilities.extensions.count(VK_KHR_PRESENT_WAIT_EXTENSION_NAME) > 0) {
+            capabilities.presentWaitFeatures.pNext = features.pNext;
+            features.pNext = &capabilities.presentWaitFeatures;
+        }
+
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        capabilities.features = features.features;
+        capabilities.vulkan12Features.pNext = nullptr;
+        capabilities.presentIdFeatures.pNext = nullptr;
+        capabilities.presentWaitFeatures.pNext = nullptr;
+    } else {
+        vkGetPhysicalDeviceFeatures(device, &capabilities.features);
+    }
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+    capabilities.queueFamilies.resize(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, capabilities.queueFamilies.data());
+
+    capabilities.presentSupport.resize(queueFamilyCount, false);
+
+    if (surface == VK_NULL_HANDLE) {
+        return capabilities;
+    }
+
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+        VkBool32 isSupported = VK_FALSE;
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &isSupported);
+        capabilities.presentSupport[i] = isSupported == VK_TRUE;
+    }
+
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &capabilities.surfaceCapabilities);
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+
+    capabilities.surfaceFormats.resize(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, capabilities.surfaceFormats.data());
+
+    uint32_t presentModeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+
+    capabilities.presentModes.resize(presentModeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, capabilities.presentModes.data());
+
+    return capabilities;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+// Snapshot of everything startup needs to know about a physical device, queried once per device and reused for device
+// selection, queue family selection, logical device creation and swapchain creation.
+struct DeviceCapabilities {
+    VkPhysicalDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features;
+    // Only queried from devices that support Vulkan 1.2, all false otherwise. pNext is left null.
+    VkPhysicalDeviceVulkan12Features vulkan12Features;
+    // Only queried from Vulkan 1.2 devices with the extension, all false otherwise. pNext is left null.
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures;
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    // Per queue family; all false without a surface.
+    std::vector<bool> presentSupport;
+    std::set<std::string> extensions;
+
+    // Left empty without a surface. The surface capabilities describe the surface at the time of the query.
+    VkSurfaceCapabilitiesKHR surfaceCapabilities;
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentModes;
+
+    bool hasExtensions(const std::vector<const char *> &names) const;
+};
+
+// The surface may be VK_NULL_HANDLE when rendering headless.
+DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice device, VkSurfaceKHR surface);
@@ -0,0 +1,312 @@
+#include "DeviceMemoryAllocator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+// Heaps up to this size get blocks of an eighth of the heap, larger ones blocks of LARGE_HEAP_BLOCK_SIZE.
+const VkDeviceSize SMALL_HEAP_MAX_SIZE = VkDeviceSize(1) << 30;
+const VkDeviceSize LARGE_HEAP_BLOCK_SIZE = VkDeviceSize(256) << 20;
+// How often a block allocation that ran out of memory is retried with half the size.
+const uint32_t BLOCK_SIZE_HALVINGS = 3;
+
+static double toMebibytes(VkDeviceSize bytes) { return bytes / double(1 << 20); }
+
+void DeviceMemoryAllocator::create(VkPhysicalDevice physicalDevice, VkDevice device) {
+    logicalDevice = device;
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+    pools.resize(2 * memoryProperties.memoryTypeCount);
+
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+        VkDeviceSize blockSize = heapSize <= SMALL_HEAP_MAX_SIZE ? heapSize / 8 : LARGE_HEAP_BLOCK_SIZE;
+
+        pool(i, ResourceTiling::Linear).blockSize = blockSize;
+        pool(i, ResourceTiling::Optimal).blockSize = blockSize;
+    }
+}
+
+void DeviceMemoryAllocator::destroy() {
+    lock_guard lock(mutex);
+
+    for (auto &memoryPool : pools) {
+        for (auto &block : memoryPool.blocks) {
+            vkFreeMemory(logicalDevice, block->memory, nullptr);
+        }
+    }
+
+    pools.clear();
+    allocationCount = 0;
+}
+
+DeviceMemoryAllocator::MemoryPool &DeviceMemoryAllocator::pool(uint32_t memoryTypeIndex, ResourceTiling tiling) {
+    return pools[2 * memoryTypeIndex + static_cast<uint32_t>(tiling)];
+}
+
+DeviceAllocation DeviceMemoryAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags requiredProperties,
+                                                 ResourceTiling tiling) {
+    lock_guard lock(mutex);
+
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((requirements.memoryTypeBits & (1u << i)) == 0 ||
+            (memoryProperties.memoryTypes[i].propertyFlags & requiredProperties) != requiredProperties) {
+            continue;
+        }
+
+        DeviceAllocation allocation;
+        if (allocateFromType(i, requirements, tiling, allocation)) {
+            return allocation;
+        }
+    }
+
+    throw runtime_error("Failed to allocate device memory!");
+}
+
+void DeviceMemoryAllocator::free(DeviceAllocation &allocation) {
+    if (allocation.block == nullptr) {
+        return;
+    }
+
+    {
+        lock_guard lock(mutex);
+        freeRegion(allocation.block, allocation.region);
+    }
+
+    allocation = {};
+}
+
+DeviceAllocation DeviceMemoryAllocator::allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags requiredProperties) {
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(logicalDevice, buffer, &requirements);
+
+    DeviceAllocation allocation = allocate(requirements, requiredProperties, ResourceTiling::Linear);
+
+    if (vkBindBufferMemory(logicalDevice, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        free(allocation);
+        throw runtime_error("Failed to bind buffer memory!");
+    }
+
+    return allocation;
+}
+
+DeviceAllocation DeviceMemoryAllocator::allocateForImage(VkImage image, VkImageTiling imageTiling,
+                                                         VkMemoryPropertyFlags requiredProperties) {
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(logicalDevice, image, &requirements);
+
+    ResourceTiling tiling = imageTiling == VK_IMAGE_TILING_OPTIMAL ? ResourceTiling::Optimal : ResourceTiling::Linear;
+    DeviceAllocation allocation = allocate(requirements, requiredProperties, tiling);
+
+    if (vkBindImageMemory(logicalDevice, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        free(allocation);
+        throw runtime_error("Failed to bind image memory!");
+    }
+
+    return allocation;
+}
+
+bool DeviceMemoryAllocator::allocateFromType(uint32_t memoryTypeIndex, const VkMemoryRequirements &requirements, ResourceTiling tiling,
+                                             DeviceAllocation &allocation) {
+    MemoryPool &memoryPool = pool(memoryTypeIndex, tiling);
+
+    if (requirements.size > memoryPool.blockSize / 2) {
+        MemoryBlock *block = createBlock(memoryTypeIndex, tiling, requirements.size);
+        if (block == nullptr) {
+            return false;
+        }
+
+        block->isDedicated = true;
+        allocation = describe(block, block->ranges.allocate(requirements.size, 1));
+        return true;
+    }
+
+    for (auto &block : memoryPool.blocks) {
+        if (block->isDedicated) {
+            continue;
+        }
+
+        uint32_t region = block->ranges.allocate(requirements.size, requirements.alignment);
+        if (region != RangeAllocator::NO_REGION) {
+            allocation = describe(block.get(), region);
+            return true;
+        }
+    }
+
+    MemoryBlock *block = nullptr;
+    VkDeviceSize blockSize = memoryPool.blockSize;
+
+    for (uint32_t i = 0; i <= BLOCK_SIZE_HALVINGS && block == nullptr && blockSize >= requirements.size; i++, blockSize /= 2) {
+        block = createBlock(memoryTypeIndex, tiling, blockSize);
+    }
+
+    if (block == nullptr) {
+        return false;
+    }
+
+    allocation = describe(block, block->ranges.allocate(requirements.size, requirements.alignment));
+    return true;
+}
+
+MemoryBlock *DeviceMemoryAllocator::createBlock(uint32_t memoryTypeIndex, ResourceTiling tiling, VkDeviceSize size) {
+    if (allocationCount >= maxAllocationCount) {
+        return nullptr;
+    }
+
+    VkMemoryAllocateInfo allocInfo{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .allocationSize = size, .memoryTypeIndex = memoryTypeIndex};
+
+    auto block = make_unique<MemoryBlock>(size);
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->tiling = tiling;
+
+    if (vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+        return nullptr;
+    }
+
+    if ((memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0 &&
+        vkMapMemory(logicalDevice, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+        vkFreeMemory(logicalDevice, block->memory, nullptr);
+        throw runtime_error("Failed to map device memory!");
+    }
+
+    allocationCount++;
+
+    MemoryPool &memoryPool = pool(memoryTypeIndex, tiling);
+    memoryPool.blocks.push_back(move(block));
+
+    return memoryPool.blocks.back().get();
+}
+
+void DeviceMemoryAllocator::destroyBlock(MemoryPool &memoryPool, MemoryBlock *block) {
+    vkFreeMemory(logicalDevice, block->memory, nullptr);
+    allocationCount--;
+
+    erase_if(memoryPool.blocks, [block](const unique_ptr<MemoryBlock> &candidate) { return candidate.get() == block; });
+}
+
+void DeviceMemoryAllocator::freeRegion(MemoryBlock *block, uint32_t region) {
+    block->ranges.free(region);
+
+    if (!block->ranges.isEmpty()) {
+        return;
+    }
+
+    MemoryPool &memoryPool = pool(block->memoryTypeIndex, block->tiling);
+
+    auto emptyBlockCount = count_if(begin(memoryPool.blocks), end(memoryPool.blocks), [](const unique_ptr<MemoryBlock> &candidate) {
+        return !candidate->isDedicated && candidate->ranges.isEmpty();
+    });
+
+    if (block->isDedicated || emptyBlockCount > 1) {
+        destroyBlock(memoryPool, block);
+    }
+}
+
+DeviceAllocation DeviceMemoryAllocator::describe(MemoryBlock *block, uint32_t region) const {
+    VkDeviceSize offset = block->ranges.offset(region);
+
+    return {.memory = block->memory,
+            .offset = offset,
+            .size = block->ranges.size(region),
+            .mapped = block->mapped != nullptr ? static_cast<char *>(block->mapped) + offset : nullptr,
+            .block = block,
+            .region = region};
+}
+
+vector<DefragmentationMove> DeviceMemoryAllocator::beginDefragmentation(VkDeviceSize maxBytesToMove) {
+    lock_guard lock(mutex);
+
+    vector<DefragmentationMove> moves;
+    VkDeviceSize bytesMoved = 0;
+
+    for (auto &memoryPool : pools) {
+        vector<MemoryBlock *> blocks;
+        for (auto &block : memoryPool.blocks) {
+            if (!block->isDedicated) {
+                blocks.push_back(block.get());
+            }
+        }
+
+        sort(begin(blocks), end(blocks), [](MemoryBlock *a, MemoryBlock *b) { return a->ranges.usedBytes() > b->ranges.usedBytes(); });
+
+        // Blocks that received a move stop being sources, otherwise a reserved destination could get moved again.
+        vector<bool> isDestination(blocks.size(), false);
+
+        for (size_t source = blocks.size(); source-- > 1 && !isDestination[source];) {
+            vector<uint32_t> regions;
+            blocks[source]->ranges.forEachAllocation([&](uint32_t region) { regions.push_back(region); });
+
+            for (uint32_t region : regions) {
+                VkDeviceSize size = blocks[source]->ranges.size(region);
+                if (bytesMoved + size > maxBytesToMove) {
+                    return moves;
+                }
+
+                for (size_t destination = 0; destination < source; destination++) {
+                    uint32_t reserved = blocks[destination]->ranges.allocate(size, blocks[source]->ranges.alignment(region));
+
+                    if (reserved != RangeAllocator::NO_REGION) {
+                        moves.push_back(
+                            {.source = describe(blocks[source], region), .destination = describe(blocks[destination], reserved)});
+                        isDestination[destination] = true;
+                        bytesMoved += size;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return moves;
+}
+
+void DeviceMemoryAllocator::finishDefragmentation(const vector<DefragmentationMove> &moves) {
+    lock_guard lock(mutex);
+
+    for (const auto &move : moves) {
+        freeRegion(move.source.block, move.source.region);
+    }
+}
+
+MemoryStats DeviceMemoryAllocator::stats() const {
+    lock_guard lock(mutex);
+
+    MemoryStats memoryStats;
+
+    for (const auto &memoryPool : pools) {
+        for (const auto &block : memoryPool.blocks) {
+            const RangeAllocator &ranges = block->ranges;
+
+            memoryStats.blockCount++;
+            memoryStats.allocationCount += ranges.allocationCount();
+            memoryStats.bytesReserved += ranges.capacity();
+            memoryStats.bytesUsed += ranges.usedBytes();
+            memoryStats.bytesWasted += ranges.capacity() - ranges.usedBytes() - ranges.largestFreeRange();
+        }
+    }
+
+    return memoryStats;
+}
+
+void DeviceMemoryAllocator::printStats(ostream &out) const {
+    MemoryStats memoryStats = stats();
+
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << fixed << setprecision(2);
+
+    out << "Device memory: " << memoryStats.allocationCount << " allocations in " << memoryStats.blockCount << " blocks, "
+        << toMebibytes(memoryStats.bytesReserved) << " MiB reserved, " << toMebibytes(memoryStats.bytesUsed) << " MiB used, "
+        << toMebibytes(memoryStats.bytesWasted) << " MiB wasted\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "RangeAllocator.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Buffers and linear images never share a block with optimal-tiling images, so bufferImageGranularity never applies
+// between neighbouring allocations.
+enum class ResourceTiling { Linear, Optimal };
+
+struct MemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    uint32_t memoryTypeIndex = 0;
+    ResourceTiling tiling = ResourceTiling::Linear;
+    // Host visible blocks stay mapped for their whole lifetime.
+    void *mapped = nullptr;
+    // Dedicated blocks hold a single resource too large to share a block and are freed together with it.
+    bool isDedicated = false;
+    RangeAllocator ranges;
+
+    explicit MemoryBlock(VkDeviceSize size) : ranges(size) {}
+};
+
+struct DeviceAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // Points at offset inside the persistent mapping of host visible memory, null otherwise.
+    void *mapped = nullptr;
+
+    MemoryBlock *block = nullptr;
+    uint32_t region = RangeAllocator::NO_REGION;
+};
+
+// The caller copies the resource bound at source into a new resource bound at destination, then hands the move back to
+// finishDefragmentation() once the copy completed on the GPU.
+struct DefragmentationMove {
+    DeviceAllocation source;
+    DeviceAllocation destination;
+};
+
+struct MemoryStats {
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+    // Size of all VkDeviceMemory objects.
+    VkDeviceSize bytesReserved = 0;
+    VkDeviceSize bytesUsed = 0;
+    // Free bytes outside each block's largest free range: fragmented space that only fits smaller requests.
+    VkDeviceSize bytesWasted = 0;
+};
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks.
+//
+// Every memory type has one pool per ResourceTiling, and a pool grows by blocks that are sub-allocated with a TLSF
+// RangeAllocator. Resources larger than half a block get a dedicated block instead. All methods may be called from any thread.
+class DeviceMemoryAllocator {
+  public:
+    void create(VkPhysicalDevice physicalDevice, VkDevice device);
+    // Frees every block; all resources bound to them have to be destroyed already.
+    void destroy();
+
+    // Uses the first memory type allowed by the requirements that has all of the required properties, falling back to the next
+    // one when its heap is exhausted.
+    DeviceAllocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags requiredProperties, ResourceTiling tiling);
+    void free(DeviceAllocation &allocation);
+
+    // Allocate memory for the resource and bind it.
+    DeviceAllocation allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags requiredProperties);
+    DeviceAllocation allocateForImage(VkImage image, VkImageTiling imageTiling, VkMemoryPropertyFlags requiredProperties);
+
+    // Plans moves that empty the least used blocks into the free space of fuller blocks of the same pool, moving at most
+    // maxBytesToMove. The destinations are reserved right away, the sources stay allocated until finishDefragmentation().
+    std::vector<DefragmentationMove> beginDefragmentation(VkDeviceSize maxBytesToMove);
+    // Frees the sources of the moves and releases the blocks that became empty.
+    void finishDefragmentation(const std::vector<DefragmentationMove> &moves);
+
+    MemoryStats stats() const;
+    void printStats(std::ostream &out) const;
+
+  private:
+    struct MemoryPool {
+        VkDeviceSize blockSize = 0;
+        std::vector<std::unique_ptr<MemoryBlock>> blocks;
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    uint32_t maxAllocationCount = 0;
+    uint32_t allocationCount = 0;
+
+    mutable std::mutex mutex;
+    // Indexed by memory type index * 2 + ResourceTiling.
+    std::vector<MemoryPool> pools;
+
+    MemoryPool &pool(uint32_t memoryTypeIndex, ResourceTiling tiling);
+    bool allocateFromType(uint32_t memoryTypeIndex, const VkMemoryRequirements &requirements, ResourceTiling tiling,
+                          DeviceAllocation &allocation);
+    // Returns null when the device is out of memory or allocations.
+    MemoryBlock *createBlock(uint32_t memoryTypeIndex, ResourceTiling tiling, VkDeviceSize size);
+    void destroyBlock(MemoryPool &memoryPool, MemoryBlock *block);
+    // Frees the region and releases the block if it became empty, keeping one empty block per pool to avoid allocating
+    // and freeing device memory back to back.
+    void freeRegion(MemoryBlock *block, uint32_t region);
+    DeviceAllocation describe(MemoryBlock *block, uint32_t region) const;
+};
@@ -0,0 +1,80 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// The scale aims at this fraction of the target.
+const double TARGET_HEADROOM = 0.9;
+// The resolution grows once the average time is below this fraction of the target.
+const double GROWTH_THRESHOLD = 0.8;
+// Largest growth of the scale per change, so a few fast frames do not overshoot into a spike.
+const float MAX_GROWTH = 1.05f;
+const double AVERAGE_WEIGHT = 0.1;
+
+static uint32_t roundToStep(float size, uint32_t maxSize) {
+    uint32_t stepped = static_cast<uint32_t>(lround(size / DynamicResolution::RESOLUTION_STEP)) * DynamicResolution::RESOLUTION_STEP;
+    return clamp(stepped, min(DynamicResolution::RESOLUTION_STEP, maxSize), maxSize);
+}
+
+static VkExtent2D scaleExtent(VkExtent2D extent, float scale) {
+    return {roundToStep(extent.width * scale, extent.width), roundToStep(extent.height * scale, extent.height)};
+}
+
+void DynamicResolution::create(VkExtent2D fullExtent, double targetMilliseconds, uint32_t framesInFlight) {
+    maxExtent = fullExtent;
+    renderExtent = fullExtent;
+    targetTime = targetMilliseconds;
+    renderScale = 1.0f;
+    averageTime = 0.0;
+    // The frame being recorded when a time arrives and the ones in flight behind it.
+    pendingFrameCount = framesInFlight - 1;
+    staleFrameCount = 0;
+}
+
+void DynamicResolution::resize(VkExtent2D fullExtent) {
+    maxExtent = fullExtent;
+    renderExtent = scaleExtent(maxExtent, renderScale);
+    // The time per pixel is unchanged, but the frames in flight were recorded at the old size.
+    averageTime = 0.0;
+    staleFrameCount = pendingFrameCount;
+}
+
+void DynamicResolution::addGpuFrameTime(double milliseconds) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    if (staleFrameCount > 0) {
+        staleFrameCount--;
+        return;
+    }
+
+    averageTime = averageTime == 0.0 ? milliseconds : averageTime + AVERAGE_WEIGHT * (milliseconds - averageTime);
+
+    if (milliseconds > targetTime) {
+        // The load changed, so the average restarts from this frame rather than being dragged down by the ones before.
+        averageTime = milliseconds;
+        setScale(renderScale * static_cast<float>(sqrt(targetTime * TARGET_HEADROOM / milliseconds)));
+    } else if (averageTime < targetTime * GROWTH_THRESHOLD && renderScale < 1.0f) {
+        setScale(renderScale * min(static_cast<float>(sqrt(targetTime * TARGET_HEADROOM / averageTime)), MAX_GROWTH));
+    }
+}
+
+void DynamicResolution::setScale(float scale) {
+    scale = clamp(scale, MIN_SCALE, 1.0f);
+
+    VkExtent2D extent = scaleExtent(maxExtent, scale);
+    // Kept even if the extent rounds to the same step, so small changes add up until they reach the next one.
+    renderScale = scale;
+
+    if (extent.width == renderExtent.width && extent.height == renderExtent.height) {
+        return;
+    }
+
+    // The average carries over to the new scale in proportion to the pixels.
+    averageTime *= double(extent.width) * extent.height / (double(renderExtent.width) * renderExtent.height);
+    renderExtent = extent;
+    staleFrameCount = pendingFrameCount;
+}
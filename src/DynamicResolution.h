@@ -0,0 +1,46 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include <cstdint>
+
+// Picks the resolution the scene renders at, within its full size, to hold the GPU frame time at a target.
+//
+// A frame's GPU time is taken to grow with its pixels, so the scale per axis moves with the square root of the time over
+// the target, aiming a little below it to leave room for noise. A frame over the target drops the resolution right away,
+// giving up some sharpness rather than the next frames; the resolution only grows back in small steps once the average
+// time stays well below the target. GPU times arrive a few frames late, so the times of the frames recorded before a change
+// are skipped. The extent is a multiple of RESOLUTION_STEP pixels, which keeps it from moving by single pixels.
+class DynamicResolution {
+  public:
+    static constexpr float MIN_SCALE = 0.5f;
+    static constexpr uint32_t RESOLUTION_STEP = 8;
+
+    // A target of 0 always renders at fullExtent.
+    void create(VkExtent2D fullExtent, double targetMilliseconds, uint32_t framesInFlight);
+
+    bool isEnabled() const { return targetTime > 0.0; }
+
+    // Keeps the scale for a new full extent, like that of a resized window.
+    void resize(VkExtent2D fullExtent);
+
+    // Render thread, with the GPU time of every completed frame in the order they completed.
+    void addGpuFrameTime(double milliseconds);
+
+    // The extent the frames recorded from now on render at.
+    VkExtent2D extent() const { return renderExtent; }
+    float scale() const { return renderScale; }
+
+  private:
+    VkExtent2D maxExtent{};
+    VkExtent2D renderExtent{};
+    double targetTime = 0.0;
+    float renderScale = 1.0f;
+    // Exponential moving average of the GPU time at the current scale; 0 until the first time arrives.
+    double averageTime = 0.0;
+    uint32_t pendingFrameCount = 0;
+    // Times still to come from frames recorded before the last change.
+    uint32_t staleFrameCount = 0;
+
+    void setScale(float scale);
+};
@@ -0,0 +1,124 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+
+using namespace std;
+
+const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+LinearArena::~LinearArena() {
+    for (const Block &block : blocks) {
+        ::operator delete(block.memory);
+    }
+}
+
+void LinearArena::reset() {
+    if (blocks.size() > 1) {
+        size_t mergedSize = max(capacity(), usedBytes);
+
+        for (const Block &block : blocks) {
+            ::operator delete(block.memory);
+        }
+
+        blocks.assign(1, {.memory = static_cast<char *>(::operator new(mergedSize)), .size = mergedSize});
+    }
+
+    currentBlock = 0;
+    offset = 0;
+    usedBytes = 0;
+}
+
+void LinearArena::reserve(size_t bytes) {
+    if (blocks.empty()) {
+        blocks.push_back({.memory = static_cast<char *>(::operator new(bytes)), .size = bytes});
+    }
+}
+
+size_t LinearArena::capacity() const {
+    size_t bytes = 0;
+
+    for (const Block &block : blocks) {
+        bytes += block.size;
+    }
+
+    return bytes;
+}
+
+void *LinearArena::do_allocate(size_t bytes, size_t alignment) {
+    usedBytes += bytes + alignment - 1;
+
+    for (;; currentBlock++, offset = 0) {
+        if (currentBlock == blocks.size()) {
+            // Large enough for the request at any alignment.
+            size_t size = max(ARENA_BLOCK_SIZE, bytes + alignment);
+            blocks.push_back({.memory = static_cast<char *>(::operator new(size)), .size = size});
+        }
+
+        const Block &block = blocks[currentBlock];
+        uintptr_t address = reinterpret_cast<uintptr_t>(block.memory) + offset;
+        size_t padding = (alignment - address % alignment) % alignment;
+
+        if (offset + padding + bytes <= block.size) {
+            offset += padding + bytes;
+            return reinterpret_cast<void *>(address + padding);
+        }
+    }
+}
+
+struct ThreadArenas {
+    unique_ptr<LinearArena[]> slots;
+};
+
+static uint32_t arenaSlotCount = 0;
+static atomic<uint32_t> currentSlot = 0;
+
+static mutex arenasMutex;
+static vector<unique_ptr<ThreadArenas>> threadArenas;
+// The arenas in threadArenas that threads took so far.
+static size_t takenArenaCount = 0;
+
+static thread_local ThreadArenas *ownArenas = nullptr;
+
+static ThreadArenas &addArenas() {
+    ThreadArenas &arenas = *threadArenas.emplace_back(make_unique<ThreadArenas>());
+    arenas.slots = make_unique<LinearArena[]>(arenaSlotCount);
+
+    for (uint32_t slot = 0; slot < arenaSlotCount; slot++) {
+        arenas.slots[slot].reserve(ARENA_BLOCK_SIZE);
+    }
+
+    return arenas;
+}
+
+void FrameArena::create(uint32_t slotCount, uint32_t threadCount) {
+    lock_guard lock(arenasMutex);
+    arenaSlotCount = slotCount;
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        addArenas();
+    }
+}
+
+void FrameArena::beginFrame(uint32_t slot) {
+    lock_guard lock(arenasMutex);
+
+    for (auto &arenas : threadArenas) {
+        arenas->slots[slot].reset();
+    }
+
+    currentSlot.store(slot, memory_order_relaxed);
+}
+
+LinearArena &FrameArena::thread() {
+    if (ownArenas == nullptr) {
+        lock_guard lock(arenasMutex);
+        ownArenas = takenArenaCount < threadArenas.size() ? threadArenas[takenArenaCount].get() : &addArenas();
+        takenArenaCount++;
+    }
+
+    return ownArenas->slots[currentSlot.load(memory_order_relaxed)];
+}
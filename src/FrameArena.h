@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator over blocks that it keeps across resets, for std::pmr containers whose memory all dies at once.
+//
+// Allocating advances an offset into the current block and deallocating does nothing. A request that does not fit moves
+// on to the next block, allocating a new one from the heap only when there is none left. reset() merges the blocks of a
+// grown arena into one, so once an arena has seen its largest use it never reaches the heap again. Not thread safe.
+class LinearArena : public std::pmr::memory_resource {
+  public:
+    LinearArena() = default;
+    ~LinearArena() override;
+
+    LinearArena(const LinearArena &) = delete;
+    LinearArena &operator=(const LinearArena &) = delete;
+
+    // Frees everything allocated since the last reset.
+    void reset();
+    // Gives an arena without blocks a first one of at least bytes.
+    void reserve(size_t bytes);
+
+    size_t capacity() const;
+
+  private:
+    struct Block {
+        char *memory;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t currentBlock = 0;
+    size_t offset = 0;
+    // Bytes asked for since the last reset, which sizes the merged block.
+    size_t usedBytes = 0;
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+};
+
+// Per-thread linear arenas for memory that only lives until the end of a frame, like the scratch containers of culling
+// and recording, with one set per frame in flight.
+//
+// The render thread resets a frame slot's arenas once the GPU retired the slot's previous frame, so memory that commands
+// of the frame point to stays valid until then. Every thread allocates from its own arena, so allocating never takes a
+// lock; only a thread's first allocation registers its arenas under a mutex. Jobs may only use the arena if they finish
+// within the frame that spawned them.
+class FrameArena {
+  public:
+    // Before any thread allocates. The arenas of the first threadCount threads to allocate are created up front, so not even
+    // a thread's first allocation has to reach the heap.
+    static void create(uint32_t slotCount, uint32_t threadCount);
+
+    // Render thread only, once the slot's previous frame retired. Its arenas are used until the next call.
+    static void beginFrame(uint32_t slot);
+
+    // The calling thread's arena of the current frame.
+    static LinearArena &thread();
+};
@@ -0,0 +1,51 @@
+#include "FrameLimiter.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+// Added to the predicted work, for frames slightly slower than the slowest recent one.
+const uint64_t WORK_MARGIN_NANOSECONDS = 500000;
+// Sleeps overshoot by up to the scheduler's granularity, so the end of the wait spins instead.
+const uint64_t SPIN_NANOSECONDS = 1000000;
+
+void FrameLimiter::create(uint32_t framesPerSecond) {
+    frameInterval = framesPerSecond > 0 ? 1000000000 / framesPerSecond : 0;
+    deadline = 0;
+    fill(begin(workHistory), end(workHistory), 0);
+    workCount = 0;
+}
+
+void FrameLimiter::waitForFrameStart() {
+    if (frameInterval == 0) {
+        return;
+    }
+
+    // Slots not written yet are 0.
+    uint64_t work = *max_element(begin(workHistory), end(workHistory)) + WORK_MARGIN_NANOSECONDS;
+    uint64_t now = Profiler::now();
+
+    // A frame that missed its deadline moves the following ones back instead of making them catch up.
+    deadline = max(deadline + frameInterval, now + work);
+
+    uint64_t start = deadline - work;
+    if (start <= now) {
+        return;
+    }
+
+    CpuZone zone("Frame limiter");
+
+    if (start - now > SPIN_NANOSECONDS) {
+        this_thread::sleep_for(chrono::nanoseconds(start - now - SPIN_NANOSECONDS));
+    }
+
+    while (Profiler::now() < start) {
+        this_thread::yield();
+    }
+}
+
+void FrameLimiter::addFrameWork(uint64_t nanoseconds) { workHistory[workCount++ % WORK_HISTORY_SIZE] = nanoseconds; }
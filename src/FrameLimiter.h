@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// Caps the frame rate by delaying the start of each frame rather than idling after it: a frame starts as late as its CPU
+// work, predicted as the longest of the last frames' input-to-submit times, still submits it by its deadline. Input is
+// sampled right after the wait, so it is as fresh as possible when the frame is submitted.
+class FrameLimiter {
+  public:
+    // 0 frames per second disables the limiter.
+    void create(uint32_t framesPerSecond);
+
+    // Render thread, right before sampling input.
+    void waitForFrameStart();
+    // Render thread. The time from sampling input to submitting the frame that started last.
+    void addFrameWork(uint64_t nanoseconds);
+
+  private:
+    static const uint32_t WORK_HISTORY_SIZE = 16;
+
+    uint64_t frameInterval = 0;
+    // Profiler::now() time the current frame is due to be submitted by.
+    uint64_t deadline = 0;
+    uint64_t workHistory[WORK_HISTORY_SIZE] = {};
+    uint32_t workCount = 0;
+};
@@ -0,0 +1,472 @@
+#include "GpuCulling.h"
+
+#include "Camera.h"
+#include "LodSelection.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <stdexcept>
+
+using namespace std;
+
+const uint32_t CULL_GROUP_SIZE = 64;
+const uint32_t REDUCE_GROUP_SIZE = 8;
+
+// Matches the CullConstants block in cull.comp.
+struct CullConstants {
+    uint32_t instanceCount;
+    uint32_t lodCount;
+    float pyramidSize[2];
+    uint32_t isOcclusionEnabled;
+    int32_t vertexOffset;
+    float framebufferHeight;
+    float lodErrorThreshold;
+    float lodHysteresis;
+};
+
+// Matches the ReduceConstants block in depth_reduce.comp.
+struct ReduceConstants {
+    uint32_t sourceSize[2];
+    uint32_t destinationSize[2];
+};
+
+static uint32_t groupCount(uint32_t count, uint32_t groupSize) { return (count + groupSize - 1) / groupSize; }
+
+static void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask,
+                          VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask) {
+    VkMemoryBarrier barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = srcAccessMask, .dstAccessMask = dstAccessMask};
+
+    vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCulling::create(VkDevice device, DeviceMemoryAllocator &allocator, PipelineCache &cache, VkShaderModule cullShader,
+                        VkShaderModule depthReduceShader, VkBuffer instanceBuffer, uint32_t instanceCount, VkBuffer lodBuffer,
+                        uint32_t lodCount, VkBuffer viewBuffer, VkImageView depthView, VkExtent2D depthExtent) {
+    logicalDevice = device;
+    memoryAllocator = &allocator;
+    sceneInstanceCount = instanceCount;
+    sceneLodCount = lodCount;
+    sceneInstanceBuffer = instanceBuffer;
+    sceneLodBuffer = lodBuffer;
+    sceneViewBuffer = viewBuffer;
+    depthBufferExtent = depthExtent;
+
+    drawBuffer = createBuffer(max(instanceCount, 1u) * sizeof(VkDrawIndexedIndirectCommand),
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, drawAllocation);
+    countBuffer = createBuffer(sizeof(uint32_t),
+                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                               countAllocation);
+    instanceLodBuffer = createBuffer(max(instanceCount, 1u) * sizeof(uint32_t),
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, instanceLodAllocation);
+
+    VkSamplerCreateInfo samplerInfo{.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                                    .magFilter = VK_FILTER_NEAREST,
+                                    .minFilter = VK_FILTER_NEAREST,
+                                    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                                    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                    .minLod = 0.0f,
+                                    .maxLod = VK_LOD_CLAMP_NONE};
+
+    if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &depthSampler) != VK_SUCCESS) {
+        throw runtime_error("Failed to create depth sampler!");
+    }
+
+    createDepthPyramid();
+    createDescriptorSetLayouts();
+    createDescriptors(depthView);
+    createPipelines(cache, cullShader, depthReduceShader);
+}
+
+void GpuCulling::resize(VkImageView depthView, VkExtent2D depthExtent, uint64_t retireValue) {
+    retiredPyramids.push_back(
+        {.retireValue = retireValue, .image = depthPyramid, .allocation = depthPyramidAllocation, .views = move(depthPyramidViews),
+         .descriptorPool = descriptorPool});
+
+    depthBufferExtent = depthExtent;
+    depthPyramidViews.clear();
+    reduceSets.clear();
+    isDepthPyramidInitialized = false;
+    hasDepthPyramid = false;
+
+    createDepthPyramid();
+    createDescriptors(depthView);
+}
+
+void GpuCulling::retire(uint64_t completedValue) {
+    while (!retiredPyramids.empty() && retiredPyramids.front().retireValue <= completedValue) {
+        destroyPyramid(retiredPyramids.front());
+        retiredPyramids.pop_front();
+    }
+}
+
+void GpuCulling::destroyPyramid(RetiredPyramid &pyramid) {
+    vkDestroyDescriptorPool(logicalDevice, pyramid.descriptorPool, nullptr);
+
+    for (auto view : pyramid.views) {
+        vkDestroyImageView(logicalDevice, view, nullptr);
+    }
+
+    vkDestroyImage(logicalDevice, pyramid.image, nullptr);
+    memoryAllocator->free(pyramid.allocation);
+}
+
+void GpuCulling::destroy() {
+    for (RetiredPyramid &pyramid : retiredPyramids) {
+        destroyPyramid(pyramid);
+    }
+
+    retiredPyramids.clear();
+
+    RetiredPyramid current{
+        .image = depthPyramid, .allocation = depthPyramidAllocation, .views = depthPyramidViews, .descriptorPool = descriptorPool};
+    destroyPyramid(current);
+
+    vkDestroyPipeline(logicalDevice, reducePipeline, nullptr);
+    vkDestroyPipeline(logicalDevice, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(logicalDevice, reduceLayout, nullptr);
+    vkDestroyPipelineLayout(logicalDevice, cullLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, reduceSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, cullSetLayout, nullptr);
+    vkDestroySampler(logicalDevice, depthSampler, nullptr);
+    vkDestroyBuffer(logicalDevice, instanceLodBuffer, nullptr);
+    memoryAllocator->free(instanceLodAllocation);
+    vkDestroyBuffer(logicalDevice, countBuffer, nullptr);
+    memoryAllocator->free(countAllocation);
+    vkDestroyBuffer(logicalDevice, drawBuffer, nullptr);
+    memoryAllocator->free(drawAllocation);
+
+    depthPyramidViews.clear();
+    reduceSets.clear();
+}
+
+VkBuffer GpuCulling::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, DeviceAllocation &allocation) {
+    VkBufferCreateInfo bufferInfo{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = usage, .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw runtime_error("Failed to create culling buffer!");
+    }
+
+    allocation = memoryAllocator->allocateForBuffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    return buffer;
+}
+
+void GpuCulling::createDepthPyramid() {
+    // Rounding down to a power of two keeps every level exactly half the size of the one below.
+    depthPyramidExtent = {bit_floor(depthBufferExtent.width), bit_floor(depthBufferExtent.height)};
+    depthPyramidLevels = static_cast<uint32_t>(bit_width(max(depthPyramidExtent.width, depthPyramidExtent.height)));
+
+    VkImageCreateInfo imageInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                .imageType = VK_IMAGE_TYPE_2D,
+                                .format = VK_FORMAT_R32_SFLOAT,
+                                .extent = {.width = depthPyramidExtent.width, .height = depthPyramidExtent.height, .depth = 1},
+                                .mipLevels = depthPyramidLevels,
+                                .arrayLayers = 1,
+                                .samples = VK_SAMPLE_COUNT_1_BIT,
+                                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+    if (vkCreateImage(logicalDevice, &imageInfo, nullptr, &depthPyramid) != VK_SUCCESS) {
+        throw runtime_error("Failed to create depth pyramid!");
+    }
+
+    depthPyramidAllocation = memoryAllocator->allocateForImage(depthPyramid, imageInfo.tiling, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    depthPyramidViews.resize(depthPyramidLevels + 1);
+
+    for (uint32_t i = 0; i < depthPyramidViews.size(); i++) {
+        VkImageViewCreateInfo viewInfo{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = depthPyramid,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = VK_FORMAT_R32_SFLOAT,
+            .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                 .baseMipLevel = i == 0 ? 0 : i - 1,
+                                 .levelCount = i == 0 ? depthPyramidLevels : 1,
+                                 .baseArrayLayer = 0,
+                                 .layerCount = 1}};
+
+        if (vkCreateImageView(logicalDevice, &viewInfo, nullptr, &depthPyramidViews[i]) != VK_SUCCESS) {
+            throw runtime_error("Failed to create depth pyramid view!");
+        }
+    }
+}
+
+void GpuCulling::createDescriptorSetLayouts() {
+    // The instances, the draws and the draw count, the depth pyramid, the LODs and the LOD every instance drew with, then the
+    // frame's slot of the view uniforms.
+    VkDescriptorSetLayoutBinding cullBindings[7];
+    for (uint32_t i = 0; i < 6; i++) {
+        cullBindings[i] = {.binding = i,
+                           .descriptorType = i == 3 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                           .descriptorCount = 1,
+                           .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT};
+    }
+    cullBindings[6] = {.binding = 6,
+                       .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                       .descriptorCount = 1,
+                       .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT};
+
+    VkDescriptorSetLayoutBinding reduceBindings[] = {{.binding = 0,
+                                                      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                      .descriptorCount = 1,
+                                                      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT},
+                                                     {.binding = 1,
+                                                      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                                      .descriptorCount = 1,
+                                                      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT}};
+
+    VkDescriptorSetLayoutCreateInfo cullLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 7, .pBindings = cullBindings};
+    VkDescriptorSetLayoutCreateInfo reduceLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 2, .pBindings = reduceBindings};
+
+    if (vkCreateDescriptorSetLayout(logicalDevice, &cullLayoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS ||
+        vkCreateDescriptorSetLayout(logicalDevice, &reduceLayoutInfo, nullptr, &reduceSetLayout) != VK_SUCCESS) {
+        throw runtime_error("Failed to create culling descriptor set layouts!");
+    }
+}
+
+// A pool per depth pyramid, so the sets of a retired pyramid are freed with it.
+void GpuCulling::createDescriptors(VkImageView depthView) {
+    VkDescriptorPoolSize poolSizes[] = {
+        {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 5},
+        {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1 + depthPyramidLevels},
+        {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = depthPyramidLevels},
+        {.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1}};
+
+    VkDescriptorPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                                        .maxSets = 1 + depthPyramidLevels,
+                                        .poolSizeCount = 4,
+                                        .pPoolSizes = poolSizes};
+
+    if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw runtime_error("Failed to create culling descriptor pool!");
+    }
+
+    vector<VkDescriptorSetLayout> setLayouts(1 + depthPyramidLevels, reduceSetLayout);
+    setLayouts[0] = cullSetLayout;
+
+    VkDescriptorSetAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                          .descriptorPool = descriptorPool,
+                                          .descriptorSetCount = static_cast<uint32_t>(setLayouts.size()),
+                                          .pSetLayouts = setLayouts.data()};
+
+    vector<VkDescriptorSet> sets(setLayouts.size());
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, sets.data()) != VK_SUCCESS) {
+        throw runtime_error("Failed to allocate culling descriptor sets!");
+    }
+
+    cullSet = sets[0];
+    reduceSets.assign(begin(sets) + 1, end(sets));
+
+    VkDescriptorBufferInfo bufferInfos[] = {{.buffer = sceneInstanceBuffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                                            {.buffer = drawBuffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                                            {.buffer = countBuffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                                            {.buffer = sceneLodBuffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                                            {.buffer = instanceLodBuffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                                            {.buffer = sceneViewBuffer, .offset = 0, .range = sizeof(ViewUniforms)}};
+
+    // The pyramid stays in GENERAL, since it is written as a storage image and sampled in the same frame.
+    VkDescriptorImageInfo pyramidInfo{.sampler = depthSampler, .imageView = depthPyramidViews[0], .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+
+    vector<VkDescriptorImageInfo> imageInfos(2 * depthPyramidLevels);
+    vector<VkWriteDescriptorSet> writes = {{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                            .dstSet = cullSet,
+                                            .dstBinding = 0,
+                                            .descriptorCount = 3,
+                                            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            .pBufferInfo = bufferInfos},
+                                           {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                            .dstSet = cullSet,
+                                            .dstBinding = 3,
+                                            .descriptorCount = 1,
+                                            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                            .pImageInfo = &pyramidInfo},
+                                           {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                            .dstSet = cullSet,
+                                            .dstBinding = 4,
+                                            .descriptorCount = 2,
+                                            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            .pBufferInfo = bufferInfos + 3},
+                                           {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                            .dstSet = cullSet,
+                                            .dstBinding = 6,
+                                            .descriptorCount = 1,
+                                            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                            .pBufferInfo = bufferInfos + 5}};
+
+    for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+        VkDescriptorImageInfo &source = imageInfos[2 * level];
+        VkDescriptorImageInfo &destination = imageInfos[2 * level + 1];
+
+        if (level == 0) {
+            source = {.sampler = depthSampler, .imageView = depthView, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        } else {
+            source = {.sampler = depthSampler, .imageView = depthPyramidViews[level], .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+        }
+
+        destination = {.sampler = VK_NULL_HANDLE, .imageView = depthPyramidViews[level + 1], .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+
+        writes.push_back({.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                          .dstSet = reduceSets[level],
+                          .dstBinding = 0,
+                          .descriptorCount = 1,
+                          .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                          .pImageInfo = &source});
+        writes.push_back({.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                          .dstSet = reduceSets[level],
+                          .dstBinding = 1,
+                          .descriptorCount = 1,
+                          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                          .pImageInfo = &destination});
+    }
+
+    vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void GpuCulling::createPipelines(PipelineCache &cache, VkShaderModule cullShader, VkShaderModule depthReduceShader) {
+    VkPushConstantRange cullConstants{.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(CullConstants)};
+    VkPushConstantRange reduceConstants{.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(ReduceConstants)};
+
+    VkPipelineLayoutCreateInfo cullLayoutInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                              .setLayoutCount = 1,
+                                              .pSetLayouts = &cullSetLayout,
+                                              .pushConstantRangeCount = 1,
+                                              .pPushConstantRanges = &cullConstants};
+    VkPipelineLayoutCreateInfo reduceLayoutInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                                .setLayoutCount = 1,
+                                                .pSetLayouts = &reduceSetLayout,
+                                                .pushConstantRangeCount = 1,
+                                                .pPushConstantRanges = &reduceConstants};
+
+    if (vkCreatePipelineLayout(logicalDevice, &cullLayoutInfo, nullptr, &cullLayout) != VK_SUCCESS ||
+        vkCreatePipelineLayout(logicalDevice, &reduceLayoutInfo, nullptr, &reduceLayout) != VK_SUCCESS) {
+        throw runtime_error("Failed to create culling pipeline layouts!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfos[] = {{.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                                                    .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                                                              .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                                                              .module = cullShader,
+                                                              .pName = "main"},
+                                                    .layout = cullLayout,
+                                                    .basePipelineHandle = VK_NULL_HANDLE,
+                                                    .basePipelineIndex = -1},
+                                                   {.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                                                    .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                                                              .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                                                              .module = depthReduceShader,
+                                                              .pName = "main"},
+                                                    .layout = reduceLayout,
+                                                    .basePipelineHandle = VK_NULL_HANDLE,
+                                                    .basePipelineIndex = -1}};
+
+    // Compute pipelines are cheap to build, so unlike graphics pipelines they are created right away on the calling thread.
+    auto buildStart = chrono::steady_clock::now();
+
+    VkPipeline pipelines[2];
+    if (vkCreateComputePipelines(logicalDevice, cache.handle(), 2, pipelineInfos, nullptr, pipelines) != VK_SUCCESS) {
+        throw runtime_error("Failed to create culling pipelines!");
+    }
+
+    cache.addBuildTime("Culling", PipelineKind::Compute, chrono::steady_clock::now() - buildStart);
+
+    cullPipeline = pipelines[0];
+    reducePipeline = pipelines[1];
+}
+
+void GpuCulling::recordCulling(VkCommandBuffer commandBuffer, uint32_t viewOffset, int32_t vertexOffset, VkExtent2D renderExtent) {
+    if (!isDepthPyramidInitialized) {
+        VkImageMemoryBarrier barrier{.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                     .srcAccessMask = 0,
+                                     .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                     .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                     .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                     .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                     .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                     .image = depthPyramid,
+                                     .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                                          .baseMipLevel = 0,
+                                                          .levelCount = depthPyramidLevels,
+                                                          .baseArrayLayer = 0,
+                                                          .layerCount = 1}};
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0,
+                             nullptr, 1, &barrier);
+        isDepthPyramidInitialized = true;
+    }
+
+    // The previous frame's indirect draws have to be done reading the buffers, and its depth pyramid has to be visible.
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdFillBuffer(commandBuffer, countBuffer, 0, sizeof(uint32_t), 0);
+
+    // Every instance starts out at full detail.
+    if (!areInstanceLodsInitialized) {
+        vkCmdFillBuffer(commandBuffer, instanceLodBuffer, 0, VK_WHOLE_SIZE, 0);
+        areInstanceLodsInitialized = true;
+    }
+
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    CullConstants constants{.instanceCount = sceneInstanceCount,
+                            .lodCount = sceneLodCount,
+                            .pyramidSize = {float(depthPyramidExtent.width), float(depthPyramidExtent.height)},
+                            .isOcclusionEnabled = hasDepthPyramid ? 1u : 0u,
+                            .vertexOffset = vertexOffset,
+                            .framebufferHeight = float(renderExtent.height),
+                            .lodErrorThreshold = LOD_ERROR_THRESHOLD_PIXELS,
+                            .lodHysteresis = LOD_HYSTERESIS};
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &cullSet, 1, &viewOffset);
+    vkCmdPushConstants(commandBuffer, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, groupCount(sceneInstanceCount, CULL_GROUP_SIZE), 1, 1);
+
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                  VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+void GpuCulling::recordDraws(VkCommandBuffer commandBuffer) {
+    vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, 0, countBuffer, 0, sceneInstanceCount, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void GpuCulling::recordDepthPyramid(VkCommandBuffer commandBuffer, VkExtent2D renderExtent) {
+    // This frame's cull has to be done reading the pyramid before it is overwritten. The render graph already made the depth
+    // buffer visible to compute shaders.
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reducePipeline);
+
+    VkExtent2D sourceSize = renderExtent;
+
+    for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+        VkExtent2D levelSize = {max(depthPyramidExtent.width >> level, 1u), max(depthPyramidExtent.height >> level, 1u)};
+        ReduceConstants constants{.sourceSize = {sourceSize.width, sourceSize.height},
+                                  .destinationSize = {levelSize.width, levelSize.height}};
+
+        if (level > 0) {
+            memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        }
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reduceLayout, 0, 1, &reduceSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, reduceLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, groupCount(levelSize.width, REDUCE_GROUP_SIZE), groupCount(levelSize.height, REDUCE_GROUP_SIZE), 1);
+
+        sourceSize = levelSize;
+    }
+
+    hasDepthPyramid = true;
+}
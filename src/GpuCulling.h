@@ -0,0 +1,105 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "DeviceMemoryAllocator.h"
+#include "PipelineCache.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// GPU-driven draw submission: a compute pass culls the scene's instances and writes one indirect draw per survivor.
+//
+// Every instance is tested against the view frustum and, from the second frame on, against a depth pyramid built from the
+// previous frame's depth buffer (hierarchical-Z occlusion). Survivors are compacted into an indirect buffer and drawn with a
+// single vkCmdDrawIndexedIndirectCount. Every survivor also picks its LOD by screen-space error (see LodSelection.h),
+// remembering it for the next frame's hysteresis. The cull, the draws and the pyramid rebuild all run on the graphics queue
+// and are ordered with pipeline barriers, so frames in flight share one set of buffers.
+class GpuCulling {
+  public:
+    // instanceBuffer holds instanceCount instances laid out like the Instance struct in cull.comp, lodBuffer the lodCount
+    // MeshLods of the submesh they draw, and viewBuffer ViewUniforms at the offsets passed to recordCulling(). depthView is
+    // the scene's depth buffer, which has to be sampleable and in SHADER_READ_ONLY_OPTIMAL for recordDepthPyramid().
+    void create(VkDevice device, DeviceMemoryAllocator &allocator, PipelineCache &cache, VkShaderModule cullShader,
+                VkShaderModule depthReduceShader, VkBuffer instanceBuffer, uint32_t instanceCount, VkBuffer lodBuffer, uint32_t lodCount,
+                VkBuffer viewBuffer, VkImageView depthView, VkExtent2D depthExtent);
+    // The device has to be idle.
+    void destroy();
+
+    // Switches to a depth buffer of another size without waiting for the frames in flight. The depth pyramid is rebuilt at the
+    // new size, so the next frame culls without occlusion; the old pyramid is destroyed once retire() passes a frame value of
+    // at least retireValue, the value of the last frame that may use it.
+    void resize(VkImageView depthView, VkExtent2D depthExtent, uint64_t retireValue);
+    // Called with the frame timeline's value once the frames up to it completed.
+    void retire(uint64_t completedValue);
+
+    // Outside of a render pass, before the draws. Culls with the view uniforms at viewOffset in the view buffer, so with the
+    // camera of the frame's draws, and picks LODs for the height of renderExtent, the part of the depth buffer drawn into.
+    void recordCulling(VkCommandBuffer commandBuffer, uint32_t viewOffset, int32_t vertexOffset, VkExtent2D renderExtent);
+    // Inside the render pass, with the scene pipeline, its descriptor set and the mesh's vertex and index buffers bound.
+    void recordDraws(VkCommandBuffer commandBuffer);
+    // After the render pass, so the next frame culls against this frame's depth. Reduces the top left renderExtent of the depth
+    // buffer, which the pyramid covers whatever the resolution of the frame.
+    void recordDepthPyramid(VkCommandBuffer commandBuffer, VkExtent2D renderExtent);
+
+  private:
+    // The resources sized by the depth buffer. The descriptor pool holds every set, which all reference the pyramid.
+    struct RetiredPyramid {
+        uint64_t retireValue;
+        VkImage image;
+        DeviceAllocation allocation;
+        std::vector<VkImageView> views;
+        VkDescriptorPool descriptorPool;
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    DeviceMemoryAllocator *memoryAllocator = nullptr;
+    uint32_t sceneInstanceCount = 0;
+    uint32_t sceneLodCount = 0;
+    VkBuffer sceneInstanceBuffer = VK_NULL_HANDLE;
+    VkBuffer sceneLodBuffer = VK_NULL_HANDLE;
+    VkBuffer sceneViewBuffer = VK_NULL_HANDLE;
+    VkExtent2D depthBufferExtent;
+
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    DeviceAllocation drawAllocation;
+    VkBuffer countBuffer = VK_NULL_HANDLE;
+    DeviceAllocation countAllocation;
+    VkBuffer instanceLodBuffer = VK_NULL_HANDLE;
+    DeviceAllocation instanceLodAllocation;
+    bool areInstanceLodsInitialized = false;
+
+    VkImage depthPyramid = VK_NULL_HANDLE;
+    DeviceAllocation depthPyramidAllocation;
+    VkExtent2D depthPyramidExtent;
+    uint32_t depthPyramidLevels = 0;
+    // The whole pyramid for culling, then one view per level for the reduction writing it.
+    std::vector<VkImageView> depthPyramidViews;
+    VkSampler depthSampler = VK_NULL_HANDLE;
+    // The pyramid is only worth testing against once a frame has built it.
+    bool isDepthPyramidInitialized = false;
+    bool hasDepthPyramid = false;
+
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout reduceSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet cullSet = VK_NULL_HANDLE;
+    // One per pyramid level, reading the depth buffer or the level below.
+    std::vector<VkDescriptorSet> reduceSets;
+
+    VkPipelineLayout cullLayout = VK_NULL_HANDLE;
+    VkPipelineLayout reduceLayout = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    VkPipeline reducePipeline = VK_NULL_HANDLE;
+
+    // In the order they were retired, so the retire values only grow.
+    std::deque<RetiredPyramid> retiredPyramids;
+
+    VkBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, DeviceAllocation &allocation);
+    void createDepthPyramid();
+    void createDescriptorSetLayouts();
+    void createDescriptors(VkImageView depthView);
+    void destroyPyramid(RetiredPyramid &pyramid);
+    void createPipelines(PipelineCache &cache, VkShaderModule cullShader, VkShaderModule depthReduceShader);
+};
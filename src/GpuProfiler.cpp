@@ -0,0 +1,298 @@
+#include "GpuProfiler.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+const uint32_t MAX_ZONES_PER_FRAME = 32;
+// The frame's begin and end, then a begin and end per zone.
+const uint32_t QUERIES_PER_FRAME = 2 + 2 * MAX_ZONES_PER_FRAME;
+const uint32_t NO_ZONE = UINT32_MAX;
+const uint64_t CALIBRATION_INTERVAL_NANOSECONDS = 1000000000;
+
+bool GpuProfiler::canCalibrate(VkInstance instance, VkPhysicalDevice device) {
+    auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+        vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+
+    if (getTimeDomains == nullptr) {
+        return false;
+    }
+
+    uint32_t timeDomainCount = 0;
+    getTimeDomains(device, &timeDomainCount, nullptr);
+
+    vector<VkTimeDomainEXT> timeDomains(timeDomainCount);
+    getTimeDomains(device, &timeDomainCount, timeDomains.data());
+
+    // Profiler::now() reads the steady clock, which is CLOCK_MONOTONIC on Linux. Elsewhere the fenced calibration is used.
+    auto hasTimeDomain = [&](VkTimeDomainEXT timeDomain) {
+        return find(timeDomains.begin(), timeDomains.end(), timeDomain) != timeDomains.end();
+    };
+    return hasTimeDomain(VK_TIME_DOMAIN_DEVICE_EXT) && hasTimeDomain(VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT);
+}
+
+void GpuProfiler::create(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t timestampValidBits, float timestampPeriod,
+                         uint32_t framesInFlight, bool hasCalibratedTimestamps) {
+    logicalDevice = device;
+    calibrationQueue = queue;
+    calibrationQueueFamily = queueFamily;
+
+    if (timestampValidBits == 0) {
+        return;
+    }
+
+    timestampMask = timestampValidBits >= 64 ? UINT64_MAX : (uint64_t(1) << timestampValidBits) - 1;
+    nanosecondsPerTick = timestampPeriod;
+    frames.resize(framesInFlight);
+
+    VkQueryPoolCreateInfo queryPoolInfo{.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                        .queryCount = framesInFlight * QUERIES_PER_FRAME};
+
+    if (vkCreateQueryPool(logicalDevice, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw runtime_error("Failed to create timestamp query pool!");
+    }
+
+    if (hasCalibratedTimestamps) {
+        getCalibratedTimestamps =
+            reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(vkGetDeviceProcAddr(logicalDevice, "vkGetCalibratedTimestampsEXT"));
+    }
+
+    calibrate();
+}
+
+void GpuProfiler::destroy() {
+    if (queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(logicalDevice, queryPool, nullptr);
+        queryPool = VK_NULL_HANDLE;
+    }
+
+    frames.clear();
+    calibrationPoints.clear();
+    pendingZones.clear();
+}
+
+uint32_t GpuProfiler::firstQuery(uint32_t frame) const { return frame * QUERIES_PER_FRAME; }
+
+// Timestamps are read a few frames apart at most, far less than half the wrap period, so a timestamp that looks more than half
+// the period ahead of the last one is behind it.
+int64_t GpuProfiler::extendTicks(uint64_t ticks) {
+    uint64_t delta = (ticks - lastTicks) & timestampMask;
+    lastTicks = ticks & timestampMask;
+
+    if (delta > timestampMask / 2) {
+        lastExtendedTicks -= static_cast<int64_t>(timestampMask - delta) + 1;
+    } else {
+        lastExtendedTicks += static_cast<int64_t>(delta);
+    }
+
+    return lastExtendedTicks;
+}
+
+// Interpolates between the calibration points around the timestamp, and extrapolates from the closest two outside of them.
+uint64_t GpuProfiler::toCpuTime(int64_t ticks) const {
+    if (calibrationPoints.size() == 1) {
+        const CalibrationPoint &point = calibrationPoints.front();
+        return point.nanoseconds + static_cast<int64_t>(static_cast<double>(ticks - point.ticks) * nanosecondsPerTick);
+    }
+
+    auto next = upper_bound(calibrationPoints.begin() + 1, calibrationPoints.end() - 1, ticks,
+                            [](int64_t value, const CalibrationPoint &point) { return value < point.ticks; });
+    const CalibrationPoint &from = *(next - 1);
+    const CalibrationPoint &to = *next;
+
+    double slope = nanosecondsPerTick;
+    if (to.ticks > from.ticks) {
+        slope = static_cast<double>(to.nanoseconds - from.nanoseconds) / static_cast<double>(to.ticks - from.ticks);
+    }
+
+    return from.nanoseconds + static_cast<int64_t>(static_cast<double>(ticks - from.ticks) * slope);
+}
+
+void GpuProfiler::calibrate() {
+    uint64_t ticks = 0;
+    uint64_t nanoseconds = 0;
+
+    if (getCalibratedTimestamps != nullptr) {
+        VkCalibratedTimestampInfoEXT timestampInfos[2] = {
+            {.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, .pNext = nullptr, .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT},
+            {.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, .pNext = nullptr, .timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT}};
+        uint64_t timestamps[2];
+        uint64_t maxDeviation;
+
+        if (getCalibratedTimestamps(logicalDevice, 2, timestampInfos, timestamps, &maxDeviation) != VK_SUCCESS) {
+            throw runtime_error("Failed to get calibrated timestamps!");
+        }
+
+        ticks = timestamps[0];
+        nanoseconds = timestamps[1];
+    } else {
+        calibrateWithFence(ticks, nanoseconds);
+    }
+
+    if (calibrationPoints.empty()) {
+        lastTicks = ticks & timestampMask;
+    }
+
+    calibrationPoints.push_back({.ticks = extendTicks(ticks), .nanoseconds = nanoseconds});
+}
+
+// Takes one timestamp on the idle queue and pairs it with the middle of the CPU time spent waiting for it, which is accurate to
+// about the submission latency. Without VK_EXT_calibrated_timestamps this is as close as the two clocks get.
+void GpuProfiler::calibrateWithFence(uint64_t &ticks, uint64_t &nanoseconds) {
+    VkCommandPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                     .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                                     .queueFamilyIndex = calibrationQueueFamily};
+
+    VkCommandPool commandPool;
+    if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw runtime_error("Failed to create calibration command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                                          .commandPool = commandPool,
+                                          .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                          .commandBufferCount = 1};
+
+    VkCommandBuffer commandBuffer;
+    VkFenceCreateInfo fenceInfo{.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VkFence fence;
+
+    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS ||
+        vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+        throw runtime_error("Failed to create calibration command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                       .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, 1);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .commandBufferCount = 1, .pCommandBuffers = &commandBuffer};
+
+    uint64_t submitTime = Profiler::now();
+
+    if (vkQueueSubmit(calibrationQueue, 1, &submitInfo, fence) != VK_SUCCESS) {
+        throw runtime_error("Failed to submit calibration command buffer!");
+    }
+
+    vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+    uint64_t completeTime = Profiler::now();
+
+    vkGetQueryPoolResults(logicalDevice, queryPool, 0, 1, sizeof(ticks), &ticks, sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    nanoseconds = submitTime + (completeTime - submitTime) / 2;
+
+    vkDestroyFence(logicalDevice, fence, nullptr);
+    vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frame, uint64_t frameNumber) {
+    if (!isSupported()) {
+        return;
+    }
+
+    recordingFrame = frame;
+
+    FrameQueries &queries = frames[frame];
+    queries.frameNumber = frameNumber;
+    queries.isPending = true;
+    queries.zoneNames.clear();
+
+    vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery(frame), QUERIES_PER_FRAME);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery(frame));
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+    if (!isSupported()) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery(recordingFrame) + 1);
+}
+
+uint32_t GpuProfiler::beginZone(VkCommandBuffer commandBuffer, const char *name) {
+    if (!isSupported()) {
+        return NO_ZONE;
+    }
+
+    vector<const char *> &zoneNames = frames[recordingFrame].zoneNames;
+    if (zoneNames.size() == MAX_ZONES_PER_FRAME) {
+        return NO_ZONE;
+    }
+
+    uint32_t zone = static_cast<uint32_t>(zoneNames.size());
+    zoneNames.push_back(name);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery(recordingFrame) + 2 + 2 * zone);
+
+    return zone;
+}
+
+void GpuProfiler::endZone(VkCommandBuffer commandBuffer, uint32_t zone) {
+    if (zone == NO_ZONE) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery(recordingFrame) + 3 + 2 * zone);
+}
+
+optional<double> GpuProfiler::collectFrame(uint32_t frame) {
+    if (!isSupported() || !frames[frame].isPending) {
+        return nullopt;
+    }
+
+    FrameQueries &queries = frames[frame];
+    queries.isPending = false;
+
+    uint32_t queryCount = 2 + 2 * static_cast<uint32_t>(queries.zoneNames.size());
+    uint64_t timestamps[QUERIES_PER_FRAME];
+
+    if (vkGetQueryPoolResults(logicalDevice, queryPool, firstQuery(frame), queryCount, queryCount * sizeof(uint64_t), timestamps,
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return nullopt;
+    }
+
+    if (Profiler::isEnabled()) {
+        for (uint32_t i = 0; i < queryCount; i += 2) {
+            const char *name = i == 0 ? "GPU frame" : queries.zoneNames[i / 2 - 1];
+            pendingZones.push_back({.name = name,
+                                    .startTicks = extendTicks(timestamps[i]),
+                                    .endTicks = extendTicks(timestamps[i + 1]),
+                                    .frameNumber = queries.frameNumber});
+        }
+
+        bool isCalibrationDue = Profiler::now() - calibrationPoints.back().nanoseconds >= CALIBRATION_INTERVAL_NANOSECONDS;
+
+        if (getCalibratedTimestamps != nullptr && isCalibrationDue) {
+            calibrate();
+            forwardPendingZones();
+        }
+    }
+
+    uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+    return ticks * nanosecondsPerTick / 1e6;
+}
+
+void GpuProfiler::exportZones() {
+    if (!isSupported() || !Profiler::isEnabled()) {
+        return;
+    }
+
+    calibrate();
+    forwardPendingZones();
+}
+
+void GpuProfiler::forwardPendingZones() {
+    for (const PendingZone &zone : pendingZones) {
+        Profiler::addGpuZone(zone.name, toCpuTime(zone.startTicks), toCpuTime(zone.endTicks), zone.frameNumber);
+    }
+
+    pendingZones.clear();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// GPU zones measured with timestamp queries written into the frame's graphics command buffer.
+//
+// Every frame in flight owns a slice of one query pool, which is read back once the frame's submission completed, so reading
+// the results never stalls. Zones are written with BOTTOM_OF_PIPE, so a zone covers the work recorded between its begin and end
+// and zones never overlap. Only the render thread may use it.
+//
+// Timestamps are converted to the CPU's steady clock by interpolating between calibration points, each a GPU timestamp and the
+// CPU time it was taken at, so the GPU zones follow the drift between the two clocks. With VK_EXT_calibrated_timestamps both
+// clocks are sampled together once a second while profiling, which is a driver call and never waits for the GPU. Without it the
+// queue is calibrated with a fenced timestamp at startup and again on export, and the zones are held back until then.
+class GpuProfiler {
+  public:
+    // Whether VK_EXT_calibrated_timestamps can sample the device's timestamps together with Profiler::now(). The device has to
+    // have the extension.
+    static bool canCalibrate(VkInstance instance, VkPhysicalDevice device);
+
+    // Does nothing when the queue family does not support timestamps (timestampValidBits is 0). The extension has to be enabled
+    // on the device when hasCalibratedTimestamps is true.
+    void create(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t timestampValidBits, float timestampPeriod,
+                uint32_t framesInFlight, bool hasCalibratedTimestamps);
+    void destroy();
+
+    bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+
+    // First and last commands of the frame's command buffer. The frame's previous results have to be collected already.
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame, uint64_t frameNumber);
+    void endFrame(VkCommandBuffer commandBuffer);
+
+    // Outside of secondary command buffers. Zones past the per-frame limit are dropped.
+    uint32_t beginZone(VkCommandBuffer commandBuffer, const char *name);
+    void endZone(VkCommandBuffer commandBuffer, uint32_t zone);
+
+    // Forwards the zones of the frame's last submission to the Profiler and returns its GPU time. Call once it completed.
+    std::optional<double> collectFrame(uint32_t frame);
+
+    // Recalibrates and forwards the zones held back to the Profiler. Call once the queue is idle and every frame was collected,
+    // before Profiler::writeChromeTrace.
+    void exportZones();
+
+  private:
+    struct FrameQueries {
+        uint64_t frameNumber = 0;
+        bool isPending = false;
+        std::vector<const char *> zoneNames;
+    };
+
+    // Ticks are extended past timestampValidBits, counting from the first calibration.
+    struct CalibrationPoint {
+        int64_t ticks;
+        uint64_t nanoseconds;
+    };
+
+    struct PendingZone {
+        const char *name;
+        int64_t startTicks;
+        int64_t endTicks;
+        uint64_t frameNumber;
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    uint64_t timestampMask = 0;
+    double nanosecondsPerTick = 1.0;
+    VkQueue calibrationQueue = VK_NULL_HANDLE;
+    uint32_t calibrationQueueFamily = 0;
+    PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps = nullptr;
+
+    // The last timestamp read and its extended value.
+    uint64_t lastTicks = 0;
+    int64_t lastExtendedTicks = 0;
+    std::vector<CalibrationPoint> calibrationPoints;
+    // Collected since the last calibration point, so they are converted once the next one brackets them.
+    std::vector<PendingZone> pendingZones;
+
+    std::vector<FrameQueries> frames;
+    uint32_t recordingFrame = 0;
+
+    uint32_t firstQuery(uint32_t frame) const;
+    int64_t extendTicks(uint64_t ticks);
+    uint64_t toCpuTime(int64_t ticks) const;
+    void calibrate();
+    void calibrateWithFence(uint64_t &ticks, uint64_t &nanoseconds);
+    void forwardPendingZones();
+};
+
+// Measures the commands recorded while it is alive as a GPU zone.
+class GpuZone {
+  public:
+    GpuZone(GpuProfiler &gpuProfiler, VkCommandBuffer zoneCommandBuffer, const char *name)
+        : profiler(gpuProfiler), commandBuffer(zoneCommandBuffer), zone(gpuProfiler.beginZone(zoneCommandBuffer, name)) {}
+
+    ~GpuZone() { profiler.endZone(commandBuffer, zone); }
+
+    GpuZone(const GpuZone &) = delete;
+    GpuZone &operator=(const GpuZone &) = delete;
+
+  private:
+    GpuProfiler &profiler;
+    VkCommandBuffer commandBuffer;
+    uint32_t zone;
+};
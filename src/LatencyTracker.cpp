@@ -0,0 +1,93 @@
+#include "LatencyTracker.h"
+
+#include "Profiler.h"
+
+using namespace std;
+
+void LatencyTracker::create(VkDevice device, VkSwapchainKHR swapchain, PresentTiming timing) {
+    logicalDevice = device;
+    swapChain = swapchain;
+    presentTiming = timing;
+
+    if (presentTiming == PresentTiming::DisplayTiming) {
+        getPastPresentationTiming =
+            reinterpret_cast<PFN_vkGetPastPresentationTimingGOOGLE>(vkGetDeviceProcAddr(device, "vkGetPastPresentationTimingGOOGLE"));
+    } else if (presentTiming == PresentTiming::PresentWait) {
+        waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+    }
+}
+
+void LatencyTracker::setSwapchain(VkSwapchainKHR swapchain) {
+    swapChain = swapchain;
+    pendingPresents.clear();
+}
+
+void LatencyTracker::inputSampled(uint64_t time) { inputTime = time; }
+
+uint64_t LatencyTracker::frameSubmitted(uint64_t time) {
+    if (Profiler::isEnabled()) {
+        Profiler::addCpuZone("Input to submit", inputTime, time);
+    }
+
+    return time - inputTime;
+}
+
+void LatencyTracker::preparePresent(VkPresentInfoKHR &presentInfo) {
+    if (presentTiming == PresentTiming::None) {
+        return;
+    }
+
+    presentId = nextPresentId++;
+    pendingPresents.push_back({.id = presentId, .inputTime = inputTime});
+
+    if (pendingPresents.size() > MAX_PENDING_PRESENTS) {
+        pendingPresents.pop_front();
+    }
+
+    if (presentTiming == PresentTiming::DisplayTiming) {
+        presentTime = {.presentID = static_cast<uint32_t>(presentId), .desiredPresentTime = 0};
+        presentTimesInfo = {.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+                            .pNext = presentInfo.pNext,
+                            .swapchainCount = 1,
+                            .pTimes = &presentTime};
+        presentInfo.pNext = &presentTimesInfo;
+    } else {
+        presentIdInfo = {.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+                         .pNext = presentInfo.pNext,
+                         .swapchainCount = 1,
+                         .pPresentIds = &presentId};
+        presentInfo.pNext = &presentIdInfo;
+    }
+}
+
+const vector<double> &LatencyTracker::collectPresented() {
+    presented.clear();
+
+    if (presentTiming == PresentTiming::DisplayTiming) {
+        uint32_t timingCount = 0;
+        getPastPresentationTiming(logicalDevice, swapChain, &timingCount, nullptr);
+
+        pastTimings.resize(timingCount);
+        getPastPresentationTiming(logicalDevice, swapChain, &timingCount, pastTimings.data());
+
+        for (uint32_t i = 0; i < timingCount; i++) {
+            // Presents before the reported one were never displayed.
+            while (!pendingPresents.empty() && pendingPresents.front().id < pastTimings[i].presentID) {
+                pendingPresents.pop_front();
+            }
+
+            if (!pendingPresents.empty() && pendingPresents.front().id == pastTimings[i].presentID) {
+                presented.push_back((static_cast<double>(pastTimings[i].actualPresentTime) - pendingPresents.front().inputTime) / 1e6);
+                pendingPresents.pop_front();
+            }
+        }
+    } else if (presentTiming == PresentTiming::PresentWait) {
+        // Ids complete in order, so the first that is not done yet ends the poll.
+        while (!pendingPresents.empty() && waitForPresent(logicalDevice, swapChain, pendingPresents.front().id, 0) == VK_SUCCESS) {
+            presented.push_back(static_cast<double>(Profiler::now() - pendingPresents.front().inputTime) / 1e6);
+            pendingPresents.pop_front();
+        }
+    }
+
+    return presented;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "PoolAllocator.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <vector>
+
+// How the swapchain reports that a present reached the display.
+enum class PresentTiming { None, DisplayTiming, PresentWait };
+
+// Measures every frame's latency from sampling input to submitting the frame and, where the swapchain can tell, to the frame
+// reaching the display.
+//
+// VK_GOOGLE_display_timing reports the time each image was actually displayed, on the monotonic clock Profiler::now() uses
+// on Linux. VK_KHR_present_wait only tells whether a present id completed; the swapchain belongs to the render thread, so it
+// is polled once per frame without blocking and those latencies are late by up to a frame, an upper bound. Only the render
+// thread may use it. Times are Profiler::now() nanoseconds.
+class LatencyTracker {
+  public:
+    // The swapchain may be VK_NULL_HANDLE with PresentTiming::None.
+    void create(VkDevice device, VkSwapchainKHR swapchain, PresentTiming timing);
+    // Switches to a recreated swapchain. The presents still pending on the old one are never reported.
+    void setSwapchain(VkSwapchainKHR swapchain);
+
+    void inputSampled(uint64_t time);
+    // Returns the input-to-submit time of the frame in nanoseconds and adds it to the trace.
+    uint64_t frameSubmitted(uint64_t time);
+
+    // Chains the frame's present id into presentInfo, which has to be presented before the next call.
+    void preparePresent(VkPresentInfoKHR &presentInfo);
+    // The input-to-present times in milliseconds of the presents that completed since the last call.
+    const std::vector<double> &collectPresented();
+
+  private:
+    // More pending presents than this are never reported, like those a MAILBOX swapchain replaced.
+    static const size_t MAX_PENDING_PRESENTS = 64;
+
+    struct PendingPresent {
+        uint64_t id;
+        uint64_t inputTime;
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    PresentTiming presentTiming = PresentTiming::None;
+    PFN_vkGetPastPresentationTimingGOOGLE getPastPresentationTiming = nullptr;
+    PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+
+    uint64_t inputTime = 0;
+    uint64_t nextPresentId = 1;
+    PoolResource pendingPresentNodes{DEQUE_NODE_SIZE, 4};
+    std::pmr::deque<PendingPresent> pendingPresents{&pendingPresentNodes};
+
+    // Chained by preparePresent().
+    uint64_t presentId = 0;
+    VkPresentTimeGOOGLE presentTime;
+    VkPresentTimesInfoGOOGLE presentTimesInfo;
+    VkPresentIdKHR presentIdInfo;
+
+    std::vector<VkPastPresentationTimingGOOGLE> pastTimings;
+    std::vector<double> presented;
+};
@@ -0,0 +1,35 @@
+#include "LodSelection.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+float projectedPixelsPerUnit(const float (&viewProjection)[16], const float (&point)[3], float framebufferHeight) {
+    float w = viewProjection[3] * point[0] + viewProjection[7] * point[1] + viewProjection[11] * point[2] + viewProjection[15];
+
+    // At or behind the camera plane every error is visible.
+    if (w <= 0.0f) {
+        return INFINITY;
+    }
+
+    // Length of the clip space y axis, so the result does not depend on the orientation of the camera.
+    const float(&m)[16] = viewProjection;
+    float scaleY = sqrt(m[1] * m[1] + m[5] * m[5] + m[9] * m[9]);
+
+    return scaleY / w * framebufferHeight / 2.0f;
+}
+
+uint32_t selectLod(const MeshLod *lods, uint32_t lodCount, uint32_t currentLod, float pixelsPerUnit) {
+    uint32_t lod = min(currentLod, lodCount - 1);
+
+    while (lod > 0 && lods[lod].error * pixelsPerUnit > LOD_ERROR_THRESHOLD_PIXELS) {
+        lod--;
+    }
+
+    while (lod + 1 < lodCount && lods[lod + 1].error * pixelsPerUnit <= LOD_ERROR_THRESHOLD_PIXELS * LOD_HYSTERESIS) {
+        lod++;
+    }
+
+    return lod;
+}
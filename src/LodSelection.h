@@ -0,0 +1,20 @@
+#pragma once
+
+#include "MeshFormat.h"
+
+#include <cstdint>
+
+// Screen-space error LOD selection. The CPU recording path uses these functions, cull.comp implements the same rules for
+// GPU culling with these constants passed in.
+//
+// An object uses its coarsest LOD whose error, projected to the screen, stays below LOD_ERROR_THRESHOLD_PIXELS. Objects
+// only move to a coarser LOD once its error is a margin below the threshold, so objects near a switching distance do not
+// flip between two LODs every frame.
+const float LOD_ERROR_THRESHOLD_PIXELS = 1.0f;
+const float LOD_HYSTERESIS = 0.75f;
+
+// Pixels per unit of world space at the point, for a framebuffer of the given height. viewProjection is column-major.
+float projectedPixelsPerUnit(const float (&viewProjection)[16], const float (&point)[3], float framebufferHeight);
+
+// lods are a submesh's LODs, finest first. pixelsPerUnit converts the mesh's units to pixels.
+uint32_t selectLod(const MeshLod *lods, uint32_t lodCount, uint32_t currentLod, float pixelsPerUnit);
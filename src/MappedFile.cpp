@@ -0,0 +1,73 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+void MappedFile::open(const string &path) {
+    filePath = path;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Failed to open file: " + path);
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+    // The mapping keeps the file open on its own.
+    fileMapping = mappedSize > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
+
+    mappedData = fileMapping != nullptr ? static_cast<const char *>(MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw runtime_error("Failed to open file: " + path);
+    }
+
+    struct stat fileStat;
+    mappedSize = fstat(file, &fileStat) == 0 ? static_cast<size_t>(fileStat.st_size) : 0;
+
+    // The mapping keeps the file open on its own.
+    void *mapping = mappedSize > 0 ? mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    ::close(file);
+
+    mappedData = mapping != MAP_FAILED ? static_cast<const char *>(mapping) : nullptr;
+#endif
+
+    if (mappedData == nullptr) {
+        close();
+        throw runtime_error("Failed to map file: " + path);
+    }
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (mappedData != nullptr) {
+        UnmapViewOfFile(mappedData);
+    }
+    if (fileMapping != nullptr) {
+        CloseHandle(fileMapping);
+        fileMapping = nullptr;
+    }
+#else
+    if (mappedData != nullptr) {
+        munmap(const_cast<char *>(mappedData), mappedSize);
+    }
+#endif
+
+    mappedData = nullptr;
+    mappedSize = 0;
+}
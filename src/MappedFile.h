@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping starts page aligned, so anything the file aligns relative to its
+// start is aligned in memory as well.
+class MappedFile {
+  public:
+    // Throws when the file cannot be opened or mapped; empty files cannot be mapped.
+    void open(const std::string &path);
+    void close();
+
+    bool isOpen() const { return mappedData != nullptr; }
+    const char *data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+    const std::string &path() const { return filePath; }
+
+  private:
+    std::string filePath;
+    const char *mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    void *fileMapping = nullptr;
+#endif
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include <cstdint>
+
+// Layout of the binary meshes written by tools/mesh_converter.cpp at build time and mapped by MeshLoader at runtime.
+//
+// A fixed-size header, the submesh and LOD tables, then the vertex streams and the index data in the layout the GPU reads them in.
+// Streams and index data start at multiples of MESH_ALIGNMENT and form one contiguous payload, which is copied to a single
+// buffer without any parsing; the header describes that buffer's vertex bindings and attributes. Vertex formats and index
+// types are stored as their Vulkan enum values. All fields are little-endian.
+//
+// The converter quantizes the attributes, which the vertex input state and shaders/mesh.glsl decode: positions are snorm16
+// scaled by positionScale around positionOffset, normals are octahedral encoded snorm16 pairs and texture coordinates are
+// half floats.
+const uint32_t MESH_MAGIC = 0x484d5456; // "VTMH"
+const uint32_t MESH_VERSION = 3;
+const uint64_t MESH_ALIGNMENT = 16;
+const uint32_t MESH_MAX_STREAMS = 4;
+const uint32_t MESH_MAX_ATTRIBUTES = 8;
+const uint32_t MESH_MAX_LODS = 8;
+
+// Attribute locations shared by the converter and the shaders.
+const uint32_t MESH_POSITION_LOCATION = 0;
+const uint32_t MESH_NORMAL_LOCATION = 1;
+const uint32_t MESH_TEXCOORD_LOCATION = 2;
+const uint32_t MESH_COLOR_LOCATION = 3;
+
+// One vertex binding.
+struct MeshStream {
+    uint32_t stride;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MeshAttribute {
+    uint32_t location;
+    uint32_t stream;
+    uint32_t format;
+    uint32_t offset;
+};
+
+// A range of the index data drawing a submesh at one level of detail. All LODs use the same vertices, so switching LODs
+// only changes the draw's index range. error bounds the simplified surface's distance from the full detail one, in the
+// mesh's units; it is 0 for the full detail LOD.
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+// Drawn with vkCmdDrawIndexed(lod.indexCount, lod.firstIndex, vertexOffset) for one of its LODs, the full detail one
+// first and errors increasing from there. The bounding sphere is in the mesh's space.
+struct MeshSubmesh {
+    uint32_t firstLod;
+    uint32_t lodCount;
+    int32_t vertexOffset;
+    uint32_t reserved;
+    float boundsCenter[3];
+    float boundsRadius;
+};
+
+struct MeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexType;
+    uint32_t streamCount;
+    uint32_t attributeCount;
+    uint32_t submeshCount;
+    uint32_t lodCount;
+    uint32_t reserved;
+    // Decoded position = stored position * positionScale + positionOffset.
+    float positionScale;
+    float positionOffset[3];
+    uint64_t submeshOffset;
+    uint64_t lodOffset;
+    uint64_t indexOffset;
+    uint64_t indexSize;
+    MeshStream streams[MESH_MAX_STREAMS];
+    MeshAttribute attributes[MESH_MAX_ATTRIBUTES];
+};
+
+// Size of one attribute of a format meshes may use, 0 for every other format.
+inline uint32_t meshAttributeSize(uint32_t format) {
+    switch (format) {
+    case VK_FORMAT_R32G32B32_SFLOAT:
+        return 12;
+    case VK_FORMAT_R32G32_SFLOAT:
+    case VK_FORMAT_R16G16B16A16_SNORM:
+        return 8;
+    case VK_FORMAT_R16G16_SNORM:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        return 4;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,266 @@
+#include "MeshLoader.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+void Mesh::bind(VkCommandBuffer commandBuffer) const {
+    VkBuffer buffers[MESH_MAX_STREAMS];
+    fill(begin(buffers), end(buffers), buffer);
+
+    vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<uint32_t>(streamOffsets.size()), buffers, streamOffsets.data());
+    vkCmdBindIndexBuffer(commandBuffer, buffer, indexOffset, indexType);
+}
+
+void MeshLoader::create(VkDevice device, DeviceMemoryAllocator &allocator, UploadQueue &uploadQueue, ThreadPool &threadPool) {
+    logicalDevice = device;
+    memoryAllocator = &allocator;
+    uploads = &uploadQueue;
+    workers = &threadPool;
+    isStopping = false;
+}
+
+void MeshLoader::destroy() {
+    isStopping = true;
+
+    for (const auto &entry : entries) {
+        workers->wait(entry->loadJob);
+    }
+
+    for (const auto &entry : entries) {
+        vkDestroyBuffer(logicalDevice, entry->mesh.buffer, nullptr);
+        memoryAllocator->free(entry->mesh.allocation);
+        entry->file.close();
+    }
+
+    inFlight.clear();
+    entries.clear();
+}
+
+MeshHandle MeshLoader::load(const string &path) {
+    MeshHandle entry;
+
+    {
+        lock_guard lock(mutex);
+
+        entry = entries.emplace_back(make_unique<MeshEntry>()).get();
+        entry->path = path;
+        inFlight.push_back(entry);
+    }
+
+    workers->submit([this, entry] { loadEntry(*entry); }, &entry->loadJob);
+
+    return entry;
+}
+
+void MeshLoader::update() {
+    lock_guard lock(mutex);
+
+    for (MeshEntry *entry : inFlight) {
+        if (!entry->isPrepared || !entry->error.empty()) {
+            continue;
+        }
+
+        if (!entry->isUploaded) {
+            try {
+                upload(*entry);
+                entry->isUploaded = true;
+            } catch (const exception &e) {
+                entry->error = e.what();
+                cerr << "Failed to upload mesh " << entry->path << ": " << entry->error << '\n';
+                continue;
+            }
+        }
+
+        entry->isReady = uploads->isAcquired(entry->ticket);
+    }
+
+    erase_if(inFlight, [](MeshEntry *entry) { return entry->isReady || !entry->error.empty(); });
+}
+
+const Mesh &MeshLoader::wait(MeshHandle handle) {
+    workers->wait(handle->loadJob);
+
+    unique_lock lock(mutex);
+
+    if (!handle->error.empty()) {
+        throw runtime_error("Failed to load mesh " + handle->path + ": " + handle->error);
+    }
+
+    if (!handle->isUploaded) {
+        upload(*handle);
+        handle->isUploaded = true;
+    }
+
+    UploadQueue::Ticket ticket = handle->ticket;
+    lock.unlock();
+
+    uploads->wait(ticket);
+
+    return handle->mesh;
+}
+
+void MeshLoader::loadEntry(MeshEntry &entry) {
+    if (isStopping) {
+        return;
+    }
+
+    string error;
+    bool isUploaded = false;
+
+    try {
+        prepare(entry);
+
+        if (uploads->isUploadAllowedFromAnyThread()) {
+            upload(entry);
+            isUploaded = true;
+        }
+    } catch (const exception &e) {
+        error = e.what();
+        cerr << "Failed to load mesh " << entry.path << ": " << error << '\n';
+    }
+
+    lock_guard lock(mutex);
+    entry.isPrepared = true;
+    entry.isUploaded = isUploaded;
+    entry.error = error;
+}
+
+// Validates everything the GPU or update() relies on except the index values themselves, which are trusted like the
+// rest of the build's output, and creates the mesh's buffer.
+void MeshLoader::prepare(MeshEntry &entry) {
+    CpuZone zone("Prepare mesh");
+
+    entry.file.open(entry.path);
+
+    const char *data = entry.file.data();
+    uint64_t size = entry.file.size();
+    MeshHeader header;
+
+    if (size < sizeof(header)) {
+        throw runtime_error("truncated header");
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != MESH_MAGIC || header.version != MESH_VERSION) {
+        throw runtime_error("unknown format");
+    }
+
+    if (header.streamCount == 0 || header.streamCount > MESH_MAX_STREAMS || header.attributeCount > MESH_MAX_ATTRIBUTES ||
+        header.submeshCount == 0 || (header.indexType != VK_INDEX_TYPE_UINT16 && header.indexType != VK_INDEX_TYPE_UINT32) ||
+        !isfinite(header.positionScale) || header.positionScale <= 0.0f) {
+        throw runtime_error("invalid header");
+    }
+
+    auto isInFile = [size](uint64_t offset, uint64_t bytes) {
+        return offset % MESH_ALIGNMENT == 0 && offset <= size && bytes <= size - offset;
+    };
+
+    uint64_t indexSize = header.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    if (!isInFile(header.indexOffset, header.indexSize) || header.indexSize != header.indexCount * indexSize) {
+        throw runtime_error("invalid index data");
+    }
+
+    uint64_t payloadStart = header.indexOffset;
+    uint64_t payloadEnd = header.indexOffset + header.indexSize;
+
+    for (uint32_t i = 0; i < header.streamCount; i++) {
+        const MeshStream &stream = header.streams[i];
+
+        if (stream.stride == 0 || !isInFile(stream.offset, stream.size) || stream.size != uint64_t(header.vertexCount) * stream.stride) {
+            throw runtime_error("invalid vertex stream " + to_string(i));
+        }
+
+        payloadStart = min(payloadStart, stream.offset);
+        payloadEnd = max(payloadEnd, stream.offset + stream.size);
+    }
+
+    for (uint32_t i = 0; i < header.attributeCount; i++) {
+        const MeshAttribute &attribute = header.attributes[i];
+        uint32_t attributeSize = meshAttributeSize(attribute.format);
+
+        if (attribute.stream >= header.streamCount || attributeSize == 0 ||
+            uint64_t(attribute.offset) + attributeSize > header.streams[attribute.stream].stride) {
+            throw runtime_error("invalid vertex attribute " + to_string(i));
+        }
+    }
+
+    if (!isInFile(header.submeshOffset, uint64_t(header.submeshCount) * sizeof(MeshSubmesh))) {
+        throw runtime_error("invalid submesh table");
+    }
+
+    if (!isInFile(header.lodOffset, uint64_t(header.lodCount) * sizeof(MeshLod))) {
+        throw runtime_error("invalid LOD table");
+    }
+
+    Mesh &mesh = entry.mesh;
+    mesh.submeshes.resize(header.submeshCount);
+    memcpy(mesh.submeshes.data(), data + header.submeshOffset, header.submeshCount * sizeof(MeshSubmesh));
+    mesh.lods.resize(header.lodCount);
+    memcpy(mesh.lods.data(), data + header.lodOffset, header.lodCount * sizeof(MeshLod));
+
+    for (const MeshSubmesh &submesh : mesh.submeshes) {
+        if (submesh.lodCount == 0 || submesh.lodCount > MESH_MAX_LODS || uint64_t(submesh.firstLod) + submesh.lodCount > header.lodCount) {
+            throw runtime_error("submesh out of the LOD table");
+        }
+    }
+
+    for (const MeshLod &lod : mesh.lods) {
+        if (uint64_t(lod.firstIndex) + lod.indexCount > header.indexCount || !isfinite(lod.error) || lod.error < 0.0f) {
+            throw runtime_error("invalid LOD");
+        }
+    }
+
+    for (uint32_t i = 0; i < header.streamCount; i++) {
+        mesh.streamOffsets.push_back(header.streams[i].offset - payloadStart);
+        mesh.vertexBindings.push_back({.binding = i, .stride = header.streams[i].stride, .inputRate = VK_VERTEX_INPUT_RATE_VERTEX});
+    }
+
+    for (uint32_t i = 0; i < header.attributeCount; i++) {
+        const MeshAttribute &attribute = header.attributes[i];
+        mesh.vertexAttributes.push_back({.location = attribute.location,
+                                         .binding = attribute.stream,
+                                         .format = static_cast<VkFormat>(attribute.format),
+                                         .offset = attribute.offset});
+    }
+
+    mesh.positionScale = header.positionScale;
+    copy(begin(header.positionOffset), end(header.positionOffset), mesh.positionOffset);
+
+    mesh.indexOffset = header.indexOffset - payloadStart;
+    mesh.indexType = static_cast<VkIndexType>(header.indexType);
+
+    entry.payloadOffset = payloadStart;
+    entry.payloadSize = payloadEnd - payloadStart;
+
+    VkBufferCreateInfo bufferInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                  .size = entry.payloadSize,
+                                  .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                           VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                  .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+
+    if (vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &mesh.buffer) != VK_SUCCESS) {
+        throw runtime_error("failed to create buffer");
+    }
+
+    mesh.allocation = memoryAllocator->allocateForBuffer(mesh.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void MeshLoader::upload(MeshEntry &entry) {
+    CpuZone zone("Upload mesh");
+
+    const char *payload = entry.file.data() + entry.payloadOffset;
+    entry.ticket = uploads->uploadToBuffer(entry.mesh.buffer, 0, payload, entry.payloadSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                           VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT);
+
+    // The payload is in the staging ring now.
+    entry.file.close();
+}
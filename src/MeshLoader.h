@@ -0,0 +1,102 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "DeviceMemoryAllocator.h"
+#include "MappedFile.h"
+#include "MeshFormat.h"
+#include "ThreadPool.h"
+#include "UploadQueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A mesh resident on the GPU: every vertex stream and the index data in one buffer, laid out like the file's payload.
+struct Mesh {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    DeviceAllocation allocation;
+    // Per vertex binding.
+    std::vector<VkDeviceSize> streamOffsets;
+    VkDeviceSize indexOffset = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    std::vector<MeshSubmesh> submeshes;
+    // Indexed by MeshSubmesh::firstLod.
+    std::vector<MeshLod> lods;
+    // Dequantization of the positions, see MeshHeader.
+    float positionScale = 1.0f;
+    float positionOffset[3] = {0.0f, 0.0f, 0.0f};
+
+    // The vertex input state of pipelines drawing the mesh, as declared by the file.
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+    // Binds the vertex streams and the index data.
+    void bind(VkCommandBuffer commandBuffer) const;
+};
+
+struct MeshEntry {
+    std::string path;
+    Mesh mesh;
+    MappedFile file;
+    // The part of the file copied to the mesh's buffer.
+    uint64_t payloadOffset = 0;
+    uint64_t payloadSize = 0;
+    UploadQueue::Ticket ticket = 0;
+    // The job loading the mesh.
+    JobCounter loadJob;
+    // Guarded by the loader's mutex.
+    bool isPrepared = false;
+    bool isUploaded = false;
+    std::string error;
+    // Only touched by the render thread.
+    bool isReady = false;
+};
+
+typedef MeshEntry *MeshHandle;
+
+// Streams binary meshes (see MeshFormat.h) in as jobs on the thread pool.
+//
+// A job maps the file, validates the header and creates the mesh's buffer; the payload is then copied from the mapping
+// straight into the staging ring, with no parsing or intermediate copy. With a dedicated transfer family the job uploads
+// too, otherwise the render thread does in update(). A mesh is handed to the renderer by update()
+// once a frame acquired its upload, so get() never returns a mesh whose data is still in flight.
+class MeshLoader {
+  public:
+    void create(VkDevice device, DeviceMemoryAllocator &allocator, UploadQueue &uploadQueue, ThreadPool &threadPool);
+    // Skips the loads that have not started, waits for the others and destroys every mesh. The device has to be idle and
+    // the pool still running.
+    void destroy();
+
+    // Never blocks; meshes load concurrently, in no particular order.
+    MeshHandle load(const std::string &path);
+
+    // Render thread only, once per frame after UploadQueue::acquireCompleted().
+    void update();
+
+    // Render thread only. Null until update() published the mesh.
+    const Mesh *get(MeshHandle handle) const { return handle->isReady ? &handle->mesh : nullptr; }
+
+    // Render thread only. Runs jobs until the mesh's data is on the GPU and throws if it failed to load; for meshes needed
+    // to render at all. The next update() publishes it.
+    const Mesh &wait(MeshHandle handle);
+
+  private:
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    DeviceMemoryAllocator *memoryAllocator = nullptr;
+    UploadQueue *uploads = nullptr;
+    ThreadPool *workers = nullptr;
+
+    std::mutex mutex;
+    // Requested meshes that update() has not published or dropped yet.
+    std::vector<MeshEntry *> inFlight;
+    std::vector<std::unique_ptr<MeshEntry>> entries;
+    std::atomic<bool> isStopping = false;
+
+    void loadEntry(MeshEntry &entry);
+    void prepare(MeshEntry &entry);
+    void upload(MeshEntry &entry);
+};
@@ -0,0 +1,163 @@
+#include "Options.h"
+
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static uint32_t parseCount(const string &option, const char *value, uint32_t minCount = 0, uint32_t maxCount = UINT32_MAX) {
+    if (value == nullptr) {
+        throw runtime_error("Missing value for option " + option);
+    }
+
+    // stoul skips whitespace and negates a leading minus, so only plain digits are accepted.
+    if (isdigit(static_cast<unsigned char>(value[0]))) {
+        try {
+            size_t parsedLength = 0;
+            unsigned long count = stoul(value, &parsedLength);
+
+            if (parsedLength == string(value).size() && count <= UINT32_MAX) {
+                if (count < minCount || count > maxCount) {
+                    throw runtime_error("Value for option " + option + " must be between " + to_string(minCount) + " and " +
+                                        to_string(maxCount) + ": " + value);
+                }
+
+                return static_cast<uint32_t>(count);
+            }
+        } catch (const logic_error &) {
+        }
+    }
+
+    throw runtime_error("Invalid value for option " + option + ": " + value);
+}
+
+static double parseMilliseconds(const string &option, const char *value) {
+    if (value == nullptr) {
+        throw runtime_error("Missing value for option " + option);
+    }
+
+    try {
+        size_t parsedLength = 0;
+        double milliseconds = stod(value, &parsedLength);
+
+        // stod also parses "inf" and "nan".
+        if (parsedLength == string(value).size() && isfinite(milliseconds) && milliseconds > 0.0) {
+            return milliseconds;
+        }
+    } catch (const logic_error &) {
+    }
+
+    throw runtime_error("Invalid value for option " + option + ": " + value);
+}
+
+static PresentMode parsePresentMode(const string &option, const char *value) {
+    if (value == nullptr) {
+        throw runtime_error("Missing value for option " + option);
+    }
+
+    string mode = value;
+
+    if (mode == "immediate") {
+        return PresentMode::Immediate;
+    } else if (mode == "mailbox") {
+        return PresentMode::Mailbox;
+    } else if (mode == "fifo") {
+        return PresentMode::Fifo;
+    }
+
+    throw runtime_error("Invalid value for option " + option + ": " + mode);
+}
+
+Options parseOptions(int argc, char **argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (option == "--headless") {
+            options.headless = true;
+        } else if (option == "--frames") {
+            options.frameCount = parseCount(option, value);
+            i++;
+        } else if (option == "--warmup") {
+            options.warmupFrames = parseCount(option, value);
+            i++;
+        } else if (option == "--draws") {
+            options.drawCount = parseCount(option, value);
+            i++;
+        } else if (option == "--record-threads") {
+            options.recordingThreadCount = parseCount(option, value);
+            i++;
+        } else if (option == "--frames-in-flight") {
+            options.framesInFlight = parseCount(option, value, 1, MAX_FRAMES_IN_FLIGHT);
+            i++;
+        } else if (option == "--present-mode") {
+            options.presentMode = parsePresentMode(option, value);
+            i++;
+        } else if (option == "--swapchain-images") {
+            options.swapchainImageCount = parseCount(option, value);
+            i++;
+        } else if (option == "--fps-limit") {
+            options.frameRateLimit = parseCount(option, value);
+            i++;
+        } else if (option == "--dynamic-resolution") {
+            options.targetGpuMilliseconds = parseMilliseconds(option, value);
+            i++;
+        } else if (option == "--animate") {
+            options.animate = true;
+        } else if (option == "--gpu-culling") {
+            options.gpuCulling = true;
+        } else if (option == "--trace") {
+            if (value == nullptr) {
+                throw runtime_error("Missing value for option " + option);
+            }
+            options.tracePath = value;
+            i++;
+        } else if (option == "--mesh") {
+            if (value == nullptr) {
+                throw runtime_error("Missing value for option " + option);
+            }
+            options.meshPath = value;
+            i++;
+        } else if (option == "--check-allocations") {
+            options.checkAllocations = true;
+        } else if (option == "--verbose") {
+            options.verbose = true;
+        } else {
+            throw runtime_error("Unknown option: " + option);
+        }
+    }
+
+    if (options.headless && options.frameCount == 0) {
+        throw runtime_error("Headless mode requires a frame count (--frames <count>)");
+    }
+
+    if (options.checkAllocations && !options.tracePath.empty()) {
+        throw runtime_error("The allocation check cannot be combined with a trace, which allocates while recording zones");
+    }
+
+    return options;
+}
+
+string optionsUsage(const char *programName) {
+    return string("Usage: ") + programName + " [options]\n" +
+           "\t--headless          render into offscreen images, no window or swapchain\n"
+           "\t--frames <count>    render a fixed number of frames and print a benchmark report\n"
+           "\t--warmup <count>    frames excluded from the benchmark report (default 10)\n"
+           "\t--draws <count>     draws in the scene, recorded every frame (default 1)\n"
+           "\t--record-threads <n> threads recording the scene (default: one per hardware thread)\n"
+           "\t--frames-in-flight <n> frames recorded ahead of the GPU, 1 to 4 (default 2)\n"
+           "\t--present-mode <m> immediate, mailbox or fifo (default: mailbox where supported, else fifo)\n"
+           "\t--swapchain-images <n> swapchain images, clamped to the surface's limits (default: its minimum + 1)\n"
+           "\t--fps-limit <fps>   pace frames, starting each as late as still meets its deadline to sample input late\n"
+           "\t--dynamic-resolution <ms> scale the scene's resolution to hold this GPU frame time, then upscale it\n"
+           "\t--animate           spin every instance, updating every transform each simulation tick\n"
+           "\t--gpu-culling       cull on the GPU and draw the scene with one indirect draw\n"
+           "\t--trace <path>      write a Chrome trace of CPU and GPU zones (chrome://tracing, Perfetto)\n"
+           "\t--mesh <path>       mesh drawn by every instance (default meshes/triangle.mesh)\n"
+           "\t--check-allocations fail if drawing a frame after the warmup allocates from the heap\n"
+           "\t--verbose           print the instance extensions and validation layers\n";
+}
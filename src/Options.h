@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+// Default picks MAILBOX where the surface supports it and FIFO otherwise.
+enum class PresentMode { Default, Immediate, Mailbox, Fifo };
+
+struct Options {
+    // Render into offscreen images instead of a window and a swapchain.
+    bool headless = false;
+    // Number of frames to render before exiting; 0 runs until the window is closed.
+    uint32_t frameCount = 0;
+    // Number of leading frames excluded from the benchmark statistics.
+    uint32_t warmupFrames = 10;
+    // Number of draws in the scene recorded every frame.
+    uint32_t drawCount = 1;
+    // Number of threads recording the scene; 0 uses the render thread plus every worker thread.
+    uint32_t recordingThreadCount = 0;
+    // Frames the CPU may record ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT; fewer trade throughput for latency.
+    uint32_t framesInFlight = 2;
+    // Falls back to FIFO, which every surface supports, if the surface lacks the mode.
+    PresentMode presentMode = PresentMode::Default;
+    // Swapchain images requested, clamped to the surface's limits; 0 requests one more than the surface's minimum.
+    uint32_t swapchainImageCount = 0;
+    // Frames per second the frame limiter paces the render loop to; 0 disables it.
+    uint32_t frameRateLimit = 0;
+    // Spin every instance, so every transform in the scene changes every simulation tick.
+    bool animate = false;
+    // GPU frame time in milliseconds the scene's render resolution is scaled to hold; 0 renders at the window's resolution.
+    double targetGpuMilliseconds = 0.0;
+    // Cull and draw the scene on the GPU with a single indirect draw instead of recording a draw per instance.
+    bool gpuCulling = false;
+    // Write a Chrome trace of CPU and GPU zones to this path on exit; empty disables profiling.
+    std::string tracePath;
+    // The scene's mesh, converted by mesh_converter.
+    std::string meshPath = "meshes/triangle.mesh";
+    // Fail the run if drawing a frame after the warmup frames allocates from the heap.
+    bool checkAllocations = false;
+    // Print the instance extensions and validation layers at startup.
+    bool verbose = false;
+};
+
+Options parseOptions(int argc, char **argv);
+
+std::string optionsUsage(const char *programName);
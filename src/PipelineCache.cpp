@@ -0,0 +1,206 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+const uint32_t PIPELINE_CACHE_FILE_MAGIC = 0x43505456; // "VTPC"
+const uint32_t PIPELINE_CACHE_FILE_VERSION = 2;
+
+// Followed by buildTimeCount build times and the dataSize bytes of the driver's blob, which the checksum covers.
+struct PipelineCacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t buildTimeCount;
+    uint64_t dataSize;
+    uint64_t dataChecksum;
+};
+
+struct PipelineCacheFileBuildTime {
+    uint64_t nameHash;
+    uint64_t coldBuildMicroseconds;
+};
+
+static uint64_t checksum(const char *data, size_t size) {
+    // FNV-1a, only meant to catch truncated or corrupted files.
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001b3;
+    }
+    return hash;
+}
+
+void PipelineCache::create(VkDevice device, const VkPhysicalDeviceProperties &properties, const string &path) {
+    logicalDevice = device;
+    deviceProperties = properties;
+    filePath = path;
+
+    vector<char> fileData;
+    ifstream file(filePath, ios::binary);
+    if (file.is_open()) {
+        fileData.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+
+    vector<char> cacheData;
+    PipelineCacheFileHeader header;
+
+    if (fileData.empty()) {
+        cout << "Pipeline cache: no cache file at " << filePath << '\n';
+    } else if (fileData.size() < sizeof(header)) {
+        cout << "Pipeline cache: ignoring truncated file " << filePath << '\n';
+    } else {
+        memcpy(&header, fileData.data(), sizeof(header));
+
+        const char *contents = fileData.data() + sizeof(header);
+        size_t contentsSize = fileData.size() - sizeof(header);
+        size_t buildTimesSize = header.buildTimeCount * sizeof(PipelineCacheFileBuildTime);
+        const char *data = contents + buildTimesSize;
+
+        if (header.magic != PIPELINE_CACHE_FILE_MAGIC || header.version != PIPELINE_CACHE_FILE_VERSION) {
+            cout << "Pipeline cache: ignoring file with unknown format " << filePath << '\n';
+        } else if (header.buildTimeCount > contentsSize / sizeof(PipelineCacheFileBuildTime) ||
+                   header.dataSize != contentsSize - buildTimesSize || header.dataChecksum != checksum(contents, contentsSize)) {
+            cout << "Pipeline cache: ignoring corrupted file " << filePath << '\n';
+        } else if (!isCompatible(data, header.dataSize)) {
+            cout << "Pipeline cache: ignoring file created by a different device or driver " << filePath << '\n';
+        } else {
+            cacheData.assign(data, data + header.dataSize);
+
+            for (uint64_t i = 0; i < header.buildTimeCount; i++) {
+                PipelineCacheFileBuildTime buildTime;
+                memcpy(&buildTime, contents + i * sizeof(buildTime), sizeof(buildTime));
+                coldBuildMicroseconds[buildTime.nameHash] = buildTime.coldBuildMicroseconds;
+            }
+        }
+    }
+
+    isHit = !cacheData.empty();
+    loadedSize = cacheData.size();
+
+    VkPipelineCacheCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                                         .initialDataSize = cacheData.size(),
+                                         .pInitialData = cacheData.empty() ? nullptr : cacheData.data()};
+
+    if (vkCreatePipelineCache(logicalDevice, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+        throw runtime_error("Failed to create pipeline cache!");
+    }
+}
+
+void PipelineCache::destroy() {
+    vkDestroyPipelineCache(logicalDevice, pipelineCache, nullptr);
+    pipelineCache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::isCompatible(const char *data, size_t size) const {
+    VkPipelineCacheHeaderVersionOne cacheHeader;
+
+    if (size < sizeof(cacheHeader)) {
+        return false;
+    }
+
+    memcpy(&cacheHeader, data, sizeof(cacheHeader));
+
+    return cacheHeader.headerSize >= sizeof(cacheHeader) && cacheHeader.headerSize <= size &&
+           cacheHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && cacheHeader.vendorID == deviceProperties.vendorID &&
+           cacheHeader.deviceID == deviceProperties.deviceID &&
+           memcmp(cacheHeader.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save() {
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+        throw runtime_error("Failed to query pipeline cache size!");
+    }
+
+    vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+        throw runtime_error("Failed to read pipeline cache data!");
+    }
+    data.resize(dataSize);
+
+    // The loaded times, updated with those of the pipelines built without a time.
+    unordered_map<uint64_t, uint64_t> coldTimes = coldBuildMicroseconds;
+    {
+        lock_guard lock(buildMutex);
+        for (const auto &[nameHash, buildTime] : buildTimes) {
+            coldTimes.try_emplace(nameHash, buildTime.microseconds);
+        }
+    }
+
+    vector<char> contents;
+    for (const auto &[nameHash, microseconds] : coldTimes) {
+        PipelineCacheFileBuildTime buildTime{.nameHash = nameHash, .coldBuildMicroseconds = microseconds};
+        contents.insert(contents.end(), reinterpret_cast<const char *>(&buildTime),
+                        reinterpret_cast<const char *>(&buildTime) + sizeof(buildTime));
+    }
+    contents.insert(contents.end(), data.begin(), data.end());
+
+    PipelineCacheFileHeader header{.magic = PIPELINE_CACHE_FILE_MAGIC,
+                                   .version = PIPELINE_CACHE_FILE_VERSION,
+                                   .buildTimeCount = coldTimes.size(),
+                                   .dataSize = data.size(),
+                                   .dataChecksum = checksum(contents.data(), contents.size())};
+
+    string temporaryPath = filePath + ".tmp";
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(contents.data(), contents.size());
+        file.close();
+
+        if (!file) {
+            throw runtime_error("Failed to write pipeline cache: " + temporaryPath);
+        }
+    }
+
+    filesystem::rename(temporaryPath, filePath);
+}
+
+void PipelineCache::addBuildTime(const char *name, PipelineKind kind, chrono::steady_clock::duration duration) {
+    uint64_t nameHash = checksum(name, strlen(name));
+    uint64_t microseconds = chrono::duration_cast<chrono::microseconds>(duration).count();
+
+    lock_guard lock(buildMutex);
+    BuildTime &buildTime = buildTimes.try_emplace(nameHash, BuildTime{.kind = kind, .microseconds = 0}).first->second;
+    buildTime.microseconds += microseconds;
+}
+
+void PipelineCache::printStartupReport(ostream &out) const {
+    // Per kind, the time this run and the time without a cache, which is this run's for pipelines built cold.
+    uint64_t builtMicroseconds[2] = {};
+    uint64_t coldMicroseconds[2] = {};
+
+    {
+        lock_guard lock(buildMutex);
+        for (const auto &[nameHash, buildTime] : buildTimes) {
+            size_t kind = static_cast<size_t>(buildTime.kind);
+            auto cold = coldBuildMicroseconds.find(nameHash);
+
+            builtMicroseconds[kind] += buildTime.microseconds;
+            coldMicroseconds[kind] += cold != coldBuildMicroseconds.end() ? cold->second : buildTime.microseconds;
+        }
+    }
+
+    size_t graphics = static_cast<size_t>(PipelineKind::Graphics);
+    size_t compute = static_cast<size_t>(PipelineKind::Compute);
+
+    if (!isHit) {
+        out << "Pipeline cache: miss, graphics pipelines built in " << builtMicroseconds[graphics] / 1000.0
+            << " ms, compute pipelines in " << builtMicroseconds[compute] / 1000.0 << " ms\n";
+        return;
+    }
+
+    int64_t savedMicroseconds = static_cast<int64_t>(coldMicroseconds[graphics] + coldMicroseconds[compute]) -
+                                static_cast<int64_t>(builtMicroseconds[graphics] + builtMicroseconds[compute]);
+
+    out << "Pipeline cache: hit (" << loadedSize << " bytes), graphics pipelines built in " << builtMicroseconds[graphics] / 1000.0
+        << " ms (" << coldMicroseconds[graphics] / 1000.0 << " ms without cache), compute pipelines in "
+        << builtMicroseconds[compute] / 1000.0 << " ms (" << coldMicroseconds[compute] / 1000.0 << " ms without cache), saved "
+        << savedMicroseconds / 1000.0 << " ms\n";
+}
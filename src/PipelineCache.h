@@ -0,0 +1,55 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+enum class PipelineKind { Graphics, Compute };
+
+// VkPipelineCache persisted to disk between runs.
+//
+// The file wraps the driver's cache blob in a small header with a checksum and the time each pipeline, by name, took to
+// build without a cache, so a warm start can report how much time the cache saved. A pipeline the file has no time for is
+// built cold and its time is saved with the cache, as are all times when the file is rebuilt. The blob is only handed to
+// the driver when its own header matches the vendor, device and pipelineCacheUUID of the current physical device.
+class PipelineCache {
+  public:
+    void create(VkDevice device, const VkPhysicalDeviceProperties &properties, const std::string &path);
+    void destroy();
+
+    // Writes the current cache contents to a temporary file and renames it over the old one, so a crash never leaves a torn file.
+    void save();
+
+    VkPipelineCache handle() const { return pipelineCache; }
+
+    // Accumulates time spent in vkCreate*Pipelines for the named pipelines, may be called from any thread. Names identify the
+    // pipelines across runs.
+    void addBuildTime(const char *name, PipelineKind kind, std::chrono::steady_clock::duration duration);
+
+    void printStartupReport(std::ostream &out) const;
+
+  private:
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties deviceProperties;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    std::string filePath;
+    // This run's builds, by the hash of their name.
+    struct BuildTime {
+        PipelineKind kind;
+        uint64_t microseconds;
+    };
+
+    bool isHit = false;
+    size_t loadedSize = 0;
+    // Loaded from the file, by the hash of the pipeline's name.
+    std::unordered_map<uint64_t, uint64_t> coldBuildMicroseconds;
+    mutable std::mutex buildMutex;
+    std::unordered_map<uint64_t, BuildTime> buildTimes;
+
+    bool isCompatible(const char *data, size_t size) const;
+};
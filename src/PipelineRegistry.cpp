@@ -0,0 +1,228 @@
+#include "PipelineRegistry.h"
+
+#include "Profiler.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+template <typename T> static void pack(string &state, const T &value) {
+    state.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static uint64_t hashState(const string &state) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : state) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+string GraphicsPipelineDescription::packState() const {
+    string state;
+
+    pack(state, vertexShader);
+    pack(state, fragmentShader);
+
+    pack(state, vertexBindings.size());
+    for (const auto &binding : vertexBindings) {
+        pack(state, binding);
+    }
+
+    pack(state, vertexAttributes.size());
+    for (const auto &attribute : vertexAttributes) {
+        pack(state, attribute);
+    }
+
+    pack(state, inputAssembly.flags);
+    pack(state, inputAssembly.topology);
+    pack(state, inputAssembly.primitiveRestartEnable);
+
+    pack(state, viewport);
+    pack(state, scissor);
+
+    pack(state, rasterizer.flags);
+    pack(state, rasterizer.depthClampEnable);
+    pack(state, rasterizer.rasterizerDiscardEnable);
+    pack(state, rasterizer.polygonMode);
+    pack(state, rasterizer.cullMode);
+    pack(state, rasterizer.frontFace);
+    pack(state, rasterizer.depthBiasEnable);
+    pack(state, rasterizer.depthBiasConstantFactor);
+    pack(state, rasterizer.depthBiasClamp);
+    pack(state, rasterizer.depthBiasSlopeFactor);
+    pack(state, rasterizer.lineWidth);
+
+    pack(state, multisampling.flags);
+    pack(state, multisampling.rasterizationSamples);
+    pack(state, multisampling.sampleShadingEnable);
+    pack(state, multisampling.minSampleShading);
+    pack(state, multisampling.pSampleMask != nullptr ? *multisampling.pSampleMask : ~VkSampleMask(0));
+    pack(state, multisampling.alphaToCoverageEnable);
+    pack(state, multisampling.alphaToOneEnable);
+
+    pack(state, depthStencil.flags);
+    pack(state, depthStencil.depthTestEnable);
+    pack(state, depthStencil.depthWriteEnable);
+    pack(state, depthStencil.depthCompareOp);
+    pack(state, depthStencil.depthBoundsTestEnable);
+    pack(state, depthStencil.stencilTestEnable);
+    pack(state, depthStencil.front);
+    pack(state, depthStencil.back);
+    pack(state, depthStencil.minDepthBounds);
+    pack(state, depthStencil.maxDepthBounds);
+
+    pack(state, colorBlendAttachment);
+
+    pack(state, colorBlending.flags);
+    pack(state, colorBlending.logicOpEnable);
+    pack(state, colorBlending.logicOp);
+    pack(state, colorBlending.blendConstants);
+
+    pack(state, dynamicStates.size());
+    for (VkDynamicState dynamicState : dynamicStates) {
+        pack(state, dynamicState);
+    }
+
+    pack(state, layout);
+    pack(state, renderPass);
+    pack(state, subpass);
+
+    return state;
+}
+
+void PipelineRegistry::create(VkDevice device, PipelineCache &cache, ThreadPool &threadPool) {
+    logicalDevice = device;
+    pipelineCache = &cache;
+    workers = &threadPool;
+}
+
+void PipelineRegistry::destroy() {
+    unique_lock lock(mutex);
+    compiled.wait(lock, [this] { return pendingCompilations == 0; });
+
+    for (const auto &entry : entries) {
+        vkDestroyPipeline(logicalDevice, entry->pipeline.load(), nullptr);
+    }
+
+    pipelines.clear();
+    entries.clear();
+}
+
+PipelineHandle PipelineRegistry::request(const GraphicsPipelineDescription &description) {
+    string state = description.packState();
+    PipelineKey key{.hash = hashState(state), .state = move(state)};
+
+    lock_guard lock(mutex);
+
+    if (auto existing = pipelines.find(key); existing != pipelines.end()) {
+        return existing->second;
+    }
+
+    PipelineHandle entry = entries.emplace_back(make_unique<PipelineEntry>()).get();
+    entry->description = description;
+    pipelines.emplace(move(key), entry);
+    pendingCompilations++;
+
+    workers->submit([this, entry] { compile(*entry); });
+
+    return entry;
+}
+
+VkPipeline PipelineRegistry::get(PipelineHandle handle) const { return handle->pipeline.load(memory_order_acquire); }
+
+VkPipeline PipelineRegistry::getOrFallback(PipelineHandle handle, PipelineHandle fallback) const {
+    VkPipeline pipeline = get(handle);
+    return pipeline != VK_NULL_HANDLE ? pipeline : get(fallback);
+}
+
+VkPipeline PipelineRegistry::wait(PipelineHandle handle) {
+    unique_lock lock(mutex);
+    compiled.wait(lock, [handle] { return handle->pipeline.load() != VK_NULL_HANDLE || handle->isFailed.load(); });
+
+    if (handle->isFailed) {
+        throw runtime_error("Failed to create graphics pipeline!");
+    }
+
+    return handle->pipeline.load();
+}
+
+size_t PipelineRegistry::pendingCount() const {
+    lock_guard lock(mutex);
+    return pendingCompilations;
+}
+
+void PipelineRegistry::compile(PipelineEntry &entry) {
+    CpuZone zone("Compile pipeline");
+    const GraphicsPipelineDescription &description = entry.description;
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {{.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                                                       .stage = VK_SHADER_STAGE_VERTEX_BIT,
+                                                       .module = description.vertexShader,
+                                                       .pName = "main"},
+                                                      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                                                       .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+                                                       .module = description.fragmentShader,
+                                                       .pName = "main"}};
+
+    const auto &bindings = description.vertexBindings;
+    const auto &attributes = description.vertexAttributes;
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                                                         .vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size()),
+                                                         .pVertexBindingDescriptions = bindings.data(),
+                                                         .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size()),
+                                                         .pVertexAttributeDescriptions = attributes.data()};
+
+    VkPipelineViewportStateCreateInfo viewportState{.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                                                    .viewportCount = 1,
+                                                    .pViewports = &description.viewport,
+                                                    .scissorCount = 1,
+                                                    .pScissors = &description.scissor};
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = description.colorBlending;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &description.colorBlendAttachment;
+
+    VkPipelineDynamicStateCreateInfo dynamicState{.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                                                  .dynamicStateCount = static_cast<uint32_t>(description.dynamicStates.size()),
+                                                  .pDynamicStates = description.dynamicStates.data()};
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                                              .stageCount = 2,
+                                              .pStages = shaderStages,
+                                              .pVertexInputState = &vertexInputInfo,
+                                              .pInputAssemblyState = &description.inputAssembly,
+                                              .pViewportState = &viewportState,
+                                              .pRasterizationState = &description.rasterizer,
+                                              .pMultisampleState = &description.multisampling,
+                                              .pDepthStencilState = &description.depthStencil,
+                                              .pColorBlendState = &colorBlending,
+                                              .pDynamicState = &dynamicState,
+                                              .layout = description.layout,
+                                              .renderPass = description.renderPass,
+                                              .subpass = description.subpass,
+                                              .basePipelineHandle = VK_NULL_HANDLE,
+                                              .basePipelineIndex = -1};
+
+    auto buildStart = chrono::steady_clock::now();
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateGraphicsPipelines(logicalDevice, pipelineCache->handle(), 1, &pipelineInfo, nullptr, &pipeline) == VK_SUCCESS) {
+        pipelineCache->addBuildTime(description.name, PipelineKind::Graphics, chrono::steady_clock::now() - buildStart);
+        entry.pipeline.store(pipeline, memory_order_release);
+    } else {
+        cerr << "Failed to create graphics pipeline!\n";
+        entry.isFailed = true;
+    }
+
+    {
+        lock_guard lock(mutex);
+        pendingCompilations--;
+    }
+
+    compiled.notify_all();
+}
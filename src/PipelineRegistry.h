@@ -0,0 +1,97 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "PipelineCache.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Everything that determines a graphics pipeline. Two descriptions that compare equal produce the same pipeline.
+// pNext chains are not part of the state and must be left null.
+struct GraphicsPipelineDescription {
+    VkShaderModule vertexShader = VK_NULL_HANDLE;
+    VkShaderModule fragmentShader = VK_NULL_HANDLE;
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+    // Ignored for the states listed in dynamicStates.
+    VkViewport viewport;
+    VkRect2D scissor;
+    VkPipelineRasterizationStateCreateInfo rasterizer;
+    VkPipelineMultisampleStateCreateInfo multisampling;
+    VkPipelineDepthStencilStateCreateInfo depthStencil;
+    VkPipelineColorBlendAttachmentState colorBlendAttachment;
+    VkPipelineColorBlendStateCreateInfo colorBlending;
+    std::vector<VkDynamicState> dynamicStates;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+    // Identifies the pipeline's build time in the pipeline cache across runs; not part of the state.
+    const char *name = "";
+
+    // Packs the state field by field, so padding bytes and pointers never leak into the key.
+    std::string packState() const;
+};
+
+struct PipelineEntry {
+    GraphicsPipelineDescription description;
+    std::atomic<VkPipeline> pipeline = VK_NULL_HANDLE;
+    std::atomic<bool> isFailed = false;
+};
+
+typedef PipelineEntry *PipelineHandle;
+
+// Deduplicates pipeline requests by a hash of their full state and compiles new pipelines on worker threads.
+//
+// request() never blocks: it returns a handle right away and the pipeline becomes available once a worker has
+// compiled it. Until then get() returns VK_NULL_HANDLE, so the render thread can skip the draw or fall back to
+// a pipeline that is already ready instead of stalling the frame.
+class PipelineRegistry {
+  public:
+    void create(VkDevice device, PipelineCache &cache, ThreadPool &threadPool);
+
+    // Waits for compilations in flight and destroys every pipeline.
+    void destroy();
+
+    PipelineHandle request(const GraphicsPipelineDescription &description);
+
+    VkPipeline get(PipelineHandle handle) const;
+    VkPipeline getOrFallback(PipelineHandle handle, PipelineHandle fallback) const;
+
+    // Blocks until the pipeline is compiled; throws if compilation failed. Meant for pipelines needed to render at all.
+    VkPipeline wait(PipelineHandle handle);
+
+    size_t pendingCount() const;
+
+  private:
+    struct PipelineKey {
+        uint64_t hash;
+        std::string state;
+
+        bool operator==(const PipelineKey &other) const { return hash == other.hash && state == other.state; }
+    };
+
+    struct PipelineKeyHash {
+        size_t operator()(const PipelineKey &key) const { return static_cast<size_t>(key.hash); }
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    PipelineCache *pipelineCache = nullptr;
+    ThreadPool *workers = nullptr;
+
+    mutable std::mutex mutex;
+    std::condition_variable compiled;
+    std::unordered_map<PipelineKey, PipelineHandle, PipelineKeyHash> pipelines;
+    std::vector<std::unique_ptr<PipelineEntry>> entries;
+    size_t pendingCompilations = 0;
+
+    void compile(PipelineEntry &entry);
+};
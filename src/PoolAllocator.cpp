@@ -0,0 +1,73 @@
+#include "PoolAllocator.h"
+
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+PoolAllocator::PoolAllocator(size_t objectSize, uint32_t objectsPerChunk) : chunkObjectCount(max(objectsPerChunk, 1u)) {
+    size_t alignment = alignof(max_align_t);
+    size = (max(objectSize, sizeof(FreeObject)) + alignment - 1) / alignment * alignment;
+}
+
+PoolAllocator::~PoolAllocator() {
+    for (void *chunk : chunks) {
+        ::operator delete(chunk);
+    }
+}
+
+void *PoolAllocator::allocate() {
+    lock_guard lock(mutex);
+    return pop();
+}
+
+void PoolAllocator::deallocate(void *object) {
+    lock_guard lock(mutex);
+    push(object);
+}
+
+void PoolAllocator::allocateBatch(void **objects, uint32_t count) {
+    lock_guard lock(mutex);
+
+    for (uint32_t i = 0; i < count; i++) {
+        objects[i] = pop();
+    }
+}
+
+void PoolAllocator::deallocateBatch(void *const *objects, uint32_t count) {
+    lock_guard lock(mutex);
+
+    for (uint32_t i = 0; i < count; i++) {
+        push(objects[i]);
+    }
+}
+
+void *PoolAllocator::pop() {
+    if (freeObjects == nullptr) {
+        char *chunk = static_cast<char *>(::operator new(size * chunkObjectCount));
+        chunks.push_back(chunk);
+
+        // Pushed back to front, so the chunk is handed out in address order.
+        for (uint32_t i = chunkObjectCount; i-- > 0;) {
+            push(chunk + i * size);
+        }
+    }
+
+    FreeObject *object = freeObjects;
+    freeObjects = object->next;
+    return object;
+}
+
+void PoolAllocator::push(void *object) { freeObjects = new (object) FreeObject{.next = freeObjects}; }
+
+void *PoolResource::do_allocate(size_t bytes, size_t alignment) {
+    return isPooled(bytes, alignment) ? pool.allocate() : upstreamResource->allocate(bytes, alignment);
+}
+
+void PoolResource::do_deallocate(void *pointer, size_t bytes, size_t alignment) {
+    if (isPooled(bytes, alignment)) {
+        pool.deallocate(pointer);
+    } else {
+        upstreamResource->deallocate(pointer, bytes, alignment);
+    }
+}
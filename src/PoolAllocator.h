@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+// Size of the nodes libstdc++'s std::deque allocates its elements in, for pools behind a std::pmr::deque.
+const size_t DEQUE_NODE_SIZE = 512;
+
+// Hands out objects of one fixed size from chunks that it keeps until it is destroyed, for small objects that are
+// created and destroyed at a high rate. Freed objects go onto an intrusive free list that the next allocation takes from,
+// so a pool that has grown to its peak never reaches the heap again. Thread safe; the batch functions take the lock once
+// for many objects, so threads can cache a few objects of their own.
+class PoolAllocator {
+  public:
+    // Objects are aligned like std::max_align_t.
+    PoolAllocator(size_t objectSize, uint32_t objectsPerChunk);
+    ~PoolAllocator();
+
+    PoolAllocator(const PoolAllocator &) = delete;
+    PoolAllocator &operator=(const PoolAllocator &) = delete;
+
+    void *allocate();
+    void deallocate(void *object);
+
+    // Fills objects with count objects.
+    void allocateBatch(void **objects, uint32_t count);
+    void deallocateBatch(void *const *objects, uint32_t count);
+
+    size_t objectSize() const { return size; }
+
+  private:
+    struct FreeObject {
+        FreeObject *next;
+    };
+
+    size_t size;
+    uint32_t chunkObjectCount;
+
+    std::mutex mutex;
+    FreeObject *freeObjects = nullptr;
+    std::vector<void *> chunks;
+
+    // The caller holds the lock.
+    void *pop();
+    void push(void *object);
+};
+
+// Lets std::pmr containers allocate from a pool, for containers whose allocations are mostly of one size like the nodes
+// of a deque or a list. Larger or over-aligned allocations go to the upstream resource.
+class PoolResource : public std::pmr::memory_resource {
+  public:
+    PoolResource(size_t objectSize, uint32_t objectsPerChunk, std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : pool(objectSize, objectsPerChunk), upstreamResource(upstream) {}
+
+  private:
+    PoolAllocator pool;
+    std::pmr::memory_resource *upstreamResource;
+
+    bool isPooled(size_t bytes, size_t alignment) const { return bytes <= pool.objectSize() && alignment <= alignof(std::max_align_t); }
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+};
@@ -0,0 +1,177 @@
+#include "Profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+const uint32_t ZONES_PER_CHUNK = 4096;
+
+struct RecordedZone {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    uint64_t frame;
+};
+
+struct ZoneChunk {
+    RecordedZone zones[ZONES_PER_CHUNK];
+    // Written by the owning thread only; readers load it with acquire and never look past it.
+    atomic<uint32_t> count = 0;
+    atomic<ZoneChunk *> next = nullptr;
+};
+
+struct ZoneBuffer {
+    string threadName;
+    uint32_t threadId = 0;
+    unique_ptr<ZoneChunk> first = make_unique<ZoneChunk>();
+    ZoneChunk *last = first.get();
+    vector<unique_ptr<ZoneChunk>> chunks;
+
+    // Only called by the owning thread.
+    void append(const RecordedZone &zone) {
+        uint32_t count = last->count.load(memory_order_relaxed);
+
+        if (count == ZONES_PER_CHUNK) {
+            ZoneChunk *chunk = chunks.emplace_back(make_unique<ZoneChunk>()).get();
+            last->next.store(chunk, memory_order_release);
+            last = chunk;
+            count = 0;
+        }
+
+        last->zones[count] = zone;
+        last->count.store(count + 1, memory_order_release);
+    }
+};
+
+static atomic<bool> isProfilerEnabled = false;
+static atomic<uint64_t> currentFrame = 0;
+static uint64_t startTime = 0;
+
+static mutex buffersMutex;
+static vector<unique_ptr<ZoneBuffer>> buffers;
+static ZoneBuffer *gpuBuffer = nullptr;
+
+static thread_local ZoneBuffer *threadBuffer = nullptr;
+
+static ZoneBuffer &registerBuffer(const string &threadName) {
+    lock_guard lock(buffersMutex);
+
+    ZoneBuffer *buffer = buffers.emplace_back(make_unique<ZoneBuffer>()).get();
+    buffer->threadId = static_cast<uint32_t>(buffers.size());
+    buffer->threadName = threadName.empty() ? "Thread " + to_string(buffer->threadId) : threadName;
+
+    return *buffer;
+}
+
+static ZoneBuffer &ownBuffer() {
+    if (threadBuffer == nullptr) {
+        threadBuffer = &registerBuffer("");
+    }
+
+    return *threadBuffer;
+}
+
+static string escapeJson(const char *text) {
+    string escaped;
+
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            escaped += '\\';
+        }
+        escaped += *c;
+    }
+
+    return escaped;
+}
+
+void Profiler::enable() {
+    startTime = now();
+
+    // The GPU gets its own row in the trace, fed by the render thread.
+    gpuBuffer = &registerBuffer("GPU");
+
+    isProfilerEnabled.store(true, memory_order_release);
+}
+
+bool Profiler::isEnabled() { return isProfilerEnabled.load(memory_order_relaxed); }
+
+uint64_t Profiler::now() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Profiler::setThreadName(const string &name) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    if (threadBuffer == nullptr) {
+        threadBuffer = &registerBuffer(name);
+        return;
+    }
+
+    lock_guard lock(buffersMutex);
+    threadBuffer->threadName = name;
+}
+
+void Profiler::setFrame(uint64_t frameNumber) { currentFrame.store(frameNumber, memory_order_relaxed); }
+
+void Profiler::addCpuZone(const char *name, uint64_t startNanoseconds, uint64_t endNanoseconds) {
+    ownBuffer().append({.name = name, .start = startNanoseconds, .end = endNanoseconds, .frame = currentFrame.load(memory_order_relaxed)});
+}
+
+void Profiler::addGpuZone(const char *name, uint64_t startNanoseconds, uint64_t endNanoseconds, uint64_t frameNumber) {
+    if (isEnabled()) {
+        gpuBuffer->append({.name = name, .start = startNanoseconds, .end = endNanoseconds, .frame = frameNumber});
+    }
+}
+
+void Profiler::writeChromeTrace(const string &path) {
+    ofstream file(path, ios::trunc);
+
+    if (!file.is_open()) {
+        throw runtime_error("Failed to open trace file: " + path);
+    }
+
+    lock_guard lock(buffersMutex);
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool isFirst = true;
+    auto separator = [&] {
+        if (!isFirst) {
+            file << ",\n";
+        }
+        isFirst = false;
+    };
+
+    for (const auto &buffer : buffers) {
+        separator();
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\""
+             << escapeJson(buffer->threadName.c_str()) << "\"}}";
+
+        for (const ZoneChunk *chunk = buffer->first.get(); chunk != nullptr; chunk = chunk->next.load(memory_order_acquire)) {
+            uint32_t count = chunk->count.load(memory_order_acquire);
+
+            for (uint32_t i = 0; i < count; i++) {
+                const RecordedZone &zone = chunk->zones[i];
+
+                // Chrome traces count in microseconds; zones that started before enable() are clamped to the start.
+                double start = zone.start > startTime ? (zone.start - startTime) / 1e3 : 0.0;
+                double duration = zone.end > zone.start ? (zone.end - zone.start) / 1e3 : 0.0;
+
+                separator();
+                file << "{\"name\":\"" << escapeJson(zone.name) << "\",\"cat\":\"" << (buffer.get() == gpuBuffer ? "gpu" : "cpu")
+                     << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"ts\":" << fixed << start << ",\"dur\":" << duration
+                     << ",\"args\":{\"frame\":" << zone.frame << "}}";
+            }
+        }
+    }
+
+    file << "\n]}\n";
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Process-wide frame profiler collecting CPU and GPU zones for a Chrome trace (chrome://tracing or Perfetto).
+//
+// Disabled until enable() is called, so zones cost a single relaxed load otherwise. Every thread appends its zones to its
+// own buffer of fixed-size chunks that is only ever written by that thread and published with release stores, so recording
+// never takes a lock; only a thread's first zone registers its buffer under a mutex. Zone names must be string literals
+// or otherwise outlive the profiler. Times are nanoseconds on the steady clock.
+class Profiler {
+  public:
+    static void enable();
+    static bool isEnabled();
+
+    static uint64_t now();
+
+    // Names the calling thread in the trace. Does nothing while the profiler is disabled.
+    static void setThreadName(const std::string &name);
+
+    // Zones recorded from here on are tagged with the frame number.
+    static void setFrame(uint64_t frameNumber);
+
+    static void addCpuZone(const char *name, uint64_t startNanoseconds, uint64_t endNanoseconds);
+    // GPU zones already converted to the CPU timeline. Must only be called from a single thread.
+    static void addGpuZone(const char *name, uint64_t startNanoseconds, uint64_t endNanoseconds, uint64_t frameNumber);
+
+    // Call once the threads that record zones are idle.
+    static void writeChromeTrace(const std::string &path);
+};
+
+// Records the scope it lives in as a CPU zone.
+class CpuZone {
+  public:
+    explicit CpuZone(const char *zoneName) : name(zoneName), isActive(Profiler::isEnabled()), start(isActive ? Profiler::now() : 0) {}
+
+    ~CpuZone() {
+        if (isActive) {
+            Profiler::addCpuZone(name, start, Profiler::now());
+        }
+    }
+
+    CpuZone(const CpuZone &) = delete;
+    CpuZone &operator=(const CpuZone &) = delete;
+
+  private:
+    const char *name;
+    bool isActive;
+    uint64_t start;
+};
@@ -0,0 +1,248 @@
+#include "RangeAllocator.h"
+
+#include <algorithm>
+#include <bit>
+
+using namespace std;
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+
+RangeAllocator::RangeAllocator(uint64_t capacity) : totalSize(capacity) {
+    for (auto &lists : freeLists) {
+        fill(begin(lists), end(lists), NO_REGION);
+    }
+
+    if (capacity > 0) {
+        regions.push_back({.offset = 0, .size = capacity});
+        insertFree(0);
+    }
+}
+
+void RangeAllocator::mapping(uint64_t size, uint32_t &firstLevel, uint32_t &secondLevel) {
+    if (size < (uint64_t(1) << SMALL_SIZE_BITS)) {
+        firstLevel = 0;
+        secondLevel = static_cast<uint32_t>(size >> (SMALL_SIZE_BITS - SECOND_LEVEL_BITS));
+        return;
+    }
+
+    uint32_t log2 = static_cast<uint32_t>(bit_width(size)) - 1;
+    firstLevel = log2 - SMALL_SIZE_BITS + 1;
+    secondLevel = static_cast<uint32_t>(size >> (log2 - SECOND_LEVEL_BITS)) - SECOND_LEVEL_COUNT;
+}
+
+uint32_t RangeAllocator::findFree(uint64_t size, uint64_t alignment) const {
+    // Round the request up to the next bin boundary, so that every range in the bin found is large enough.
+    uint64_t searchSize = size + alignment - 1;
+    uint64_t binStep = searchSize < (uint64_t(1) << SMALL_SIZE_BITS)
+                           ? uint64_t(1) << (SMALL_SIZE_BITS - SECOND_LEVEL_BITS)
+                           : uint64_t(1) << (bit_width(searchSize) - 1 - SECOND_LEVEL_BITS);
+
+    if (searchSize <= totalSize) {
+        uint32_t firstLevel, secondLevel;
+        mapping(alignUp(searchSize, binStep), firstLevel, secondLevel);
+
+        uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+
+        if (secondLevelMap == 0) {
+            uint64_t firstLevelMap = firstLevel + 1 < FIRST_LEVEL_COUNT ? firstLevelBitmap & (~uint64_t(0) << (firstLevel + 1)) : 0;
+
+            if (firstLevelMap != 0) {
+                firstLevel = static_cast<uint32_t>(countr_zero(firstLevelMap));
+                secondLevelMap = secondLevelBitmaps[firstLevel];
+            }
+        }
+
+        if (secondLevelMap != 0) {
+            return freeLists[firstLevel][countr_zero(secondLevelMap)];
+        }
+    }
+
+    // Larger bins are empty, but the bin the request itself falls into may still hold a range that fits exactly,
+    // e.g. a request for the whole capacity.
+    uint32_t firstLevel, secondLevel;
+    mapping(size, firstLevel, secondLevel);
+
+    for (uint32_t i = freeLists[firstLevel][secondLevel]; i != NO_REGION; i = regions[i].nextFree) {
+        const Region &region = regions[i];
+
+        if (alignUp(region.offset, alignment) + size <= region.offset + region.size) {
+            return i;
+        }
+    }
+
+    return NO_REGION;
+}
+
+uint32_t RangeAllocator::allocate(uint64_t size, uint64_t alignment) {
+    size = max<uint64_t>(size, 1);
+
+    if (size > totalSize || alignment > totalSize) {
+        return NO_REGION;
+    }
+
+    uint32_t region = findFree(size, alignment);
+    if (region == NO_REGION) {
+        return NO_REGION;
+    }
+
+    removeFree(region);
+
+    uint64_t padding = alignUp(regions[region].offset, alignment) - regions[region].offset;
+    if (padding > 0) {
+        uint32_t aligned = split(region, padding);
+        insertFree(region);
+        region = aligned;
+    }
+
+    if (regions[region].size > size) {
+        insertFree(split(region, size));
+    }
+
+    regions[region].alignment = alignment;
+    allocatedBytes += size;
+    allocatedCount++;
+
+    return region;
+}
+
+void RangeAllocator::free(uint32_t region) {
+    allocatedBytes -= regions[region].size;
+    allocatedCount--;
+
+    uint32_t next = regions[region].nextPhysical;
+    if (next != NO_REGION && regions[next].isFree) {
+        removeFree(next);
+        merge(region, next);
+    }
+
+    uint32_t prev = regions[region].prevPhysical;
+    if (prev != NO_REGION && regions[prev].isFree) {
+        removeFree(prev);
+        merge(prev, region);
+        region = prev;
+    }
+
+    insertFree(region);
+}
+
+uint64_t RangeAllocator::largestFreeRange() const {
+    if (firstLevelBitmap == 0) {
+        return 0;
+    }
+
+    uint32_t firstLevel = 63 - static_cast<uint32_t>(countl_zero(firstLevelBitmap));
+    uint32_t secondLevel = 31 - static_cast<uint32_t>(countl_zero(secondLevelBitmaps[firstLevel]));
+
+    uint64_t largest = 0;
+    for (uint32_t i = freeLists[firstLevel][secondLevel]; i != NO_REGION; i = regions[i].nextFree) {
+        largest = max(largest, regions[i].size);
+    }
+
+    return largest;
+}
+
+void RangeAllocator::forEachAllocation(const function<void(uint32_t region)> &visit) const {
+    // Splitting keeps the index of the front part and merging keeps the index of the lower region, so region 0 always
+    // starts at offset 0.
+    for (uint32_t i = regions.empty() ? NO_REGION : 0; i != NO_REGION; i = regions[i].nextPhysical) {
+        if (!regions[i].isFree) {
+            visit(i);
+        }
+    }
+}
+
+uint32_t RangeAllocator::newRegion() {
+    if (unusedRegions.empty()) {
+        regions.emplace_back();
+        return static_cast<uint32_t>(regions.size() - 1);
+    }
+
+    uint32_t region = unusedRegions.back();
+    unusedRegions.pop_back();
+    regions[region] = {};
+
+    return region;
+}
+
+void RangeAllocator::insertFree(uint32_t region) {
+    uint32_t firstLevel, secondLevel;
+    mapping(regions[region].size, firstLevel, secondLevel);
+
+    uint32_t head = freeLists[firstLevel][secondLevel];
+
+    regions[region].isFree = true;
+    regions[region].prevFree = NO_REGION;
+    regions[region].nextFree = head;
+
+    if (head != NO_REGION) {
+        regions[head].prevFree = region;
+    }
+
+    freeLists[firstLevel][secondLevel] = region;
+    secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+    firstLevelBitmap |= uint64_t(1) << firstLevel;
+}
+
+void RangeAllocator::removeFree(uint32_t region) {
+    Region &removed = regions[region];
+
+    if (removed.prevFree != NO_REGION) {
+        regions[removed.prevFree].nextFree = removed.nextFree;
+    } else {
+        uint32_t firstLevel, secondLevel;
+        mapping(removed.size, firstLevel, secondLevel);
+
+        freeLists[firstLevel][secondLevel] = removed.nextFree;
+
+        if (removed.nextFree == NO_REGION) {
+            secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+
+            if (secondLevelBitmaps[firstLevel] == 0) {
+                firstLevelBitmap &= ~(uint64_t(1) << firstLevel);
+            }
+        }
+    }
+
+    if (removed.nextFree != NO_REGION) {
+        regions[removed.nextFree].prevFree = removed.prevFree;
+    }
+
+    removed.isFree = false;
+    removed.prevFree = NO_REGION;
+    removed.nextFree = NO_REGION;
+}
+
+uint32_t RangeAllocator::split(uint32_t region, uint64_t size) {
+    uint32_t remainder = newRegion();
+
+    Region &front = regions[region];
+    Region &back = regions[remainder];
+
+    back.offset = front.offset + size;
+    back.size = front.size - size;
+    back.prevPhysical = region;
+    back.nextPhysical = front.nextPhysical;
+
+    if (front.nextPhysical != NO_REGION) {
+        regions[front.nextPhysical].prevPhysical = remainder;
+    }
+
+    front.size = size;
+    front.nextPhysical = remainder;
+
+    return remainder;
+}
+
+void RangeAllocator::merge(uint32_t region, uint32_t next) {
+    Region &front = regions[region];
+    Region &back = regions[next];
+
+    front.size += back.size;
+    front.nextPhysical = back.nextPhysical;
+
+    if (back.nextPhysical != NO_REGION) {
+        regions[back.nextPhysical].prevPhysical = region;
+    }
+
+    unusedRegions.push_back(next);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Two-level segregated fit (TLSF) allocator over the offsets [0, capacity) of some external memory.
+//
+// Free ranges are kept in lists binned by a power of two and a linear subdivision of it, with a bitmap per level, so
+// allocate() and free() run in constant time regardless of how fragmented the memory is. The bookkeeping lives in this
+// object and not in the managed memory, which is what device memory needs since it usually cannot be read by the CPU.
+class RangeAllocator {
+  public:
+    static constexpr uint32_t NO_REGION = UINT32_MAX;
+
+    explicit RangeAllocator(uint64_t capacity);
+
+    // Returns the allocated region or NO_REGION when no free range fits. alignment has to be a power of two.
+    uint32_t allocate(uint64_t size, uint64_t alignment);
+    void free(uint32_t region);
+
+    uint64_t offset(uint32_t region) const { return regions[region].offset; }
+    uint64_t size(uint32_t region) const { return regions[region].size; }
+    uint64_t alignment(uint32_t region) const { return regions[region].alignment; }
+
+    uint64_t capacity() const { return totalSize; }
+    uint64_t usedBytes() const { return allocatedBytes; }
+    uint32_t allocationCount() const { return allocatedCount; }
+    bool isEmpty() const { return allocatedCount == 0; }
+    uint64_t largestFreeRange() const;
+
+    // Visits the allocated regions in offset order.
+    void forEachAllocation(const std::function<void(uint32_t region)> &visit) const;
+
+  private:
+    static constexpr uint32_t SECOND_LEVEL_BITS = 4;
+    static constexpr uint32_t SECOND_LEVEL_COUNT = 1u << SECOND_LEVEL_BITS;
+    // Sizes below 2^SMALL_SIZE_BITS all share the first first-level bin, subdivided linearly.
+    static constexpr uint32_t SMALL_SIZE_BITS = 8;
+    static constexpr uint32_t FIRST_LEVEL_COUNT = 64 - SMALL_SIZE_BITS + 1;
+
+    struct Region {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t alignment = 1;
+        uint32_t prevPhysical = NO_REGION;
+        uint32_t nextPhysical = NO_REGION;
+        uint32_t prevFree = NO_REGION;
+        uint32_t nextFree = NO_REGION;
+        bool isFree = false;
+    };
+
+    uint64_t totalSize;
+    uint64_t allocatedBytes = 0;
+    uint32_t allocatedCount = 0;
+    std::vector<Region> regions;
+    std::vector<uint32_t> unusedRegions;
+    uint64_t firstLevelBitmap = 0;
+    uint32_t secondLevelBitmaps[FIRST_LEVEL_COUNT] = {};
+    uint32_t freeLists[FIRST_LEVEL_COUNT][SECOND_LEVEL_COUNT];
+
+    static void mapping(uint64_t size, uint32_t &firstLevel, uint32_t &secondLevel);
+    uint32_t findFree(uint64_t size, uint64_t alignment) const;
+    uint32_t newRegion();
+    void insertFree(uint32_t region);
+    void removeFree(uint32_t region);
+    // Shrinks `region` to its first `size` bytes and returns a new region for the remainder, which is in no free list yet.
+    uint32_t split(uint32_t region, uint64_t size);
+    // Absorbs `next`, the physical successor of `region`, into it.
+    void merge(uint32_t region, uint32_t next);
+};
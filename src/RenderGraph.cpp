@@ -0,0 +1,1000 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+const VkAccessFlags WRITE_ACCESS =
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+const VkImageUsageFlags ATTACHMENT_USAGE =
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+// What an ImageAccess means for synchronization.
+struct UseInfo {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    bool isWrite;
+    // Overwrites the whole image without reading it, so its previous contents do not matter.
+    bool discards;
+};
+
+// Since the last write of an image: who wrote it, who read it, and whom the write was made visible to.
+struct ImageState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags writeStages = 0;
+    VkAccessFlags writeAccess = 0;
+    VkPipelineStageFlags readStages = 0;
+    VkPipelineStageFlags visibleStages = 0;
+    VkAccessFlags visibleAccess = 0;
+};
+
+static double toMebibytes(VkDeviceSize bytes) { return bytes / double(1 << 20); }
+
+static bool isDepthFormat(VkFormat format) {
+    return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT ||
+           format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+static VkImageAspectFlags aspectMask(VkFormat format) {
+    return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+static bool isAttachment(ImageUse use) { return use != ImageUse::Sampled && use != ImageUse::Storage; }
+
+static UseInfo useInfo(ImageUse use, VkAttachmentLoadOp loadOp, RenderPassType type, VkFormat format) {
+    VkPipelineStageFlags shaderStage =
+        type == RenderPassType::Compute ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    bool isLoaded = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+    VkAccessFlags colorRead = isLoaded ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0;
+    VkImageLayout inputLayout =
+        isDepthFormat(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    switch (use) {
+    case ImageUse::ColorAttachment:
+        return {.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | colorRead,
+                .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                .isWrite = true,
+                .discards = !isLoaded};
+    case ImageUse::DepthAttachment:
+        return {.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                .access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                .isWrite = true,
+                .discards = !isLoaded};
+    case ImageUse::InputAttachment:
+        return {.stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                .access = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+                .layout = inputLayout,
+                .isWrite = false,
+                .discards = false};
+    case ImageUse::Sampled:
+        return {.stages = shaderStage,
+                .access = VK_ACCESS_SHADER_READ_BIT,
+                .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                .isWrite = false,
+                .discards = false};
+    case ImageUse::Storage:
+        return {.stages = shaderStage,
+                .access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                .layout = VK_IMAGE_LAYOUT_GENERAL,
+                .isWrite = true,
+                .discards = false};
+    }
+
+    throw runtime_error("Unknown image use!");
+}
+
+static VkImageUsageFlags usageFlags(ImageUse use) {
+    switch (use) {
+    case ImageUse::ColorAttachment:
+        return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    case ImageUse::DepthAttachment:
+        return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    case ImageUse::InputAttachment:
+        return VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+    case ImageUse::Sampled:
+        return VK_IMAGE_USAGE_SAMPLED_BIT;
+    case ImageUse::Storage:
+        return VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+
+    return 0;
+}
+
+// Moves the state past a use. Returns whether the use has to wait for the state's accesses, and the barrier that does.
+static bool advance(ImageState &state, const UseInfo &use, VkPipelineStageFlags &srcStages, VkAccessFlags &srcAccess,
+                    VkImageLayout &oldLayout) {
+    oldLayout = state.layout;
+
+    if (use.isWrite || use.layout != state.layout) {
+        // Writes and layout transitions wait for everything since the last write. A transition writes too, but the barrier
+        // makes it visible to the use.
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+
+        state = {.layout = use.layout,
+                 .writeStages = use.stages,
+                 .writeAccess = use.isWrite ? use.access & WRITE_ACCESS : 0,
+                 .readStages = use.isWrite ? 0 : use.stages,
+                 .visibleStages = use.isWrite ? 0 : use.stages,
+                 .visibleAccess = use.isWrite ? 0 : use.access};
+    } else if ((use.stages & ~state.visibleStages) != 0 || (use.access & ~state.visibleAccess) != 0) {
+        srcStages = state.writeStages;
+        srcAccess = state.writeAccess;
+
+        state.readStages |= use.stages;
+        state.visibleStages |= use.stages;
+        state.visibleAccess |= use.access;
+    } else {
+        state.readStages |= use.stages;
+        return false;
+    }
+
+    if (srcStages == 0) {
+        srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+
+    return true;
+}
+
+// Dependencies between the same subpasses are merged into one.
+static void addDependency(vector<VkSubpassDependency> &dependencies, uint32_t srcSubpass, uint32_t dstSubpass,
+                          VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages,
+                          VkAccessFlags dstAccess) {
+    // Between subpasses, every access is to attachments of the same pixel.
+    VkDependencyFlags flags = srcSubpass != VK_SUBPASS_EXTERNAL && dstSubpass != VK_SUBPASS_EXTERNAL ? VK_DEPENDENCY_BY_REGION_BIT : 0;
+
+    for (VkSubpassDependency &dependency : dependencies) {
+        if (dependency.srcSubpass == srcSubpass && dependency.dstSubpass == dstSubpass) {
+            dependency.srcStageMask |= srcStages;
+            dependency.srcAccessMask |= srcAccess;
+            dependency.dstStageMask |= dstStages;
+            dependency.dstAccessMask |= dstAccess;
+            return;
+        }
+    }
+
+    dependencies.push_back({.srcSubpass = srcSubpass,
+                            .dstSubpass = dstSubpass,
+                            .srcStageMask = srcStages,
+                            .dstStageMask = dstStages,
+                            .srcAccessMask = srcAccess,
+                            .dstAccessMask = dstAccess,
+                            .dependencyFlags = flags});
+}
+
+RenderGraphImage RenderGraph::createImage(const char *name, VkFormat format, VkExtent2D extent) {
+    images.push_back({.name = name, .format = format, .extent = extent});
+    return static_cast<RenderGraphImage>(images.size() - 1);
+}
+
+RenderGraphImage RenderGraph::importImage(const char *name, const ImportedImage &image) {
+    images.push_back({.name = name,
+                      .format = image.format,
+                      .extent = image.extent,
+                      .isImported = true,
+                      .images = image.images,
+                      .views = image.views,
+                      .startStages = image.startStages,
+                      .startLayout = image.startLayout,
+                      .finalLayout = image.finalLayout});
+    return static_cast<RenderGraphImage>(images.size() - 1);
+}
+
+RenderGraphPass RenderGraph::addPass(const char *name, RenderPassType type, RecordPass record) {
+    passes.push_back({.name = name, .type = type, .record = move(record)});
+    return static_cast<RenderGraphPass>(passes.size() - 1);
+}
+
+void RenderGraph::useSecondaryCommandBuffers(RenderGraphPass pass) { passes[pass].usesSecondaries = true; }
+
+void RenderGraph::keep(RenderGraphPass pass) { passes[pass].isKept = true; }
+
+void RenderGraph::writeColor(RenderGraphPass pass, RenderGraphImage image, VkAttachmentLoadOp loadOp, VkClearColorValue clearValue) {
+    addAccess(pass, image, ImageUse::ColorAttachment, loadOp, {.color = clearValue});
+}
+
+void RenderGraph::writeDepth(RenderGraphPass pass, RenderGraphImage image, VkAttachmentLoadOp loadOp,
+                             VkClearDepthStencilValue clearValue) {
+    addAccess(pass, image, ImageUse::DepthAttachment, loadOp, {.depthStencil = clearValue});
+}
+
+void RenderGraph::readAttachment(RenderGraphPass pass, RenderGraphImage image) {
+    addAccess(pass, image, ImageUse::InputAttachment, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+void RenderGraph::readImage(RenderGraphPass pass, RenderGraphImage image) {
+    addAccess(pass, image, ImageUse::Sampled, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+void RenderGraph::writeStorage(RenderGraphPass pass, RenderGraphImage image) {
+    addAccess(pass, image, ImageUse::Storage, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+void RenderGraph::addAccess(RenderGraphPass pass, RenderGraphImage image, ImageUse use, VkAttachmentLoadOp loadOp,
+                            VkClearValue clearValue) {
+    if (isAttachment(use) && passes[pass].type != RenderPassType::Graphics) {
+        throw runtime_error(string("Render graph pass ") + passes[pass].name + " is not a graphics pass!");
+    }
+
+    for (const ImageAccess &access : passes[pass].accesses) {
+        if (access.image == image) {
+            throw runtime_error(string("Render graph pass ") + passes[pass].name + " uses " + images[image].name + " twice!");
+        }
+    }
+
+    passes[pass].accesses.push_back({.image = image, .use = use, .loadOp = loadOp, .clearValue = clearValue});
+}
+
+void RenderGraph::compile(VkDevice device, DeviceMemoryAllocator &allocator) {
+    logicalDevice = device;
+    memoryAllocator = &allocator;
+
+    for (const Image &image : images) {
+        variantCount = max(variantCount, static_cast<uint32_t>(image.views.size()));
+    }
+
+    cullPasses();
+    mergeSteps();
+    findImageUsage();
+    createImages();
+    aliasMemory();
+    allocateMemory();
+    synchronize();
+    createRenderPasses();
+    createFramebuffers();
+
+    size_t maxBarrierCount = finalBarriers.size();
+    for (const Step &step : steps) {
+        maxBarrierCount = max(maxBarrierCount, step.barriers.size());
+    }
+    imageBarriers.reserve(maxBarrierCount);
+}
+
+void RenderGraph::cullPasses() {
+    // Walking backwards, an image is needed if it is imported or a later pass that is not culled reads it.
+    vector<bool> isNeeded(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        isNeeded[i] = images[i].isImported;
+    }
+
+    for (size_t i = passes.size(); i-- > 0;) {
+        Pass &pass = passes[i];
+        bool isUsed = pass.isKept;
+
+        for (const ImageAccess &access : pass.accesses) {
+            UseInfo info = useInfo(access.use, access.loadOp, pass.type, images[access.image].format);
+            isUsed |= info.isWrite && isNeeded[access.image];
+        }
+
+        if (!isUsed) {
+            pass.isCulled = true;
+            culledPassCount++;
+            continue;
+        }
+
+        for (const ImageAccess &access : pass.accesses) {
+            UseInfo info = useInfo(access.use, access.loadOp, pass.type, images[access.image].format);
+            if (!info.discards) {
+                isNeeded[access.image] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::mergeSteps() {
+    for (size_t i = 0; i < passes.size(); i++) {
+        Pass &pass = passes[i];
+
+        if (pass.isCulled) {
+            continue;
+        }
+
+        if (pass.type == RenderPassType::Graphics && !steps.empty() && canMerge(steps.back(), pass)) {
+            pass.step = static_cast<uint32_t>(steps.size() - 1);
+            pass.subpass = static_cast<uint32_t>(steps.back().passes.size());
+            steps.back().passes.push_back(static_cast<RenderGraphPass>(i));
+            continue;
+        }
+
+        Step step;
+        step.passes.push_back(static_cast<RenderGraphPass>(i));
+
+        if (pass.type == RenderPassType::Graphics) {
+            auto attachment = find_if(pass.accesses.begin(), pass.accesses.end(), [](const ImageAccess &access) {
+                return isAttachment(access.use);
+            });
+
+            if (attachment == pass.accesses.end()) {
+                throw runtime_error(string("Render graph pass ") + pass.name + " has no attachments!");
+            }
+
+            step.extent = images[attachment->image].extent;
+            step.renderArea = step.extent;
+        }
+
+        pass.step = static_cast<uint32_t>(steps.size());
+        pass.subpass = 0;
+        steps.push_back(move(step));
+    }
+}
+
+// A graphics pass joins the render pass before it if it renders at the same size, and neither samples or stores to an image
+// the other uses, which would need a barrier between them.
+bool RenderGraph::canMerge(const Step &step, const Pass &pass) const {
+    if (passes[step.passes.front()].type != RenderPassType::Graphics) {
+        return false;
+    }
+
+    for (const ImageAccess &access : pass.accesses) {
+        const VkExtent2D &extent = images[access.image].extent;
+
+        if (isAttachment(access.use) && (extent.width != step.extent.width || extent.height != step.extent.height)) {
+            return false;
+        }
+
+        for (RenderGraphPass other : step.passes) {
+            for (const ImageAccess &otherAccess : passes[other].accesses) {
+                if (otherAccess.image == access.image && (!isAttachment(access.use) || !isAttachment(otherAccess.use))) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+void RenderGraph::findImageUsage() {
+    for (uint32_t s = 0; s < steps.size(); s++) {
+        for (RenderGraphPass pass : steps[s].passes) {
+            for (const ImageAccess &access : passes[pass].accesses) {
+                Image &image = images[access.image];
+                image.firstStep = min(image.firstStep, s);
+                image.lastStep = s;
+                image.usage |= usageFlags(access.use);
+            }
+        }
+    }
+
+    for (Image &image : images) {
+        // Only attached within one render pass, so tilers can keep the image in tile memory.
+        if (!image.isImported && image.firstStep == image.lastStep && (image.usage & ~ATTACHMENT_USAGE) == 0) {
+            image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+    }
+}
+
+void RenderGraph::createImages() {
+    for (Image &image : images) {
+        // Images no remaining pass uses are not created.
+        if (image.isImported || image.firstStep == NO_STEP) {
+            continue;
+        }
+
+        VkImageCreateInfo imageInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                    .imageType = VK_IMAGE_TYPE_2D,
+                                    .format = image.format,
+                                    .extent = {.width = image.extent.width, .height = image.extent.height, .depth = 1},
+                                    .mipLevels = 1,
+                                    .arrayLayers = 1,
+                                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                    .usage = image.usage,
+                                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+        VkImage vulkanImage;
+        if (vkCreateImage(logicalDevice, &imageInfo, nullptr, &vulkanImage) != VK_SUCCESS) {
+            throw runtime_error(string("Failed to create render graph image ") + image.name + "!");
+        }
+
+        image.images.push_back(vulkanImage);
+        vkGetImageMemoryRequirements(logicalDevice, vulkanImage, &image.memoryRequirements);
+    }
+}
+
+// Greedily puts the largest images first into the first slot whose images are used in other steps, so an image shares memory
+// with images that are done before its first step or start after its last.
+void RenderGraph::aliasMemory() {
+    vector<RenderGraphImage> transients;
+
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!images[i].isImported && images[i].firstStep != NO_STEP) {
+            transients.push_back(static_cast<RenderGraphImage>(i));
+        }
+    }
+
+    sort(transients.begin(), transients.end(), [this](RenderGraphImage a, RenderGraphImage b) {
+        return images[a].memoryRequirements.size > images[b].memoryRequirements.size;
+    });
+
+    for (RenderGraphImage i : transients) {
+        const Image &image = images[i];
+        const VkMemoryRequirements &requirements = image.memoryRequirements;
+
+        auto fits = [this, &image, &requirements](const MemorySlot &slot) {
+            return (slot.requirements.memoryTypeBits & requirements.memoryTypeBits) != 0 &&
+                   none_of(slot.images.begin(), slot.images.end(), [this, &image](RenderGraphImage other) {
+                       return images[other].firstStep <= image.lastStep && image.firstStep <= images[other].lastStep;
+                   });
+        };
+
+        auto slot = find_if(memorySlots.begin(), memorySlots.end(), fits);
+
+        if (slot == memorySlots.end()) {
+            memorySlots.push_back({.requirements = requirements});
+            slot = memorySlots.end() - 1;
+        } else {
+            slot->requirements.size = max(slot->requirements.size, requirements.size);
+            slot->requirements.alignment = max(slot->requirements.alignment, requirements.alignment);
+            slot->requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        }
+
+        slot->images.push_back(i);
+    }
+
+    for (MemorySlot &slot : memorySlots) {
+        sort(slot.images.begin(), slot.images.end(),
+             [this](RenderGraphImage a, RenderGraphImage b) { return images[a].firstStep < images[b].firstStep; });
+    }
+}
+
+void RenderGraph::allocateMemory() {
+    for (MemorySlot &slot : memorySlots) {
+        slot.allocation = memoryAllocator->allocate(slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ResourceTiling::Optimal);
+
+        for (RenderGraphImage i : slot.images) {
+            Image &image = images[i];
+            vkBindImageMemory(logicalDevice, image.images.front(), slot.allocation.memory, slot.allocation.offset);
+
+            VkImageViewCreateInfo viewInfo{
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = image.images.front(),
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = image.format,
+                .subresourceRange = {
+                    .aspectMask = aspectMask(image.format), .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1}};
+
+            VkImageView view;
+            if (vkCreateImageView(logicalDevice, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+                throw runtime_error(string("Failed to create render graph image view ") + image.name + "!");
+            }
+
+            image.views.push_back(view);
+        }
+    }
+}
+
+void RenderGraph::synchronize() {
+    struct Use {
+        uint32_t step;
+        uint32_t subpass;
+        ImageUse use;
+        UseInfo info;
+    };
+
+    // The uses of every image in execution order, and the attachments of every render pass in the order passes add them.
+    vector<vector<Use>> imageUses(images.size());
+
+    for (uint32_t s = 0; s < steps.size(); s++) {
+        Step &step = steps[s];
+
+        for (RenderGraphPass pass : step.passes) {
+            for (const ImageAccess &access : passes[pass].accesses) {
+                const Image &image = images[access.image];
+                UseInfo info = useInfo(access.use, access.loadOp, passes[pass].type, image.format);
+                imageUses[access.image].push_back({.step = s, .subpass = passes[pass].subpass, .use = access.use, .info = info});
+
+                if (!isAttachment(access.use) ||
+                    find(step.attachments.begin(), step.attachments.end(), access.image) != step.attachments.end()) {
+                    continue;
+                }
+
+                // The contents only need to be stored if a later step or frame uses them.
+                bool isStored = image.isImported || image.lastStep > s;
+
+                step.attachments.push_back(access.image);
+                step.clearValues.push_back(access.clearValue);
+                step.attachmentDescriptions.push_back(
+                    {.format = image.format,
+                     .samples = VK_SAMPLE_COUNT_1_BIT,
+                     .loadOp = access.use == ImageUse::InputAttachment ? VK_ATTACHMENT_LOAD_OP_LOAD : access.loadOp,
+                     .storeOp = isStored ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                     .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                     .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE});
+            }
+        }
+    }
+
+    auto description = [this](uint32_t step, RenderGraphImage image) -> VkAttachmentDescription & {
+        const vector<RenderGraphImage> &attachments = steps[step].attachments;
+        return steps[step].attachmentDescriptions[find(attachments.begin(), attachments.end(), image) - attachments.begin()];
+    };
+
+    // The state an image's uses leave it in at the end of a frame.
+    auto finalState = [&imageUses](RenderGraphImage image) {
+        ImageState state;
+        VkPipelineStageFlags srcStages;
+        VkAccessFlags srcAccess;
+        VkImageLayout oldLayout;
+
+        for (const Use &use : imageUses[image]) {
+            advance(state, use.info, srcStages, srcAccess, oldLayout);
+        }
+
+        return state;
+    };
+
+    // The image that used the memory of a graph image last, which is itself in the previous frame without aliasing.
+    auto previousOccupant = [this](RenderGraphImage image) {
+        for (const MemorySlot &slot : memorySlots) {
+            auto position = find(slot.images.begin(), slot.images.end(), image);
+
+            if (position != slot.images.end()) {
+                return position == slot.images.begin() ? slot.images.back() : *(position - 1);
+            }
+        }
+
+        return image;
+    };
+
+    for (size_t i = 0; i < images.size(); i++) {
+        const Image &image = images[i];
+        const vector<Use> &uses = imageUses[i];
+
+        if (uses.empty()) {
+            continue;
+        }
+
+        ImageState state;
+        bool isAliased = false;
+
+        if (image.isImported) {
+            state.layout = uses.front().info.discards ? VK_IMAGE_LAYOUT_UNDEFINED : image.startLayout;
+            state.writeStages = image.startStages;
+        } else {
+            if (!uses.front().info.discards) {
+                throw runtime_error(string("Render graph image ") + image.name + " is read before it is written!");
+            }
+
+            RenderGraphImage previous = previousOccupant(static_cast<RenderGraphImage>(i));
+            state = finalState(previous);
+            state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            isAliased = previous != i;
+        }
+
+        // Uses past the last one transition imported images into their final layout.
+        for (size_t u = 0; u <= uses.size(); u++) {
+            const Use *previousUse = u > 0 ? &uses[u - 1] : nullptr;
+            const Use *use = u < uses.size() ? &uses[u] : nullptr;
+
+            UseInfo info = use != nullptr ? use->info
+                                          : UseInfo{.stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                                    .access = 0,
+                                                    .layout = image.isImported ? image.finalLayout : state.layout,
+                                                    .isWrite = false,
+                                                    .discards = false};
+
+            bool isFirstInStep = use != nullptr && (previousUse == nullptr || previousUse->step != use->step);
+
+            if (use != nullptr && isAttachment(use->use)) {
+                if (isFirstInStep) {
+                    description(use->step, static_cast<RenderGraphImage>(i)).initialLayout = info.layout;
+                }
+                description(use->step, static_cast<RenderGraphImage>(i)).finalLayout = info.layout;
+            }
+
+            Barrier barrier{.image = static_cast<RenderGraphImage>(i),
+                            .dstStages = info.stages,
+                            .dstAccess = info.access,
+                            .newLayout = info.layout,
+                            .isAliased = isAliased && u == 0};
+
+            if (use == nullptr && info.layout == state.layout) {
+                break;
+            }
+
+            if (!advance(state, info, barrier.srcStages, barrier.srcAccess, barrier.oldLayout)) {
+                continue;
+            }
+
+            if (previousUse != nullptr && use != nullptr && previousUse->step == use->step) {
+                // Attachment layouts within a render pass follow the subpasses' references.
+                addDependency(steps[use->step].dependencies, previousUse->subpass, use->subpass, barrier.srcStages, barrier.srcAccess,
+                              barrier.dstStages, barrier.dstAccess);
+            } else if (previousUse != nullptr && isAttachment(previousUse->use)) {
+                // The render pass that used the image last transitions it on the way out.
+                description(previousUse->step, static_cast<RenderGraphImage>(i)).finalLayout = barrier.newLayout;
+                addDependency(steps[previousUse->step].dependencies, previousUse->subpass, VK_SUBPASS_EXTERNAL, barrier.srcStages,
+                              barrier.srcAccess, barrier.dstStages, barrier.dstAccess);
+            } else if (use != nullptr && isAttachment(use->use)) {
+                description(use->step, static_cast<RenderGraphImage>(i)).initialLayout = barrier.oldLayout;
+                addDependency(steps[use->step].dependencies, VK_SUBPASS_EXTERNAL, use->subpass, barrier.srcStages, barrier.srcAccess,
+                              barrier.dstStages, barrier.dstAccess);
+            } else if (use != nullptr) {
+                steps[use->step].barriers.push_back(barrier);
+            } else {
+                finalBarriers.push_back(barrier);
+            }
+        }
+    }
+}
+
+void RenderGraph::createRenderPasses() {
+    for (Step &step : steps) {
+        if (passes[step.passes.front()].type != RenderPassType::Graphics) {
+            continue;
+        }
+
+        size_t subpassCount = step.passes.size();
+        size_t attachmentCount = step.attachments.size();
+
+        vector<vector<VkAttachmentReference>> colorReferences(subpassCount);
+        vector<vector<VkAttachmentReference>> inputReferences(subpassCount);
+        vector<VkAttachmentReference> depthReferences(subpassCount);
+        vector<vector<uint32_t>> preserved(subpassCount);
+        vector<VkSubpassDescription> subpasses(subpassCount);
+
+        // The first and last subpass using every attachment, which has to be preserved by the subpasses in between.
+        vector<uint32_t> firstSubpass(attachmentCount, UINT32_MAX);
+        vector<uint32_t> lastSubpass(attachmentCount, 0);
+        vector<vector<bool>> isUsed(subpassCount, vector<bool>(attachmentCount));
+
+        for (uint32_t s = 0; s < subpassCount; s++) {
+            const Pass &pass = passes[step.passes[s]];
+            bool hasDepth = false;
+
+            for (const ImageAccess &access : pass.accesses) {
+                if (!isAttachment(access.use)) {
+                    continue;
+                }
+
+                uint32_t index = static_cast<uint32_t>(find(step.attachments.begin(), step.attachments.end(), access.image) -
+                                                       step.attachments.begin());
+                UseInfo info = useInfo(access.use, access.loadOp, pass.type, images[access.image].format);
+                VkAttachmentReference reference{.attachment = index, .layout = info.layout};
+
+                if (access.use == ImageUse::ColorAttachment) {
+                    colorReferences[s].push_back(reference);
+                } else if (access.use == ImageUse::DepthAttachment) {
+                    depthReferences[s] = reference;
+                    hasDepth = true;
+                } else {
+                    inputReferences[s].push_back(reference);
+                }
+
+                firstSubpass[index] = min(firstSubpass[index], s);
+                lastSubpass[index] = s;
+                isUsed[s][index] = true;
+            }
+
+            subpasses[s] = {.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            .inputAttachmentCount = static_cast<uint32_t>(inputReferences[s].size()),
+                            .pInputAttachments = inputReferences[s].data(),
+                            .colorAttachmentCount = static_cast<uint32_t>(colorReferences[s].size()),
+                            .pColorAttachments = colorReferences[s].data(),
+                            .pDepthStencilAttachment = hasDepth ? &depthReferences[s] : nullptr};
+        }
+
+        for (uint32_t s = 0; s < subpassCount; s++) {
+            for (uint32_t a = 0; a < attachmentCount; a++) {
+                if (!isUsed[s][a] && firstSubpass[a] < s && s < lastSubpass[a]) {
+                    preserved[s].push_back(a);
+                }
+            }
+
+            subpasses[s].preserveAttachmentCount = static_cast<uint32_t>(preserved[s].size());
+            subpasses[s].pPreserveAttachments = preserved[s].data();
+        }
+
+        VkRenderPassCreateInfo renderPassInfo{.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+                                              .attachmentCount = static_cast<uint32_t>(attachmentCount),
+                                              .pAttachments = step.attachmentDescriptions.data(),
+                                              .subpassCount = static_cast<uint32_t>(subpassCount),
+                                              .pSubpasses = subpasses.data(),
+                                              .dependencyCount = static_cast<uint32_t>(step.dependencies.size()),
+                                              .pDependencies = step.dependencies.data()};
+
+        if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &step.renderPass) != VK_SUCCESS) {
+            throw runtime_error(string("Failed to create render pass ") + passes[step.passes.front()].name + "!");
+        }
+    }
+}
+
+void RenderGraph::createFramebuffers() {
+    for (Step &step : steps) {
+        if (step.renderPass == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        size_t attachmentCount = step.attachments.size();
+        vector<VkImageView> views(attachmentCount);
+
+        for (uint32_t variant = 0; variant < variantCount; variant++) {
+            for (size_t a = 0; a < attachmentCount; a++) {
+                const vector<VkImageView> &imageViews = images[step.attachments[a]].views;
+                views[a] = imageViews[variant % imageViews.size()];
+            }
+
+            VkFramebufferCreateInfo framebufferInfo{.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                                                    .renderPass = step.renderPass,
+                                                    .attachmentCount = static_cast<uint32_t>(attachmentCount),
+                                                    .pAttachments = views.data(),
+                                                    .width = step.extent.width,
+                                                    .height = step.extent.height,
+                                                    .layers = 1};
+
+            VkFramebuffer framebuffer;
+            if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+                throw runtime_error("Failed to create framebuffer!");
+            }
+
+            step.framebuffers.push_back(framebuffer);
+        }
+    }
+}
+
+void RenderGraph::reimportImage(RenderGraphImage image, const ImportedImage &imported) {
+    Image &graphImage = images[image];
+
+    if (imported.format != graphImage.format) {
+        throw runtime_error(string("Render graph image ") + graphImage.name + " cannot change its format!");
+    }
+
+    graphImage.extent = imported.extent;
+    graphImage.images = imported.images;
+    graphImage.views = imported.views;
+}
+
+void RenderGraph::resizeImage(RenderGraphImage image, VkExtent2D extent) { images[image].extent = extent; }
+
+void RenderGraph::recreateImages(uint64_t retireValue) {
+    RetiredResources resources{.retireValue = retireValue};
+
+    for (Step &step : steps) {
+        resources.framebuffers.insert(resources.framebuffers.end(), step.framebuffers.begin(), step.framebuffers.end());
+        step.framebuffers.clear();
+    }
+
+    for (Image &image : images) {
+        if (!image.isImported) {
+            resources.views.insert(resources.views.end(), image.views.begin(), image.views.end());
+            resources.images.insert(resources.images.end(), image.images.begin(), image.images.end());
+            image.views.clear();
+            image.images.clear();
+        }
+    }
+
+    for (MemorySlot &slot : memorySlots) {
+        resources.allocations.push_back(slot.allocation);
+    }
+
+    retired.push_back(move(resources));
+
+    variantCount = 1;
+    for (const Image &image : images) {
+        variantCount = max(variantCount, static_cast<uint32_t>(image.views.size()));
+    }
+
+    createImages();
+
+    // The images keep sharing memory like they did, since the barriers between them were generated for that.
+    for (MemorySlot &slot : memorySlots) {
+        slot.requirements = images[slot.images.front()].memoryRequirements;
+
+        for (RenderGraphImage i : slot.images) {
+            const VkMemoryRequirements &requirements = images[i].memoryRequirements;
+            slot.requirements.size = max(slot.requirements.size, requirements.size);
+            slot.requirements.alignment = max(slot.requirements.alignment, requirements.alignment);
+            slot.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        }
+
+        if (slot.requirements.memoryTypeBits == 0) {
+            throw runtime_error("Render graph images sharing memory have no memory type in common anymore!");
+        }
+    }
+
+    allocateMemory();
+
+    for (Step &step : steps) {
+        if (step.renderPass == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        step.extent = images[step.attachments.front()].extent;
+        step.renderArea = step.extent;
+
+        for (RenderGraphImage attachment : step.attachments) {
+            if (images[attachment].extent.width != step.extent.width || images[attachment].extent.height != step.extent.height) {
+                throw runtime_error(string("Render graph image ") + images[attachment].name + " was resized apart from its render pass!");
+            }
+        }
+    }
+
+    createFramebuffers();
+}
+
+void RenderGraph::retire(uint64_t completedValue) {
+    while (!retired.empty() && retired.front().retireValue <= completedValue) {
+        destroyRetired(retired.front());
+        retired.pop_front();
+    }
+}
+
+void RenderGraph::destroyRetired(const RetiredResources &resources) {
+    for (VkFramebuffer framebuffer : resources.framebuffers) {
+        vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+    }
+
+    for (VkImageView view : resources.views) {
+        vkDestroyImageView(logicalDevice, view, nullptr);
+    }
+
+    for (VkImage vulkanImage : resources.images) {
+        vkDestroyImage(logicalDevice, vulkanImage, nullptr);
+    }
+
+    for (DeviceAllocation allocation : resources.allocations) {
+        memoryAllocator->free(allocation);
+    }
+}
+
+void RenderGraph::destroy() {
+    for (const RetiredResources &resources : retired) {
+        destroyRetired(resources);
+    }
+
+    retired.clear();
+
+    for (Step &step : steps) {
+        for (VkFramebuffer framebuffer : step.framebuffers) {
+            vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+        }
+
+        vkDestroyRenderPass(logicalDevice, step.renderPass, nullptr);
+    }
+
+    for (Image &image : images) {
+        if (image.isImported) {
+            continue;
+        }
+
+        for (VkImageView view : image.views) {
+            vkDestroyImageView(logicalDevice, view, nullptr);
+        }
+
+        for (VkImage vulkanImage : image.images) {
+            vkDestroyImage(logicalDevice, vulkanImage, nullptr);
+        }
+    }
+
+    for (MemorySlot &slot : memorySlots) {
+        memoryAllocator->free(slot.allocation);
+    }
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t variant, GpuProfiler &profiler) {
+    for (const Step &step : steps) {
+        const Pass &firstPass = passes[step.passes.front()];
+        GpuZone zone(profiler, commandBuffer, firstPass.name);
+
+        recordBarriers(commandBuffer, step.barriers, variant);
+
+        if (step.renderPass == VK_NULL_HANDLE) {
+            firstPass.record({.commandBuffer = commandBuffer, .renderPass = VK_NULL_HANDLE, .subpass = 0, .framebuffer = VK_NULL_HANDLE});
+            continue;
+        }
+
+        VkFramebuffer framebuffer = step.framebuffers[variant % step.framebuffers.size()];
+        VkRenderPassBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                                        .renderPass = step.renderPass,
+                                        .framebuffer = framebuffer,
+                                        .renderArea = {.offset = {0, 0}, .extent = step.renderArea},
+                                        .clearValueCount = static_cast<uint32_t>(step.clearValues.size()),
+                                        .pClearValues = step.clearValues.data()};
+
+        for (uint32_t s = 0; s < step.passes.size(); s++) {
+            const Pass &pass = passes[step.passes[s]];
+            VkSubpassContents contents = pass.usesSecondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+
+            if (s == 0) {
+                vkCmdBeginRenderPass(commandBuffer, &beginInfo, contents);
+            } else {
+                vkCmdNextSubpass(commandBuffer, contents);
+            }
+
+            pass.record({.commandBuffer = commandBuffer,
+                         .renderPass = step.renderPass,
+                         .subpass = s,
+                         .framebuffer = framebuffer,
+                         .renderArea = beginInfo.renderArea});
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    recordBarriers(commandBuffer, finalBarriers, variant);
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const vector<Barrier> &barriers, uint32_t variant) {
+    if (barriers.empty()) {
+        return;
+    }
+
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    VkMemoryBarrier aliasingBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    imageBarriers.clear();
+
+    for (const Barrier &barrier : barriers) {
+        const Image &image = images[barrier.image];
+        srcStages |= barrier.srcStages;
+        dstStages |= barrier.dstStages;
+
+        if (barrier.isAliased) {
+            aliasingBarrier.srcAccessMask |= barrier.srcAccess;
+            aliasingBarrier.dstAccessMask |= barrier.dstAccess;
+        }
+
+        imageBarriers.push_back({.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                 .srcAccessMask = barrier.srcAccess,
+                                 .dstAccessMask = barrier.dstAccess,
+                                 .oldLayout = barrier.oldLayout,
+                                 .newLayout = barrier.newLayout,
+                                 .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                 .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                 .image = image.images[variant % image.images.size()],
+                                 .subresourceRange = {.aspectMask = aspectMask(image.format),
+                                                      .baseMipLevel = 0,
+                                                      .levelCount = VK_REMAINING_MIP_LEVELS,
+                                                      .baseArrayLayer = 0,
+                                                      .layerCount = VK_REMAINING_ARRAY_LAYERS}});
+    }
+
+    uint32_t memoryBarrierCount = aliasingBarrier.srcAccessMask != 0 ? 1 : 0;
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, memoryBarrierCount, &aliasingBarrier, 0, nullptr,
+                         static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void RenderGraph::setRenderArea(RenderGraphPass pass, VkExtent2D extent) {
+    Step &step = steps[passes[pass].step];
+    step.renderArea = {min(extent.width, step.extent.width), min(extent.height, step.extent.height)};
+}
+
+VkRenderPass RenderGraph::renderPass(RenderGraphPass pass) const { return steps[passes[pass].step].renderPass; }
+
+void RenderGraph::printStats(ostream &out) const {
+    size_t synchronizationCount = finalBarriers.size();
+    for (const Step &step : steps) {
+        synchronizationCount += step.barriers.size() + step.dependencies.size();
+    }
+
+    VkDeviceSize imageBytes = 0;
+    for (const Image &image : images) {
+        if (!image.isImported && image.firstStep != NO_STEP) {
+            imageBytes += image.memoryRequirements.size;
+        }
+    }
+
+    VkDeviceSize slotBytes = 0;
+    for (const MemorySlot &slot : memorySlots) {
+        slotBytes += slot.requirements.size;
+    }
+
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << fixed << setprecision(2);
+
+    out << "Render graph: " << passes.size() - culledPassCount << " passes in " << steps.size() << " steps, " << culledPassCount
+        << " culled, " << synchronizationCount << " barriers and dependencies, " << toMebibytes(slotBytes) << " MiB for "
+        << toMebibytes(imageBytes) << " MiB of transient images\n";
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "DeviceMemoryAllocator.h"
+#include "GpuProfiler.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+// Indices of the images and passes of a RenderGraph.
+typedef uint32_t RenderGraphImage;
+typedef uint32_t RenderGraphPass;
+
+enum class RenderPassType { Graphics, Compute };
+
+// How a pass uses an image, which implies the stages, accesses and layout the graph synchronizes it for. Sampled and storage
+// images are used by the fragment shader of graphics passes and by compute passes.
+enum class ImageUse { ColorAttachment, DepthAttachment, InputAttachment, Sampled, Storage };
+
+// An image the graph does not own, like the swapchain images. Every frame it starts out used by startStages in startLayout and
+// has to end up in finalLayout.
+struct ImportedImage {
+    VkFormat format;
+    VkExtent2D extent;
+    // One per variant, execute() picks the variant's.
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+    VkPipelineStageFlags startStages;
+    VkImageLayout startLayout;
+    VkImageLayout finalLayout;
+};
+
+// What a pass records into. Graphics passes record inside their subpass of renderPass and draw into renderArea.
+struct RenderPassContext {
+    VkCommandBuffer commandBuffer;
+    VkRenderPass renderPass;
+    uint32_t subpass;
+    VkFramebuffer framebuffer;
+    VkRect2D renderArea;
+};
+
+typedef std::function<void(const RenderPassContext &)> RecordPass;
+
+// The passes of a frame and the images they read and write, compiled once into render passes and barriers.
+//
+// Passes run in the order they were added, so a pass has to be added after the passes writing what it reads. compile() culls
+// the passes that neither write an imported image nor anything a kept pass reads, and merges consecutive graphics passes of
+// the same size into the subpasses of one VkRenderPass unless one samples what another renders. Between uses of an image it
+// tracks the last writers and readers, and synchronizes a use only if it writes, changes the layout or reads in a stage the
+// last write is not visible to yet. Dependencies on attachments become subpass dependencies and attachment layouts, the rest
+// become one batched vkCmdPipelineBarrier before each step. Images the graph creates only live within a frame, so images
+// whose first and last steps do not overlap share memory, and an image only used within one render pass is transient.
+// All frames in flight share these images; each frame's first use of an image waits for the previous frame's last one.
+class RenderGraph {
+  public:
+    static const uint32_t NO_STEP = UINT32_MAX;
+
+    // Created by compile(), its contents are undefined at the start of every frame.
+    RenderGraphImage createImage(const char *name, VkFormat format, VkExtent2D extent);
+    RenderGraphImage importImage(const char *name, const ImportedImage &image);
+
+    // Names also label the GPU zone of the pass's step; they have to outlive the graph.
+    RenderGraphPass addPass(const char *name, RenderPassType type, RecordPass record);
+    // Graphics passes that record their draws into secondary command buffers.
+    void useSecondaryCommandBuffers(RenderGraphPass pass);
+    // Passes that write buffers or images outside the graph, which are never culled.
+    void keep(RenderGraphPass pass);
+
+    // Attachments are bound in the order they are added. Only loads of VK_ATTACHMENT_LOAD_OP_LOAD read the previous contents.
+    void writeColor(RenderGraphPass pass, RenderGraphImage image, VkAttachmentLoadOp loadOp, VkClearColorValue clearValue = {});
+    void writeDepth(RenderGraphPass pass, RenderGraphImage image, VkAttachmentLoadOp loadOp, VkClearDepthStencilValue clearValue = {});
+    void readAttachment(RenderGraphPass pass, RenderGraphImage image);
+    void readImage(RenderGraphPass pass, RenderGraphImage image);
+    void writeStorage(RenderGraphPass pass, RenderGraphImage image);
+
+    void compile(VkDevice device, DeviceMemoryAllocator &allocator);
+    // The device has to be idle.
+    void destroy();
+
+    // Replace the images of an imported image, like those of a recreated swapchain, and the size of an image the graph creates,
+    // which take effect with recreateImages(). Formats cannot change, and attachments of a render pass have to stay the same size.
+    void reimportImage(RenderGraphImage image, const ImportedImage &imported);
+    void resizeImage(RenderGraphImage image, VkExtent2D extent);
+    // Recreates the graph's images, their memory and the framebuffers without waiting for the frames in flight. The render
+    // passes and barriers stay, and so do pipelines created with them. The old images, views and framebuffers are destroyed
+    // once retire() passes a frame value of at least retireValue, the value of the last frame that may use them.
+    void recreateImages(uint64_t retireValue);
+    // Called with the frame timeline's value once the frames up to it completed.
+    void retire(uint64_t completedValue);
+
+    // Renders the following frames of the graphics pass's render pass into the top left extent of its attachments, which is
+    // clamped to their size and covers all of them until set. Attachments are only cleared and stored within it.
+    void setRenderArea(RenderGraphPass pass, VkExtent2D extent);
+
+    // Records the frame's steps, each in a GPU zone, with the imported images of the variant.
+    void execute(VkCommandBuffer commandBuffer, uint32_t variant, GpuProfiler &profiler);
+
+    // For creating pipelines and views of the graph's images once compiled. Views change with recreateImages().
+    VkRenderPass renderPass(RenderGraphPass pass) const;
+    uint32_t subpass(RenderGraphPass pass) const { return passes[pass].subpass; }
+    VkImageView view(RenderGraphImage image) const { return images[image].views.front(); }
+
+    void printStats(std::ostream &out) const;
+
+  private:
+    struct ImageAccess {
+        RenderGraphImage image;
+        ImageUse use;
+        VkAttachmentLoadOp loadOp;
+        VkClearValue clearValue;
+    };
+
+    struct Pass {
+        const char *name;
+        RenderPassType type;
+        RecordPass record;
+        bool usesSecondaries = false;
+        bool isKept = false;
+        bool isCulled = false;
+        std::vector<ImageAccess> accesses;
+        uint32_t step = NO_STEP;
+        uint32_t subpass = 0;
+    };
+
+    struct Image {
+        const char *name;
+        VkFormat format;
+        VkExtent2D extent;
+        bool isImported = false;
+        // One per variant for imported images, a single one otherwise.
+        std::vector<VkImage> images;
+        std::vector<VkImageView> views;
+        VkPipelineStageFlags startStages = 0;
+        VkImageLayout startLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        uint32_t firstStep = NO_STEP;
+        uint32_t lastStep = NO_STEP;
+        VkImageUsageFlags usage = 0;
+        VkMemoryRequirements memoryRequirements{};
+    };
+
+    // A layout transition or memory dependency of one image. Barriers of aliased images also wait for the image that used
+    // the memory before, which an image barrier does not cover.
+    struct Barrier {
+        RenderGraphImage image;
+        VkPipelineStageFlags srcStages;
+        VkAccessFlags srcAccess;
+        VkPipelineStageFlags dstStages;
+        VkAccessFlags dstAccess;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+        bool isAliased;
+    };
+
+    // A render pass of one or more graphics passes, or a single compute pass.
+    struct Step {
+        std::vector<RenderGraphPass> passes;
+        VkExtent2D extent{};
+        VkExtent2D renderArea{};
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        std::vector<RenderGraphImage> attachments;
+        std::vector<VkAttachmentDescription> attachmentDescriptions;
+        std::vector<VkSubpassDependency> dependencies;
+        std::vector<VkClearValue> clearValues;
+        // One per variant.
+        std::vector<VkFramebuffer> framebuffers;
+        // Before the step.
+        std::vector<Barrier> barriers;
+    };
+
+    // Memory shared by transient images whose steps do not overlap, in the order of their first steps.
+    struct MemorySlot {
+        std::vector<RenderGraphImage> images;
+        VkMemoryRequirements requirements;
+        DeviceAllocation allocation;
+    };
+
+    // Replaced by recreateImages() while frames in flight may still use them.
+    struct RetiredResources {
+        uint64_t retireValue;
+        std::vector<VkFramebuffer> framebuffers;
+        std::vector<VkImageView> views;
+        std::vector<VkImage> images;
+        std::vector<DeviceAllocation> allocations;
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    DeviceMemoryAllocator *memoryAllocator = nullptr;
+
+    std::vector<Image> images;
+    std::vector<Pass> passes;
+    std::vector<Step> steps;
+    std::vector<MemorySlot> memorySlots;
+    // After the last step, into the imported images' final layouts.
+    std::vector<Barrier> finalBarriers;
+    // In the order they were retired, so the retire values only grow.
+    std::deque<RetiredResources> retired;
+    uint32_t variantCount = 1;
+    uint32_t culledPassCount = 0;
+
+    // Filled for every batch of barriers, reserved by compile().
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+
+    void addAccess(RenderGraphPass pass, RenderGraphImage image, ImageUse use, VkAttachmentLoadOp loadOp, VkClearValue clearValue);
+    void cullPasses();
+    void mergeSteps();
+    bool canMerge(const Step &step, const Pass &pass) const;
+    void findImageUsage();
+    void createImages();
+    void aliasMemory();
+    void allocateMemory();
+    void synchronize();
+    void createRenderPasses();
+    void createFramebuffers();
+    void destroyRetired(const RetiredResources &resources);
+    void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier> &barriers, uint32_t variant);
+};
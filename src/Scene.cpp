@@ -0,0 +1,374 @@
+#include "Scene.h"
+
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+// Every hierarchy level starts at a multiple of the widest SIMD group, so all builds share the layout.
+const uint32_t GROUP_SIZE = 8;
+// Slots updated by one call of the parallel for, a multiple of GROUP_SIZE.
+const uint32_t UPDATE_BATCH_SIZE = 2048;
+
+const float IDENTITY_WORLD[12] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+
+// a[0] * x + a[1] * y + a[2] * z + offset.
+static Lanes dotLanes(const Lanes *a, Lanes x, Lanes y, Lanes z, Lanes offset) {
+    return addLanes(addLanes(multiplyLanes(a[0], x), multiplyLanes(a[1], y)), addLanes(multiplyLanes(a[2], z), offset));
+}
+
+// Copies the world transforms and bounds of LANE_COUNT entities into their instances. components points at the first lane
+// of the 12 world components followed by the 4 bounds components. Lanes without a destination are skipped.
+static void storeInstances(const float *const (&components)[16], SceneInstance *const (&destinations)[LANE_COUNT]) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    // Transposes four components of four lanes at a time into a row of each of their instances.
+    for (uint32_t quad = 0; quad < LANE_COUNT; quad += 4) {
+        for (uint32_t row = 0; row < 4; row++) {
+            __m128 lane0 = _mm_load_ps(components[row * 4] + quad);
+            __m128 lane1 = _mm_load_ps(components[row * 4 + 1] + quad);
+            __m128 lane2 = _mm_load_ps(components[row * 4 + 2] + quad);
+            __m128 lane3 = _mm_load_ps(components[row * 4 + 3] + quad);
+            _MM_TRANSPOSE4_PS(lane0, lane1, lane2, lane3);
+
+            __m128 rows[4] = {lane0, lane1, lane2, lane3};
+            for (uint32_t i = 0; i < 4; i++) {
+                if (SceneInstance *instance = destinations[quad + i]) {
+                    _mm_store_ps(row < 3 ? &instance->world[row * 4] : instance->bounds, rows[i]);
+                }
+            }
+        }
+    }
+#else
+    if (SceneInstance *instance = destinations[0]) {
+        for (uint32_t i = 0; i < 12; i++) {
+            instance->world[i] = *components[i];
+        }
+        for (uint32_t i = 0; i < 4; i++) {
+            instance->bounds[i] = *components[12 + i];
+        }
+    }
+#endif
+}
+
+float SceneInstance::scale() const { return sqrt(world[0] * world[0] + world[4] * world[4] + world[8] * world[8]); }
+
+Scene::EntityChunk::EntityChunk() {
+    for (uint32_t i = 0; i < CHUNK_SIZE; i++) {
+        position[0][i] = position[1][i] = position[2][i] = 0.0f;
+        rotation[0][i] = rotation[1][i] = rotation[2][i] = 0.0f;
+        rotation[3][i] = 1.0f;
+        scale[i] = 1.0f;
+        boundsCenter[0][i] = boundsCenter[1][i] = boundsCenter[2][i] = boundsRadius[i] = 0.0f;
+
+        for (uint32_t component = 0; component < 12; component++) {
+            world[component][i] = IDENTITY_WORLD[component];
+        }
+
+        parent[i] = NO_PARENT;
+        instance[i] = NO_INSTANCE;
+        isDirty[i] = 0;
+        isWorldChanged[i] = 0;
+    }
+}
+
+uint32_t Scene::add(uint32_t parent, const LocalTransform &local) {
+    uint32_t entity = static_cast<uint32_t>(entitySlots.size());
+
+    if (parent != NO_PARENT && parent >= entity) {
+        throw runtime_error("Scene entity added below a parent that does not exist!");
+    }
+
+    // Appended for now; the next update sorts it into its level.
+    if (slotCount == chunks.size() * CHUNK_SIZE) {
+        chunks.emplace_back();
+    }
+
+    uint32_t slot = slotCount++;
+    entitySlots.push_back(slot);
+    entityParents.push_back(parent);
+    chunkOf(slot).parent[slot % CHUNK_SIZE] = parent == NO_PARENT ? NO_PARENT : entitySlots[parent];
+    setLocal(entity, local);
+
+    isLayoutDirty = true;
+
+    return entity;
+}
+
+void Scene::attachInstance(uint32_t entity, uint32_t instance, const float (&boundsCenter)[3], float boundsRadius) {
+    uint32_t slot = entitySlots[entity];
+    EntityChunk &chunk = chunkOf(slot);
+    uint32_t lane = slot % CHUNK_SIZE;
+
+    sceneInstanceCount = max(sceneInstanceCount, instance + 1);
+
+    chunk.instance[lane] = instance;
+    for (uint32_t i = 0; i < 3; i++) {
+        chunk.boundsCenter[i][lane] = boundsCenter[i];
+    }
+    chunk.boundsRadius[lane] = boundsRadius;
+    chunk.isDirty[lane] = 1;
+}
+
+void Scene::setLocal(uint32_t entity, const LocalTransform &local) {
+    uint32_t slot = entitySlots[entity];
+    EntityChunk &chunk = chunkOf(slot);
+    uint32_t lane = slot % CHUNK_SIZE;
+
+    for (uint32_t i = 0; i < 3; i++) {
+        chunk.position[i][lane] = local.position[i];
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        chunk.rotation[i][lane] = local.rotation[i];
+    }
+    chunk.scale[lane] = local.scale;
+    chunk.isDirty[lane] = 1;
+}
+
+void Scene::setRotation(uint32_t entity, const float (&rotation)[4]) {
+    uint32_t slot = entitySlots[entity];
+    EntityChunk &chunk = chunkOf(slot);
+    uint32_t lane = slot % CHUNK_SIZE;
+
+    for (uint32_t i = 0; i < 4; i++) {
+        chunk.rotation[i][lane] = rotation[i];
+    }
+    chunk.isDirty[lane] = 1;
+}
+
+void Scene::update(ThreadPool &threadPool, SceneInstance *instances) {
+    if (isLayoutDirty) {
+        sortByDepth();
+    }
+
+    changed.clear();
+
+    for (size_t level = 0; level + 1 < levelStarts.size(); level++) {
+        uint32_t levelStart = levelStarts[level];
+        uint32_t levelEnd = levelStarts[level + 1];
+        uint32_t batchCount = (levelEnd - levelStart + UPDATE_BATCH_SIZE - 1) / UPDATE_BATCH_SIZE;
+
+        if (batchChanged.size() < batchCount) {
+            batchChanged.resize(batchCount);
+        }
+
+        threadPool.parallelFor(batchCount, [&](uint32_t batch) {
+            uint32_t batchStart = levelStart + batch * UPDATE_BATCH_SIZE;
+            uint32_t batchEnd = min(levelEnd, batchStart + UPDATE_BATCH_SIZE);
+
+            for (uint32_t slot = batchStart; slot < batchEnd; slot += LANE_COUNT) {
+                updateGroup(slot, instances, batchChanged[batch]);
+            }
+        });
+
+        for (uint32_t batch = 0; batch < batchCount; batch++) {
+            changed.insert(changed.end(), batchChanged[batch].begin(), batchChanged[batch].end());
+            batchChanged[batch].clear();
+        }
+    }
+}
+
+// Counting sort of the entities by depth. Parents are always created before their children, so a single pass in creation
+// order knows the depth of every parent.
+void Scene::sortByDepth() {
+    uint32_t entityCount = static_cast<uint32_t>(entitySlots.size());
+    vector<uint32_t> depths(entityCount);
+    vector<uint32_t> levelSizes;
+
+    for (uint32_t entity = 0; entity < entityCount; entity++) {
+        uint32_t parent = entityParents[entity];
+        depths[entity] = parent == NO_PARENT ? 0 : depths[parent] + 1;
+
+        if (depths[entity] == levelSizes.size()) {
+            levelSizes.push_back(0);
+        }
+        levelSizes[depths[entity]]++;
+    }
+
+    vector<uint32_t> levelSlots(levelSizes.size());
+    uint32_t sortedSlotCount = 0;
+
+    for (size_t level = 0; level < levelSizes.size(); level++) {
+        levelSlots[level] = sortedSlotCount;
+        sortedSlotCount += (levelSizes[level] + GROUP_SIZE - 1) / GROUP_SIZE * GROUP_SIZE;
+    }
+
+    levelStarts.assign(levelSlots.begin(), levelSlots.end());
+    levelStarts.push_back(sortedSlotCount);
+
+    vector<EntityChunk> sorted((sortedSlotCount + CHUNK_SIZE - 1) / CHUNK_SIZE);
+
+    for (uint32_t entity = 0; entity < entityCount; entity++) {
+        uint32_t slot = levelSlots[depths[entity]]++;
+        const EntityChunk &from = chunkOf(entitySlots[entity]);
+        uint32_t fromLane = entitySlots[entity] % CHUNK_SIZE;
+        EntityChunk &to = sorted[slot / CHUNK_SIZE];
+        uint32_t toLane = slot % CHUNK_SIZE;
+
+        for (uint32_t i = 0; i < 3; i++) {
+            to.position[i][toLane] = from.position[i][fromLane];
+            to.boundsCenter[i][toLane] = from.boundsCenter[i][fromLane];
+        }
+        for (uint32_t i = 0; i < 4; i++) {
+            to.rotation[i][toLane] = from.rotation[i][fromLane];
+        }
+        for (uint32_t i = 0; i < 12; i++) {
+            to.world[i][toLane] = from.world[i][fromLane];
+        }
+        to.scale[toLane] = from.scale[fromLane];
+        to.boundsRadius[toLane] = from.boundsRadius[fromLane];
+        to.instance[toLane] = from.instance[fromLane];
+        to.isDirty[toLane] = from.isDirty[fromLane];
+
+        // Parents are sorted before their children, so their new slot is known already.
+        entitySlots[entity] = slot;
+        uint32_t parent = entityParents[entity];
+        to.parent[toLane] = parent == NO_PARENT ? NO_PARENT : entitySlots[parent];
+    }
+
+    chunks = move(sorted);
+    slotCount = sortedSlotCount;
+    isLayoutDirty = false;
+}
+
+void Scene::updateGroup(uint32_t firstSlot, SceneInstance *instances, vector<uint32_t> &groupChanged) {
+    EntityChunk &chunk = chunkOf(firstSlot);
+    uint32_t first = firstSlot % CHUNK_SIZE;
+
+    bool isAnyChanged = false;
+    bool isParentShared = true;
+
+    for (uint32_t i = first; i < first + LANE_COUNT; i++) {
+        uint32_t parent = chunk.parent[i];
+        bool isParentChanged = parent != NO_PARENT && chunkOf(parent).isWorldChanged[parent % CHUNK_SIZE] != 0;
+
+        chunk.isWorldChanged[i] = chunk.isDirty[i] != 0 || isParentChanged;
+        chunk.isDirty[i] = 0;
+        isAnyChanged |= chunk.isWorldChanged[i] != 0;
+        isParentShared &= parent == chunk.parent[first];
+    }
+
+    if (!isAnyChanged) {
+        return;
+    }
+
+    // Siblings usually sit next to each other, so most groups broadcast one parent instead of gathering one per lane.
+    Lanes parentWorld[12];
+
+    if (isParentShared) {
+        uint32_t parent = chunk.parent[first];
+        const float *parentRows = IDENTITY_WORLD;
+        float gathered[12];
+
+        if (parent != NO_PARENT) {
+            for (uint32_t component = 0; component < 12; component++) {
+                gathered[component] = chunkOf(parent).world[component][parent % CHUNK_SIZE];
+            }
+            parentRows = gathered;
+        }
+
+        for (uint32_t component = 0; component < 12; component++) {
+            parentWorld[component] = broadcastLanes(parentRows[component]);
+        }
+    } else {
+        alignas(32) float gathered[12][LANE_COUNT];
+
+        for (uint32_t i = 0; i < LANE_COUNT; i++) {
+            uint32_t parent = chunk.parent[first + i];
+
+            for (uint32_t component = 0; component < 12; component++) {
+                gathered[component][i] =
+                    parent == NO_PARENT ? IDENTITY_WORLD[component] : chunkOf(parent).world[component][parent % CHUNK_SIZE];
+            }
+        }
+
+        for (uint32_t component = 0; component < 12; component++) {
+            parentWorld[component] = loadLanes(gathered[component]);
+        }
+    }
+
+    // Local rotation and scale as a 3x3 matrix.
+    Lanes x = loadLanes(&chunk.rotation[0][first]);
+    Lanes y = loadLanes(&chunk.rotation[1][first]);
+    Lanes z = loadLanes(&chunk.rotation[2][first]);
+    Lanes w = loadLanes(&chunk.rotation[3][first]);
+    Lanes scale = loadLanes(&chunk.scale[first]);
+
+    Lanes twoScale = multiplyLanes(broadcastLanes(2.0f), scale);
+    Lanes xx = multiplyLanes(x, x), yy = multiplyLanes(y, y), zz = multiplyLanes(z, z);
+    Lanes xy = multiplyLanes(x, y), xz = multiplyLanes(x, z), yz = multiplyLanes(y, z);
+    Lanes wx = multiplyLanes(w, x), wy = multiplyLanes(w, y), wz = multiplyLanes(w, z);
+
+    Lanes local[3][3] = {{subtractLanes(scale, multiplyLanes(twoScale, addLanes(yy, zz))), multiplyLanes(twoScale, subtractLanes(xy, wz)),
+                          multiplyLanes(twoScale, addLanes(xz, wy))},
+                         {multiplyLanes(twoScale, addLanes(xy, wz)), subtractLanes(scale, multiplyLanes(twoScale, addLanes(xx, zz))),
+                          multiplyLanes(twoScale, subtractLanes(yz, wx))},
+                         {multiplyLanes(twoScale, subtractLanes(xz, wy)), multiplyLanes(twoScale, addLanes(yz, wx)),
+                          subtractLanes(scale, multiplyLanes(twoScale, addLanes(xx, yy)))}};
+    Lanes position[3] = {loadLanes(&chunk.position[0][first]), loadLanes(&chunk.position[1][first]), loadLanes(&chunk.position[2][first])};
+
+    // World = parent * local, both affine.
+    Lanes world[12];
+
+    for (uint32_t row = 0; row < 3; row++) {
+        const Lanes *parentRow = &parentWorld[row * 4];
+
+        for (uint32_t column = 0; column < 3; column++) {
+            world[row * 4 + column] = dotLanes(parentRow, local[0][column], local[1][column], local[2][column], broadcastLanes(0.0f));
+        }
+        world[row * 4 + 3] = dotLanes(parentRow, position[0], position[1], position[2], parentRow[3]);
+    }
+
+    // The bounding sphere's center is transformed, its radius grows by the largest axis scale.
+    Lanes center[3] = {loadLanes(&chunk.boundsCenter[0][first]), loadLanes(&chunk.boundsCenter[1][first]),
+                       loadLanes(&chunk.boundsCenter[2][first])};
+    Lanes bounds[4];
+
+    for (uint32_t row = 0; row < 3; row++) {
+        bounds[row] = dotLanes(&world[row * 4], center[0], center[1], center[2], world[row * 4 + 3]);
+    }
+
+    Lanes axisScales[3];
+    for (uint32_t column = 0; column < 3; column++) {
+        Lanes axis[3] = {world[column], world[4 + column], world[8 + column]};
+        axisScales[column] = dotLanes(axis, axis[0], axis[1], axis[2], broadcastLanes(0.0f));
+    }
+
+    Lanes largestScale = squareRootLanes(maximumLanes(axisScales[0], maximumLanes(axisScales[1], axisScales[2])));
+    bounds[3] = multiplyLanes(loadLanes(&chunk.boundsRadius[first]), largestScale);
+
+    // Unchanged lanes compute the same values again, so the whole group is stored. Only the children need the world
+    // transform, the bounds only go to the instances.
+    alignas(32) float worldBounds[4][LANE_COUNT];
+
+    for (uint32_t component = 0; component < 12; component++) {
+        storeLanes(&chunk.world[component][first], world[component]);
+    }
+    for (uint32_t component = 0; component < 4; component++) {
+        storeLanes(worldBounds[component], bounds[component]);
+    }
+
+    SceneInstance *destinations[LANE_COUNT];
+
+    for (uint32_t i = 0; i < LANE_COUNT; i++) {
+        uint32_t instance = chunk.instance[first + i];
+        bool isWritten = chunk.isWorldChanged[first + i] != 0 && instance != NO_INSTANCE;
+
+        destinations[i] = isWritten ? &instances[instance] : nullptr;
+        if (isWritten) {
+            groupChanged.push_back(instance);
+        }
+    }
+
+    const float *components[16];
+    for (uint32_t component = 0; component < 12; component++) {
+        components[component] = &chunk.world[component][first];
+    }
+    for (uint32_t component = 0; component < 4; component++) {
+        components[12 + component] = worldBounds[component];
+    }
+
+    storeInstances(components, destinations);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <vector>
+
+// Per-instance data in the scene's storage buffer; the layout matches the Instance struct in shader.vert and cull.comp.
+struct alignas(16) SceneInstance {
+    // The rows of the world transform's upper 3x4.
+    float world[12];
+    // xyz: world space bounding sphere center, w: radius.
+    float bounds[4];
+
+    // Length of the first basis vector, which is the world scale as long as every scale in the hierarchy is uniform.
+    float scale() const;
+};
+
+struct LocalTransform {
+    float position[3] = {0.0f, 0.0f, 0.0f};
+    // Unit quaternion, xyzw.
+    float rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    float scale = 1.0f;
+};
+
+// Transform hierarchy of the scene's entities, computing the world transforms of the entities that changed once a frame.
+//
+// Entities are stored as structure of arrays in cache line aligned chunks, sorted by their depth in the hierarchy with
+// every level starting at a multiple of the SIMD width. A single linear pass therefore always sees the parents before their
+// children and never a parent and its child in the same SIMD group, and computes the world transforms of 8 (AVX2), 4 (SSE)
+// or 1 entities at a time. The groups of a level only read the levels before it, so every level is split into batches that
+// run in parallel on the thread pool. Entities whose local transform or parent changed write their world transform and bounds
+// straight into their instance in the caller's array, and only those instances are reported. Adding entities re-sorts the
+// hierarchy on the next update, so spawn them in bulk.
+class Scene {
+  public:
+    static const uint32_t NO_PARENT = UINT32_MAX;
+    static const uint32_t NO_INSTANCE = UINT32_MAX;
+
+    // parent has to be an existing entity or NO_PARENT. Returns the entity, entities are numbered from 0 in creation order.
+    uint32_t add(uint32_t parent, const LocalTransform &local);
+    // The entity writes its world transform and bounds into the instance. boundsCenter and boundsRadius are in the entity's
+    // space.
+    void attachInstance(uint32_t entity, uint32_t instance, const float (&boundsCenter)[3], float boundsRadius);
+
+    void setLocal(uint32_t entity, const LocalTransform &local);
+    void setRotation(uint32_t entity, const float (&rotation)[4]);
+
+    // Recomputes the world transforms of the entities that changed since the last update and of their descendants, and writes
+    // them into instances, which has room for instanceCount() of them. Instances without an entity are never written.
+    void update(ThreadPool &threadPool, SceneInstance *instances);
+
+    // One more than the highest instance attached.
+    uint32_t instanceCount() const { return sceneInstanceCount; }
+    // The instances the last update() wrote, in no particular order.
+    const std::vector<uint32_t> &changedInstances() const { return changed; }
+
+  private:
+    static const uint32_t CHUNK_SIZE = 16;
+
+    // CHUNK_SIZE entities, one cache line per float component.
+    struct alignas(64) EntityChunk {
+        float position[3][CHUNK_SIZE];
+        float rotation[4][CHUNK_SIZE];
+        float scale[CHUNK_SIZE];
+        float boundsCenter[3][CHUNK_SIZE];
+        float boundsRadius[CHUNK_SIZE];
+        // Rows of the upper 3x4.
+        float world[12][CHUNK_SIZE];
+        // Slot of the parent, NO_PARENT for roots and unused slots.
+        uint32_t parent[CHUNK_SIZE];
+        uint32_t instance[CHUNK_SIZE];
+        uint8_t isDirty[CHUNK_SIZE];
+        uint8_t isWorldChanged[CHUNK_SIZE];
+
+        EntityChunk();
+    };
+
+    std::vector<EntityChunk> chunks;
+    uint32_t slotCount = 0;
+    // Indexed by entity.
+    std::vector<uint32_t> entitySlots;
+    std::vector<uint32_t> entityParents;
+    bool isLayoutDirty = false;
+    // The first slot of every level of the hierarchy, then the end of the last one.
+    std::vector<uint32_t> levelStarts;
+
+    uint32_t sceneInstanceCount = 0;
+    std::vector<uint32_t> changed;
+    // The instances every batch of a level wrote, appended to changed once the level is done.
+    std::vector<std::vector<uint32_t>> batchChanged;
+
+    EntityChunk &chunkOf(uint32_t slot) { return chunks[slot / CHUNK_SIZE]; }
+    void sortByDepth();
+    void updateGroup(uint32_t firstSlot, SceneInstance *instances, std::vector<uint32_t> &groupChanged);
+};
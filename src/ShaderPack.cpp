@@ -0,0 +1,111 @@
+#include "ShaderPack.h"
+
+#include "ShaderPackFormat.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+void ShaderPack::open(const string &path) {
+    file.open(path);
+
+    try {
+        validate();
+    } catch (...) {
+        file.close();
+        throw;
+    }
+
+    ShaderPackHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+
+    // The mapping is page aligned and the index directly follows the header, so the entries can be read in place.
+    entries = reinterpret_cast<const ShaderPackEntry *>(file.data() + sizeof(ShaderPackHeader));
+    shaderCount = header.shaderCount;
+}
+
+void ShaderPack::close() {
+    file.close();
+    entries = nullptr;
+    shaderCount = 0;
+}
+
+// Checks everything find() relies on, so lookups never have to.
+void ShaderPack::validate() const {
+    const char *data = file.data();
+    size_t size = file.size();
+    const string &filePath = file.path();
+    ShaderPackHeader header;
+
+    if (size < sizeof(header)) {
+        throw runtime_error("Truncated shader pack: " + filePath);
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != SHADER_PACK_MAGIC || header.version != SHADER_PACK_VERSION) {
+        throw runtime_error("Unknown shader pack format: " + filePath);
+    }
+
+    if ((size - sizeof(header)) / sizeof(ShaderPackEntry) < header.shaderCount) {
+        throw runtime_error("Truncated shader pack index: " + filePath);
+    }
+
+    const char *previousName = "";
+
+    for (uint32_t i = 0; i < header.shaderCount; i++) {
+        ShaderPackEntry entry;
+        memcpy(&entry, data + sizeof(header) + i * sizeof(ShaderPackEntry), sizeof(entry));
+
+        const char *name = data + sizeof(header) + i * sizeof(ShaderPackEntry) + offsetof(ShaderPackEntry, name);
+
+        bool isValid = entry.name[SHADER_PACK_MAX_NAME_LENGTH] == '\0' && (i == 0 || strcmp(previousName, name) < 0) &&
+                       entry.offset % SHADER_PACK_ALIGNMENT == 0 && entry.size >= sizeof(uint32_t) && entry.size % sizeof(uint32_t) == 0 &&
+                       entry.offset <= size && entry.size <= size - entry.offset;
+
+        uint32_t firstWord = 0;
+        if (isValid) {
+            memcpy(&firstWord, data + entry.offset, sizeof(firstWord));
+        }
+
+        if (!isValid || firstWord != SPIRV_MAGIC) {
+            throw runtime_error("Invalid shader pack entry " + to_string(i) + ": " + filePath);
+        }
+
+        previousName = name;
+    }
+}
+
+span<const uint32_t> ShaderPack::find(const string &name) const {
+    const ShaderPackEntry *end = entries + shaderCount;
+    const ShaderPackEntry *entry = lower_bound(entries, end, name, [](const ShaderPackEntry &element, const string &key) {
+        return strcmp(element.name, key.c_str()) < 0;
+    });
+
+    if (entry == end || name != entry->name) {
+        return {};
+    }
+
+    return {reinterpret_cast<const uint32_t *>(file.data() + entry->offset), entry->size / sizeof(uint32_t)};
+}
+
+VkShaderModule ShaderPack::createShaderModule(VkDevice device, const string &name) const {
+    span<const uint32_t> code = find(name);
+
+    if (code.empty()) {
+        throw runtime_error("Shader " + name + " is missing from the shader pack " + file.path());
+    }
+
+    VkShaderModuleCreateInfo createInfo{
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = code.size_bytes(), .pCode = code.data()};
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+        throw runtime_error("Failed to create shader module " + name + "!");
+    }
+
+    return shaderModule;
+}
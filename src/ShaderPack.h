@@ -0,0 +1,35 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+struct ShaderPackEntry;
+
+// Read-only memory mapping of the shader pack built by add_shader_pack() in CMakeLists.txt.
+//
+// Opening the pack validates its index once; shader modules are then created straight from the mapped words, so shader
+// bytecode is never read into or copied on the heap. Modules do not reference the pack after creation, so it can be closed
+// as soon as they exist. find() and createShaderModule() may be called from any thread while the pack is open.
+class ShaderPack {
+  public:
+    // Throws when the file is missing or not a valid shader pack.
+    void open(const std::string &path);
+    void close();
+
+    // The shader's SPIR-V words, empty when the pack has no shader of that name.
+    std::span<const uint32_t> find(const std::string &name) const;
+
+    VkShaderModule createShaderModule(VkDevice device, const std::string &name) const;
+
+  private:
+    MappedFile file;
+    const ShaderPackEntry *entries = nullptr;
+    uint32_t shaderCount = 0;
+
+    void validate() const;
+};
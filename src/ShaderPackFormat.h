@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+// Layout of the shader pack written by tools/shader_packer.cpp at build time and mapped by ShaderPack at runtime.
+//
+// A header, the index of shaderCount entries sorted by name, then the SPIR-V blobs. Every blob starts at a multiple of
+// SHADER_PACK_ALIGNMENT from the start of the file, so its words can be handed to vkCreateShaderModule straight from a
+// mapping of the file. All fields are little-endian, like SPIR-V on every platform Vitamin targets.
+const uint32_t SHADER_PACK_MAGIC = 0x4b505456; // "VTPK"
+const uint32_t SHADER_PACK_VERSION = 1;
+const uint64_t SHADER_PACK_ALIGNMENT = 16;
+const uint32_t SHADER_PACK_MAX_NAME_LENGTH = 47;
+const uint32_t SPIRV_MAGIC = 0x07230203;
+
+// Set when the packer removed the debug instructions from the shaders.
+const uint32_t SHADER_PACK_STRIPPED_BIT = 1;
+
+struct ShaderPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t shaderCount;
+    uint32_t flags;
+};
+
+struct ShaderPackEntry {
+    // The shader's source file name, e.g. "shader.vert", null-terminated.
+    char name[SHADER_PACK_MAX_NAME_LENGTH + 1];
+    uint64_t offset;
+    uint64_t size;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// A group of floats processed by one instruction: 8 with AVX2, 4 with SSE and a single float otherwise, picked at compile
+// time. Loads and stores have to be aligned to the group's size.
+#if defined(__AVX2__)
+using Lanes = __m256;
+const uint32_t LANE_COUNT = 8;
+
+inline Lanes loadLanes(const float *values) { return _mm256_load_ps(values); }
+inline void storeLanes(float *values, Lanes lanes) { _mm256_store_ps(values, lanes); }
+inline Lanes broadcastLanes(float value) { return _mm256_set1_ps(value); }
+inline Lanes addLanes(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+inline Lanes subtractLanes(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+inline Lanes multiplyLanes(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+inline Lanes maximumLanes(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+inline Lanes squareRootLanes(Lanes a) { return _mm256_sqrt_ps(a); }
+// Bit i is set when a < b in lane i.
+inline uint32_t lessThanMask(Lanes a, Lanes b) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ))); }
+#elif defined(__SSE2__)
+using Lanes = __m128;
+const uint32_t LANE_COUNT = 4;
+
+inline Lanes loadLanes(const float *values) { return _mm_load_ps(values); }
+inline void storeLanes(float *values, Lanes lanes) { _mm_store_ps(values, lanes); }
+inline Lanes broadcastLanes(float value) { return _mm_set1_ps(value); }
+inline Lanes addLanes(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes subtractLanes(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes multiplyLanes(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes maximumLanes(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+inline Lanes squareRootLanes(Lanes a) { return _mm_sqrt_ps(a); }
+inline uint32_t lessThanMask(Lanes a, Lanes b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a, b))); }
+#else
+using Lanes = float;
+const uint32_t LANE_COUNT = 1;
+
+inline Lanes loadLanes(const float *values) { return *values; }
+inline void storeLanes(float *values, Lanes lanes) { *values = lanes; }
+inline Lanes broadcastLanes(float value) { return value; }
+inline Lanes addLanes(Lanes a, Lanes b) { return a + b; }
+inline Lanes subtractLanes(Lanes a, Lanes b) { return a - b; }
+inline Lanes multiplyLanes(Lanes a, Lanes b) { return a * b; }
+inline Lanes maximumLanes(Lanes a, Lanes b) { return std::max(a, b); }
+inline Lanes squareRootLanes(Lanes a) { return std::sqrt(a); }
+inline uint32_t lessThanMask(Lanes a, Lanes b) { return a < b ? 1u : 0u; }
+#endif
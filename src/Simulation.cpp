@@ -0,0 +1,173 @@
+#include "Simulation.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// Instances interpolated by one call of the parallel for.
+const uint32_t INTERPOLATION_BATCH_SIZE = 4096;
+
+void Simulation::create(Scene &simulatedScene, ThreadPool &threadPool, double tickSeconds, function<void(uint64_t)> update) {
+    scene = &simulatedScene;
+    workers = &threadPool;
+    tickDuration = tickSeconds;
+    tickUpdate = move(update);
+
+    snapshots[0].instances.assign(scene->instanceCount(), SceneInstance{});
+    scene->update(*workers, snapshots[0].instances.data());
+
+    for (SceneSnapshot &snapshot : snapshots) {
+        snapshot.time = 0.0;
+        snapshot.instances = snapshots[0].instances;
+        snapshot.changed.clear();
+    }
+
+    previous = 0;
+    latest = 1;
+    next = 2;
+    publishCount = 0;
+    tick = 0;
+    nextTickTime = tickDuration;
+    isMarked.assign(scene->instanceCount(), 0);
+}
+
+void Simulation::destroy() { wait(); }
+
+void Simulation::advance(double targetTime) {
+    wait();
+    workers->submit([this, targetTime] { simulate(targetTime); }, &job);
+}
+
+void Simulation::wait() { workers->wait(job); }
+
+void Simulation::interpolate(double time, vector<SceneInstance> &instances, vector<uint32_t> &changed, SceneInstance *upload) {
+    const SceneSnapshot &from = snapshots[previous];
+    const SceneSnapshot &to = snapshots[latest];
+
+    changed.clear();
+
+    if (instances.size() != to.instances.size()) {
+        instances = to.instances;
+        copy(instances.begin(), instances.end(), upload);
+
+        for (uint32_t i = 0; i < instances.size(); i++) {
+            changed.push_back(i);
+        }
+
+        interpolatedPublish = publishCount;
+        interpolatedAlpha = 1.0f;
+        return;
+    }
+
+    float alpha = to.time > from.time ? static_cast<float>(clamp((time - from.time) / (to.time - from.time), 0.0, 1.0)) : 1.0f;
+
+    if (interpolatedPublish == publishCount && alpha == interpolatedAlpha) {
+        return;
+    }
+
+    // The instances interpolated towards the snapshot that is the previous one now finish their motion, unless they move on.
+    if (interpolatedPublish != publishCount && interpolatedAlpha < 1.0f) {
+        for (uint32_t i : to.changed) {
+            isMarked[i] = 1;
+        }
+
+        for (uint32_t i : from.changed) {
+            if (!isMarked[i]) {
+                instances[i] = from.instances[i];
+                upload[changed.size()] = from.instances[i];
+                changed.push_back(i);
+            }
+        }
+
+        for (uint32_t i : to.changed) {
+            isMarked[i] = 0;
+        }
+    }
+
+    SceneInstance *blendedUpload = upload + changed.size();
+    changed.insert(changed.end(), to.changed.begin(), to.changed.end());
+
+    // A linear blend of the matrices, which is close to the blend of the rotations for the small steps of a tick. Every
+    // instance is written to the upload right away, so it is not read back from instances for it.
+    uint32_t blendCount = static_cast<uint32_t>(to.changed.size());
+    uint32_t batchCount = (blendCount + INTERPOLATION_BATCH_SIZE - 1) / INTERPOLATION_BATCH_SIZE;
+
+    workers->parallelFor(batchCount, [&](uint32_t batch) {
+        uint32_t end = min(blendCount, (batch + 1) * INTERPOLATION_BATCH_SIZE);
+
+        for (uint32_t j = batch * INTERPOLATION_BATCH_SIZE; j < end; j++) {
+            uint32_t i = to.changed[j];
+            const float *a = &from.instances[i].world[0];
+            const float *b = &to.instances[i].world[0];
+            SceneInstance blended;
+
+            for (uint32_t component = 0; component < 12; component++) {
+                blended.world[component] = a[component] + (b[component] - a[component]) * alpha;
+            }
+
+            for (uint32_t component = 0; component < 4; component++) {
+                float fromBounds = from.instances[i].bounds[component];
+                blended.bounds[component] = fromBounds + (to.instances[i].bounds[component] - fromBounds) * alpha;
+            }
+
+            instances[i] = blended;
+            blendedUpload[j] = blended;
+        }
+    });
+
+    interpolatedPublish = publishCount;
+    interpolatedAlpha = alpha;
+}
+
+void Simulation::simulate(double targetTime) {
+    if (targetTime - nextTickTime >= MAX_TICKS_PER_ADVANCE * tickDuration) {
+        nextTickTime = targetTime - (MAX_TICKS_PER_ADVANCE - 1) * tickDuration;
+    }
+
+    if (nextTickTime > targetTime) {
+        return;
+    }
+
+    CpuZone zone("Simulate");
+
+    SceneSnapshot &snapshot = snapshots[next];
+    snapshot.changed.clear();
+
+    while (nextTickTime <= targetTime) {
+        tickUpdate(tick);
+        scene->update(*workers, snapshot.instances.data());
+
+        for (uint32_t i : scene->changedInstances()) {
+            if (!isMarked[i]) {
+                isMarked[i] = 1;
+                snapshot.changed.push_back(i);
+            }
+        }
+
+        snapshot.time = nextTickTime;
+        tick++;
+        nextTickTime += tickDuration;
+    }
+
+    // The snapshot holds the state before the previous one, so it also takes the instances of the two newer snapshots that
+    // the ticks above did not write. The latest snapshot has them as the scene left them.
+    for (uint32_t newer : {previous, latest}) {
+        for (uint32_t i : snapshots[newer].changed) {
+            if (!isMarked[i]) {
+                snapshot.instances[i] = snapshots[latest].instances[i];
+            }
+        }
+    }
+
+    for (uint32_t i : snapshot.changed) {
+        isMarked[i] = 0;
+    }
+
+    uint32_t published = next;
+    next = previous;
+    previous = latest;
+    latest = published;
+    publishCount++;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Scene.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// The scene's instances after a simulation tick.
+struct SceneSnapshot {
+    // Simulated time of the tick in seconds.
+    double time = 0.0;
+    std::vector<SceneInstance> instances;
+    // The instances that differ from the previous snapshot.
+    std::vector<uint32_t> changed;
+};
+
+// Simulates the scene at a fixed timestep in jobs on the thread pool, overlapped with the render thread culling, recording
+// and submitting the previous state.
+//
+// A job runs the ticks due up to the time it was given and publishes their result as an immutable snapshot. Snapshots are
+// triple buffered: the render thread interpolates between the latest two while the job fills the third, so motion is
+// smooth whatever the frame rate, at the cost of up to a tick of latency. Only the instances that changed since the
+// previous snapshot are copied into a snapshot and interpolated.
+class Simulation {
+  public:
+    // Computes the initial state. update is called from a job before every tick's transform update, with the number of the
+    // tick, to change the scene's local transforms. Until destroy() the scene belongs to the simulation's jobs.
+    void create(Scene &simulatedScene, ThreadPool &threadPool, double tickSeconds, std::function<void(uint64_t)> update);
+    // Waits for the running job.
+    void destroy();
+
+    // Render thread. Starts a job simulating the ticks due up to targetTime, in seconds since create(); at most one job
+    // runs at a time. A job far behind drops ticks instead of slowing every following frame down.
+    void advance(double targetTime);
+    // Render thread. Waits for the job started by the last advance().
+    void wait();
+
+    // Render thread, once after every wait(). Writes the state at time, interpolated between the latest two snapshots,
+    // into instances, lists the instances it wrote in changed and writes them to upload in the same order, which has room
+    // for every instance. The first call writes every instance, later calls only those that moved since. The blend is
+    // split across the thread pool.
+    void interpolate(double time, std::vector<SceneInstance> &instances, std::vector<uint32_t> &changed, SceneInstance *upload);
+
+  private:
+    static const uint32_t MAX_TICKS_PER_ADVANCE = 8;
+
+    Scene *scene = nullptr;
+    ThreadPool *workers = nullptr;
+    double tickDuration = 0.0;
+    std::function<void(uint64_t)> tickUpdate;
+
+    SceneSnapshot snapshots[3];
+    // Indices into snapshots; next holds the state before previous.
+    uint32_t previous = 0;
+    uint32_t latest = 1;
+    uint32_t next = 2;
+    uint64_t publishCount = 0;
+    uint64_t tick = 0;
+    double nextTickTime = 0.0;
+    JobCounter job;
+
+    // The snapshots and alpha of the last interpolate().
+    uint64_t interpolatedPublish = 0;
+    float interpolatedAlpha = 1.0f;
+    // Per instance scratch of simulate() and interpolate(), which never run at the same time.
+    std::vector<uint8_t> isMarked;
+
+    void simulate(double targetTime);
+};
@@ -0,0 +1,35 @@
+#include "StartupTimer.h"
+
+#include "Profiler.h"
+
+#include <iomanip>
+
+using namespace std;
+
+StartupTimer::StartupTimer() : start(Profiler::now()), lastMark(start) {}
+
+void StartupTimer::mark(const char *phaseName) {
+    uint64_t now = Profiler::now();
+
+    if (Profiler::isEnabled()) {
+        Profiler::addCpuZone(phaseName, lastMark, now);
+    }
+
+    phases.push_back({.name = phaseName, .nanoseconds = now - lastMark});
+    lastMark = now;
+}
+
+void StartupTimer::printReport(ostream &out) const {
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << fixed << setprecision(3);
+
+    out << "Startup: " << (lastMark - start) / 1e6 << " ms\n";
+
+    for (const Phase &phase : phases) {
+        out << '\t' << setw(8) << phase.nanoseconds / 1e6 << " ms  " << phase.name << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
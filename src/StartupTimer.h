@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Splits startup into named phases. Each mark() ends the phase that started at the previous mark, or at construction, and
+// records it as a CPU zone as well, so the phases also show up in a trace. Phase names must be string literals.
+class StartupTimer {
+  public:
+    StartupTimer();
+
+    void mark(const char *phaseName);
+
+    void printReport(std::ostream &out) const;
+
+  private:
+    struct Phase {
+        const char *name;
+        uint64_t nanoseconds;
+    };
+
+    uint64_t start;
+    uint64_t lastMark;
+    std::vector<Phase> phases;
+};
@@ -0,0 +1,452 @@
+#include "ThreadPool.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <exception>
+#include <new>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+// Idle workers retry this often before going to sleep, which keeps the latency of short dependency chains low.
+const uint32_t IDLE_SPIN_COUNT = 64;
+const uint32_t JOBS_PER_CHUNK = 1024;
+// Jobs each deque's owner keeps for itself, moved to and from the pool half at a time.
+const uint32_t JOB_CACHE_SIZE = 64;
+
+struct Job {
+    function<void()> task;
+    JobCounter *counter;
+};
+
+// Shared by the threads running the iterations of a parallelFor().
+struct ParallelFor {
+    atomic<uint32_t> next = 0;
+    uint32_t count;
+    const void *body;
+    void (*call)(const void *body, uint32_t i);
+    std::mutex errorMutex;
+    exception_ptr firstError;
+
+    void runIterations() {
+        for (uint32_t i = next++; i < count; i = next++) {
+            try {
+                call(body, i);
+            } catch (...) {
+                lock_guard lock(errorMutex);
+                if (!firstError) {
+                    firstError = current_exception();
+                }
+            }
+        }
+    }
+};
+
+// Chase-Lev deque with the memory orders of Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models". The
+// owner pushes and pops at the bottom, any thread steals from the top. The capacity is fixed; the owner submits to the
+// injection queue while its deque is full.
+class ThreadPool::WorkQueue {
+  public:
+    // Owner only. Returns false if the deque is full.
+    bool push(Job *job) {
+        int64_t b = bottom.load(memory_order_relaxed);
+        int64_t t = top.load(memory_order_acquire);
+
+        if (b - t >= CAPACITY) {
+            return false;
+        }
+
+        slots[b & (CAPACITY - 1)].store(job, memory_order_relaxed);
+        // Instead of the paper's release fence, which publishes the job just the same.
+        bottom.store(b + 1, memory_order_release);
+
+        return true;
+    }
+
+    // Owner only. Returns the most recently pushed job.
+    Job *pop() {
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job *job = slots[b & (CAPACITY - 1)].load(memory_order_relaxed);
+
+        if (t == b) {
+            // The last job, which a thief may be taking at the same time.
+            if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+                job = nullptr;
+            }
+            bottom.store(b + 1, memory_order_relaxed);
+        }
+
+        return job;
+    }
+
+    // Any thread. Returns the oldest job, or null if the deque is empty or another thread took it first.
+    Job *steal() {
+        int64_t t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom.load(memory_order_acquire);
+
+        if (t >= b) {
+            return nullptr;
+        }
+
+        Job *job = slots[t & (CAPACITY - 1)].load(memory_order_relaxed);
+
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            return nullptr;
+        }
+
+        return job;
+    }
+
+    // Owner only.
+    void *cachedJobs[JOB_CACHE_SIZE];
+    uint32_t cachedJobCount = 0;
+
+  private:
+    static const int64_t CAPACITY = 4096;
+
+    // On separate cache lines, thieves only write top.
+    alignas(64) atomic<int64_t> top = 0;
+    alignas(64) atomic<int64_t> bottom = 0;
+    atomic<Job *> slots[CAPACITY];
+};
+
+// The pool whose deque queues[currentQueue] the current thread owns.
+static thread_local ThreadPool *currentPool = nullptr;
+static thread_local uint32_t currentQueue = 0;
+
+ThreadPool::ThreadPool() : jobPool(sizeof(Job), JOBS_PER_CHUNK) {}
+
+void ThreadPool::start(uint32_t threadCount) {
+    isStopping = false;
+
+    for (uint32_t i = 0; i <= threadCount; i++) {
+        queues.push_back(new WorkQueue());
+    }
+
+    currentPool = this;
+    currentQueue = 0;
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        workers.emplace_back([this, i] {
+            Profiler::setThreadName("Worker " + to_string(i));
+            workerLoop(i + 1);
+        });
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        lock_guard lock(sleepMutex);
+        isStopping = true;
+    }
+
+    jobAvailable.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    workers.clear();
+
+    // Jobs that were pushed by the last running jobs.
+    while (Job *job = findJob()) {
+        run(job);
+    }
+
+    runMainThreadJobs();
+
+    for (WorkQueue *queue : queues) {
+        jobPool.deallocateBatch(queue->cachedJobs, queue->cachedJobCount);
+        delete queue;
+    }
+
+    queues.clear();
+    currentPool = nullptr;
+}
+
+void ThreadPool::submit(function<void()> task, JobCounter *counter) {
+    if (counter) {
+        counter->pending.fetch_add(1, memory_order_relaxed);
+    }
+
+    push(newJob(move(task), counter));
+}
+
+void ThreadPool::submitAfter(JobCounter &dependency, function<void()> task, JobCounter *counter) {
+    if (counter) {
+        counter->pending.fetch_add(1, memory_order_relaxed);
+    }
+
+    Job *job = newJob(move(task), counter);
+
+    {
+        // finish() drops the count under the same lock, so the job is either queued here or released there.
+        lock_guard lock(dependency.mutex);
+
+        if (dependency.pending.load(memory_order_relaxed) > 0) {
+            dependency.continuations.push_back(job);
+            return;
+        }
+    }
+
+    push(job);
+}
+
+void ThreadPool::wait(JobCounter &counter) {
+    uint32_t idleCount = 0;
+
+    while (!counter.isDone()) {
+        if (Job *job = findJob()) {
+            run(job);
+            idleCount = 0;
+        } else if (idleCount < IDLE_SPIN_COUNT) {
+            this_thread::yield();
+            idleCount++;
+        } else {
+            // Sleeps like an idle worker, until a job is queued or finish() reports the counter's last job.
+            unique_lock lock(sleepMutex);
+            sleepingCount++;
+            jobAvailable.wait(lock, [this, &counter] { return queuedJobs > 0 || counter.isDone(); });
+            sleepingCount--;
+            idleCount = 0;
+        }
+    }
+
+    exception_ptr error;
+
+    {
+        // The job that finished last may still hold the lock.
+        lock_guard lock(counter.mutex);
+        error = exchange(counter.firstError, nullptr);
+    }
+
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+void ThreadPool::runParallelFor(uint32_t count, const void *body, void (*call)(const void *body, uint32_t i)) {
+    ParallelFor state;
+    state.count = count;
+    state.body = body;
+    state.call = call;
+    // Only a pointer, which std::function stores without allocating.
+    auto runIterations = [&state] { state.runIterations(); };
+
+    // Helpers that run after all iterations were claimed return right away; waiting on them keeps the state above alive.
+    JobCounter helpers;
+    uint32_t helperCount = min(threadCount(), count > 0 ? count - 1 : 0);
+    for (uint32_t i = 0; i < helperCount; i++) {
+        submit(runIterations, &helpers);
+    }
+
+    state.runIterations();
+    wait(helpers);
+
+    if (state.firstError) {
+        rethrow_exception(state.firstError);
+    }
+}
+
+void ThreadPool::submitToMainThread(function<void()> task) {
+    lock_guard lock(mainThreadMutex);
+    mainThreadTasks.push_back(move(task));
+}
+
+void ThreadPool::runMainThreadJobs() {
+    vector<function<void()>> tasks;
+
+    {
+        lock_guard lock(mainThreadMutex);
+        tasks.swap(mainThreadTasks);
+    }
+
+    for (auto &task : tasks) {
+        task();
+    }
+}
+
+uint32_t ThreadPool::defaultThreadCount() { return max(thread::hardware_concurrency(), 2u) - 1; }
+
+Job *ThreadPool::newJob(function<void()> task, JobCounter *counter) {
+    void *memory;
+
+    if (currentPool == this) {
+        WorkQueue &queue = *queues[currentQueue];
+
+        if (queue.cachedJobCount == 0) {
+            jobPool.allocateBatch(queue.cachedJobs, JOB_CACHE_SIZE / 2);
+            queue.cachedJobCount = JOB_CACHE_SIZE / 2;
+        }
+
+        memory = queue.cachedJobs[--queue.cachedJobCount];
+    } else {
+        memory = jobPool.allocate();
+    }
+
+    return new (memory) Job{.task = move(task), .counter = counter};
+}
+
+void ThreadPool::deleteJob(Job *job) {
+    job->~Job();
+
+    if (currentPool != this) {
+        jobPool.deallocate(job);
+        return;
+    }
+
+    WorkQueue &queue = *queues[currentQueue];
+
+    if (queue.cachedJobCount == JOB_CACHE_SIZE) {
+        queue.cachedJobCount -= JOB_CACHE_SIZE / 2;
+        jobPool.deallocateBatch(queue.cachedJobs + queue.cachedJobCount, JOB_CACHE_SIZE / 2);
+    }
+
+    queue.cachedJobs[queue.cachedJobCount++] = job;
+}
+
+void ThreadPool::push(Job *job) {
+    if (currentPool != this || !queues[currentQueue]->push(job)) {
+        lock_guard lock(injectionMutex);
+        injectedJobs.push_back(job);
+        injectedCount.store(static_cast<uint32_t>(injectedJobs.size()), memory_order_relaxed);
+    }
+
+    // Sequentially consistent with the sleeping workers' checks in workerLoop(), so either they see the job or this sees
+    // them sleeping.
+    queuedJobs++;
+
+    if (sleepingCount > 0) {
+        lock_guard lock(sleepMutex);
+        jobAvailable.notify_one();
+    }
+}
+
+Job *ThreadPool::findJob() {
+    Job *job = nullptr;
+    uint32_t queueCount = static_cast<uint32_t>(queues.size());
+    uint32_t ownQueue = currentPool == this ? currentQueue : queueCount;
+
+    if (ownQueue < queueCount) {
+        job = queues[ownQueue]->pop();
+    }
+
+    // Steal starting after the own deque, so thieves spread over the victims.
+    for (uint32_t i = 1; !job && i <= queueCount; i++) {
+        uint32_t victim = (ownQueue + i) % (queueCount + 1);
+        if (victim < queueCount) {
+            job = queues[victim]->steal();
+        }
+    }
+
+    if (!job && injectedCount.load(memory_order_relaxed) > 0) {
+        lock_guard lock(injectionMutex);
+
+        if (!injectedJobs.empty()) {
+            job = injectedJobs.front();
+            injectedJobs.pop_front();
+            injectedCount.store(static_cast<uint32_t>(injectedJobs.size()), memory_order_relaxed);
+        }
+    }
+
+    if (job) {
+        queuedJobs--;
+    }
+
+    return job;
+}
+
+void ThreadPool::run(Job *job) {
+    JobCounter *counter = job->counter;
+    exception_ptr error;
+
+    try {
+        job->task();
+    } catch (...) {
+        if (!counter) {
+            terminate();
+        }
+
+        error = current_exception();
+    }
+
+    deleteJob(job);
+
+    if (counter) {
+        if (error) {
+            lock_guard lock(counter->mutex);
+            if (!counter->firstError) {
+                counter->firstError = error;
+            }
+        }
+
+        finish(*counter);
+    }
+}
+
+void ThreadPool::finish(JobCounter &counter) {
+    vector<Job *> released;
+    bool isLast = false;
+
+    {
+        lock_guard lock(counter.mutex);
+
+        if (counter.pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+            released.swap(counter.continuations);
+            isLast = true;
+        }
+    }
+
+    // The counter may be gone once its lock is released.
+    if (isLast) {
+        // A waiter checks the counter under the same lock before it sleeps, so it either sees it done or gets woken.
+        lock_guard lock(sleepMutex);
+        if (sleepingCount > 0) {
+            jobAvailable.notify_all();
+        }
+    }
+
+    for (Job *job : released) {
+        push(job);
+    }
+}
+
+void ThreadPool::workerLoop(uint32_t queue) {
+    currentPool = this;
+    currentQueue = queue;
+
+    while (true) {
+        Job *job = findJob();
+
+        for (uint32_t i = 0; !job && i < IDLE_SPIN_COUNT; i++) {
+            this_thread::yield();
+            job = findJob();
+        }
+
+        if (job) {
+            run(job);
+            continue;
+        }
+
+        unique_lock lock(sleepMutex);
+        sleepingCount++;
+        jobAvailable.wait(lock, [this] { return isStopping || queuedJobs > 0; });
+        sleepingCount--;
+
+        if (isStopping && queuedJobs == 0) {
+            return;
+        }
+    }
+}
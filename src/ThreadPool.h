@@ -0,0 +1,124 @@
+#pragma once
+
+#include "PoolAllocator.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+
+// Counts unfinished jobs. Every job submitted with a counter increments it and decrements it once it returned or threw; jobs
+// submitted after a counter run once it dropped to zero. The first exception thrown by its jobs is rethrown by the wait on
+// it. A counter must outlive its jobs and continuations, so wait on it before destroying it.
+class JobCounter {
+  public:
+    bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class ThreadPool;
+
+    std::atomic<uint32_t> pending = 0;
+    std::mutex mutex;
+    // Released once pending drops to zero.
+    std::vector<Job *> continuations;
+    // Taken by the wait that rethrows it.
+    std::exception_ptr firstError;
+};
+
+// Work-stealing job scheduler shared by every subsystem.
+//
+// Each worker and the thread that started the pool own a Chase-Lev deque: they push and pop jobs at its bottom without
+// locking, while idle workers steal from the top of the others' deques, so nested jobs stay on the thread that spawned
+// them until another thread runs out of work. Other threads submit into a locked injection queue. Waiting on a counter
+// runs other jobs, so jobs may wait on the jobs they spawned; with nothing left to run, the waiter sleeps like an idle worker
+// until a job is queued or the counter is done. Jobs that have to run on the main
+// thread, like every GLFW call, are queued separately and run by runMainThreadJobs(). Jobs come from a pool, of which
+// every deque's owner caches a few, so spawning and finishing jobs stays off the heap.
+class ThreadPool {
+  public:
+    ThreadPool();
+
+    // The calling thread becomes the main thread.
+    void start(uint32_t threadCount);
+
+    // Runs the jobs that are already queued, then joins the workers.
+    void stop();
+
+    // Jobs without a counter have no one to report an exception to, so they must not throw; async() forwards exceptions.
+    void submit(std::function<void()> task, JobCounter *counter = nullptr);
+    // Submits task once dependency is done.
+    void submitAfter(JobCounter &dependency, std::function<void()> task, JobCounter *counter = nullptr);
+
+    // Runs queued jobs until counter is done, then rethrows the first exception its jobs threw. Any thread may wait.
+    void wait(JobCounter &counter);
+
+    // Runs function on a worker and returns a future of its result; exceptions are rethrown by the future's get().
+    template <typename Function> auto async(Function function) -> std::future<decltype(function())> {
+        // std::function needs a copyable task, so the packaged_task is shared with it.
+        auto task = std::make_shared<std::packaged_task<decltype(function())()>>(std::move(function));
+        std::future<decltype(function())> result = task->get_future();
+        submit([task] { (*task)(); });
+        return result;
+    }
+
+    // Calls body(i) for every i in [0, count) and returns once all calls finished. The calling thread takes part and
+    // runs other jobs while the last calls finish, so this may be nested in jobs. If any call throws, the remaining
+    // calls still run and the first exception is rethrown on the calling thread.
+    template <typename Body> void parallelFor(uint32_t count, const Body &body) {
+        // Called through a function pointer, so the body is not copied into a std::function that might allocate.
+        runParallelFor(count, &body, [](const void *context, uint32_t i) { (*static_cast<const Body *>(context))(i); });
+    }
+
+    // Queues task for the next runMainThreadJobs().
+    void submitToMainThread(std::function<void()> task);
+    // Main thread only, once per frame.
+    void runMainThreadJobs();
+
+    uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    // Worker count that leaves one hardware thread for the render thread.
+    static uint32_t defaultThreadCount();
+
+  private:
+    class WorkQueue;
+
+    PoolAllocator jobPool;
+    std::vector<std::thread> workers;
+    // Index 0 belongs to the main thread, index i + 1 to worker i.
+    std::vector<WorkQueue *> queues;
+
+    std::mutex injectionMutex;
+    PoolResource injectedJobNodes{DEQUE_NODE_SIZE, 4};
+    std::pmr::deque<Job *> injectedJobs{&injectedJobNodes};
+    // Size of injectedJobs, read without locking.
+    std::atomic<uint32_t> injectedCount = 0;
+
+    std::mutex mainThreadMutex;
+    std::vector<std::function<void()>> mainThreadTasks;
+
+    // Jobs in the deques and the injection queue, for idle workers to know when to sleep.
+    std::atomic<int64_t> queuedJobs = 0;
+    std::mutex sleepMutex;
+    std::condition_variable jobAvailable;
+    std::atomic<uint32_t> sleepingCount = 0;
+    bool isStopping = false;
+
+    Job *newJob(std::function<void()> task, JobCounter *counter);
+    void deleteJob(Job *job);
+    void runParallelFor(uint32_t count, const void *body, void (*call)(const void *body, uint32_t i));
+    void push(Job *job);
+    Job *findJob();
+    void run(Job *job);
+    void finish(JobCounter &counter);
+    void workerLoop(uint32_t queue);
+};
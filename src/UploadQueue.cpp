@@ -0,0 +1,441 @@
+#include "UploadQueue.h"
+
+#include "FrameArena.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// Staging offsets are kept at a multiple of every common texel block size, as vkCmdCopyBufferToImage requires.
+const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+static VkImageSubresourceRange subresourceRange(const VkImageSubresourceLayers &layers) {
+    return {.aspectMask = layers.aspectMask,
+            .baseMipLevel = layers.mipLevel,
+            .levelCount = 1,
+            .baseArrayLayer = layers.baseArrayLayer,
+            .layerCount = layers.layerCount};
+}
+
+void UploadQueue::create(VkDevice device, DeviceMemoryAllocator &allocator, VkQueue queue, uint32_t transferFamily, uint32_t graphicsFamily,
+                         VkDeviceSize ringSize) {
+    logicalDevice = device;
+    memoryAllocator = &allocator;
+    transferQueue = queue;
+    transferQueueFamily = transferFamily;
+    graphicsQueueFamily = graphicsFamily;
+    ringCapacity = alignUp(ringSize, STAGING_ALIGNMENT);
+
+    VkSemaphoreTypeCreateInfo typeInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                                       .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                                       .initialValue = 0};
+    VkSemaphoreCreateInfo semaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &typeInfo};
+
+    if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+        throw runtime_error("Failed to create upload timeline semaphore!");
+    }
+
+    VkBufferCreateInfo bufferInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                  .size = ringCapacity,
+                                  .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+
+    if (vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &stagingBuffer) != VK_SUCCESS) {
+        throw runtime_error("Failed to create staging buffer!");
+    }
+
+    stagingAllocation =
+        memoryAllocator->allocateForBuffer(stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+void UploadQueue::destroy() {
+    for (auto &batch : batches) {
+        vkDestroyCommandPool(logicalDevice, batch->commandPool, nullptr);
+    }
+
+    batches.clear();
+    submitted.clear();
+    freeBatches.clear();
+    pending = nullptr;
+
+    vkDestroySemaphore(logicalDevice, timeline, nullptr);
+
+    vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
+    memoryAllocator->free(stagingAllocation);
+}
+
+UploadQueue::Ticket UploadQueue::uploadToBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+                                                VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask) {
+    lock_guard lock(mutex);
+
+    // Large buffers go through the ring in chunks, so they never need more than a part of it at once.
+    VkDeviceSize maxChunkSize = max(ringCapacity / 4 / STAGING_ALIGNMENT * STAGING_ALIGNMENT, STAGING_ALIGNMENT);
+
+    for (VkDeviceSize copied = 0; copied < size;) {
+        VkDeviceSize chunkSize = min(size - copied, maxChunkSize);
+        VkDeviceSize stagingOffset = allocateStaging(chunkSize);
+
+        memcpy(static_cast<char *>(stagingAllocation.mapped) + stagingOffset, static_cast<const char *>(data) + copied, chunkSize);
+
+        pendingBatch().bufferUploads.push_back({.buffer = buffer,
+                                                .copy = {.srcOffset = stagingOffset, .dstOffset = offset + copied, .size = chunkSize},
+                                                .dstStageMask = dstStageMask,
+                                                .dstAccessMask = dstAccessMask});
+
+        copied += chunkSize;
+    }
+
+    // A full ring may have submitted the first chunks already, but the last one always goes into the pending batch.
+    return pendingBatch().ticket;
+}
+
+void UploadQueue::uploadToImage(VkImage image, const VkImageSubresourceLayers &subresource, VkExtent3D extent, const void *data,
+                                VkDeviceSize size, VkImageLayout finalLayout, VkPipelineStageFlags dstStageMask,
+                                VkAccessFlags dstAccessMask) {
+    if (alignUp(size, STAGING_ALIGNMENT) > ringCapacity) {
+        throw runtime_error("Image upload does not fit into the staging ring!");
+    }
+
+    lock_guard lock(mutex);
+
+    VkDeviceSize stagingOffset = allocateStaging(size);
+
+    memcpy(static_cast<char *>(stagingAllocation.mapped) + stagingOffset, data, size);
+
+    pendingBatch().imageUploads.push_back({.image = image,
+                                           .copy = {.bufferOffset = stagingOffset,
+                                                    .bufferRowLength = 0,
+                                                    .bufferImageHeight = 0,
+                                                    .imageSubresource = subresource,
+                                                    .imageOffset = {0, 0, 0},
+                                                    .imageExtent = extent},
+                                           .finalLayout = finalLayout,
+                                           .dstStageMask = dstStageMask,
+                                           .dstAccessMask = dstAccessMask});
+}
+
+void UploadQueue::flush() {
+    CpuZone zone("Flush uploads");
+    lock_guard lock(mutex);
+    submitPending();
+}
+
+void UploadQueue::wait(Ticket ticket) {
+    lock_guard lock(mutex);
+
+    if (pending != nullptr && pending->ticket == ticket) {
+        submitPending();
+    }
+
+    VkSemaphoreWaitInfo waitInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                                 .semaphoreCount = 1,
+                                 .pSemaphores = &timeline,
+                                 .pValues = &ticket};
+    vkWaitSemaphores(logicalDevice, &waitInfo, UINT64_MAX);
+}
+
+void UploadQueue::acquireCompleted(VkCommandBuffer commandBuffer, pmr::vector<VkSemaphore> &waitSemaphores,
+                                   pmr::vector<uint64_t> &waitValues, pmr::vector<VkPipelineStageFlags> &waitStages) {
+    lock_guard lock(mutex);
+
+    pmr::vector<VkBufferMemoryBarrier> bufferBarriers(&FrameArena::thread());
+    pmr::vector<VkImageMemoryBarrier> imageBarriers(&FrameArena::thread());
+    VkPipelineStageFlags acquireStages = 0;
+    Ticket completed = completedTicket();
+    Ticket acquired = 0;
+
+    while (!submitted.empty() && submitted.front()->ticket <= completed) {
+        UploadBatch *batch = submitted.front();
+        submitted.pop_front();
+
+        // Batches finish in submission order, so the ring space of the oldest one is always the next to come back.
+        ringUsedBytes -= batch->stagingBytes;
+        batch->stagingBytes = 0;
+
+        for (const auto &upload : batch->bufferUploads) {
+            acquireStages |= upload.dstStageMask;
+            bufferBarriers.push_back({.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                                      .srcAccessMask = 0,
+                                      .dstAccessMask = upload.dstAccessMask,
+                                      .srcQueueFamilyIndex = transferQueueFamily,
+                                      .dstQueueFamilyIndex = graphicsQueueFamily,
+                                      .buffer = upload.buffer,
+                                      .offset = upload.copy.dstOffset,
+                                      .size = upload.copy.size});
+        }
+
+        for (const auto &upload : batch->imageUploads) {
+            acquireStages |= upload.dstStageMask;
+            imageBarriers.push_back({.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                     .srcAccessMask = 0,
+                                     .dstAccessMask = upload.dstAccessMask,
+                                     .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     .newLayout = upload.finalLayout,
+                                     .srcQueueFamilyIndex = transferQueueFamily,
+                                     .dstQueueFamilyIndex = graphicsQueueFamily,
+                                     .image = upload.image,
+                                     .subresourceRange = subresourceRange(upload.copy.imageSubresource)});
+        }
+
+        // The command buffer has executed and the barriers are recorded, so the batch can take new uploads right away.
+        acquired = batch->ticket;
+        freeBatches.push_back(batch);
+    }
+
+    if (acquired == 0) {
+        return;
+    }
+
+    // The newest batch's value covers every older one.
+    waitSemaphores.push_back(timeline);
+    waitValues.push_back(acquired);
+    waitStages.push_back(acquireStages);
+    lastAcquiredTicket.store(acquired, memory_order_release);
+
+    // The barrier's source stages match the semaphore wait stages, so it is ordered after the wait.
+    if (!isSharedFamily() && (!bufferBarriers.empty() || !imageBarriers.empty())) {
+        vkCmdPipelineBarrier(commandBuffer, acquireStages, acquireStages, 0, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()),
+                             bufferBarriers.data(), static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+}
+
+UploadQueue::Ticket UploadQueue::completedTicket() const {
+    Ticket value = 0;
+    vkGetSemaphoreCounterValue(logicalDevice, timeline, &value);
+    return value;
+}
+
+VkDeviceSize UploadQueue::allocateStaging(VkDeviceSize size) {
+    size = alignUp(size, STAGING_ALIGNMENT);
+
+    VkDeviceSize offset;
+    while (!tryAllocateStaging(size, offset)) {
+        if (reclaimStaging(false) || reclaimStaging(true)) {
+            continue;
+        }
+
+        // Only the pending uploads hold the ring, so they have to be submitted before their space can come back.
+        if (pending == nullptr || pending->stagingBytes == 0) {
+            throw runtime_error("Upload does not fit into the staging ring!");
+        }
+
+        submitPending();
+    }
+
+    return offset;
+}
+
+bool UploadQueue::tryAllocateStaging(VkDeviceSize size, VkDeviceSize &offset) {
+    if (ringUsedBytes == 0) {
+        ringHead = 0;
+    } else if (ringUsedBytes == ringCapacity) {
+        return false;
+    }
+
+    VkDeviceSize tail = (ringHead + ringCapacity - ringUsedBytes) % ringCapacity;
+    VkDeviceSize consumed;
+
+    if (ringHead >= tail && size <= ringCapacity - ringHead) {
+        offset = ringHead;
+        consumed = size;
+    } else if (ringHead >= tail && size <= tail) {
+        // Skip the end of the ring; the skipped bytes come back together with this allocation.
+        offset = 0;
+        consumed = ringCapacity - ringHead + size;
+    } else if (ringHead < tail && size <= tail - ringHead) {
+        offset = ringHead;
+        consumed = size;
+    } else {
+        return false;
+    }
+
+    ringHead = (offset + size) % ringCapacity;
+    ringUsedBytes += consumed;
+    pendingBatch().stagingBytes += consumed;
+
+    return true;
+}
+
+bool UploadQueue::reclaimStaging(bool wait) {
+    auto oldest = find_if(begin(submitted), end(submitted), [](UploadBatch *batch) { return batch->stagingBytes > 0; });
+
+    if (oldest == end(submitted)) {
+        return false;
+    }
+
+    if (wait) {
+        VkSemaphoreWaitInfo waitInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                                     .semaphoreCount = 1,
+                                     .pSemaphores = &timeline,
+                                     .pValues = &(*oldest)->ticket};
+        vkWaitSemaphores(logicalDevice, &waitInfo, UINT64_MAX);
+    }
+
+    bool isReclaimed = false;
+    Ticket completed = completedTicket();
+
+    for (auto batch = oldest; batch != end(submitted) && (*batch)->ticket <= completed; ++batch) {
+        ringUsedBytes -= (*batch)->stagingBytes;
+        (*batch)->stagingBytes = 0;
+        isReclaimed = true;
+    }
+
+    return isReclaimed;
+}
+
+UploadQueue::UploadBatch &UploadQueue::pendingBatch() {
+    if (pending != nullptr) {
+        return *pending;
+    }
+
+    if (!freeBatches.empty()) {
+        pending = freeBatches.back();
+        freeBatches.pop_back();
+
+        vkResetCommandPool(logicalDevice, pending->commandPool, 0);
+        pending->bufferUploads.clear();
+        pending->imageUploads.clear();
+        pending->ticket = ++lastTicket;
+
+        return *pending;
+    }
+
+    auto batch = make_unique<UploadBatch>();
+
+    VkCommandPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                     .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                                     .queueFamilyIndex = transferQueueFamily};
+
+    if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &batch->commandPool) != VK_SUCCESS) {
+        throw runtime_error("Failed to create upload command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                                          .commandPool = batch->commandPool,
+                                          .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                          .commandBufferCount = 1};
+
+    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &batch->commandBuffer) != VK_SUCCESS) {
+        throw runtime_error("Failed to create upload batch!");
+    }
+
+    batch->ticket = ++lastTicket;
+    batches.push_back(move(batch));
+    pending = batches.back().get();
+
+    return *pending;
+}
+
+void UploadQueue::submitPending() {
+    if (pending == nullptr || (pending->bufferUploads.empty() && pending->imageUploads.empty())) {
+        return;
+    }
+
+    UploadBatch &batch = *pending;
+    pending = nullptr;
+
+    recordBatch(batch);
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                                               .signalSemaphoreValueCount = 1,
+                                               .pSignalSemaphoreValues = &batch.ticket};
+    VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                            .pNext = &timelineInfo,
+                            .commandBufferCount = 1,
+                            .pCommandBuffers = &batch.commandBuffer,
+                            .signalSemaphoreCount = 1,
+                            .pSignalSemaphores = &timeline};
+
+    if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw runtime_error("Failed to submit upload command buffer!");
+    }
+
+    submitted.push_back(&batch);
+}
+
+void UploadQueue::recordBatch(UploadBatch &batch) {
+    VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                       .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+
+    if (vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw runtime_error("Failed to begin recording upload command buffer!");
+    }
+
+    vector<VkImageMemoryBarrier> transferBarriers;
+
+    for (const auto &upload : batch.imageUploads) {
+        transferBarriers.push_back({.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                    .srcAccessMask = 0,
+                                    .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                    .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                    .image = upload.image,
+                                    .subresourceRange = subresourceRange(upload.copy.imageSubresource)});
+    }
+
+    if (!transferBarriers.empty()) {
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                             nullptr, static_cast<uint32_t>(transferBarriers.size()), transferBarriers.data());
+    }
+
+    for (const auto &upload : batch.bufferUploads) {
+        vkCmdCopyBuffer(batch.commandBuffer, stagingBuffer, upload.buffer, 1, &upload.copy);
+    }
+
+    for (const auto &upload : batch.imageUploads) {
+        vkCmdCopyBufferToImage(batch.commandBuffer, stagingBuffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &upload.copy);
+    }
+
+    // With a dedicated transfer family these barriers release ownership and their destination half lives in the acquire
+    // barriers; on a shared family they make the copies visible to the graphics stages directly.
+    uint32_t srcFamily = isSharedFamily() ? VK_QUEUE_FAMILY_IGNORED : transferQueueFamily;
+    uint32_t dstFamily = isSharedFamily() ? VK_QUEUE_FAMILY_IGNORED : graphicsQueueFamily;
+    VkPipelineStageFlags dstStages = 0;
+
+    vector<VkBufferMemoryBarrier> bufferBarriers;
+    vector<VkImageMemoryBarrier> imageBarriers;
+
+    for (const auto &upload : batch.bufferUploads) {
+        dstStages |= upload.dstStageMask;
+        bufferBarriers.push_back({.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                                  .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                  .dstAccessMask = isSharedFamily() ? upload.dstAccessMask : 0,
+                                  .srcQueueFamilyIndex = srcFamily,
+                                  .dstQueueFamilyIndex = dstFamily,
+                                  .buffer = upload.buffer,
+                                  .offset = upload.copy.dstOffset,
+                                  .size = upload.copy.size});
+    }
+
+    for (const auto &upload : batch.imageUploads) {
+        dstStages |= upload.dstStageMask;
+        imageBarriers.push_back({.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                 .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                 .dstAccessMask = isSharedFamily() ? upload.dstAccessMask : 0,
+                                 .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 .newLayout = upload.finalLayout,
+                                 .srcQueueFamilyIndex = srcFamily,
+                                 .dstQueueFamilyIndex = dstFamily,
+                                 .image = upload.image,
+                                 .subresourceRange = subresourceRange(upload.copy.imageSubresource)});
+    }
+
+    if (!isSharedFamily()) {
+        dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    }
+
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0, 0, nullptr,
+                         static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), static_cast<uint32_t>(imageBarriers.size()),
+                         imageBarriers.data());
+
+    if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS) {
+        throw runtime_error("Failed to record upload command buffer!");
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include "DeviceMemoryAllocator.h"
+#include "PoolAllocator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+// Uploads buffer and image data through a persistently mapped staging ring buffer on the transfer queue.
+//
+// Uploads are copied into the ring right away and batched until flush(), which submits all of them with a single
+// vkQueueSubmit. A batch signals the queue's timeline semaphore with its ticket, and a frame only acquires batches whose
+// value the semaphore already reached, waiting on the newest of them, so the graphics queue never waits for a transfer
+// and only pays for the acquire barriers. With a dedicated transfer family the batch releases queue family ownership and
+// the acquire barriers take it over on the graphics family; with a shared family the batch makes the data visible itself.
+class UploadQueue {
+  public:
+    // Identifies the batch an upload went into. Batches are numbered in submission order, so a ticket also covers every
+    // upload made before it. It is also the value the batch signals.
+    typedef uint64_t Ticket;
+
+    void create(VkDevice device, DeviceMemoryAllocator &allocator, VkQueue queue, uint32_t transferFamily, uint32_t graphicsFamily,
+                VkDeviceSize ringSize);
+    // The device has to be idle.
+    void destroy();
+
+    // The stage and access masks describe how the graphics queue uses the data afterwards. Blocks only when the ring is full
+    // of copies the transfer queue has not executed yet. A full ring submits the pending copies from the calling thread, so
+    // without a dedicated transfer family, where the transfer queue is the graphics queue, only the render thread may upload.
+    Ticket uploadToBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size, VkPipelineStageFlags dstStageMask,
+                          VkAccessFlags dstAccessMask);
+    // The whole upload has to fit into the ring. The subresource ends up in finalLayout.
+    void uploadToImage(VkImage image, const VkImageSubresourceLayers &subresource, VkExtent3D extent, const void *data, VkDeviceSize size,
+                       VkImageLayout finalLayout, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+
+    // Submits the uploads since the last flush to the transfer queue. Meant to be called once per frame.
+    void flush();
+    // Submits the ticket's batch if it is still pending and blocks until the transfer queue executed it.
+    void wait(Ticket ticket);
+
+    // True once a frame acquired the ticket's batch, so commands recorded after that frame's acquireCompleted() may use the data.
+    bool isAcquired(Ticket ticket) const { return ticket <= lastAcquiredTicket.load(std::memory_order_acquire); }
+
+    // Without a dedicated transfer family a full ring submits to the graphics queue, which only the render thread may do.
+    bool isUploadAllowedFromAnyThread() const { return !isSharedFamily(); }
+
+    // Records the acquire barriers of every batch the transfer queue has finished into the frame's graphics command buffer
+    // and appends the timeline value the frame's submission has to wait on. Call outside of a render pass, on the render
+    // thread, which builds the barriers in its frame arena.
+    void acquireCompleted(VkCommandBuffer commandBuffer, std::pmr::vector<VkSemaphore> &waitSemaphores,
+                          std::pmr::vector<uint64_t> &waitValues, std::pmr::vector<VkPipelineStageFlags> &waitStages);
+
+  private:
+    struct BufferUpload {
+        VkBuffer buffer;
+        VkBufferCopy copy;
+        VkPipelineStageFlags dstStageMask;
+        VkAccessFlags dstAccessMask;
+    };
+
+    struct ImageUpload {
+        VkImage image;
+        VkBufferImageCopy copy;
+        VkImageLayout finalLayout;
+        VkPipelineStageFlags dstStageMask;
+        VkAccessFlags dstAccessMask;
+    };
+
+    struct UploadBatch {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        Ticket ticket = 0;
+        // Ring bytes the batch holds until the transfer queue executed it, including space skipped when wrapping around.
+        VkDeviceSize stagingBytes = 0;
+        std::vector<BufferUpload> bufferUploads;
+        std::vector<ImageUpload> imageUploads;
+    };
+
+    VkDevice logicalDevice = VK_NULL_HANDLE;
+    DeviceMemoryAllocator *memoryAllocator = nullptr;
+    VkQueue transferQueue = VK_NULL_HANDLE;
+    uint32_t transferQueueFamily = 0;
+    uint32_t graphicsQueueFamily = 0;
+    // Reaches a batch's ticket once the transfer queue executed it.
+    VkSemaphore timeline = VK_NULL_HANDLE;
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    DeviceAllocation stagingAllocation;
+    VkDeviceSize ringCapacity = 0;
+    VkDeviceSize ringHead = 0;
+    VkDeviceSize ringUsedBytes = 0;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<UploadBatch>> batches;
+    UploadBatch *pending = nullptr;
+    // In submission order, waiting for a frame to acquire them. Pooled nodes, so batches pass through without allocating.
+    PoolResource submittedNodes{DEQUE_NODE_SIZE, 4};
+    std::pmr::deque<UploadBatch *> submitted{&submittedNodes};
+    std::vector<UploadBatch *> freeBatches;
+    Ticket lastTicket = 0;
+    std::atomic<Ticket> lastAcquiredTicket = 0;
+
+    bool isSharedFamily() const { return transferQueueFamily == graphicsQueueFamily; }
+    Ticket completedTicket() const;
+    // Returns the ring offset of `size` free bytes, submitting and waiting for earlier batches when the ring is full.
+    VkDeviceSize allocateStaging(VkDeviceSize size);
+    bool tryAllocateStaging(VkDeviceSize size, VkDeviceSize &offset);
+    // Returns the ring space of submitted batches the transfer queue has finished, oldest first. Waits for the oldest one if asked to.
+    bool reclaimStaging(bool wait);
+    UploadBatch &pendingBatch();
+    void submitPending();
+    void recordBatch(UploadBatch &batch);
+};
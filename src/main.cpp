@@ -2,18 +2,48 @@
 #include "GLFW/glfw3.h"
 #include "vulkan/vulkan_core.h"
 
+#include "AllocationCounter.h"
+#include "Benchmark.h"
+#include "BindlessDescriptors.h"
+#include "Bvh.h"
+#include "Camera.h"
+#include "CommandRecorder.h"
+#include "DeviceCapabilities.h"
+#include "DeviceMemoryAllocator.h"
+#include "DynamicResolution.h"
+#include "FrameArena.h"
+#include "FrameLimiter.h"
+#include "GpuCulling.h"
+#include "GpuProfiler.h"
+#include "LatencyTracker.h"
+#include "LodSelection.h"
+#include "MeshLoader.h"
+#include "Options.h"
+#include "PipelineCache.h"
+#include "PipelineRegistry.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "Scene.h"
+#include "ShaderPack.h"
+#include "Simulation.h"
+#include "StartupTimer.h"
+#include "ThreadPool.h"
+#include "UploadQueue.h"
+
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <fstream>
+#include <deque>
+#include <future>
 #include <iostream>
 #include <iterator>
 #include <map>
 #include <optional>
 #include <set>
 #include <stdexcept>
-#include <tuple>
 #include <vector>
 
 using namespace std;
@@ -22,7 +52,17 @@ const uint32_t WINDOW_WIDTH = 800;
 const uint32_t WINDOW_HEIGHT = 600;
 const vector<const char *> REQUIRED_VALIDATION_LAYERS = {"VK_LAYER_KHRONOS_validation"};
 const vector<const char *> REQUIRED_DEVICE_EXTENSIONS = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-const int MAX_FRAMES_IN_FLIGHT = 2;
+const uint32_t OFFSCREEN_IMAGE_COUNT = 3;
+const VkFormat OFFSCREEN_IMAGE_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+const VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+const char *const PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+const char *const SHADER_PACK_PATH = "shaders/shaders.pack";
+const VkDeviceSize STAGING_RING_SIZE = VkDeviceSize(64) << 20;
+// Animated entities per job; distinct entities touch distinct floats, so the batches need no synchronization.
+const uint32_t ANIMATION_BATCH_SIZE = 4096;
+const double SIMULATION_TICK_SECONDS = 1.0 / 60.0;
+// Retire value of a swapchain whose replacement has not presented yet.
+const uint64_t UNPRESENTED_RETIRE_VALUE = UINT64_MAX;
 
 #ifdef NDEBUG
 [[maybe_unused]] const bool ENABLE_VALIDATION_LAYERS = false;
@@ -30,118 +70,466 @@ const int MAX_FRAMES_IN_FLIGHT = 2;
 [[maybe_unused]] const bool ENABLE_VALIDATION_LAYERS = true;
 #endif
 
-static vector<char> readFile(const string &filename) {
-    ifstream file(filename, ios::ate | ios::binary);
-
-    if (!file.is_open()) {
-        throw runtime_error("Failed to open file: " + filename);
-    }
+// The camera keeps turning until it is latched right before submission, so the CPU culls against a frustum this much wider.
+const float LATE_LATCH_GUARD_BAND = 0.1f;
 
-    size_t fileSize = (size_t)file.tellg();
-    vector<char> buffer(fileSize);
+// Matches the DrawConstants block in shader.vert. The buffers are indices into the bindless storage buffers.
+struct DrawConstants {
+    float positionOffset[3];
+    float positionScale;
+    uint32_t instanceBuffer;
+    uint32_t instanceMaterialBuffer;
+    uint32_t materialBuffer;
+};
 
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
+// Matches Material in shader.vert. The texture and sampler are indices into the bindless arrays.
+struct Material {
+    float baseColor[4];
+    uint32_t texture;
+    uint32_t sampler;
+    uint32_t pad[2];
+};
 
-    file.close();
+// Matches the UpscaleConstants block in upscale.frag. The image and sampler are indices into the bindless arrays.
+struct UpscaleConstants {
+    float renderScale[2];
+    float renderMax[2];
+    uint32_t image;
+    uint32_t sampler;
+};
 
-    return buffer;
-}
+// Side of the square procedural textures the materials sample.
+const uint32_t MATERIAL_TEXTURE_SIZE = 64;
 
 class Vitamin {
   public:
+    explicit Vitamin(const Options &appOptions) : options(appOptions) {}
+
     void run() {
+        if (!options.tracePath.empty()) {
+            Profiler::enable();
+            Profiler::setThreadName("Render");
+        }
+
+        StartupTimer startup;
+
+        // For the render thread and every worker.
+        FrameArena::create(options.framesInFlight, ThreadPool::defaultThreadCount() + 1);
+        workerThreads.start(ThreadPool::defaultThreadCount());
+        // Only maps the file, the shaders are paged in when their modules are created.
+        shaderPack.open(SHADER_PACK_PATH);
+
         initWindow();
-        initVulkan();
+        startup.mark("Window");
+        initVulkan(startup);
+        startup.printReport(cout);
+
         mainLoop();
         cleanup();
     }
 
   private:
-    GLFWwindow *window;
+    struct QueueFamilyIndices {
+        optional<uint32_t> graphicsFamily;
+        optional<uint32_t> presentFamily;
+        // Only set for a family without graphics support, uploads go through the graphics queue otherwise.
+        optional<uint32_t> transferFamily;
+
+        bool isComplete(bool presentationRequired) {
+            return graphicsFamily.has_value() && (presentFamily.has_value() || !presentationRequired);
+        }
+    };
+
+    // The culling modules are only created when GPU culling is enabled, and destroyed once its pipelines are built.
+    struct ShaderModules {
+        VkShaderModule vertex = VK_NULL_HANDLE;
+        VkShaderModule fragment = VK_NULL_HANDLE;
+        VkShaderModule cull = VK_NULL_HANDLE;
+        VkShaderModule depthReduce = VK_NULL_HANDLE;
+        // Only with dynamic resolution.
+        VkShaderModule upscaleVertex = VK_NULL_HANDLE;
+        VkShaderModule upscaleFragment = VK_NULL_HANDLE;
+    };
+
+    // A swapchain replaced while frames in flight may still render into and present its images. The timeline only tells
+    // when the GPU finished a frame, not when the presentation engine finished presenting it, so the swapchain is kept
+    // until its replacement presented an image, which implies the old presents were taken up. retireValue is the value of
+    // that frame, UNPRESENTED_RETIRE_VALUE until then, and the swapchain is destroyed once the frame timeline reaches it.
+    struct RetiredSwapChain {
+        uint64_t retireValue;
+        VkSwapchainKHR swapChain;
+        vector<VkImageView> views;
+        // Waited on by the presents of its images.
+        vector<VkSemaphore> renderFinishedSemaphores;
+    };
+
+    const Options options;
+    GLFWwindow *window = nullptr;
     VkInstance instance;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    // Queried once while picking the device; the surface capabilities are queried again whenever the swapchain is recreated.
+    DeviceCapabilities deviceCapabilities;
+    QueueFamilyIndices queueFamilyIndices;
+    bool isGpuCullingEnabled = false;
     VkDevice logicalDevice;
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
     VkQueue graphicsQueue;
     VkQueue presentQueue;
-    VkSwapchainKHR swapChain;
+    VkQueue transferQueue;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    VkPresentModeKHR swapChainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
     vector<VkImage> swapChainImages;
+    DeviceMemoryAllocator memoryAllocator;
+    vector<DeviceAllocation> offscreenImageAllocations;
+    UploadQueue uploadQueue;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     vector<VkImageView> swapChainImageViews;
-    VkRenderPass renderPass;
+    // Set by the window when its framebuffer is resized, which not every platform reports as an out of date swapchain.
+    bool isFramebufferResized = false;
+    // Replaced swapchains, in the order they were retired.
+    deque<RetiredSwapChain> retiredSwapChains;
+    // The frame's passes. A single depth buffer is shared by all frames in flight; the graph serializes its use.
+    RenderGraph renderGraph;
+    RenderGraphImage swapChainTarget;
+    RenderGraphImage depthBuffer;
+    RenderGraphPass scenePass;
+    // With dynamic resolution the scene renders into the top left of sceneColor, which the upscale pass stretches over the
+    // swapchain image. Both images are allocated at the swapchain's size.
+    DynamicResolution dynamicResolution;
+    RenderGraphImage sceneColor;
+    RenderGraphPass upscalePass;
+    VkShaderModule upscaleVertShaderModule = VK_NULL_HANDLE;
+    VkShaderModule upscaleFragShaderModule = VK_NULL_HANDLE;
+    VkPipelineLayout upscalePipelineLayout = VK_NULL_HANDLE;
+    PipelineHandle upscalePipeline = nullptr;
+    VkSampler upscaleSampler = VK_NULL_HANDLE;
+    uint32_t sceneColorIndex = 0;
+    uint32_t upscaleSamplerIndex = 0;
+    ShaderPack shaderPack;
+    PipelineCache pipelineCache;
+    ThreadPool workerThreads;
+    PipelineRegistry pipelineRegistry;
+    VkShaderModule vertShaderModule;
+    VkShaderModule fragShaderModule;
+    // Set 0 of the pipeline layout, the view set is set 1.
+    BindlessDescriptors bindless;
+    VkDescriptorSetLayout viewSetLayout;
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
-    vector<VkFramebuffer> swapChainFramebuffers;
-    VkCommandPool commandPool;
-    vector<VkCommandBuffer> commandBuffers;
+    PipelineHandle graphicsPipeline;
+    CommandRecorder commandRecorder;
+    // A root entity with one child per instance, owned by the simulation's jobs once created.
+    Scene scene;
+    Simulation simulation;
+    chrono::steady_clock::time_point simulationStart;
+    double lastFrameTime = 0.0;
+    // The instances as rendered this frame, interpolated between the simulation's latest ticks, and those that changed.
+    vector<SceneInstance> frameInstances;
+    vector<uint32_t> frameChanged;
+    // Turned by dragging with the left mouse button.
+    Camera camera;
+    double cursorX = 0.0;
+    double cursorY = 0.0;
+    bool hasCursor = false;
+    // The camera when the frame's input was sampled, which the CPU culls and picks LODs with. The GPU uses the camera
+    // latched into the frame's slot of the view uniforms right before submission.
+    float frameViewProjection[16];
+    // One ViewUniforms slot per frame in flight, bound with a dynamic offset; stays mapped.
+    VkBuffer viewUniformBuffer;
+    DeviceAllocation viewUniformAllocation;
+    VkDeviceSize viewUniformStride = 0;
+    // The LOD every instance was recorded with last, for the hysteresis of the CPU recording path.
+    vector<uint32_t> instanceLods;
+    VkBuffer instanceBuffer;
+    DeviceAllocation instanceBufferAllocation;
+    uint32_t instanceBufferIndex;
+    // One slice per frame in flight holding the instances that changed that frame, copied into the instance buffer.
+    VkBuffer instanceStagingBuffer;
+    DeviceAllocation instanceStagingAllocation;
+    vector<VkBufferCopy> instanceCopies;
+    // CPU culling of the instances' bounds for the CPU recording path, built on the first frame and refit after that.
+    Bvh instanceBvh;
+    vector<Aabb> instanceBoxes;
+    vector<uint32_t> visibleInstances;
+    MeshLoader meshLoader;
+    MeshHandle sceneMesh;
+    // The LODs of the scene's submesh, read by the GPU culling pass.
+    VkBuffer lodBuffer;
+    DeviceAllocation lodBufferAllocation;
+    // Textures, samplers and materials, all referenced through the bindless set, and the material of every instance.
+    vector<VkImage> materialTextures;
+    vector<DeviceAllocation> materialTextureAllocations;
+    vector<VkImageView> materialTextureViews;
+    vector<uint32_t> materialTextureIndices;
+    vector<VkSampler> materialSamplers;
+    VkBuffer materialBuffer;
+    DeviceAllocation materialBufferAllocation;
+    uint32_t materialBufferIndex;
+    VkBuffer instanceMaterialBuffer;
+    DeviceAllocation instanceMaterialBufferAllocation;
+    uint32_t instanceMaterialBufferIndex;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet viewSet;
+    GpuCulling gpuCulling;
+    // Acquire semaphores are per frame slot, whose previous frame completed before the slot is reused. Present semaphores are
+    // per swapchain image: a present may still wait on one when its frame slot comes around again, but not once its image
+    // was acquired again.
     vector<VkSemaphore> imageAvailableSemaphores;
     vector<VkSemaphore> renderFinishedSemaphores;
-    vector<VkFence> inFlightFences;
-    vector<VkFence> imagesInFlight;
+    // Frame n's submission signals n + 1, so waiting for a frame slot or swapchain image is waiting for a value.
+    VkSemaphore frameTimeline;
+    // Per swapchain image, the value of the last frame rendering into it.
+    vector<uint64_t> imageFrameValues;
+    GpuProfiler gpuProfiler;
+    // How presents report reaching the display, picked from the device's extensions.
+    PresentTiming presentTiming = PresentTiming::None;
+    // Whether GPU and CPU timestamps can be sampled together, picked from the device's extensions.
+    bool hasCalibratedTimestamps = false;
+    FrameLimiter frameLimiter;
+    LatencyTracker latencyTracker;
     size_t currentFrame = 0;
+    uint64_t frameNumber = 0;
+    optional<Benchmark> benchmark;
+    // Heap allocations of the frames drawn after the warmup, counted with --check-allocations.
+    uint64_t frameAllocations = 0;
 
     void initWindow() {
+        if (options.headless) {
+            return;
+        }
+
         glfwInit();
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Vitamin", nullptr, nullptr);
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, [](GLFWwindow *resized, int, int) {
+            static_cast<Vitamin *>(glfwGetWindowUserPointer(resized))->isFramebufferResized = true;
+        });
     }
 
-    void initVulkan() {
+    void initVulkan(StartupTimer &startup) {
         createInstance();
-        createSurface();
+        if (!options.headless) {
+            createSurface();
+        }
+        startup.mark("Instance");
         pickAndPrintPhysicalDevices();
         createLogicalDevice();
-        createSwapChain();
+        startup.mark("Device");
+
+        // Shader modules and the pipeline cache only need the device, so they are created while the render targets are.
+        future<ShaderModules> shaderModules = createShaderModules();
+        future<void> pipelineCacheLoaded =
+            workerThreads.async([this] { pipelineCache.create(logicalDevice, deviceCapabilities.properties, PIPELINE_CACHE_PATH); });
+
+        memoryAllocator.create(physicalDevice, logicalDevice);
+        createUploadQueue();
+        // The scene's mesh streams in while the rest of the device is set up.
+        meshLoader.create(logicalDevice, memoryAllocator, uploadQueue, workerThreads);
+        sceneMesh = meshLoader.load(options.meshPath);
+        if (options.headless) {
+            createOffscreenImages();
+        } else {
+            // Picked once, so recreating the swapchain keeps the mode and its fallback is only reported at startup.
+            swapChainPresentMode = chooseSwapPresentMode(deviceCapabilities.presentModes);
+            createSwapChain();
+        }
         createImageViews();
-        createRenderPass();
-        createGraphicsPipeline();
-        createFramebuffers();
-        createCommandPool();
-        createCommandBuffers();
+        createRenderGraph();
+        dynamicResolution.create(swapChainExtent, options.targetGpuMilliseconds, options.framesInFlight);
+        startup.mark("Render targets");
+
+        pipelineCacheLoaded.get();
+        ShaderModules modules = shaderModules.get();
+        // The modules do not reference the pack, so its mapping is not needed anymore.
+        shaderPack.close();
+        const Mesh &mesh = meshLoader.wait(sceneMesh);
+        startup.mark("Wait for shaders, pipeline cache and mesh");
+
+        pipelineRegistry.create(logicalDevice, pipelineCache, workerThreads);
+        bindless.create(logicalDevice);
+        createGraphicsPipeline(modules, mesh);
+        if (dynamicResolution.isEnabled()) {
+            createUpscalePipeline(modules);
+        }
+        createCommandRecorder();
+        createGpuProfiler();
+        createScene(modules, mesh);
+        startup.mark("Scene");
+
+        // The scene has a single pipeline, so there is nothing to draw until it is compiled.
+        pipelineRegistry.wait(graphicsPipeline);
+        if (dynamicResolution.isEnabled()) {
+            pipelineRegistry.wait(upscalePipeline);
+        }
+        startup.mark("Wait for pipelines");
+        pipelineCache.printStartupReport(cout);
+        memoryAllocator.printStats(cout);
+        renderGraph.printStats(cout);
         createSyncObjects();
+        createLatencyTracking();
     }
 
     void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
-            drawFrame();
+        if (options.frameCount > 0) {
+            benchmark.emplace(options.warmupFrames, options.frameCount);
+        }
+
+        simulationStart = chrono::steady_clock::now();
+
+        while (!isDone()) {
+            Profiler::setFrame(frameNumber);
+            CpuZone zone("Frame");
+
+            if (benchmark) {
+                benchmark->beginFrame();
+            }
+
+            // Waiting for the GPU and the frame limiter come before sampling input, so neither adds to its latency.
+            waitForFrameSlot();
+            frameLimiter.waitForFrameStart();
+
+            if (!options.headless) {
+                glfwPollEvents();
+            }
+
+            latencyTracker.inputSampled(Profiler::now());
+            sampleCamera();
+            camera.viewProjection(frameViewProjection);
+            workerThreads.runMainThreadJobs();
+
+            if (isCheckingAllocations()) {
+                AllocationCounter::start();
+                drawFrame();
+                frameAllocations += AllocationCounter::stop();
+            } else {
+                drawFrame();
+            }
+
+            if (benchmark) {
+                benchmark->endFrame();
+            }
         }
 
         vkDeviceWaitIdle(logicalDevice);
+
+        for (size_t i = 0; i < options.framesInFlight; i++) {
+            collectGpuFrameTime(i);
+        }
+
+        if (benchmark) {
+            benchmark->printReport(cout);
+        }
+
+        if (!options.tracePath.empty()) {
+            gpuProfiler.exportZones();
+            Profiler::writeChromeTrace(options.tracePath);
+            cout << "Trace written to " << options.tracePath << '\n';
+        }
+
+        if (options.checkAllocations) {
+            cout << "Heap allocations while drawing frames after the warmup: " << frameAllocations << '\n';
+
+            if (frameAllocations > 0) {
+                throw runtime_error("Drawing a frame allocated from the heap!");
+            }
+        }
+    }
+
+    bool isCheckingAllocations() const { return options.checkAllocations && frameNumber >= options.warmupFrames; }
+
+    bool isDone() {
+        if (options.frameCount > 0 && frameNumber >= options.frameCount) {
+            return true;
+        }
+
+        return !options.headless && glfwWindowShouldClose(window);
     }
 
     void cleanup() {
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(logicalDevice, renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(logicalDevice, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(logicalDevice, inFlightFences[i], nullptr);
+        for (VkSemaphore semaphore : imageAvailableSemaphores) {
+            vkDestroySemaphore(logicalDevice, semaphore, nullptr);
+        }
+
+        for (VkSemaphore semaphore : renderFinishedSemaphores) {
+            vkDestroySemaphore(logicalDevice, semaphore, nullptr);
         }
 
-        vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+        vkDestroySemaphore(logicalDevice, frameTimeline, nullptr);
+
+        gpuProfiler.destroy();
 
-        for (auto framebuffer : swapChainFramebuffers) {
-            vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+        commandRecorder.destroy();
+
+        if (isGpuCullingEnabled) {
+            gpuCulling.destroy();
+            vkDestroyBuffer(logicalDevice, lodBuffer, nullptr);
+            memoryAllocator.free(lodBufferAllocation);
         }
 
-        vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
+        vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+        destroyMaterials();
+        vkDestroyBuffer(logicalDevice, viewUniformBuffer, nullptr);
+        memoryAllocator.free(viewUniformAllocation);
+        vkDestroyBuffer(logicalDevice, instanceStagingBuffer, nullptr);
+        memoryAllocator.free(instanceStagingAllocation);
+        vkDestroyBuffer(logicalDevice, instanceBuffer, nullptr);
+        memoryAllocator.free(instanceBufferAllocation);
+
+        renderGraph.destroy();
+
+        pipelineRegistry.destroy();
+        simulation.destroy();
+        meshLoader.destroy();
+        workerThreads.stop();
+        pipelineCache.save();
+        pipelineCache.destroy();
+        vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
+        vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
         vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
-        vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+
+        if (dynamicResolution.isEnabled()) {
+            vkDestroySampler(logicalDevice, upscaleSampler, nullptr);
+            vkDestroyShaderModule(logicalDevice, upscaleFragShaderModule, nullptr);
+            vkDestroyShaderModule(logicalDevice, upscaleVertShaderModule, nullptr);
+            vkDestroyPipelineLayout(logicalDevice, upscalePipelineLayout, nullptr);
+        }
+
+        vkDestroyDescriptorSetLayout(logicalDevice, viewSetLayout, nullptr);
+        bindless.destroy();
+        destroyRetiredSwapChains(UINT64_MAX);
 
         for (auto imageView : swapChainImageViews) {
             vkDestroyImageView(logicalDevice, imageView, nullptr);
         }
 
-        vkDestroySwapchainKHR(logicalDevice, swapChain, nullptr);
+        if (options.headless) {
+            for (size_t i = 0; i < swapChainImages.size(); i++) {
+                vkDestroyImage(logicalDevice, swapChainImages[i], nullptr);
+                memoryAllocator.free(offscreenImageAllocations[i]);
+            }
+        } else {
+            vkDestroySwapchainKHR(logicalDevice, swapChain, nullptr);
+        }
+
+        uploadQueue.destroy();
+        memoryAllocator.destroy();
+
         vkDestroyDevice(logicalDevice, nullptr);
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+
+        if (!options.headless) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
+
         vkDestroyInstance(instance, nullptr);
-        glfwDestroyWindow(window);
-        glfwTerminate();
+
+        if (!options.headless) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
     }
 
     void createInstance() {
@@ -150,12 +538,15 @@ class Vitamin {
                                   .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
                                   .pEngineName = "No Engine",
                                   .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-                                  .apiVersion = VK_API_VERSION_1_0};
+                                  .apiVersion = VK_API_VERSION_1_2};
 
+        // Headless rendering draws into offscreen images, so no surface extensions are needed.
         uint32_t glfwExtensionCount = 0;
-        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        const char **glfwExtensions = options.headless ? nullptr : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-        printVulkanExtensions(glfwExtensions, glfwExtensionCount);
+        if (options.verbose) {
+            printVulkanExtensions(glfwExtensions, glfwExtensionCount);
+        }
 
         VkInstanceCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
                                         .pApplicationInfo = &appInfo,
@@ -189,47 +580,43 @@ class Vitamin {
 
         cout << "Available GPUs:\n";
 
-        multimap<int32_t, tuple<VkPhysicalDevice, VkPhysicalDeviceProperties, VkPhysicalDeviceFeatures>, greater<int>> devicePreferenceMap;
+        multimap<int32_t, DeviceCapabilities, greater<int>> devicePreferenceMap;
 
         for (const auto &device : devices) {
-            VkPhysicalDeviceProperties deviceProperties;
-            vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-            VkPhysicalDeviceFeatures deviceFeatures;
-            vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
-            QueueFamilyIndices queueFamilyIndices = findQueueFamilies(device);
+            DeviceCapabilities capabilities = queryDeviceCapabilities(device, surface);
 
             int32_t score = 0;
 
-            if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+            if (capabilities.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
                 score += 1000;
             }
 
-            if (!deviceFeatures.geometryShader || !deviceFeatures.tessellationShader) {
+            if (!capabilities.features.geometryShader || !capabilities.features.tessellationShader) {
                 score = -10;
             }
-            if (!queueFamilyIndices.isComplete()) {
+            if (!findQueueFamilies(capabilities).isComplete(!options.headless)) {
                 score = -20;
             }
-            if (!checkDeviceExtensionSupport(device)) {
+            if (!capabilities.hasExtensions(requiredDeviceExtensions())) {
                 score = -30;
-            } else {
-                SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-                if (swapChainSupport.formats.empty() || swapChainSupport.presentModes.empty()) {
-                    score = -40;
-                }
+            } else if (capabilities.properties.apiVersion < VK_API_VERSION_1_2 || !capabilities.vulkan12Features.timelineSemaphore ||
+                       !hasBindlessSupport(capabilities)) {
+                // Frames and uploads are synchronized with timeline semaphores, and draws read their resources bindless.
+                score = -50;
+            } else if (!options.headless && (capabilities.surfaceFormats.empty() || capabilities.presentModes.empty())) {
+                score = -40;
             }
 
-            devicePreferenceMap.insert(make_pair(score, make_tuple(device, deviceProperties, deviceFeatures)));
+            devicePreferenceMap.emplace(score, move(capabilities));
         }
 
         bool isTopChoice = true;
-        for (const auto &[score, mapValue] : devicePreferenceMap) {
-            const auto &[device, props, features] = mapValue;
+        for (const auto &[score, capabilities] : devicePreferenceMap) {
+            const VkPhysicalDeviceProperties &props = capabilities.properties;
 
             if (score >= 0 && isTopChoice) {
-                physicalDevice = device;
+                physicalDevice = capabilities.device;
+                deviceCapabilities = capabilities;
                 cout << '*';
                 isTopChoice = false;
             }
@@ -240,13 +627,44 @@ class Vitamin {
         if (physicalDevice == VK_NULL_HANDLE) {
             throw runtime_error("Failed to find a suitable GPU!");
         }
+
+        queueFamilyIndices = findQueueFamilies(deviceCapabilities);
+        isGpuCullingEnabled = options.gpuCulling && checkGpuCullingSupport();
     }
 
-    void createLogicalDevice() {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    // The descriptor indexing features BindlessDescriptors and the shaders indexing its arrays need.
+    static bool hasBindlessSupport(const DeviceCapabilities &capabilities) {
+        const VkPhysicalDeviceVulkan12Features &features = capabilities.vulkan12Features;
+
+        return capabilities.features.shaderStorageBufferArrayDynamicIndexing && features.runtimeDescriptorArray &&
+               features.descriptorBindingPartiallyBound && features.descriptorBindingStorageBufferUpdateAfterBind &&
+               features.descriptorBindingSampledImageUpdateAfterBind && features.shaderSampledImageArrayNonUniformIndexing;
+    }
+
+    // GPU culling draws with vkCmdDrawIndexedIndirectCount from Vulkan 1.2, and every indirect draw starts at its instance.
+    bool checkGpuCullingSupport() {
+        bool isSupported = deviceCapabilities.properties.apiVersion >= VK_API_VERSION_1_2 &&
+                           deviceCapabilities.features.drawIndirectFirstInstance && deviceCapabilities.vulkan12Features.drawIndirectCount &&
+                           deviceCapabilities.properties.limits.maxDrawIndirectCount >= options.drawCount;
 
+        if (!isSupported) {
+            cout << "GPU culling needs Vulkan 1.2 with drawIndirectCount and drawIndirectFirstInstance, recording draws on the CPU\n";
+        }
+
+        return isSupported;
+    }
+
+    void createLogicalDevice() {
         vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        set<uint32_t> uniqueQueueFamilies = {queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.presentFamily.value()};
+        set<uint32_t> uniqueQueueFamilies = {queueFamilyIndices.graphicsFamily.value()};
+
+        if (!options.headless) {
+            uniqueQueueFamilies.insert(queueFamilyIndices.presentFamily.value());
+        }
+
+        if (queueFamilyIndices.transferFamily.has_value()) {
+            uniqueQueueFamilies.insert(queueFamilyIndices.transferFamily.value());
+        }
 
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -257,13 +675,51 @@ class Vitamin {
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
+        VkPhysicalDeviceFeatures deviceFeatures{.drawIndirectFirstInstance = isGpuCullingEnabled,
+                                                .shaderStorageBufferArrayDynamicIndexing = VK_TRUE};
+        VkPhysicalDeviceVulkan12Features vulkan12Features{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+                                                          .drawIndirectCount = isGpuCullingEnabled,
+                                                          .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+                                                          .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+                                                          .descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE,
+                                                          .descriptorBindingPartiallyBound = VK_TRUE,
+                                                          .runtimeDescriptorArray = VK_TRUE,
+                                                          .timelineSemaphore = VK_TRUE};
+        vector<const char *> deviceExtensions = requiredDeviceExtensions();
+
+        // Measuring input-to-present latency prefers the actual display times, then present completion.
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+                                                               .pNext = nullptr,
+                                                               .presentId = VK_TRUE};
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+                                                                   .pNext = &presentIdFeatures,
+                                                                   .presentWait = VK_TRUE};
+
+        if (options.headless) {
+            presentTiming = PresentTiming::None;
+        } else if (deviceCapabilities.hasExtensions({VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME})) {
+            presentTiming = PresentTiming::DisplayTiming;
+            deviceExtensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+        } else if (deviceCapabilities.presentIdFeatures.presentId && deviceCapabilities.presentWaitFeatures.presentWait) {
+            presentTiming = PresentTiming::PresentWait;
+            deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+            vulkan12Features.pNext = &presentWaitFeatures;
+        }
+
+        // Keeps the GPU zones of long traces in line with the CPU zones.
+        if (deviceCapabilities.hasExtensions({VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME}) &&
+            GpuProfiler::canCalibrate(instance, physicalDevice)) {
+            hasCalibratedTimestamps = true;
+            deviceExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        }
 
         VkDeviceCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+                                      .pNext = &vulkan12Features,
                                       .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
                                       .pQueueCreateInfos = queueCreateInfos.data(),
-                                      .enabledExtensionCount = static_cast<uint32_t>(REQUIRED_DEVICE_EXTENSIONS.size()),
-                                      .ppEnabledExtensionNames = REQUIRED_DEVICE_EXTENSIONS.data(),
+                                      .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
+                                      .ppEnabledExtensionNames = deviceExtensions.data(),
                                       .pEnabledFeatures = &deviceFeatures};
 
         if (ENABLE_VALIDATION_LAYERS) {
@@ -276,7 +732,28 @@ class Vitamin {
         }
 
         vkGetDeviceQueue(logicalDevice, queueFamilyIndices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(logicalDevice, queueFamilyIndices.presentFamily.value(), 0, &presentQueue);
+
+        if (!options.headless) {
+            vkGetDeviceQueue(logicalDevice, queueFamilyIndices.presentFamily.value(), 0, &presentQueue);
+        }
+
+        vkGetDeviceQueue(logicalDevice, queueFamilyIndices.transferFamily.value_or(queueFamilyIndices.graphicsFamily.value()), 0,
+                         &transferQueue);
+    }
+
+    void createUploadQueue() {
+        uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+
+        uploadQueue.create(logicalDevice, memoryAllocator, transferQueue, queueFamilyIndices.transferFamily.value_or(graphicsFamily),
+                           graphicsFamily, STAGING_RING_SIZE);
+    }
+
+    vector<const char *> requiredDeviceExtensions() {
+        if (options.headless) {
+            return {};
+        }
+
+        return REQUIRED_DEVICE_EXTENSIONS;
     }
 
     void printVulkanExtensions(const char **requiredExtensions, uint32_t requiredExtensionCount) {
@@ -314,7 +791,9 @@ class Vitamin {
         vector<VkLayerProperties> availableLayers(layerCount);
         vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
 
-        cout << "Required Vulkan validation layers:\n";
+        if (options.verbose) {
+            cout << "Required Vulkan validation layers:\n";
+        }
 
         bool isRequiredLayerMissing = false;
         for (const auto &requiredLayer : requiredValidationLayers) {
@@ -322,72 +801,54 @@ class Vitamin {
                               return strcmp(element.layerName, requiredLayer) == 0;
                           }) != end(availableLayers);
 
-            if (exists) {
-                cout << "ok";
-            } else {
+            if (!exists) {
                 isRequiredLayerMissing = true;
+                cout << "Missing Vulkan validation layer " << requiredLayer << '\n';
+            } else if (options.verbose) {
+                cout << "ok\t" << requiredLayer << '\n';
             }
-
-            cout << '\t' << requiredLayer << '\n';
         }
 
-        cout << "Available Vulkan validation layers:\n";
+        if (options.verbose) {
+            cout << "Available Vulkan validation layers:\n";
 
-        for (const auto &availableLayer : availableLayers) {
-            cout << '\t' << availableLayer.layerName << '\n';
+            for (const auto &availableLayer : availableLayers) {
+                cout << '\t' << availableLayer.layerName << '\n';
+            }
         }
 
         return !isRequiredLayerMissing;
     }
 
-    struct QueueFamilyIndices {
-        optional<uint32_t> graphicsFamily;
-        optional<uint32_t> presentFamily;
-
-        bool isComplete() { return graphicsFamily.has_value() && presentFamily.has_value(); }
-    };
-
-    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
+    QueueFamilyIndices findQueueFamilies(const DeviceCapabilities &device) {
         QueueFamilyIndices indices;
 
-        uint32_t queueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-        vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+        const vector<VkQueueFamilyProperties> &queueFamilies = device.queueFamilies;
+        uint32_t queueFamilyCount = static_cast<uint32_t>(queueFamilies.size());
 
-        int i = 0;
-        for (const auto &queueFamily : queueFamilies) {
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        for (uint32_t i = 0; i < queueFamilyCount; i++) {
+            if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
                 indices.graphicsFamily = i;
             }
 
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-            if (presentSupport) {
+            if (device.presentSupport[i]) {
                 indices.presentFamily = i;
             }
-
-            i++;
         }
 
-        return indices;
-    }
-
-    bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
-        uint32_t extensionCount;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        // Prefer a transfer-only family, which usually maps to the GPU's copy engines, over a compute family.
+        const VkQueueFlags capabilities = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+        const VkQueueFlags preferredFlags[] = {VK_QUEUE_TRANSFER_BIT, VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT};
 
-        vector<VkExtensionProperties> availableExtensions(extensionCount);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-        set<string> requiredExtensions(REQUIRED_DEVICE_EXTENSIONS.begin(), REQUIRED_DEVICE_EXTENSIONS.end());
-
-        for (const auto &extension : availableExtensions) {
-            requiredExtensions.erase(extension.extensionName);
+        for (VkQueueFlags requiredFlags : preferredFlags) {
+            for (uint32_t j = 0; j < queueFamilyCount && !indices.transferFamily.has_value(); j++) {
+                if ((queueFamilies[j].queueFlags & capabilities) == requiredFlags) {
+                    indices.transferFamily = j;
+                }
+            }
         }
 
-        return requiredExtensions.empty();
+        return indices;
     }
 
     void createSurface() {
@@ -396,36 +857,6 @@ class Vitamin {
         }
     }
 
-    struct SwapChainSupportDetails {
-        VkSurfaceCapabilitiesKHR capabilities;
-        vector<VkSurfaceFormatKHR> formats;
-        vector<VkPresentModeKHR> presentModes;
-    };
-
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
-        SwapChainSupportDetails details;
-
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
-
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
-
-        if (formatCount != 0) {
-            details.formats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
-        }
-
-        uint32_t presentModeCount;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
-
-        if (presentModeCount != 0) {
-            details.presentModes.resize(presentModeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
-        }
-
-        return details;
-    }
-
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const vector<VkSurfaceFormatKHR> &availableFormats) {
         for (const auto &availableFormat : availableFormats) {
             if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
@@ -437,10 +868,20 @@ class Vitamin {
     }
 
     VkPresentModeKHR chooseSwapPresentMode(const vector<VkPresentModeKHR> &availablePresentModes) {
-        for (const auto &availablePresentMode : availablePresentModes) {
-            if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return availablePresentMode;
-            }
+        VkPresentModeKHR requestedMode = VK_PRESENT_MODE_MAILBOX_KHR;
+
+        if (options.presentMode == PresentMode::Immediate) {
+            requestedMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        } else if (options.presentMode == PresentMode::Fifo) {
+            requestedMode = VK_PRESENT_MODE_FIFO_KHR;
+        }
+
+        if (find(begin(availablePresentModes), end(availablePresentModes), requestedMode) != end(availablePresentModes)) {
+            return requestedMode;
+        }
+
+        if (options.presentMode != PresentMode::Default) {
+            cout << "The surface does not support the requested present mode, presenting with FIFO\n";
         }
 
         return VK_PRESENT_MODE_FIFO_KHR;
@@ -463,16 +904,21 @@ class Vitamin {
     }
 
     void createSwapChain() {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+        const VkSurfaceCapabilitiesKHR &surfaceCapabilities = deviceCapabilities.surfaceCapabilities;
+
+        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(deviceCapabilities.surfaceFormats);
+        VkExtent2D extent = chooseSwapExtent(surfaceCapabilities);
 
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+        uint32_t minImageCount = options.swapchainImageCount > 0 ? options.swapchainImageCount : surfaceCapabilities.minImageCount + 1;
+        minImageCount = max(minImageCount, surfaceCapabilities.minImageCount);
 
-        uint32_t minImageCount = swapChainSupport.capabilities.minImageCount + 1;
+        if (surfaceCapabilities.maxImageCount > 0 && minImageCount > surfaceCapabilities.maxImageCount) {
+            minImageCount = surfaceCapabilities.maxImageCount;
+        }
 
-        if (swapChainSupport.capabilities.maxImageCount > 0 && minImageCount > swapChainSupport.capabilities.maxImageCount) {
-            minImageCount = swapChainSupport.capabilities.maxImageCount;
+        // Reported once, recreating the swapchain on every resize would repeat it.
+        if (options.swapchainImageCount > 0 && minImageCount != options.swapchainImageCount && swapChain == VK_NULL_HANDLE) {
+            cout << "Swapchain images clamped to the surface's limits: " << minImageCount << '\n';
         }
 
         VkSwapchainCreateInfoKHR createInfo{.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -483,19 +929,18 @@ class Vitamin {
                                             .imageExtent = extent,
                                             .imageArrayLayers = 1,
                                             .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                                            .preTransform = swapChainSupport.capabilities.currentTransform,
+                                            .preTransform = surfaceCapabilities.currentTransform,
                                             .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-                                            .presentMode = presentMode,
+                                            .presentMode = swapChainPresentMode,
                                             .clipped = VK_TRUE,
-                                            .oldSwapchain = VK_NULL_HANDLE};
+                                            .oldSwapchain = swapChain};
 
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+        uint32_t sharingFamilies[] = {queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.presentFamily.value()};
 
-        if (indices.graphicsFamily != indices.presentFamily) {
+        if (queueFamilyIndices.graphicsFamily != queueFamilyIndices.presentFamily) {
             createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
             createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+            createInfo.pQueueFamilyIndices = sharingFamilies;
         } else {
             createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
             createInfo.queueFamilyIndexCount = 0;
@@ -516,6 +961,36 @@ class Vitamin {
         swapChainExtent = extent;
     }
 
+    // Headless replacement for the swapchain: plain color attachments that are rendered into round-robin and never presented.
+    void createOffscreenImages() {
+        swapChainImageFormat = OFFSCREEN_IMAGE_FORMAT;
+        swapChainExtent = {WINDOW_WIDTH, WINDOW_HEIGHT};
+
+        swapChainImages.resize(OFFSCREEN_IMAGE_COUNT);
+        offscreenImageAllocations.resize(OFFSCREEN_IMAGE_COUNT);
+
+        for (size_t i = 0; i < OFFSCREEN_IMAGE_COUNT; i++) {
+            VkImageCreateInfo imageInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                        .imageType = VK_IMAGE_TYPE_2D,
+                                        .format = swapChainImageFormat,
+                                        .extent = {.width = swapChainExtent.width, .height = swapChainExtent.height, .depth = 1},
+                                        .mipLevels = 1,
+                                        .arrayLayers = 1,
+                                        .samples = VK_SAMPLE_COUNT_1_BIT,
+                                        .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+            if (vkCreateImage(logicalDevice, &imageInfo, nullptr, &swapChainImages[i]) != VK_SUCCESS) {
+                throw runtime_error("Failed to create offscreen image!");
+            }
+
+            offscreenImageAllocations[i] =
+                memoryAllocator.allocateForImage(swapChainImages[i], imageInfo.tiling, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+    }
+
     void createImageViews() {
         swapChainImageViews.resize(swapChainImages.size());
         for (size_t i = 0; i < swapChainImages.size(); i++) {
@@ -537,49 +1012,90 @@ class Vitamin {
         }
     }
 
-    void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("shaders/shader.vert.spv");
-        auto fragShaderCode = readFile("shaders/shader.frag.spv");
+    // Replaces the swapchain and everything sized by it without waiting for the frames in flight, which keep rendering into
+    // and presenting the old images; those are destroyed once the frames completed. The render passes and pipelines stay, the
+    // pipelines set the viewport and scissor dynamically. A minimized window has nothing to render into, so this waits until
+    // it is restored and returns false if it is closed meanwhile.
+    bool recreateSwapChain() {
+        CpuZone zone("Recreate swapchain");
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
 
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                                                            .stage = VK_SHADER_STAGE_VERTEX_BIT,
-                                                            .module = vertShaderModule,
-                                                            .pName = "main"};
+        while (width == 0 || height == 0) {
+            if (glfwWindowShouldClose(window)) {
+                return false;
+            }
 
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                                                            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-                                                            .module = fragShaderModule,
-                                                            .pName = "main"};
+            glfwWaitEvents();
+            glfwGetFramebufferSize(window, &width, &height);
+        }
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+        isFramebufferResized = false;
 
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-                                                             .vertexBindingDescriptionCount = 0,
-                                                             .pVertexBindingDescriptions = nullptr,
-                                                             .vertexAttributeDescriptionCount = 0,
-                                                             .pVertexAttributeDescriptions = nullptr};
+        if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &deviceCapabilities.surfaceCapabilities) != VK_SUCCESS) {
+            throw runtime_error("Failed to query the surface capabilities!");
+        }
 
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-                                                             .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-                                                             .primitiveRestartEnable = VK_FALSE};
+        // The last submitted frame signals frameNumber.
+        uint64_t retireValue = frameNumber;
+        VkSwapchainKHR oldSwapChain = swapChain;
 
-        VkViewport viewport{.x = 0.0f,
-                            .y = 0.0f,
-                            .width = (float)swapChainExtent.width,
-                            .height = (float)swapChainExtent.height,
-                            .minDepth = 0.0f,
-                            .maxDepth = 1.0f};
+        createSwapChain();
+        retiredSwapChains.push_back({.retireValue = UNPRESENTED_RETIRE_VALUE,
+                                     .swapChain = oldSwapChain,
+                                     .views = move(swapChainImageViews),
+                                     .renderFinishedSemaphores = move(renderFinishedSemaphores)});
+        createImageViews();
+        createRenderFinishedSemaphores();
+        imageFrameValues.assign(swapChainImages.size(), 0);
+        latencyTracker.setSwapchain(swapChain);
+
+        renderGraph.reimportImage(swapChainTarget, swapChainImport());
+        renderGraph.resizeImage(depthBuffer, swapChainExtent);
+
+        if (dynamicResolution.isEnabled()) {
+            renderGraph.resizeImage(sceneColor, swapChainExtent);
+        }
+
+        renderGraph.recreateImages(retireValue);
+
+        if (dynamicResolution.isEnabled()) {
+            bindless.remove(BindlessType::SampledImage, sceneColorIndex, retireValue);
+            sceneColorIndex = bindless.addSampledImage(renderGraph.view(sceneColor), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            dynamicResolution.resize(swapChainExtent);
+        }
+
+        if (isGpuCullingEnabled) {
+            gpuCulling.resize(renderGraph.view(depthBuffer), swapChainExtent, retireValue);
+        }
+
+        return true;
+    }
+
+    void destroyRetiredSwapChains(uint64_t completedValue) {
+        while (!retiredSwapChains.empty() && retiredSwapChains.front().retireValue <= completedValue) {
+            for (auto imageView : retiredSwapChains.front().views) {
+                vkDestroyImageView(logicalDevice, imageView, nullptr);
+            }
 
-        VkRect2D scissor{.offset = {0, 0}, .extent = swapChainExtent};
+            for (VkSemaphore semaphore : retiredSwapChains.front().renderFinishedSemaphores) {
+                vkDestroySemaphore(logicalDevice, semaphore, nullptr);
+            }
 
-        VkPipelineViewportStateCreateInfo viewportState{.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-                                                        .viewportCount = 1,
-                                                        .pViewports = &viewport,
-                                                        .scissorCount = 1,
-                                                        .pScissors = &scissor};
+            vkDestroySwapchainKHR(logicalDevice, retiredSwapChains.front().swapChain, nullptr);
+            retiredSwapChains.pop_front();
+        }
+    }
+
+    void createGraphicsPipeline(const ShaderModules &modules, const Mesh &mesh) {
+        // The modules stay alive until cleanup(), pipelines using them may still be compiling on a worker thread.
+        vertShaderModule = modules.vertex;
+        fragShaderModule = modules.fragment;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                                                             .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                                                             .primitiveRestartEnable = VK_FALSE};
 
         VkPipelineRasterizationStateCreateInfo rasterizer{.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
                                                           .depthClampEnable = VK_FALSE,
@@ -601,6 +1117,15 @@ class Vitamin {
                                                            .alphaToCoverageEnable = VK_FALSE,
                                                            .alphaToOneEnable = VK_FALSE};
 
+        VkPipelineDepthStencilStateCreateInfo depthStencil{.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+                                                           .depthTestEnable = VK_TRUE,
+                                                           .depthWriteEnable = VK_TRUE,
+                                                           .depthCompareOp = VK_COMPARE_OP_LESS,
+                                                           .depthBoundsTestEnable = VK_FALSE,
+                                                           .stencilTestEnable = VK_FALSE,
+                                                           .minDepthBounds = 0.0f,
+                                                           .maxDepthBounds = 1.0f};
+
         VkPipelineColorBlendAttachmentState colorBlendAttachment{.blendEnable = VK_FALSE,
                                                                  .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
                                                                  .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
@@ -615,240 +1140,1057 @@ class Vitamin {
                                                           .logicOpEnable = VK_FALSE,
                                                           .logicOp = VK_LOGIC_OP_COPY,
                                                           .attachmentCount = 1,
-                                                          .pAttachments = &colorBlendAttachment,
                                                           .blendConstants = {0.0f, 0.0f, 0.0f, 0.0f}};
 
-        // VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_LINE_WIDTH};
+        // The frame's slot of the view uniforms. Everything else the shaders read comes from the bindless set.
+        VkDescriptorSetLayoutBinding viewBinding{.binding = 0,
+                                                 .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                                 .descriptorCount = 1,
+                                                 .stageFlags = VK_SHADER_STAGE_VERTEX_BIT};
 
-        // VkPipelineDynamicStateCreateInfo dynamicState{
-        //     .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO, .dynamicStateCount = 2, .pDynamicStates = dynamicStates};
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 1, .pBindings = &viewBinding};
+
+        if (vkCreateDescriptorSetLayout(logicalDevice, &setLayoutInfo, nullptr, &viewSetLayout) != VK_SUCCESS) {
+            throw runtime_error("Failed to create descriptor set layout!");
+        }
+
+        VkDescriptorSetLayout setLayouts[] = {bindless.layout(), viewSetLayout};
+        VkPushConstantRange drawConstantsRange{.stageFlags = VK_SHADER_STAGE_VERTEX_BIT, .offset = 0, .size = sizeof(DrawConstants)};
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-                                                      .setLayoutCount = 0,
-                                                      .pSetLayouts = nullptr,
-                                                      .pushConstantRangeCount = 0,
-                                                      .pPushConstantRanges = nullptr};
+                                                      .setLayoutCount = 2,
+                                                      .pSetLayouts = setLayouts,
+                                                      .pushConstantRangeCount = 1,
+                                                      .pPushConstantRanges = &drawConstantsRange};
 
         if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
             throw runtime_error("Failed to create pipeline layout!");
         }
 
-        VkGraphicsPipelineCreateInfo pipelineInfo{.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-                                                  .stageCount = 2,
-                                                  .pStages = shaderStages,
-                                                  .pVertexInputState = &vertexInputInfo,
-                                                  .pInputAssemblyState = &inputAssembly,
-                                                  .pViewportState = &viewportState,
-                                                  .pRasterizationState = &rasterizer,
-                                                  .pMultisampleState = &multisampling,
-                                                  .pDepthStencilState = nullptr,
-                                                  .pColorBlendState = &colorBlending,
-                                                  .pDynamicState = nullptr,
-                                                  .layout = pipelineLayout,
-                                                  .renderPass = renderPass,
-                                                  .subpass = 0,
-                                                  .basePipelineHandle = VK_NULL_HANDLE,
-                                                  .basePipelineIndex = -1};
+        GraphicsPipelineDescription description{.vertexShader = vertShaderModule,
+                                                .fragmentShader = fragShaderModule,
+                                                .vertexBindings = mesh.vertexBindings,
+                                                .vertexAttributes = mesh.vertexAttributes,
+                                                .inputAssembly = inputAssembly,
+                                                .rasterizer = rasterizer,
+                                                .multisampling = multisampling,
+                                                .depthStencil = depthStencil,
+                                                .colorBlendAttachment = colorBlendAttachment,
+                                                .colorBlending = colorBlending,
+                                                // The scene's render area changes with the resolution.
+                                                .dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR},
+                                                .layout = pipelineLayout,
+                                                .renderPass = renderGraph.renderPass(scenePass),
+                                                .subpass = renderGraph.subpass(scenePass),
+                                                .name = "Scene"};
+
+        graphicsPipeline = pipelineRegistry.request(description);
+    }
 
-        if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-            throw runtime_error("Failed to create graphics pipeline!");
+    // A fullscreen triangle sampling the scene color through the bindless set, with a linear sampler clamped to its edges.
+    void createUpscalePipeline(const ShaderModules &modules) {
+        upscaleVertShaderModule = modules.upscaleVertex;
+        upscaleFragShaderModule = modules.upscaleFragment;
+
+        VkSamplerCreateInfo samplerInfo{.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                                        .magFilter = VK_FILTER_LINEAR,
+                                        .minFilter = VK_FILTER_LINEAR,
+                                        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                                        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                        .maxLod = 0.0f};
+
+        if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &upscaleSampler) != VK_SUCCESS) {
+            throw runtime_error("Failed to create sampler!");
         }
 
-        vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
-        vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
+        upscaleSamplerIndex = bindless.addSampler(upscaleSampler);
+        sceneColorIndex = bindless.addSampledImage(renderGraph.view(sceneColor), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        VkDescriptorSetLayout setLayout = bindless.layout();
+        VkPushConstantRange constantsRange{.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT, .offset = 0, .size = sizeof(UpscaleConstants)};
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                                      .setLayoutCount = 1,
+                                                      .pSetLayouts = &setLayout,
+                                                      .pushConstantRangeCount = 1,
+                                                      .pPushConstantRanges = &constantsRange};
+
+        if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &upscalePipelineLayout) != VK_SUCCESS) {
+            throw runtime_error("Failed to create pipeline layout!");
+        }
+
+        GraphicsPipelineDescription description{
+            .vertexShader = upscaleVertShaderModule,
+            .fragmentShader = upscaleFragShaderModule,
+            .inputAssembly = {.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                              .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                              .primitiveRestartEnable = VK_FALSE},
+            .rasterizer = {.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                           .polygonMode = VK_POLYGON_MODE_FILL,
+                           .cullMode = VK_CULL_MODE_NONE,
+                           .frontFace = VK_FRONT_FACE_CLOCKWISE,
+                           .lineWidth = 1.0f},
+            .multisampling = {.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                              .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+                              .minSampleShading = 1.0f},
+            .depthStencil = {.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+                             .depthTestEnable = VK_FALSE,
+                             .depthWriteEnable = VK_FALSE,
+                             .depthCompareOp = VK_COMPARE_OP_ALWAYS},
+            .colorBlendAttachment = {.blendEnable = VK_FALSE,
+                                     .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
+                                                       VK_COLOR_COMPONENT_A_BIT},
+            .colorBlending = {.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                              .logicOpEnable = VK_FALSE,
+                              .logicOp = VK_LOGIC_OP_COPY,
+                              .attachmentCount = 1},
+            .dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR},
+            .layout = upscalePipelineLayout,
+            .renderPass = renderGraph.renderPass(upscalePass),
+            .subpass = renderGraph.subpass(upscalePass),
+            .name = "Upscale"};
+
+        upscalePipeline = pipelineRegistry.request(description);
+    }
+
+    // Creates the modules from the mapped shader pack on a worker thread.
+    future<ShaderModules> createShaderModules() {
+        return workerThreads.async([this] {
+            ShaderModules modules{.vertex = shaderPack.createShaderModule(logicalDevice, "shader.vert"),
+                                  .fragment = shaderPack.createShaderModule(logicalDevice, "shader.frag")};
+
+            if (isGpuCullingEnabled) {
+                modules.cull = shaderPack.createShaderModule(logicalDevice, "cull.comp");
+                modules.depthReduce = shaderPack.createShaderModule(logicalDevice, "depth_reduce.comp");
+            }
+
+            if (options.targetGpuMilliseconds > 0.0) {
+                modules.upscaleVertex = shaderPack.createShaderModule(logicalDevice, "upscale.vert");
+                modules.upscaleFragment = shaderPack.createShaderModule(logicalDevice, "upscale.frag");
+            }
+
+            return modules;
+        });
+    }
+
+    // GPU culling, the scene, the depth pyramid GPU culling builds from the scene's depth for the next frame, and the upscale of
+    // the scene to the swapchain image with dynamic resolution.
+    void createRenderGraph() {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, DEPTH_FORMAT, &formatProperties);
+
+        if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
+            throw runtime_error("The depth buffer format is not supported!");
+        }
+
+        swapChainTarget = renderGraph.importImage("Swapchain", swapChainImport());
+        depthBuffer = renderGraph.createImage("Depth", DEPTH_FORMAT, swapChainExtent);
+        RenderGraphImage sceneTarget = swapChainTarget;
+
+        if (options.targetGpuMilliseconds > 0.0) {
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChainImageFormat, &formatProperties);
+            VkFormatFeatureFlags sceneColorFeatures =
+                VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+            if ((formatProperties.optimalTilingFeatures & sceneColorFeatures) != sceneColorFeatures) {
+                throw runtime_error("The swapchain format cannot be sampled with linear filtering for dynamic resolution!");
+            }
+
+            sceneColor = renderGraph.createImage("Scene color", swapChainImageFormat, swapChainExtent);
+            sceneTarget = sceneColor;
+        }
+
+        if (isGpuCullingEnabled) {
+            RenderGraphPass culling = renderGraph.addPass("Culling", RenderPassType::Compute, [this](const RenderPassContext &context) {
+                const Mesh &mesh = *meshLoader.get(sceneMesh);
+                gpuCulling.recordCulling(context.commandBuffer, viewUniformOffset(), mesh.submeshes[0].vertexOffset,
+                                         dynamicResolution.extent());
+            });
+            // Writes the indirect draws of the scene.
+            renderGraph.keep(culling);
+        }
+
+        scenePass =
+            renderGraph.addPass("Scene", RenderPassType::Graphics, [this](const RenderPassContext &context) { recordScenePass(context); });
+        renderGraph.writeColor(scenePass, sceneTarget, VK_ATTACHMENT_LOAD_OP_CLEAR, {.float32 = {0.0f, 0.0f, 0.0f, 1.0f}});
+        renderGraph.writeDepth(scenePass, depthBuffer, VK_ATTACHMENT_LOAD_OP_CLEAR, {.depth = 1.0f, .stencil = 0});
+
+        if (isGpuCullingEnabled) {
+            RenderGraphPass depthPyramid =
+                renderGraph.addPass("Depth pyramid", RenderPassType::Compute, [this](const RenderPassContext &context) {
+                    gpuCulling.recordDepthPyramid(context.commandBuffer, dynamicResolution.extent());
+                });
+            renderGraph.readImage(depthPyramid, depthBuffer);
+            // Writes the pyramid the next frame culls against.
+            renderGraph.keep(depthPyramid);
+        } else {
+            renderGraph.useSecondaryCommandBuffers(scenePass);
+        }
+
+        if (options.targetGpuMilliseconds > 0.0) {
+            upscalePass = renderGraph.addPass("Upscale", RenderPassType::Graphics,
+                                              [this](const RenderPassContext &context) { recordUpscalePass(context); });
+            renderGraph.readImage(upscalePass, sceneColor);
+            // Every pixel is drawn over.
+            renderGraph.writeColor(upscalePass, swapChainTarget, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+        }
+
+        renderGraph.compile(logicalDevice, memoryAllocator);
+    }
+
+    ImportedImage swapChainImport() const {
+        // Acquiring an image waits at the color attachment output stage, so the image's first use only waits for that.
+        return {.format = swapChainImageFormat,
+                .extent = swapChainExtent,
+                .images = swapChainImages,
+                .views = swapChainImageViews,
+                .startStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .startLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = options.headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+    }
+
+    void createCommandRecorder() {
+        // The render thread records alongside the workers, so by default there is one recording thread per hardware thread.
+        uint32_t recordingThreadCount = options.recordingThreadCount > 0 ? options.recordingThreadCount : workerThreads.threadCount() + 1;
+
+        commandRecorder.create(logicalDevice, queueFamilyIndices.graphicsFamily.value(), options.framesInFlight, workerThreads,
+                               recordingThreadCount);
+    }
+
+    // Lays the scene's instances of the mesh out on a square grid covering the viewport; a single draw covers it like before.
+    void createScene(const ShaderModules &modules, const Mesh &mesh) {
+        // Every instance draws the mesh's first submesh.
+        const MeshSubmesh &submesh = mesh.submeshes[0];
+
+        uint32_t columns = static_cast<uint32_t>(ceil(sqrt(static_cast<double>(options.drawCount))));
+        float cellSize = 2.0f / columns;
+
+        instanceLods.assign(options.drawCount, 0);
+
+        uint32_t root = scene.add(Scene::NO_PARENT, LocalTransform{});
+
+        // Instance i is entity i + 1.
+        for (uint32_t i = 0; i < options.drawCount; i++) {
+            LocalTransform local{.position = {-1.0f + cellSize * (i % columns + 0.5f), -1.0f + cellSize * (i / columns + 0.5f), 0.5f},
+                                 .scale = cellSize / 2.0f};
+
+            uint32_t entity = scene.add(root, local);
+            scene.attachInstance(entity, i, submesh.boundsCenter, submesh.boundsRadius);
+        }
+
+        simulation.create(scene, workerThreads, SIMULATION_TICK_SECONDS, [this](uint64_t tick) { animateScene(tick); });
+
+        // The first frame's interpolation writes every instance, so it copies all of them into the instance buffer.
+        VkDeviceSize instanceBytes = max<size_t>(options.drawCount, 1) * sizeof(SceneInstance);
+
+        instanceBuffer = createDeviceBuffer(instanceBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, instanceBufferAllocation);
+        instanceBufferIndex = bindless.addStorageBuffer(instanceBuffer, 0, VK_WHOLE_SIZE);
+        instanceStagingBuffer = createStagingBuffer(options.framesInFlight * instanceBytes, instanceStagingAllocation);
+        createViewUniforms();
+        createMaterials();
+
+        if (isGpuCullingEnabled) {
+            VkDeviceSize lodBytes = submesh.lodCount * sizeof(MeshLod);
+
+            lodBuffer = createDeviceBuffer(lodBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lodBufferAllocation);
+            uploadQueue.uploadToBuffer(lodBuffer, 0, &mesh.lods[submesh.firstLod], lodBytes, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                       VK_ACCESS_SHADER_READ_BIT);
+        }
+
+        // A frame only acquires uploads the transfer queue has finished, so wait for the scene to be complete before the first one.
+        uploadQueue.flush();
+        vkQueueWaitIdle(transferQueue);
+
+        createViewDescriptorSet();
+
+        if (isGpuCullingEnabled) {
+            gpuCulling.create(logicalDevice, memoryAllocator, pipelineCache, modules.cull, modules.depthReduce, instanceBuffer,
+                              options.drawCount, lodBuffer, submesh.lodCount, viewUniformBuffer, renderGraph.view(depthBuffer),
+                              swapChainExtent);
+
+            vkDestroyShaderModule(logicalDevice, modules.depthReduce, nullptr);
+            vkDestroyShaderModule(logicalDevice, modules.cull, nullptr);
+        }
     }
 
-    VkShaderModule createShaderModule(const vector<char> &code) {
-        VkShaderModuleCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-                                            .codeSize = code.size(),
-                                            .pCode = reinterpret_cast<const uint32_t *>(code.data())};
+    // Device local buffer filled through the upload queue.
+    VkBuffer createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, DeviceAllocation &allocation) {
+        VkBufferCreateInfo bufferInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                      .size = size,
+                                      .usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                      .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
 
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-            throw runtime_error("Failed to create shader module!");
+        VkBuffer buffer;
+        if (vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw runtime_error("Failed to create buffer!");
         }
 
-        return shaderModule;
+        allocation = memoryAllocator.allocateForBuffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        return buffer;
     }
 
-    void createRenderPass() {
-        VkAttachmentDescription colorAttachment{.format = swapChainImageFormat,
-                                                .samples = VK_SAMPLE_COUNT_1_BIT,
-                                                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                                                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-                                                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-                                                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                                                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                                                .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+    // Host visible buffer that stays mapped, copied from on the graphics queue.
+    VkBuffer createStagingBuffer(VkDeviceSize size, DeviceAllocation &allocation) {
+        VkBufferCreateInfo bufferInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                      .size = size,
+                                      .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                      .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
 
-        VkAttachmentReference colorAttachmentRef{.attachment = 0, .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        VkBuffer buffer;
+        if (vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw runtime_error("Failed to create staging buffer!");
+        }
+
+        allocation =
+            memoryAllocator.allocateForBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-        VkSubpassDescription subpass{
-            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS, .colorAttachmentCount = 1, .pColorAttachments = &colorAttachmentRef};
+        return buffer;
+    }
 
-        VkSubpassDependency dependency{
-            .srcSubpass = VK_SUBPASS_EXTERNAL,
-            .dstSubpass = 0,
-            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        };
+    void createViewUniforms() {
+        VkDeviceSize alignment = deviceCapabilities.properties.limits.minUniformBufferOffsetAlignment;
+        viewUniformStride = (sizeof(ViewUniforms) + alignment - 1) / alignment * alignment;
 
-        VkRenderPassCreateInfo renderPassInfo{.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-                                              .attachmentCount = 1,
-                                              .pAttachments = &colorAttachment,
-                                              .subpassCount = 1,
-                                              .pSubpasses = &subpass,
-                                              .dependencyCount = 1,
-                                              .pDependencies = &dependency};
+        VkBufferCreateInfo bufferInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                      .size = options.framesInFlight * viewUniformStride,
+                                      .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                      .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
 
-        if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-            throw runtime_error("Failed to create render pass!");
+        if (vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &viewUniformBuffer) != VK_SUCCESS) {
+            throw runtime_error("Failed to create view uniform buffer!");
         }
+
+        // Coherent, so the camera latched right before a submission needs no flush.
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        viewUniformAllocation = memoryAllocator.allocateForBuffer(viewUniformBuffer, properties);
     }
 
-    void createFramebuffers() {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
+    uint32_t viewUniformOffset() const { return static_cast<uint32_t>(currentFrame * viewUniformStride); }
 
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            VkImageView attachments[] = {swapChainImageViews[i]};
+    // Two checkerboard textures, a nearest and a linear sampler, and four materials combining them, which the instances take turns
+    // using. The scene only waits for the upload queue after this, so the textures are ready by the first frame.
+    void createMaterials() {
+        const uint32_t checkerCells[] = {8, 2};
 
-            VkFramebufferCreateInfo framebufferInfo{.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-                                                    .renderPass = renderPass,
-                                                    .attachmentCount = 1,
-                                                    .pAttachments = attachments,
-                                                    .width = swapChainExtent.width,
-                                                    .height = swapChainExtent.height,
-                                                    .layers = 1};
+        for (uint32_t cells : checkerCells) {
+            vector<uint32_t> texels(MATERIAL_TEXTURE_SIZE * MATERIAL_TEXTURE_SIZE);
+            uint32_t cellSize = MATERIAL_TEXTURE_SIZE / cells;
 
-            if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-                throw runtime_error("Failed to create framebuffer!");
+            for (uint32_t y = 0; y < MATERIAL_TEXTURE_SIZE; y++) {
+                for (uint32_t x = 0; x < MATERIAL_TEXTURE_SIZE; x++) {
+                    // RGBA8, white and grey.
+                    texels[y * MATERIAL_TEXTURE_SIZE + x] = (x / cellSize + y / cellSize) % 2 == 0 ? 0xffffffff : 0xff808080;
+                }
             }
+
+            createMaterialTexture(texels);
+        }
+
+        const VkFilter samplerFilters[] = {VK_FILTER_NEAREST, VK_FILTER_LINEAR};
+        vector<uint32_t> samplerIndices;
+
+        for (VkFilter filter : samplerFilters) {
+            VkSamplerCreateInfo samplerInfo{.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                                            .magFilter = filter,
+                                            .minFilter = filter,
+                                            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                                            .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                                            .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                                            .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                                            .maxLod = 0.0f};
+
+            VkSampler sampler;
+            if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+                throw runtime_error("Failed to create sampler!");
+            }
+
+            materialSamplers.push_back(sampler);
+            samplerIndices.push_back(bindless.addSampler(sampler));
+        }
+
+        const Material materials[] = {{.baseColor = {1.0f, 1.0f, 1.0f, 1.0f}, .texture = 0, .sampler = 0},
+                                      {.baseColor = {1.0f, 0.6f, 0.6f, 1.0f}, .texture = 1, .sampler = 1},
+                                      {.baseColor = {0.6f, 1.0f, 0.6f, 1.0f}, .texture = 0, .sampler = 1},
+                                      {.baseColor = {0.6f, 0.6f, 1.0f, 1.0f}, .texture = 1, .sampler = 0}};
+        const uint32_t materialCount = sizeof(materials) / sizeof(materials[0]);
+
+        // Turn the texture and sampler into their bindless indices.
+        Material boundMaterials[materialCount];
+        for (uint32_t i = 0; i < materialCount; i++) {
+            boundMaterials[i] = materials[i];
+            boundMaterials[i].texture = materialTextureIndices[materials[i].texture];
+            boundMaterials[i].sampler = samplerIndices[materials[i].sampler];
+        }
+
+        materialBuffer = createDeviceBuffer(sizeof(boundMaterials), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, materialBufferAllocation);
+        uploadQueue.uploadToBuffer(materialBuffer, 0, boundMaterials, sizeof(boundMaterials), VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                                   VK_ACCESS_SHADER_READ_BIT);
+        materialBufferIndex = bindless.addStorageBuffer(materialBuffer, 0, VK_WHOLE_SIZE);
+
+        vector<uint32_t> instanceMaterials(max<size_t>(options.drawCount, 1));
+        for (uint32_t i = 0; i < instanceMaterials.size(); i++) {
+            instanceMaterials[i] = i % materialCount;
+        }
+
+        VkDeviceSize instanceMaterialBytes = instanceMaterials.size() * sizeof(uint32_t);
+        instanceMaterialBuffer =
+            createDeviceBuffer(instanceMaterialBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, instanceMaterialBufferAllocation);
+        uploadQueue.uploadToBuffer(instanceMaterialBuffer, 0, instanceMaterials.data(), instanceMaterialBytes,
+                                   VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        instanceMaterialBufferIndex = bindless.addStorageBuffer(instanceMaterialBuffer, 0, VK_WHOLE_SIZE);
+    }
+
+    void createMaterialTexture(const vector<uint32_t> &texels) {
+        VkImageCreateInfo imageInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                    .imageType = VK_IMAGE_TYPE_2D,
+                                    .format = VK_FORMAT_R8G8B8A8_UNORM,
+                                    .extent = {.width = MATERIAL_TEXTURE_SIZE, .height = MATERIAL_TEXTURE_SIZE, .depth = 1},
+                                    .mipLevels = 1,
+                                    .arrayLayers = 1,
+                                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                    .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+        VkImage image;
+        if (vkCreateImage(logicalDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw runtime_error("Failed to create texture image!");
+        }
+
+        materialTextures.push_back(image);
+        materialTextureAllocations.push_back(
+            memoryAllocator.allocateForImage(image, imageInfo.tiling, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+
+        VkImageSubresourceLayers subresource{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1};
+        uploadQueue.uploadToImage(image, subresource, imageInfo.extent, texels.data(), texels.size() * sizeof(uint32_t),
+                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                  VK_ACCESS_SHADER_READ_BIT);
+
+        VkImageViewCreateInfo viewInfo{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = imageInfo.format,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1}};
+
+        VkImageView view;
+        if (vkCreateImageView(logicalDevice, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw runtime_error("Failed to create texture image view!");
+        }
+
+        materialTextureViews.push_back(view);
+        materialTextureIndices.push_back(bindless.addSampledImage(view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+    }
+
+    void destroyMaterials() {
+        vkDestroyBuffer(logicalDevice, instanceMaterialBuffer, nullptr);
+        memoryAllocator.free(instanceMaterialBufferAllocation);
+        vkDestroyBuffer(logicalDevice, materialBuffer, nullptr);
+        memoryAllocator.free(materialBufferAllocation);
+
+        for (VkSampler sampler : materialSamplers) {
+            vkDestroySampler(logicalDevice, sampler, nullptr);
+        }
+
+        for (size_t i = 0; i < materialTextures.size(); i++) {
+            vkDestroyImageView(logicalDevice, materialTextureViews[i], nullptr);
+            vkDestroyImage(logicalDevice, materialTextures[i], nullptr);
+            memoryAllocator.free(materialTextureAllocations[i]);
+        }
+    }
+
+    void createViewDescriptorSet() {
+        VkDescriptorPoolSize poolSize{.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1};
+
+        VkDescriptorPoolCreateInfo poolInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, .maxSets = 1, .poolSizeCount = 1, .pPoolSizes = &poolSize};
+
+        if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw runtime_error("Failed to create descriptor pool!");
         }
+
+        VkDescriptorSetAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                              .descriptorPool = descriptorPool,
+                                              .descriptorSetCount = 1,
+                                              .pSetLayouts = &viewSetLayout};
+
+        if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, &viewSet) != VK_SUCCESS) {
+            throw runtime_error("Failed to allocate descriptor set!");
+        }
+
+        VkDescriptorBufferInfo viewInfo{.buffer = viewUniformBuffer, .offset = 0, .range = sizeof(ViewUniforms)};
+
+        VkWriteDescriptorSet write{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                   .dstSet = viewSet,
+                                   .dstBinding = 0,
+                                   .descriptorCount = 1,
+                                   .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                   .pBufferInfo = &viewInfo};
+
+        vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, nullptr);
+    }
+
+    // Binds everything the scene's draws use and sets their viewport to the render area, so the draws themselves bind nothing.
+    void bindScene(VkCommandBuffer commandBuffer, const Mesh &mesh, const VkRect2D &renderArea) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(graphicsPipeline));
+        setViewport(commandBuffer, renderArea);
+        VkDescriptorSet sets[] = {bindless.set(), viewSet};
+        uint32_t viewOffset = viewUniformOffset();
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, sets, 1, &viewOffset);
+        mesh.bind(commandBuffer);
+
+        DrawConstants constants{.positionScale = mesh.positionScale,
+                                .instanceBuffer = instanceBufferIndex,
+                                .instanceMaterialBuffer = instanceMaterialBufferIndex,
+                                .materialBuffer = materialBufferIndex};
+        copy(begin(mesh.positionOffset), end(mesh.positionOffset), constants.positionOffset);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
     }
 
-    void createCommandPool() {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    // Draws visibleInstances[firstDraw, firstDraw + drawCount). Picks the LOD of every instance it records, so the selection is
+    // spread across the recording threads like the draws.
+    void recordScene(VkCommandBuffer commandBuffer, const Mesh &mesh, const VkRect2D &renderArea, uint32_t firstDraw, uint32_t drawCount) {
+        const MeshSubmesh &submesh = mesh.submeshes[0];
+        const MeshLod *lods = &mesh.lods[submesh.firstLod];
+        float renderHeight = float(renderArea.extent.height);
+
+        bindScene(commandBuffer, mesh, renderArea);
+
+        for (uint32_t draw = firstDraw; draw < firstDraw + drawCount; draw++) {
+            uint32_t i = visibleInstances[draw];
+            const SceneInstance &sceneInstance = frameInstances[i];
+            const float boundsCenter[3] = {sceneInstance.bounds[0], sceneInstance.bounds[1], sceneInstance.bounds[2]};
+            float pixelsPerUnit = sceneInstance.scale() * projectedPixelsPerUnit(frameViewProjection, boundsCenter, renderHeight);
+
+            instanceLods[i] = selectLod(lods, submesh.lodCount, instanceLods[i], pixelsPerUnit);
+            const MeshLod &lod = lods[instanceLods[i]];
+
+            vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, lod.firstIndex, submesh.vertexOffset, i);
+        }
+    }
 
-        VkCommandPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-                                         .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value()};
+    // Simulation tick: spins every instance when animating.
+    void animateScene(uint64_t tick) {
+        if (options.animate) {
+            float angle = 0.02f * tick;
+            const float rotation[4] = {0.0f, 0.0f, sin(angle / 2.0f), cos(angle / 2.0f)};
+
+            uint32_t batchCount = (options.drawCount + ANIMATION_BATCH_SIZE - 1) / ANIMATION_BATCH_SIZE;
+            workerThreads.parallelFor(batchCount, [&](uint32_t batch) {
+                uint32_t end = min(options.drawCount, (batch + 1) * ANIMATION_BATCH_SIZE);
+                for (uint32_t i = batch * ANIMATION_BATCH_SIZE; i < end; i++) {
+                    scene.setRotation(i + 1, rotation);
+                }
+            });
+        }
+    }
 
-        if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-            throw runtime_error("Failed to create command pool!");
+    // Interpolates the instances rendered this frame from the simulation's latest ticks, then starts simulating the ticks
+    // due by the next frame, which run while this one is culled, recorded and rendered.
+    void updateScene() {
+        {
+            CpuZone zone("Wait for simulation");
+            simulation.wait();
         }
+
+        double time = chrono::duration<double>(chrono::steady_clock::now() - simulationStart).count();
+
+        // One tick in the past, which the last ticks simulated up to the estimated time of this frame cover. The frame slot's
+        // previous submission completed, so the instances go straight into its staging slice.
+        simulation.interpolate(time - SIMULATION_TICK_SECONDS, frameInstances, frameChanged, instanceStagingSlice());
+        simulation.advance(time + (time - lastFrameTime));
+        lastFrameTime = time;
     }
 
-    void createCommandBuffers() {
-        commandBuffers.resize(swapChainFramebuffers.size());
+    // Turns the camera by the cursor's movement since the last call while the left mouse button is held.
+    void sampleCamera() {
+        if (options.headless) {
+            return;
+        }
 
-        VkCommandBufferAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-                                              .commandPool = commandPool,
-                                              .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-                                              .commandBufferCount = (uint32_t)commandBuffers.size()};
+        double x, y;
+        glfwGetCursorPos(window, &x, &y);
 
-        if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-            throw runtime_error("Failed to allocate command buffers!");
+        if (hasCursor && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+            camera.turn(x - cursorX, y - cursorY);
         }
 
-        for (size_t i = 0; i < commandBuffers.size(); i++) {
-            VkCommandBufferBeginInfo beginInfo{
-                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = 0, .pInheritanceInfo = nullptr};
+        cursorX = x;
+        cursorY = y;
+        hasCursor = true;
+    }
+
+    // Samples the latest mouse input into the frame's slot of the view uniforms, which the GPU only reads once the frame is
+    // submitted. The frame slot's previous submission completed, so the slot is free.
+    void latchCamera() {
+        if (!options.headless) {
+            glfwPollEvents();
+        }
+
+        sampleCamera();
+
+        auto *view = reinterpret_cast<ViewUniforms *>(static_cast<char *>(viewUniformAllocation.mapped) + viewUniformOffset());
+        camera.viewProjection(view->viewProjection);
+    }
 
-            if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-                throw runtime_error("Failed to begin recording command buffer!");
+    // Frustum culls the instances for the CPU recording path, refitting the BVH to the instances that moved.
+    void cullScene() {
+        const vector<SceneInstance> &instances = frameInstances;
+        const vector<uint32_t> &changed = frameChanged;
+
+        if (instanceBoxes.empty()) {
+            instanceBoxes.resize(instances.size());
+            transform(instances.begin(), instances.end(), instanceBoxes.begin(), boundsBox);
+            instanceBvh.build(instanceBoxes);
+        } else if (!changed.empty()) {
+            for (uint32_t i : changed) {
+                instanceBoxes[i] = boundsBox(instances[i]);
             }
+            instanceBvh.refit(instanceBoxes, changed);
+        }
+
+        // Scaling clip space x and y down widens the frustum by the guard band.
+        float cullViewProjection[16];
+        copy(begin(frameViewProjection), end(frameViewProjection), cullViewProjection);
+
+        for (uint32_t column = 0; column < 4; column++) {
+            cullViewProjection[column * 4 + 0] /= 1.0f + LATE_LATCH_GUARD_BAND;
+            cullViewProjection[column * 4 + 1] /= 1.0f + LATE_LATCH_GUARD_BAND;
+        }
+
+        instanceBvh.cull(extractFrustum(cullViewProjection), workerThreads, visibleInstances);
+    }
 
-            VkClearValue clearColor = {.color = {{0.0f, 0.0f, 0.0f, 1.0f}}};
+    static Aabb boundsBox(const SceneInstance &sceneInstance) {
+        const float *bounds = sceneInstance.bounds;
+        return {.min = {bounds[0] - bounds[3], bounds[1] - bounds[3], bounds[2] - bounds[3]},
+                .max = {bounds[0] + bounds[3], bounds[1] + bounds[3], bounds[2] + bounds[3]}};
+    }
+
+    VkDeviceSize instanceStagingOffset() const { return currentFrame * options.drawCount * sizeof(SceneInstance); }
+
+    SceneInstance *instanceStagingSlice() const {
+        return reinterpret_cast<SceneInstance *>(static_cast<char *>(instanceStagingAllocation.mapped) + instanceStagingOffset());
+    }
+
+    // Copies the instances that changed this frame from the frame's staging slice, which updateScene() wrote them to in the
+    // order of frameChanged, into the instance buffer.
+    void recordInstanceUpload(VkCommandBuffer commandBuffer) {
+        const vector<uint32_t> &changed = frameChanged;
+
+        if (changed.empty()) {
+            return;
+        }
 
-            VkRenderPassBeginInfo renderPassInfo{.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-                                                 .renderPass = renderPass,
-                                                 .framebuffer = swapChainFramebuffers[i],
-                                                 .renderArea = {.offset = {0, 0}, .extent = swapChainExtent},
-                                                 .clearValueCount = 1,
-                                                 .pClearValues = &clearColor};
+        VkDeviceSize sliceOffset = instanceStagingOffset();
 
-            vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-            vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
-            vkCmdEndRenderPass(commandBuffers[i]);
+        // Instances change in runs, so neighbours share a copy region.
+        instanceCopies.clear();
 
-            if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-                throw runtime_error("Failed to record command buffer!");
+        for (size_t i = 0; i < changed.size(); i++) {
+            VkDeviceSize sourceOffset = sliceOffset + i * sizeof(SceneInstance);
+            VkDeviceSize destinationOffset = changed[i] * sizeof(SceneInstance);
+
+            if (!instanceCopies.empty() && instanceCopies.back().srcOffset + instanceCopies.back().size == sourceOffset &&
+                instanceCopies.back().dstOffset + instanceCopies.back().size == destinationOffset) {
+                instanceCopies.back().size += sizeof(SceneInstance);
+            } else {
+                instanceCopies.push_back({.srcOffset = sourceOffset, .dstOffset = destinationOffset, .size = sizeof(SceneInstance)});
+            }
+        }
+
+        // The previous frames only read the instances, so waiting for their shaders to finish is enough before overwriting them.
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+        vkCmdCopyBuffer(commandBuffer, instanceStagingBuffer, instanceBuffer, static_cast<uint32_t>(instanceCopies.size()),
+                        instanceCopies.data());
+
+        VkMemoryBarrier barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0,
+                             nullptr);
+    }
+
+    void recordScenePass(const RenderPassContext &context) {
+        // Waited for at startup, so the mesh is published by the first frame's update.
+        const Mesh &mesh = *meshLoader.get(sceneMesh);
+
+        if (isGpuCullingEnabled) {
+            // A single indirect draw has nothing to spread across recording threads.
+            bindScene(context.commandBuffer, mesh, context.renderArea);
+            gpuCulling.recordDraws(context.commandBuffer);
+            return;
+        }
+
+        VkCommandBufferInheritanceInfo inheritance{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+                                                   .renderPass = context.renderPass,
+                                                   .subpass = context.subpass,
+                                                   .framebuffer = context.framebuffer};
+
+        commandRecorder.recordSecondaries(currentFrame, inheritance, static_cast<uint32_t>(visibleInstances.size()),
+                                          [this, &mesh, &context](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+                                              recordScene(secondary, mesh, context.renderArea, first, count);
+                                          });
+    }
+
+    // Stretches the part of the scene color the frame rendered over the whole render area.
+    void recordUpscalePass(const RenderPassContext &context) {
+        VkExtent2D fullExtent = swapChainExtent;
+        VkExtent2D renderExtent = dynamicResolution.extent();
+        UpscaleConstants constants{
+            .renderScale = {float(renderExtent.width) / fullExtent.width, float(renderExtent.height) / fullExtent.height},
+            .renderMax = {(renderExtent.width - 0.5f) / fullExtent.width, (renderExtent.height - 0.5f) / fullExtent.height},
+            .image = sceneColorIndex,
+            .sampler = upscaleSamplerIndex};
+
+        VkDescriptorSet set = bindless.set();
+
+        vkCmdBindPipeline(context.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRegistry.get(upscalePipeline));
+        setViewport(context.commandBuffer, context.renderArea);
+        vkCmdBindDescriptorSets(context.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipelineLayout, 0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(context.commandBuffer, upscalePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+        vkCmdDraw(context.commandBuffer, 3, 1, 0, 0);
+    }
+
+    // Viewport and scissor are dynamic in every pipeline.
+    static void setViewport(VkCommandBuffer commandBuffer, const VkRect2D &renderArea) {
+        VkViewport viewport{.x = float(renderArea.offset.x),
+                            .y = float(renderArea.offset.y),
+                            .width = float(renderArea.extent.width),
+                            .height = float(renderArea.extent.height),
+                            .minDepth = 0.0f,
+                            .maxDepth = 1.0f};
+
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &renderArea);
+    }
+
+    // Must be called once the frame slot's previous submission completed, since it resets that submission's command pools.
+    VkCommandBuffer recordFrame(uint32_t imageIndex, pmr::vector<VkSemaphore> &waitSemaphores, pmr::vector<uint64_t> &waitValues,
+                                pmr::vector<VkPipelineStageFlags> &waitStages) {
+        VkCommandBuffer commandBuffer = commandRecorder.beginFrame(currentFrame);
+
+        gpuProfiler.beginFrame(commandBuffer, static_cast<uint32_t>(currentFrame), frameNumber);
+
+        uploadQueue.acquireCompleted(commandBuffer, waitSemaphores, waitValues, waitStages);
+        meshLoader.update();
+
+        recordInstanceUpload(commandBuffer);
+        if (dynamicResolution.isEnabled()) {
+            renderGraph.setRenderArea(scenePass, dynamicResolution.extent());
+        }
+        renderGraph.execute(commandBuffer, imageIndex, gpuProfiler);
+
+        gpuProfiler.endFrame(commandBuffer);
+
+        return commandRecorder.endFrame(currentFrame);
+    }
+
+    void createGpuProfiler() {
+        uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+        uint32_t validBits = deviceCapabilities.queueFamilies[graphicsFamily].timestampValidBits;
+
+        if (validBits == 0) {
+            cout << "GPU timestamps are not supported on the graphics queue, GPU times will not be reported\n";
+
+            if (dynamicResolution.isEnabled()) {
+                cout << "Dynamic resolution needs GPU times, the scene renders at full resolution\n";
+            }
+        }
+
+        gpuProfiler.create(logicalDevice, graphicsQueue, graphicsFamily, validBits, deviceCapabilities.properties.limits.timestampPeriod,
+                           options.framesInFlight, hasCalibratedTimestamps);
+    }
+
+    // Must be called once the frame slot's last submission completed, so its timestamps are available.
+    void collectGpuFrameTime(size_t frame) {
+        optional<double> milliseconds = gpuProfiler.collectFrame(static_cast<uint32_t>(frame));
+
+        if (!milliseconds.has_value()) {
+            return;
+        }
+
+        // Picks the resolution of the frame about to be recorded.
+        dynamicResolution.addGpuFrameTime(milliseconds.value());
+
+        if (benchmark) {
+            benchmark->addGpuFrameTime(milliseconds.value());
+        }
+    }
+
+    // Blocks until the submission of the frame that signals value completed; 0 returns right away.
+    void waitForFrameValue(uint64_t value) {
+        VkSemaphoreWaitInfo waitInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                                     .semaphoreCount = 1,
+                                     .pSemaphores = &frameTimeline,
+                                     .pValues = &value};
+        vkWaitSemaphores(logicalDevice, &waitInfo, UINT64_MAX);
+    }
+
+    // Waits for the frame that last used this slot, options.framesInFlight frames ago, which frees the slot's arenas.
+    void waitForFrameSlot() {
+        uint64_t completedValue = frameNumber >= options.framesInFlight ? frameNumber + 1 - options.framesInFlight : 0;
+
+        {
+            CpuZone zone("Wait for frame slot");
+            waitForFrameValue(completedValue);
+        }
+
+        bindless.retire(completedValue);
+        renderGraph.retire(completedValue);
+        destroyRetiredSwapChains(completedValue);
+
+        if (isGpuCullingEnabled) {
+            gpuCulling.retire(completedValue);
+        }
+
+        FrameArena::beginFrame(static_cast<uint32_t>(currentFrame));
+
+        collectGpuFrameTime(currentFrame);
+    }
+
+    // The surface may keep changing while it is resized, so every out of date acquire recreates the swapchain and tries again;
+    // nothing was acquired, so the frame goes to the new swapchain right away. A suboptimal swapchain still presents, it is
+    // recreated after the frame's present. Returns false if the window was closed while minimized.
+    bool acquireImage(uint32_t &imageIndex) {
+        while (true) {
+            VkResult result = vkAcquireNextImageKHR(logicalDevice, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
+                                                    VK_NULL_HANDLE, &imageIndex);
+
+            if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+                return true;
+            }
+
+            if (result != VK_ERROR_OUT_OF_DATE_KHR) {
+                throw runtime_error("Failed to acquire a swap chain image!");
+            }
+
+            if (!recreateSwapChain()) {
+                return false;
             }
         }
     }
 
     void drawFrame() {
-        vkWaitForFences(logicalDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-        vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
+        uploadQueue.flush();
+
+        {
+            CpuZone zone("Update scene");
+            updateScene();
+        }
 
         uint32_t imageIndex;
-        vkAcquireNextImageKHR(logicalDevice, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        if (options.headless) {
+            imageIndex = static_cast<uint32_t>(frameNumber % swapChainImages.size());
+        } else {
+            CpuZone zone("Acquire image");
+            if (!acquireImage(imageIndex)) {
+                // Closed while minimized, isDone() ends the loop.
+                return;
+            }
+        }
+
+        // With more frames in flight than images, an older frame may still render into this one.
+        {
+            CpuZone zone("Wait for image");
+            waitForFrameValue(imageFrameValues[imageIndex]);
+        }
+        imageFrameValues[imageIndex] = frameNumber + 1;
+
+        // Nothing is acquired or presented in headless mode, so there is no binary semaphore to wait on or to signal. Binary
+        // semaphores take a value of 0, which is ignored.
+        LinearArena &arena = FrameArena::thread();
+        pmr::vector<VkSemaphore> waitSemaphores(&arena);
+        pmr::vector<uint64_t> waitValues(&arena);
+        pmr::vector<VkPipelineStageFlags> waitStages(&arena);
+
+        if (!options.headless) {
+            waitSemaphores.push_back(imageAvailableSemaphores[currentFrame]);
+            waitValues.push_back(0);
+            waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        }
+
+        if (!isGpuCullingEnabled) {
+            CpuZone zone("Cull");
+            cullScene();
+        }
 
-        // Check if a previous frame is using this image (i.e. there is its fence to wait on)
-        if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-            vkWaitForFences(logicalDevice, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+        auto recordStart = chrono::steady_clock::now();
+        VkCommandBuffer commandBuffer;
+        {
+            CpuZone zone("Record");
+            commandBuffer = recordFrame(imageIndex, waitSemaphores, waitValues, waitStages);
         }
-        // Mark the image as now being in use by this frame
-        imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
+        if (benchmark) {
+            benchmark->addRecordTime(chrono::duration<double, milli>(chrono::steady_clock::now() - recordStart).count());
+
+            if (dynamicResolution.isEnabled()) {
+                benchmark->addRenderScale(dynamicResolution.scale());
+            }
+        }
 
+        VkSemaphore signalSemaphores[] = {frameTimeline, renderFinishedSemaphores[imageIndex]};
+        uint64_t signalValues[] = {frameNumber + 1, 0};
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                                                   .waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size()),
+                                                   .pWaitSemaphoreValues = waitValues.data(),
+                                                   .signalSemaphoreValueCount = options.headless ? 1u : 2u,
+                                                   .pSignalSemaphoreValues = signalValues};
         VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                                .waitSemaphoreCount = 1,
-                                .pWaitSemaphores = waitSemaphores,
-                                .pWaitDstStageMask = waitStages,
+                                .pNext = &timelineInfo,
+                                .waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+                                .pWaitSemaphores = waitSemaphores.data(),
+                                .pWaitDstStageMask = waitStages.data(),
                                 .commandBufferCount = 1,
-                                .pCommandBuffers = &commandBuffers[imageIndex],
-                                .signalSemaphoreCount = 1,
+                                .pCommandBuffers = &commandBuffer,
+                                .signalSemaphoreCount = options.headless ? 1u : 2u,
                                 .pSignalSemaphores = signalSemaphores};
 
-        vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
+        {
+            CpuZone zone("Latch camera");
+            latchCamera();
+        }
+
+        {
+            CpuZone zone("Submit");
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw runtime_error("Failed to submit draw command buffer!");
+            }
+        }
 
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-            throw runtime_error("Failed to submit draw command buffer!");
+        uint64_t inputToSubmit = latencyTracker.frameSubmitted(Profiler::now());
+        frameLimiter.addFrameWork(inputToSubmit);
+
+        if (benchmark) {
+            benchmark->addInputToSubmitTime(static_cast<double>(inputToSubmit) / 1e6);
+        }
+
+        frameNumber++;
+
+        if (options.headless) {
+            currentFrame = (currentFrame + 1) % options.framesInFlight;
+            return;
         }
 
         VkSwapchainKHR swapChains[] = {swapChain};
 
         VkPresentInfoKHR presentInfo{.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
                                      .waitSemaphoreCount = 1,
-                                     .pWaitSemaphores = signalSemaphores,
+                                     .pWaitSemaphores = &renderFinishedSemaphores[imageIndex],
                                      .swapchainCount = 1,
                                      .pSwapchains = swapChains,
                                      .pImageIndices = &imageIndex,
                                      .pResults = nullptr};
+        latencyTracker.preparePresent(presentInfo);
+
+        VkResult presentResult;
+        {
+            CpuZone zone("Present");
+            presentResult = vkQueuePresentKHR(presentQueue, &presentInfo);
+        }
+
+        if (presentResult != VK_SUCCESS && presentResult != VK_SUBOPTIMAL_KHR && presentResult != VK_ERROR_OUT_OF_DATE_KHR) {
+            throw runtime_error("Failed to present a swap chain image!");
+        }
+
+        // The swapchains this one replaced are done once the frame just presented is, which signals frameNumber.
+        if (presentResult != VK_ERROR_OUT_OF_DATE_KHR) {
+            for (RetiredSwapChain &retiredSwapChain : retiredSwapChains) {
+                if (retiredSwapChain.retireValue == UNPRESENTED_RETIRE_VALUE) {
+                    retiredSwapChain.retireValue = frameNumber;
+                }
+            }
+        }
 
-        vkQueuePresentKHR(presentQueue, &presentInfo);
+        const vector<double> &presentLatencies = latencyTracker.collectPresented();
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        if (benchmark) {
+            for (double milliseconds : presentLatencies) {
+                benchmark->addInputToPresentTime(milliseconds);
+            }
+        }
+
+        // Recreated before the next acquire, so resizing never drops a frame.
+        if (presentResult != VK_SUCCESS || isFramebufferResized) {
+            recreateSwapChain();
+        }
+
+        currentFrame = (currentFrame + 1) % options.framesInFlight;
+    }
+
+    void createLatencyTracking() {
+        latencyTracker.create(logicalDevice, options.headless ? VK_NULL_HANDLE : swapChain, presentTiming);
+        frameLimiter.create(options.frameRateLimit);
+
+        if (presentTiming == PresentTiming::DisplayTiming) {
+            cout << "Input-to-present latency: display times from VK_GOOGLE_display_timing\n";
+        } else if (presentTiming == PresentTiming::PresentWait) {
+            cout << "Input-to-present latency: present completion polled with VK_KHR_present_wait, late by up to a frame\n";
+        } else if (!options.headless) {
+            cout << "Input-to-present latency: not measured, needs VK_GOOGLE_display_timing or VK_KHR_present_wait\n";
+        }
     }
 
     void createSyncObjects() {
-        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-        imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+        imageAvailableSemaphores.resize(options.framesInFlight);
+        imageFrameValues.assign(swapChainImages.size(), 0);
 
-        VkSemaphoreCreateInfo semaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
-        VkFenceCreateInfo fenceInfo{.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .flags = VK_FENCE_CREATE_SIGNALED_BIT};
+        VkSemaphoreTypeCreateInfo timelineInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                                               .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                                               .initialValue = 0};
+        VkSemaphoreCreateInfo timelineSemaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &timelineInfo};
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(logicalDevice, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+        if (vkCreateSemaphore(logicalDevice, &timelineSemaphoreInfo, nullptr, &frameTimeline) != VK_SUCCESS) {
+            throw runtime_error("Failed to create the frame timeline semaphore!");
+        }
 
+        VkSemaphoreCreateInfo semaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+
+        for (size_t i = 0; i < options.framesInFlight; i++) {
+            if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS) {
                 throw std::runtime_error("Failed to create synchronization objects for a frame!");
             }
         }
+
+        createRenderFinishedSemaphores();
     };
+
+    void createRenderFinishedSemaphores() {
+        renderFinishedSemaphores.resize(swapChainImages.size());
+
+        VkSemaphoreCreateInfo semaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+
+        for (VkSemaphore &semaphore : renderFinishedSemaphores) {
+            if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create synchronization objects for a swapchain image!");
+            }
+        }
+    }
 };
 
-int main() {
-    Vitamin app;
+int main(int argc, char **argv) {
+    Options options;
+
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const exception &e) {
+        cerr << e.what() << '\n' << optionsUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Vitamin app(options);
 
     try {
         app.run();
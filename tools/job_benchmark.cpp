@@ -0,0 +1,153 @@
+// Micro-benchmarks of the job scheduler in ThreadPool.h.
+//
+// Usage: job_benchmark [worker count]
+//
+// Spawn overhead: empty jobs submitted from the main thread, which go to its own deque, and from inside a job on a worker.
+// Parallel-for scaling: a fixed amount of arithmetic split into iterations, for every worker count up to the given one.
+// Dependency chain latency: jobs that each only start once the previous one finished, through submitAfter().
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+const uint32_t SPAWN_COUNT = 200000;
+// Jobs spawned before waiting on them, within the capacity of a thread's deque.
+const uint32_t SPAWN_BATCH = 1000;
+const uint32_t PARALLEL_FOR_COUNT = 4096;
+const uint32_t ITERATION_WORK = 2000;
+const uint32_t CHAIN_LENGTH = 20000;
+const uint32_t REPETITIONS = 5;
+
+// The best of REPETITIONS runs of function, in milliseconds.
+template <typename Function> static double measure(Function function) {
+    double best = INFINITY;
+
+    for (uint32_t i = 0; i < REPETITIONS; i++) {
+        auto start = chrono::steady_clock::now();
+        function();
+        best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+
+    return best;
+}
+
+// Arithmetic the compiler cannot remove, so iterations take a fixed time.
+static float work(uint32_t seed) {
+    float value = static_cast<float>(seed);
+    for (uint32_t i = 0; i < ITERATION_WORK; i++) {
+        value = sqrt(value * value + 1.0f);
+    }
+    return value;
+}
+
+static void benchmarkSpawn(uint32_t workerCount) {
+    ThreadPool pool;
+    pool.start(workerCount);
+
+    auto spawn = [&] {
+        for (uint32_t batch = 0; batch < SPAWN_COUNT / SPAWN_BATCH; batch++) {
+            JobCounter counter;
+            for (uint32_t i = 0; i < SPAWN_BATCH; i++) {
+                pool.submit([] {}, &counter);
+            }
+            pool.wait(counter);
+        }
+    };
+
+    double fromMain = measure(spawn);
+
+    double fromJob = measure([&] {
+        JobCounter root;
+        pool.submit(spawn, &root);
+        pool.wait(root);
+    });
+
+    pool.stop();
+
+    cout << "Spawn and run, from the main thread: " << fromMain * 1e6 / SPAWN_COUNT << " ns per job\n";
+    cout << "Spawn and run, from a job:           " << fromJob * 1e6 / SPAWN_COUNT << " ns per job\n";
+}
+
+static void benchmarkParallelFor(uint32_t maxWorkerCount) {
+    cout << "Parallel for, " << PARALLEL_FOR_COUNT << " iterations:\n";
+
+    double serial = 0.0;
+
+    for (uint32_t workerCount = 0; workerCount <= maxWorkerCount; workerCount++) {
+        ThreadPool pool;
+        pool.start(workerCount);
+
+        unique_ptr<float[]> results(new float[PARALLEL_FOR_COUNT]);
+        double time = measure([&] { pool.parallelFor(PARALLEL_FOR_COUNT, [&](uint32_t i) { results[i] = work(i); }); });
+
+        pool.stop();
+
+        if (workerCount == 0) {
+            serial = time;
+        }
+
+        cout << "  " << setw(2) << workerCount << " workers: " << setw(8) << time << " ms, " << serial / time << "x\n";
+    }
+}
+
+static void benchmarkDependencyChain(uint32_t workerCount) {
+    ThreadPool pool;
+    pool.start(workerCount);
+
+    unique_ptr<JobCounter[]> counters;
+
+    double time = measure([&] {
+        counters.reset(new JobCounter[CHAIN_LENGTH]);
+
+        // Submitting the whole chain up front, so the timing covers releasing and running each link.
+        for (uint32_t i = 0; i < CHAIN_LENGTH; i++) {
+            if (i == 0) {
+                pool.submit([] {}, &counters[i]);
+            } else {
+                pool.submitAfter(counters[i - 1], [] {}, &counters[i]);
+            }
+        }
+
+        pool.wait(counters[CHAIN_LENGTH - 1]);
+    });
+
+    pool.stop();
+
+    cout << "Dependency chain: " << time * 1e6 / CHAIN_LENGTH << " ns per link\n";
+}
+
+int main(int argc, char **argv) {
+    uint32_t workerCount = ThreadPool::defaultThreadCount();
+
+    if (argc > 2) {
+        cerr << "Usage: " << argv[0] << " [worker count]\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (argc == 2) {
+            workerCount = static_cast<uint32_t>(stoul(argv[1]));
+        }
+
+        cout << fixed << setprecision(2) << "Workers: " << workerCount << ", best of " << REPETITIONS << " runs\n";
+
+        benchmarkSpawn(workerCount);
+        benchmarkParallelFor(workerCount);
+        benchmarkDependencyChain(workerCount);
+    } catch (const exception &e) {
+        cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
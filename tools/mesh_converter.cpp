@@ -0,0 +1,1153 @@
+// Converts Wavefront OBJ files into the binary mesh format mapped by MeshLoader at runtime, see MeshFormat.h.
+//
+// Usage: mesh_converter <input.obj> <output.mesh>
+//
+// Every object or group becomes a submesh. Polygons are triangulated as fans, and vertices are deduplicated by their
+// position, texture coordinate and normal indices. Colors follow the position on "v" lines (x y z r g b), as many
+// exporters write them, and default to white.
+//
+// Every submesh gets a chain of simplified LODs, which index into the same vertices as the full detail one.
+//
+// The triangles of every LOD are then reordered for the post-transform vertex cache and, in cache-friendly clusters,
+// for less overdraw; vertices are renumbered in the order the indices first use them, so fetches walk the vertex
+// buffers front to back. Finally the attributes are quantized, see MeshFormat.h.
+
+#include "MeshFormat.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Tom Forsyth's linear-speed vertex cache optimization: a vertex scores by its position in a simulated LRU cache and the
+// number of its triangles left, and the triangle with the highest score among those using cached vertices goes next.
+const uint32_t OPTIMIZER_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// The FIFO post-transform cache of typical hardware, used to measure the result and to find clusters for overdraw.
+const uint32_t FIFO_CACHE_SIZE = 16;
+// Clusters may cost this much more cache misses per triangle than the order they are cut from.
+const float OVERDRAW_CACHE_THRESHOLD = 1.05f;
+
+// Every LOD aims for this share of the triangles of the one before it.
+const float LOD_TRIANGLE_RATIO = 0.5f;
+// A LOD keeping more than this share of the previous one's triangles is not worth its index data and ends the chain,
+// usually because only locked vertices are left.
+const float LOD_MAX_KEPT_RATIO = 0.9f;
+// Collapses turning a triangle by more than about 75 degrees are rejected; turning by more than 90 would flip it.
+const float MAX_NORMAL_DEVIATION_COSINE = 0.25f;
+
+struct ObjData {
+    vector<array<float, 3>> positions;
+    vector<array<float, 3>> colors;
+    vector<array<float, 2>> texcoords;
+    vector<array<float, 3>> normals;
+};
+
+// Position, texture coordinate and normal index of a face corner; -1 when absent.
+typedef array<int32_t, 3> Corner;
+
+struct Vertex {
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+    uint8_t color[4];
+};
+
+struct Lod {
+    vector<uint32_t> indices;
+    float error;
+};
+
+struct Submesh {
+    string name;
+    // Filled by readObj() and moved into the first LOD by generateLods().
+    vector<uint32_t> indices;
+    vector<Lod> lods;
+};
+
+static int32_t resolveIndex(const string &token, size_t count, const string &line) {
+    int32_t index = stoi(token);
+
+    // OBJ indices start at 1, negative ones count back from the last element.
+    int32_t resolved = index < 0 ? static_cast<int32_t>(count) + index : index - 1;
+
+    if (index == 0 || resolved < 0 || resolved >= static_cast<int32_t>(count)) {
+        throw runtime_error("Index out of range: " + line);
+    }
+
+    return resolved;
+}
+
+static Corner parseCorner(const string &token, const ObjData &obj, const string &line) {
+    Corner corner{-1, -1, -1};
+    size_t firstSlash = token.find('/');
+    size_t secondSlash = firstSlash == string::npos ? string::npos : token.find('/', firstSlash + 1);
+
+    corner[0] = resolveIndex(token.substr(0, firstSlash), obj.positions.size(), line);
+
+    if (firstSlash != string::npos) {
+        string texcoord = token.substr(firstSlash + 1, secondSlash == string::npos ? string::npos : secondSlash - firstSlash - 1);
+        if (!texcoord.empty()) {
+            corner[1] = resolveIndex(texcoord, obj.texcoords.size(), line);
+        }
+    }
+
+    if (secondSlash != string::npos) {
+        corner[2] = resolveIndex(token.substr(secondSlash + 1), obj.normals.size(), line);
+    }
+
+    return corner;
+}
+
+static uint8_t toUnorm8(float value) { return static_cast<uint8_t>(lround(clamp(value, 0.0f, 1.0f) * 255.0f)); }
+
+static uint64_t alignUp(uint64_t value) { return (value + MESH_ALIGNMENT - 1) / MESH_ALIGNMENT * MESH_ALIGNMENT; }
+
+struct ConvertedMesh {
+    vector<Vertex> vertices;
+    vector<Submesh> submeshes;
+    bool hasTexcoords = false;
+    bool hasNormals = false;
+};
+
+static ConvertedMesh readObj(const string &path) {
+    ifstream file(path);
+
+    if (!file.is_open()) {
+        throw runtime_error("Failed to open " + path);
+    }
+
+    ObjData obj;
+    ConvertedMesh mesh;
+    map<Corner, uint32_t> vertexIndices;
+    string line;
+
+    mesh.submeshes.push_back({.name = "default", .indices = {}, .lods = {}});
+
+    while (getline(file, line)) {
+        istringstream tokens(line);
+        string keyword;
+        tokens >> keyword;
+
+        if (keyword == "v") {
+            array<float, 3> position{};
+            array<float, 3> color{1.0f, 1.0f, 1.0f};
+            tokens >> position[0] >> position[1] >> position[2];
+
+            if (!(tokens >> color[0] >> color[1] >> color[2])) {
+                color = {1.0f, 1.0f, 1.0f};
+            }
+
+            obj.positions.push_back(position);
+            obj.colors.push_back(color);
+        } else if (keyword == "vt") {
+            array<float, 2> texcoord{};
+            tokens >> texcoord[0] >> texcoord[1];
+            obj.texcoords.push_back(texcoord);
+        } else if (keyword == "vn") {
+            array<float, 3> normal{};
+            tokens >> normal[0] >> normal[1] >> normal[2];
+            obj.normals.push_back(normal);
+        } else if (keyword == "o" || keyword == "g") {
+            string name;
+            tokens >> name;
+
+            // Objects and groups without faces of their own do not need a submesh.
+            if (mesh.submeshes.back().indices.empty()) {
+                mesh.submeshes.back().name = name;
+            } else {
+                mesh.submeshes.push_back({.name = name, .indices = {}, .lods = {}});
+            }
+        } else if (keyword == "f") {
+            vector<uint32_t> polygon;
+            string token;
+
+            while (tokens >> token) {
+                Corner corner = parseCorner(token, obj, line);
+                auto [vertex, isNew] = vertexIndices.emplace(corner, static_cast<uint32_t>(mesh.vertices.size()));
+
+                if (isNew) {
+                    Vertex converted{};
+                    memcpy(converted.position, obj.positions[corner[0]].data(), sizeof(converted.position));
+
+                    const array<float, 3> &color = obj.colors[corner[0]];
+                    for (int i = 0; i < 3; i++) {
+                        converted.color[i] = toUnorm8(color[i]);
+                    }
+                    converted.color[3] = 255;
+
+                    if (corner[1] >= 0) {
+                        memcpy(converted.texcoord, obj.texcoords[corner[1]].data(), sizeof(converted.texcoord));
+                        mesh.hasTexcoords = true;
+                    }
+
+                    if (corner[2] >= 0) {
+                        memcpy(converted.normal, obj.normals[corner[2]].data(), sizeof(converted.normal));
+                        mesh.hasNormals = true;
+                    }
+
+                    mesh.vertices.push_back(converted);
+                }
+
+                polygon.push_back(vertex->second);
+            }
+
+            if (polygon.size() < 3) {
+                throw runtime_error("Face with fewer than three corners: " + line);
+            }
+
+            for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                mesh.submeshes.back().indices.insert(mesh.submeshes.back().indices.end(), {polygon[0], polygon[i], polygon[i + 1]});
+            }
+        }
+    }
+
+    erase_if(mesh.submeshes, [](const Submesh &submesh) { return submesh.indices.empty(); });
+
+    if (mesh.submeshes.empty()) {
+        throw runtime_error("No faces in " + path);
+    }
+
+    return mesh;
+}
+
+// Forsyth's scores, see OPTIMIZER_CACHE_SIZE.
+static float vertexScore(int32_t cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+
+    if (cachePosition >= 0) {
+        // The last triangle's vertices score the same regardless of their order, so it makes no difference which goes first.
+        if (cachePosition < 3) {
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scaled = 1.0f - float(cachePosition - 3) / (OPTIMIZER_CACHE_SIZE - 3);
+            score = pow(scaled, CACHE_DECAY_POWER);
+        }
+    }
+
+    return score + VALENCE_BOOST_SCALE * pow(float(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+static void optimizeVertexCache(vector<uint32_t> &indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+
+    // The triangles around every vertex, as ranges of one array.
+    vector<uint32_t> remainingTriangles(vertexCount, 0);
+    for (uint32_t index : indices) {
+        remainingTriangles[index]++;
+    }
+
+    vector<uint32_t> firstAdjacent(vertexCount + 1, 0);
+    partial_sum(remainingTriangles.begin(), remainingTriangles.end(), firstAdjacent.begin() + 1);
+
+    vector<uint32_t> adjacentTriangles(indices.size());
+    vector<uint32_t> adjacentCursor(firstAdjacent.begin(), firstAdjacent.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacentTriangles[adjacentCursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    vector<int32_t> cachePositions(vertexCount, -1);
+    vector<float> vertexScores(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        vertexScores[i] = vertexScore(-1, remainingTriangles[i]);
+    }
+
+    vector<bool> isEmitted(triangleCount, false);
+    vector<uint32_t> cache;
+    vector<uint32_t> nextCache;
+    vector<uint32_t> optimized;
+    optimized.reserve(indices.size());
+
+    size_t scanCursor = 0;
+    int64_t bestTriangle = -1;
+
+    while (optimized.size() < indices.size()) {
+        // Nothing in the cache is adjacent to a triangle left, so continue with the next one in the input order.
+        if (bestTriangle < 0) {
+            while (isEmitted[scanCursor]) {
+                scanCursor++;
+            }
+            bestTriangle = static_cast<int64_t>(scanCursor);
+        }
+
+        const uint32_t *triangle = &indices[bestTriangle * 3];
+        optimized.insert(optimized.end(), triangle, triangle + 3);
+        isEmitted[bestTriangle] = true;
+
+        nextCache.assign(triangle, triangle + 3);
+        for (uint32_t vertex : cache) {
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+                nextCache.push_back(vertex);
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            remainingTriangles[triangle[i]]--;
+        }
+
+        for (size_t i = OPTIMIZER_CACHE_SIZE; i < nextCache.size(); i++) {
+            cachePositions[nextCache[i]] = -1;
+            vertexScores[nextCache[i]] = vertexScore(-1, remainingTriangles[nextCache[i]]);
+        }
+
+        nextCache.resize(min<size_t>(nextCache.size(), OPTIMIZER_CACHE_SIZE));
+        swap(cache, nextCache);
+
+        for (size_t i = 0; i < cache.size(); i++) {
+            cachePositions[cache[i]] = static_cast<int32_t>(i);
+            vertexScores[cache[i]] = vertexScore(static_cast<int32_t>(i), remainingTriangles[cache[i]]);
+        }
+
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+
+        for (uint32_t vertex : cache) {
+            for (uint32_t i = firstAdjacent[vertex]; i < firstAdjacent[vertex + 1]; i++) {
+                uint32_t candidate = adjacentTriangles[i];
+                if (isEmitted[candidate]) {
+                    continue;
+                }
+
+                const uint32_t *corners = &indices[candidate * 3];
+                float score = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = candidate;
+                }
+            }
+        }
+    }
+
+    indices = move(optimized);
+}
+
+// Simulates the FIFO_CACHE_SIZE FIFO cache. A vertex is cached while fewer than FIFO_CACHE_SIZE misses happened since its
+// own; advancing the time by more than that flushes the cache.
+struct FifoCache {
+    vector<uint32_t> missTimes;
+    uint32_t time = FIFO_CACHE_SIZE + 1;
+
+    explicit FifoCache(size_t vertexCount) : missTimes(vertexCount, 0) {}
+
+    uint32_t countMisses(const uint32_t *triangle) {
+        uint32_t misses = 0;
+
+        for (int i = 0; i < 3; i++) {
+            if (time - missTimes[triangle[i]] > FIFO_CACHE_SIZE) {
+                missTimes[triangle[i]] = time++;
+                misses++;
+            }
+        }
+
+        return misses;
+    }
+
+    void flush() { time += FIFO_CACHE_SIZE + 1; }
+};
+
+static uint32_t countCacheMisses(const vector<uint32_t> &indices, size_t vertexCount) {
+    FifoCache cache(vertexCount);
+    uint32_t misses = 0;
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        misses += cache.countMisses(&indices[i]);
+    }
+
+    return misses;
+}
+
+static array<float, 3> subtract(const float (&a)[3], const float (&b)[3]) { return {a[0] - b[0], a[1] - b[1], a[2] - b[2]}; }
+
+static array<float, 3> cross(const array<float, 3> &a, const array<float, 3> &b) {
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+// Fast triangle reordering (Sander, Nehab and Barczak): cuts the cache-optimized order into clusters at the points where
+// the cache would start over anyway, or nearly so, and draws the clusters facing away from the mesh's center first, since
+// they are the most likely to occlude the rest.
+static void optimizeOverdraw(vector<uint32_t> &indices, const vector<Vertex> &vertices) {
+    size_t triangleCount = indices.size() / 3;
+    vector<uint32_t> triangleMisses(triangleCount);
+    vector<size_t> hardBoundaries;
+
+    FifoCache cache(vertices.size());
+    for (size_t i = 0; i < triangleCount; i++) {
+        triangleMisses[i] = cache.countMisses(&indices[i * 3]);
+
+        if (i == 0 || triangleMisses[i] == 3) {
+            hardBoundaries.push_back(i);
+        }
+    }
+
+    hardBoundaries.push_back(triangleCount);
+
+    // Inside a hard cluster a new cluster starts as soon as the current one, with a flushed cache at its start, is about as
+    // cache-friendly as the whole hard cluster.
+    vector<size_t> clusterStarts;
+
+    for (size_t i = 0; i + 1 < hardBoundaries.size(); i++) {
+        size_t start = hardBoundaries[i];
+        size_t end = hardBoundaries[i + 1];
+
+        uint32_t hardMisses = accumulate(triangleMisses.begin() + start, triangleMisses.begin() + end, 0u);
+        float threshold = OVERDRAW_CACHE_THRESHOLD * hardMisses / float(end - start);
+
+        clusterStarts.push_back(start);
+        cache.flush();
+        uint32_t clusterMisses = 0;
+
+        for (size_t triangle = start; triangle + 1 < end; triangle++) {
+            clusterMisses += cache.countMisses(&indices[triangle * 3]);
+
+            if (clusterMisses <= threshold * float(triangle + 1 - clusterStarts.back())) {
+                clusterStarts.push_back(triangle + 1);
+                cache.flush();
+                clusterMisses = 0;
+            }
+        }
+    }
+
+    clusterStarts.push_back(triangleCount);
+
+    // Area weighted, so the clusters of a finely tessellated part do not drag the center towards it.
+    struct Cluster {
+        size_t start;
+        size_t end;
+        array<float, 3> centroid;
+        array<float, 3> normal;
+        float area;
+    };
+
+    vector<Cluster> clusters;
+    array<float, 3> meshCentroid{};
+    float meshArea = 0.0f;
+
+    for (size_t i = 0; i + 1 < clusterStarts.size(); i++) {
+        Cluster cluster{.start = clusterStarts[i], .end = clusterStarts[i + 1], .centroid = {}, .normal = {}, .area = 0.0f};
+
+        for (size_t triangle = cluster.start; triangle < cluster.end; triangle++) {
+            const float(&a)[3] = vertices[indices[triangle * 3]].position;
+            const float(&b)[3] = vertices[indices[triangle * 3 + 1]].position;
+            const float(&c)[3] = vertices[indices[triangle * 3 + 2]].position;
+
+            array<float, 3> normal = cross(subtract(b, a), subtract(c, a));
+            float area = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+            for (int axis = 0; axis < 3; axis++) {
+                cluster.centroid[axis] += (a[axis] + b[axis] + c[axis]) / 3.0f * area;
+                cluster.normal[axis] += normal[axis];
+            }
+            cluster.area += area;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            meshCentroid[axis] += cluster.centroid[axis];
+        }
+        meshArea += cluster.area;
+
+        clusters.push_back(cluster);
+    }
+
+    // Degenerate geometry has no meaningful front or back.
+    if (meshArea <= 0.0f) {
+        return;
+    }
+
+    vector<float> sortKeys;
+
+    for (Cluster &cluster : clusters) {
+        float normalLength = sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] +
+                                  cluster.normal[2] * cluster.normal[2]);
+        float key = 0.0f;
+
+        if (cluster.area > 0.0f && normalLength > 0.0f) {
+            for (int axis = 0; axis < 3; axis++) {
+                key += (cluster.centroid[axis] / cluster.area - meshCentroid[axis] / meshArea) * cluster.normal[axis] / normalLength;
+            }
+        }
+
+        sortKeys.push_back(key);
+    }
+
+    vector<size_t> order(clusters.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    vector<uint32_t> reordered;
+    reordered.reserve(indices.size());
+
+    for (size_t cluster : order) {
+        reordered.insert(reordered.end(), indices.begin() + clusters[cluster].start * 3, indices.begin() + clusters[cluster].end * 3);
+    }
+
+    indices = move(reordered);
+}
+
+// Garland and Heckbert's quadric error metric: the sum of the squared distances to the planes of a vertex's triangles,
+// weighted by their area.
+struct Quadric {
+    double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0, yy = 0.0, yz = 0.0, yw = 0.0, zz = 0.0, zw = 0.0, ww = 0.0;
+    double weight = 0.0;
+
+    void addPlane(const array<double, 4> &plane, double planeWeight) {
+        xx += planeWeight * plane[0] * plane[0];
+        xy += planeWeight * plane[0] * plane[1];
+        xz += planeWeight * plane[0] * plane[2];
+        xw += planeWeight * plane[0] * plane[3];
+        yy += planeWeight * plane[1] * plane[1];
+        yz += planeWeight * plane[1] * plane[2];
+        yw += planeWeight * plane[1] * plane[3];
+        zz += planeWeight * plane[2] * plane[2];
+        zw += planeWeight * plane[2] * plane[3];
+        ww += planeWeight * plane[3] * plane[3];
+        weight += planeWeight;
+    }
+
+    void add(const Quadric &other) {
+        xx += other.xx, xy += other.xy, xz += other.xz, xw += other.xw, yy += other.yy;
+        yz += other.yz, yw += other.yw, zz += other.zz, zw += other.zw, ww += other.ww;
+        weight += other.weight;
+    }
+
+    // The mean squared distance of the point to the planes.
+    double error(const float (&point)[3]) const {
+        double x = point[0], y = point[1], z = point[2];
+        double sum = xx * x * x + yy * y * y + zz * z * z + 2.0 * (xy * x * y + xz * x * z + yz * y * z) +
+                     2.0 * (xw * x + yw * y + zw * z) + ww;
+
+        return weight > 0.0 ? max(sum, 0.0) / weight : 0.0;
+    }
+};
+
+static array<float, 3> triangleNormal(const float (&a)[3], const float (&b)[3], const float (&c)[3]) {
+    return cross(subtract(b, a), subtract(c, a));
+}
+
+static float dot(const array<float, 3> &a, const array<float, 3> &b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+// Vertices that must not move: the ones sharing their position with another vertex, which sit on an attribute seam, and
+// the ones on an open border. Moving either would tear the surface open.
+static vector<bool> findLockedVertices(const vector<uint32_t> &indices, const vector<Vertex> &vertices) {
+    map<array<float, 3>, uint32_t> positionIds;
+    vector<uint32_t> vertexPositions(vertices.size());
+    vector<uint32_t> verticesPerPosition;
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        array<float, 3> position{vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]};
+        auto [id, isNew] = positionIds.emplace(position, static_cast<uint32_t>(verticesPerPosition.size()));
+
+        if (isNew) {
+            verticesPerPosition.push_back(0);
+        }
+
+        vertexPositions[i] = id->second;
+        verticesPerPosition[id->second]++;
+    }
+
+    // Border edges belong to a single triangle, counted between positions so that seams do not look like borders.
+    map<pair<uint32_t, uint32_t>, uint32_t> edgeTriangles;
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        uint32_t a = vertexPositions[indices[i]];
+        uint32_t b = vertexPositions[indices[i - i % 3 + (i + 1) % 3]];
+        edgeTriangles[minmax(a, b)]++;
+    }
+
+    vector<bool> isBorderPosition(verticesPerPosition.size(), false);
+
+    for (const auto &[edge, triangleCount] : edgeTriangles) {
+        if (triangleCount == 1) {
+            isBorderPosition[edge.first] = true;
+            isBorderPosition[edge.second] = true;
+        }
+    }
+
+    vector<bool> isLocked(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        isLocked[i] = verticesPerPosition[vertexPositions[i]] > 1 || isBorderPosition[vertexPositions[i]];
+    }
+
+    return isLocked;
+}
+
+// Collapses edges onto one of their vertices, cheapest quadric error first, until at most targetIndexCount indices are
+// left or no edge can collapse anymore. Vertices never move, so the result indexes into the same vertices. Every pass
+// collapses each vertex at most once and rejects collapses that would flip a triangle or turn it nearly on its side.
+// error is set to the largest collapse error, as a distance in the mesh's units.
+static vector<uint32_t> simplify(const vector<uint32_t> &indices, const vector<Vertex> &vertices, size_t targetIndexCount,
+                                 float &error) {
+    size_t vertexCount = vertices.size();
+    vector<bool> isLocked = findLockedVertices(indices, vertices);
+    vector<Quadric> quadrics(vertexCount);
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const float(&a)[3] = vertices[indices[i]].position;
+        array<float, 3> normal = triangleNormal(a, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position);
+        double length = sqrt(dot(normal, normal));
+
+        if (length == 0.0) {
+            continue;
+        }
+
+        array<double, 4> plane{normal[0] / length, normal[1] / length, normal[2] / length, 0.0};
+        plane[3] = -(plane[0] * a[0] + plane[1] * a[1] + plane[2] * a[2]);
+
+        for (int corner = 0; corner < 3; corner++) {
+            quadrics[indices[i + corner]].addPlane(plane, length / 2.0);
+        }
+    }
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double error;
+    };
+
+    vector<uint32_t> current = indices;
+    vector<uint32_t> remap(vertexCount);
+    iota(remap.begin(), remap.end(), 0);
+    double maxError = 0.0;
+
+    while (current.size() > targetIndexCount) {
+        vector<uint32_t> firstAdjacent(vertexCount + 1, 0);
+        for (uint32_t index : current) {
+            firstAdjacent[index + 1]++;
+        }
+        partial_sum(firstAdjacent.begin(), firstAdjacent.end(), firstAdjacent.begin());
+
+        vector<uint32_t> adjacentTriangles(current.size());
+        vector<uint32_t> adjacentCursor(firstAdjacent.begin(), firstAdjacent.end() - 1);
+        for (size_t i = 0; i < current.size(); i++) {
+            adjacentTriangles[adjacentCursor[current[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // Every interior edge shows up once in each direction, and border edges cannot collapse.
+        vector<Collapse> collapses;
+
+        for (size_t i = 0; i < current.size(); i++) {
+            uint32_t a = current[i];
+            uint32_t b = current[i - i % 3 + (i + 1) % 3];
+
+            if (a > b || (isLocked[a] && isLocked[b])) {
+                continue;
+            }
+
+            Quadric sum = quadrics[a];
+            sum.add(quadrics[b]);
+
+            double errorToB = isLocked[a] ? INFINITY : sum.error(vertices[b].position);
+            double errorToA = isLocked[b] ? INFINITY : sum.error(vertices[a].position);
+
+            if (errorToB <= errorToA) {
+                collapses.push_back({.from = a, .to = b, .error = errorToB});
+            } else {
+                collapses.push_back({.from = b, .to = a, .error = errorToA});
+            }
+        }
+
+        sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        vector<bool> isTouched(vertexCount, false);
+        size_t removedIndices = 0;
+        bool hasCollapsed = false;
+
+        for (const Collapse &collapse : collapses) {
+            if (current.size() - removedIndices <= targetIndexCount) {
+                break;
+            }
+
+            if (isTouched[collapse.from] || isTouched[collapse.to]) {
+                continue;
+            }
+
+            // Triangles around the vertex, with this pass's collapses so far applied, before and after moving it.
+            bool isFlipping = false;
+            size_t collapsedTriangles = 0;
+
+            for (uint32_t i = firstAdjacent[collapse.from]; i < firstAdjacent[collapse.from + 1] && !isFlipping; i++) {
+                uint32_t triangle[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    triangle[corner] = remap[current[adjacentTriangles[i] * 3 + corner]];
+                }
+
+                if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0]) {
+                    continue;
+                }
+
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                    collapsedTriangles++;
+                    continue;
+                }
+
+                array<float, 3> before = triangleNormal(vertices[triangle[0]].position, vertices[triangle[1]].position,
+                                                        vertices[triangle[2]].position);
+                for (uint32_t &corner : triangle) {
+                    corner = corner == collapse.from ? collapse.to : corner;
+                }
+                array<float, 3> after = triangleNormal(vertices[triangle[0]].position, vertices[triangle[1]].position,
+                                                       vertices[triangle[2]].position);
+
+                isFlipping = dot(before, after) <= MAX_NORMAL_DEVIATION_COSINE * sqrt(dot(before, before) * dot(after, after));
+            }
+
+            if (isFlipping) {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            isTouched[collapse.from] = true;
+            isTouched[collapse.to] = true;
+            maxError = max(maxError, collapse.error);
+            removedIndices += collapsedTriangles * 3;
+            hasCollapsed = true;
+        }
+
+        if (!hasCollapsed) {
+            break;
+        }
+
+        vector<uint32_t> collapsed;
+        collapsed.reserve(current.size() - removedIndices);
+
+        for (size_t i = 0; i < current.size(); i += 3) {
+            uint32_t a = remap[current[i]];
+            uint32_t b = remap[current[i + 1]];
+            uint32_t c = remap[current[i + 2]];
+
+            if (a != b && b != c && c != a) {
+                collapsed.insert(collapsed.end(), {a, b, c});
+            }
+        }
+
+        current = move(collapsed);
+    }
+
+    error = static_cast<float>(sqrt(maxError));
+
+    return current;
+}
+
+// Simplifies every LOD from the full detail one, so the errors do not compound along the chain.
+static void generateLods(ConvertedMesh &mesh) {
+    for (Submesh &submesh : mesh.submeshes) {
+        submesh.lods.push_back({.indices = move(submesh.indices), .error = 0.0f});
+
+        while (submesh.lods.size() < MESH_MAX_LODS) {
+            size_t previousIndexCount = submesh.lods.back().indices.size();
+            size_t targetIndexCount = static_cast<size_t>(previousIndexCount / 3 * LOD_TRIANGLE_RATIO) * 3;
+
+            float error = 0.0f;
+            vector<uint32_t> simplified = simplify(submesh.lods[0].indices, mesh.vertices, targetIndexCount, error);
+
+            if (simplified.empty() || simplified.size() > previousIndexCount * LOD_MAX_KEPT_RATIO) {
+                break;
+            }
+
+            // Errors are measured against the full detail mesh, but a coarser LOD must never claim to be more accurate.
+            submesh.lods.push_back({.indices = move(simplified), .error = max(error, submesh.lods.back().error)});
+        }
+    }
+}
+
+// Renumbers the vertices in the order the submeshes' indices first use them, finest LOD first.
+static void optimizeVertexFetch(ConvertedMesh &mesh) {
+    vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+    vector<Vertex> reordered;
+    reordered.reserve(mesh.vertices.size());
+
+    for (Submesh &submesh : mesh.submeshes) {
+        for (Lod &lod : submesh.lods) {
+            for (uint32_t &index : lod.indices) {
+                if (remap[index] == UINT32_MAX) {
+                    remap[index] = static_cast<uint32_t>(reordered.size());
+                    reordered.push_back(mesh.vertices[index]);
+                }
+                index = remap[index];
+            }
+        }
+    }
+
+    mesh.vertices = move(reordered);
+}
+
+struct OptimizationStats {
+    uint32_t missesBefore = 0;
+    uint32_t missesAfter = 0;
+};
+
+static OptimizationStats optimize(ConvertedMesh &mesh) {
+    OptimizationStats stats;
+
+    for (Submesh &submesh : mesh.submeshes) {
+        stats.missesBefore += countCacheMisses(submesh.lods[0].indices, mesh.vertices.size());
+
+        for (Lod &lod : submesh.lods) {
+            optimizeVertexCache(lod.indices, mesh.vertices.size());
+            optimizeOverdraw(lod.indices, mesh.vertices);
+        }
+
+        stats.missesAfter += countCacheMisses(submesh.lods[0].indices, mesh.vertices.size());
+    }
+
+    optimizeVertexFetch(mesh);
+
+    return stats;
+}
+
+static int16_t toSnorm16(float value) { return static_cast<int16_t>(lround(clamp(value, -1.0f, 1.0f) * 32767.0f)); }
+
+static float fromSnorm16(int16_t value) { return max(value / 32767.0f, -1.0f); }
+
+// Rounds to the nearest half float, ties to even.
+static uint16_t toHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t floatExponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+
+    if (floatExponent == 0xff) {
+        return sign | (mantissa != 0 ? 0x7e00 : 0x7c00);
+    }
+
+    if (exponent >= 31) {
+        return sign | 0x7c00;
+    }
+
+    // Subnormal halves lose the implicit bit, so it is shifted into the mantissa.
+    uint32_t shift = 13;
+    uint32_t half = 0;
+
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+    } else {
+        half = static_cast<uint32_t>(exponent) << 10;
+    }
+
+    half |= mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+
+    // A carry out of the mantissa correctly moves on to the next exponent, or to infinity.
+    if (remainder > halfway || (remainder == halfway && (half & 1) != 0)) {
+        half++;
+    }
+
+    return static_cast<uint16_t>(sign | half);
+}
+
+// Octahedral encoding: the unit sphere projected onto an octahedron, whose lower half is folded over the upper half onto
+// the square [-1, 1]^2. Decoded by decodeNormal in shaders/mesh.glsl.
+static array<int16_t, 2> toOctahedral(const float (&normal)[3]) {
+    float length = fabs(normal[0]) + fabs(normal[1]) + fabs(normal[2]);
+
+    if (length == 0.0f) {
+        return {0, 0};
+    }
+
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+
+    if (normal[2] < 0.0f) {
+        float foldedX = (1.0f - fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    return {toSnorm16(x), toSnorm16(y)};
+}
+
+// Positions are stored relative to the center of the mesh's bounding box, divided by its largest half extent. A uniform
+// scale keeps the decoded normals valid without any correction.
+static void computePositionQuantization(const ConvertedMesh &mesh, MeshHeader &header) {
+    float minimum[3] = {INFINITY, INFINITY, INFINITY};
+    float maximum[3] = {-INFINITY, -INFINITY, -INFINITY};
+
+    for (const Vertex &vertex : mesh.vertices) {
+        for (int i = 0; i < 3; i++) {
+            minimum[i] = min(minimum[i], vertex.position[i]);
+            maximum[i] = max(maximum[i], vertex.position[i]);
+        }
+    }
+
+    header.positionScale = 0.0f;
+
+    for (int i = 0; i < 3; i++) {
+        header.positionOffset[i] = (minimum[i] + maximum[i]) / 2.0f;
+        header.positionScale = max(header.positionScale, (maximum[i] - minimum[i]) / 2.0f);
+    }
+
+    if (header.positionScale == 0.0f) {
+        header.positionScale = 1.0f;
+    }
+}
+
+static array<int16_t, 4> quantizePosition(const float (&position)[3], const MeshHeader &header) {
+    array<int16_t, 4> quantized{};
+
+    for (int i = 0; i < 3; i++) {
+        quantized[i] = toSnorm16((position[i] - header.positionOffset[i]) / header.positionScale);
+    }
+
+    return quantized;
+}
+
+// Bounding sphere around the center of the full detail LOD's bounding box, of the positions as the GPU decodes them.
+static void computeBounds(const vector<array<float, 3>> &positions, const Submesh &submesh, MeshSubmesh &converted) {
+    float minimum[3] = {INFINITY, INFINITY, INFINITY};
+    float maximum[3] = {-INFINITY, -INFINITY, -INFINITY};
+
+    for (uint32_t index : submesh.lods[0].indices) {
+        for (int i = 0; i < 3; i++) {
+            minimum[i] = min(minimum[i], positions[index][i]);
+            maximum[i] = max(maximum[i], positions[index][i]);
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        converted.boundsCenter[i] = (minimum[i] + maximum[i]) / 2.0f;
+    }
+
+    float radiusSquared = 0.0f;
+
+    for (uint32_t index : submesh.lods[0].indices) {
+        float distanceSquared = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            float delta = positions[index][i] - converted.boundsCenter[i];
+            distanceSquared += delta * delta;
+        }
+        radiusSquared = max(radiusSquared, distanceSquared);
+    }
+
+    converted.boundsRadius = sqrt(radiusSquared);
+}
+
+// The attributes of the second stream, in the order they are written.
+struct StreamAttribute {
+    uint32_t location;
+    VkFormat format;
+};
+
+static vector<StreamAttribute> streamAttributes(const ConvertedMesh &mesh) {
+    vector<StreamAttribute> attributes;
+
+    if (mesh.hasNormals) {
+        attributes.push_back({MESH_NORMAL_LOCATION, VK_FORMAT_R16G16_SNORM});
+    }
+    if (mesh.hasTexcoords) {
+        attributes.push_back({MESH_TEXCOORD_LOCATION, VK_FORMAT_R16G16_SFLOAT});
+    }
+    attributes.push_back({MESH_COLOR_LOCATION, VK_FORMAT_R8G8B8A8_UNORM});
+
+    return attributes;
+}
+
+static void writeAttribute(char *destination, uint32_t location, const Vertex &vertex) {
+    if (location == MESH_NORMAL_LOCATION) {
+        array<int16_t, 2> normal = toOctahedral(vertex.normal);
+        memcpy(destination, normal.data(), sizeof(normal));
+    } else if (location == MESH_TEXCOORD_LOCATION) {
+        uint16_t texcoord[2] = {toHalf(vertex.texcoord[0]), toHalf(vertex.texcoord[1])};
+        memcpy(destination, texcoord, sizeof(texcoord));
+    } else {
+        memcpy(destination, vertex.color, sizeof(vertex.color));
+    }
+}
+
+// Positions get a stream of their own, so passes that only need positions fetch nothing else.
+static void writeMesh(const string &path, const ConvertedMesh &mesh) {
+    MeshHeader header{};
+    header.magic = MESH_MAGIC;
+    header.version = MESH_VERSION;
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.submeshCount = static_cast<uint32_t>(mesh.submeshes.size());
+    computePositionQuantization(mesh, header);
+
+    vector<array<int16_t, 4>> positions;
+    vector<array<float, 3>> decodedPositions;
+
+    for (const Vertex &vertex : mesh.vertices) {
+        array<int16_t, 4> position = quantizePosition(vertex.position, header);
+        positions.push_back(position);
+
+        array<float, 3> decoded;
+        for (int i = 0; i < 3; i++) {
+            decoded[i] = fromSnorm16(position[i]) * header.positionScale + header.positionOffset[i];
+        }
+        decodedPositions.push_back(decoded);
+    }
+
+    vector<uint32_t> indices;
+    vector<MeshSubmesh> submeshes(mesh.submeshes.size());
+    vector<MeshLod> lods;
+
+    for (size_t i = 0; i < mesh.submeshes.size(); i++) {
+        submeshes[i].firstLod = static_cast<uint32_t>(lods.size());
+        submeshes[i].lodCount = static_cast<uint32_t>(mesh.submeshes[i].lods.size());
+        computeBounds(decodedPositions, mesh.submeshes[i], submeshes[i]);
+
+        for (const Lod &lod : mesh.submeshes[i].lods) {
+            MeshLod converted{};
+            converted.firstIndex = static_cast<uint32_t>(indices.size());
+            converted.indexCount = static_cast<uint32_t>(lod.indices.size());
+            converted.error = lod.error;
+            lods.push_back(converted);
+
+            indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+        }
+    }
+
+    header.indexCount = static_cast<uint32_t>(indices.size());
+    header.lodCount = static_cast<uint32_t>(lods.size());
+
+    header.streamCount = 2;
+    header.attributes[header.attributeCount++] = {
+        .location = MESH_POSITION_LOCATION, .stream = 0, .format = VK_FORMAT_R16G16B16A16_SNORM, .offset = 0};
+
+    vector<StreamAttribute> attributes = streamAttributes(mesh);
+    uint32_t stride = 0;
+
+    for (const StreamAttribute &attribute : attributes) {
+        header.attributes[header.attributeCount++] = {
+            .location = attribute.location, .stream = 1, .format = static_cast<uint32_t>(attribute.format), .offset = stride};
+        stride += meshAttributeSize(attribute.format);
+    }
+
+    header.streams[0].stride = sizeof(positions[0]);
+    header.streams[1].stride = stride;
+
+    bool hasShortIndices = mesh.vertices.size() <= UINT16_MAX;
+    header.indexType = hasShortIndices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+    header.submeshOffset = alignUp(sizeof(header));
+    header.lodOffset = alignUp(header.submeshOffset + submeshes.size() * sizeof(MeshSubmesh));
+    uint64_t offset = alignUp(header.lodOffset + lods.size() * sizeof(MeshLod));
+
+    for (uint32_t i = 0; i < header.streamCount; i++) {
+        header.streams[i].offset = offset;
+        header.streams[i].size = uint64_t(header.vertexCount) * header.streams[i].stride;
+        offset = alignUp(offset + header.streams[i].size);
+    }
+
+    header.indexOffset = offset;
+    header.indexSize = indices.size() * (hasShortIndices ? sizeof(uint16_t) : sizeof(uint32_t));
+
+    vector<char> file(alignUp(header.indexOffset + header.indexSize), 0);
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + header.submeshOffset, submeshes.data(), submeshes.size() * sizeof(MeshSubmesh));
+    memcpy(file.data() + header.lodOffset, lods.data(), lods.size() * sizeof(MeshLod));
+    memcpy(file.data() + header.streams[0].offset, positions.data(), header.streams[0].size);
+
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        char *destination = file.data() + header.streams[1].offset + i * stride;
+
+        for (const StreamAttribute &attribute : attributes) {
+            writeAttribute(destination, attribute.location, mesh.vertices[i]);
+            destination += meshAttributeSize(attribute.format);
+        }
+    }
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (hasShortIndices) {
+            uint16_t index = static_cast<uint16_t>(indices[i]);
+            memcpy(file.data() + header.indexOffset + i * sizeof(index), &index, sizeof(index));
+        } else {
+            memcpy(file.data() + header.indexOffset + i * sizeof(uint32_t), &indices[i], sizeof(uint32_t));
+        }
+    }
+
+    // Written next to the output and renamed over it, so an interrupted build never leaves a torn mesh behind.
+    string temporaryPath = path + ".tmp";
+    ofstream output(temporaryPath, ios::binary | ios::trunc);
+    output.write(file.data(), static_cast<streamsize>(file.size()));
+    output.close();
+
+    if (!output) {
+        throw runtime_error("Failed to write " + temporaryPath);
+    }
+
+    filesystem::rename(temporaryPath, path);
+}
+
+// Bytes per vertex of the attributes as 32-bit floats, like the OBJ file stores them.
+static uint32_t unquantizedVertexSize(const ConvertedMesh &mesh) {
+    return 3 * sizeof(float) + (mesh.hasNormals ? 3 * sizeof(float) : 0) + (mesh.hasTexcoords ? 2 * sizeof(float) : 0) + 4;
+}
+
+static uint32_t quantizedVertexSize(const ConvertedMesh &mesh) {
+    uint32_t size = 4 * sizeof(int16_t);
+    for (const StreamAttribute &attribute : streamAttributes(mesh)) {
+        size += meshAttributeSize(attribute.format);
+    }
+    return size;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <input.obj> <output.mesh>\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        ConvertedMesh mesh = readObj(argv[1]);
+        generateLods(mesh);
+        OptimizationStats stats = optimize(mesh);
+        writeMesh(argv[2], mesh);
+
+        // Triangles per LOD level, summed over the submeshes.
+        vector<size_t> lodTriangles;
+        for (const Submesh &submesh : mesh.submeshes) {
+            lodTriangles.resize(max(lodTriangles.size(), submesh.lods.size()));
+            for (size_t i = 0; i < submesh.lods.size(); i++) {
+                lodTriangles[i] += submesh.lods[i].indices.size() / 3;
+            }
+        }
+
+        // Average cache misses per triangle (ACMR) for a FIFO_CACHE_SIZE FIFO cache.
+        cout << fixed << setprecision(2) << argv[1] << ": " << mesh.vertices.size() << " vertices, " << lodTriangles[0]
+             << " triangles, ACMR " << float(stats.missesBefore) / lodTriangles[0] << " -> " << float(stats.missesAfter) / lodTriangles[0]
+             << ", " << unquantizedVertexSize(mesh) << " -> " << quantizedVertexSize(mesh) << " bytes per vertex, LOD triangles";
+
+        for (size_t triangles : lodTriangles) {
+            cout << ' ' << triangles;
+        }
+        cout << '\n';
+    } catch (const exception &e) {
+        cerr << argv[1] << ": " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+// Packs SPIR-V files into the shader pack mapped by ShaderPack at runtime, see ShaderPackFormat.h.
+//
+// Usage: shader_packer [--strip-debug] <output> <name>=<spirv path>...
+
+#include "ShaderPackFormat.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const uint32_t SPIRV_HEADER_WORDS = 5;
+
+// Debug instructions that no other instruction of a shader compiled by glslc refers to.
+const uint32_t SPIRV_DEBUG_OPCODES[] = {
+    2,   // OpSourceContinued
+    3,   // OpSource
+    4,   // OpSourceExtension
+    5,   // OpName
+    6,   // OpMemberName
+    8,   // OpLine
+    317, // OpNoLine
+    330, // OpModuleProcessed
+};
+
+struct Shader {
+    string name;
+    vector<uint32_t> words;
+};
+
+static vector<uint32_t> readSpirv(const string &path) {
+    ifstream file(path, ios::binary);
+
+    if (!file.is_open()) {
+        throw runtime_error("Failed to open " + path);
+    }
+
+    vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    if (bytes.size() < SPIRV_HEADER_WORDS * sizeof(uint32_t) || bytes.size() % sizeof(uint32_t) != 0) {
+        throw runtime_error("Not a SPIR-V module: " + path);
+    }
+
+    vector<uint32_t> words(bytes.size() / sizeof(uint32_t));
+    memcpy(words.data(), bytes.data(), bytes.size());
+
+    if (words[0] != SPIRV_MAGIC) {
+        throw runtime_error("Not a little-endian SPIR-V module: " + path);
+    }
+
+    return words;
+}
+
+static vector<uint32_t> stripDebugInstructions(const vector<uint32_t> &words, const string &name) {
+    vector<uint32_t> stripped(words.begin(), words.begin() + SPIRV_HEADER_WORDS);
+
+    for (size_t i = SPIRV_HEADER_WORDS; i < words.size();) {
+        // Every instruction starts with its word count in the high and its opcode in the low half word.
+        uint32_t wordCount = words[i] >> 16;
+        uint32_t opcode = words[i] & 0xffff;
+
+        if (wordCount == 0 || wordCount > words.size() - i) {
+            throw runtime_error("Malformed SPIR-V instruction in " + name);
+        }
+
+        if (find(begin(SPIRV_DEBUG_OPCODES), end(SPIRV_DEBUG_OPCODES), opcode) == end(SPIRV_DEBUG_OPCODES)) {
+            stripped.insert(stripped.end(), words.begin() + i, words.begin() + i + wordCount);
+        }
+
+        i += wordCount;
+    }
+
+    return stripped;
+}
+
+static uint64_t alignUp(uint64_t value) { return (value + SHADER_PACK_ALIGNMENT - 1) / SHADER_PACK_ALIGNMENT * SHADER_PACK_ALIGNMENT; }
+
+static void writePack(const string &path, vector<Shader> &shaders, bool isStripped) {
+    sort(shaders.begin(), shaders.end(), [](const Shader &a, const Shader &b) { return a.name < b.name; });
+
+    ShaderPackHeader header{.magic = SHADER_PACK_MAGIC,
+                            .version = SHADER_PACK_VERSION,
+                            .shaderCount = static_cast<uint32_t>(shaders.size()),
+                            .flags = isStripped ? SHADER_PACK_STRIPPED_BIT : 0};
+
+    vector<ShaderPackEntry> entries(shaders.size());
+    uint64_t offset = alignUp(sizeof(header) + entries.size() * sizeof(ShaderPackEntry));
+
+    for (size_t i = 0; i < shaders.size(); i++) {
+        if (i > 0 && shaders[i].name == shaders[i - 1].name) {
+            throw runtime_error("Duplicate shader name " + shaders[i].name);
+        }
+
+        entries[i] = {};
+        strcpy(entries[i].name, shaders[i].name.c_str());
+        entries[i].offset = offset;
+        entries[i].size = shaders[i].words.size() * sizeof(uint32_t);
+
+        offset = alignUp(offset + entries[i].size);
+    }
+
+    vector<char> pack(offset, 0);
+    memcpy(pack.data(), &header, sizeof(header));
+    memcpy(pack.data() + sizeof(header), entries.data(), entries.size() * sizeof(ShaderPackEntry));
+
+    for (size_t i = 0; i < shaders.size(); i++) {
+        memcpy(pack.data() + entries[i].offset, shaders[i].words.data(), entries[i].size);
+    }
+
+    // Written next to the output and renamed over it, so an interrupted build never leaves a torn pack behind.
+    string temporaryPath = path + ".tmp";
+    ofstream file(temporaryPath, ios::binary | ios::trunc);
+    file.write(pack.data(), static_cast<streamsize>(pack.size()));
+    file.close();
+
+    if (!file) {
+        throw runtime_error("Failed to write " + temporaryPath);
+    }
+
+    filesystem::rename(temporaryPath, path);
+}
+
+int main(int argc, char **argv) {
+    bool isStripped = false;
+    int firstArgument = 1;
+
+    if (argc > 1 && strcmp(argv[1], "--strip-debug") == 0) {
+        isStripped = true;
+        firstArgument++;
+    }
+
+    if (argc - firstArgument < 1) {
+        cerr << "Usage: " << argv[0] << " [--strip-debug] <output> <name>=<spirv path>...\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        vector<Shader> shaders;
+
+        for (int i = firstArgument + 1; i < argc; i++) {
+            string argument = argv[i];
+            size_t separator = argument.find('=');
+
+            if (separator == string::npos || separator == 0 || separator > SHADER_PACK_MAX_NAME_LENGTH) {
+                throw runtime_error("Expected <name>=<spirv path> with a name of at most " + to_string(SHADER_PACK_MAX_NAME_LENGTH) +
+                                    " characters: " + argument);
+            }
+
+            Shader shader{.name = argument.substr(0, separator), .words = readSpirv(argument.substr(separator + 1))};
+
+            if (isStripped) {
+                shader.words = stripDebugInstructions(shader.words, shader.name);
+            }
+
+            shaders.push_back(move(shader));
+        }
+
+        writePack(argv[firstArgument], shaders, isStripped);
+    } catch (const exception &e) {
+        cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}